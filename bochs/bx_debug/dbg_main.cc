@@ -1663,13 +1663,18 @@ void bx_dbg_tlb_lookup(bx_lin_address laddr)
 
   char cpu_param_name[16];
 
-  Bit32u index = cpu->ITLB.get_index_of(laddr);
-  sprintf(cpu_param_name, "ITLB.entry%d", index);
-  bx_dbg_show_param_command(cpu_param_name, 0);
+  // show all ways of the TLB set the address maps to
+  Bit32u index = cpu->ITLB.get_index_of(laddr) * cpu->ITLB.get_ways();
+  for (unsigned way=0; way < cpu->ITLB.get_ways(); way++) {
+    sprintf(cpu_param_name, "ITLB.entry%d", index + way);
+    bx_dbg_show_param_command(cpu_param_name, 0);
+  }
 
-  index = cpu->DTLB.get_index_of(laddr);
-  sprintf(cpu_param_name, "DTLB.entry%d", index);
-  bx_dbg_show_param_command(cpu_param_name, 0);
+  index = cpu->DTLB.get_index_of(laddr) * cpu->DTLB.get_ways();
+  for (unsigned way=0; way < cpu->DTLB.get_ways(); way++) {
+    sprintf(cpu_param_name, "DTLB.entry%d", index + way);
+    bx_dbg_show_param_command(cpu_param_name, 0);
+  }
 }
 
 unsigned dbg_show_mask = 0;
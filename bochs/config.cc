@@ -613,6 +613,36 @@ void bx_init_options()
       "Don't put CPU to sleep state by MWAIT",
       0);
 #endif
+  new bx_param_num_c(cpu_param,
+      "dtlb_entries", "Number of DTLB entries",
+      "Number of data TLB entries, must be power of 2",
+      64, BX_DTLB_SIZE,
+      BX_DTLB_SIZE);
+  new bx_param_num_c(cpu_param,
+      "itlb_entries", "Number of ITLB entries",
+      "Number of instruction TLB entries, must be power of 2",
+      64, BX_ITLB_SIZE,
+      BX_ITLB_SIZE);
+  new bx_param_num_c(cpu_param,
+      "tlb_ways", "TLB associativity",
+      "Number of ways in each DTLB and ITLB set (1, 2 or 4), 1 means direct mapped TLB",
+      1, BX_TLB_MAX_WAYS,
+      1);
+  new bx_param_num_c(cpu_param,
+      "icache_entries", "Number of trace cache entries",
+      "Number of decoded trace cache entries, must be power of 2",
+      1024, 1024*1024,
+      64*1024);
+  new bx_param_num_c(cpu_param,
+      "icache_ways", "Trace cache associativity",
+      "Number of ways in each trace cache set (1 or 2), 1 means direct mapped cache",
+      1, 2,
+      1);
+  new bx_param_filename_c(cpu_param,
+      "trace_cache",
+      "Decoded trace cache file",
+      "Set path to the file keeping decoded traces between runs",
+      "", BX_PATHNAME_LEN);
 #if BX_CONFIGURE_MSRS
   new bx_param_filename_c(cpu_param,
       "msrs",
@@ -877,6 +907,12 @@ void bx_init_options()
       4, 8192,
       128);
   mem_block_size->set_ask_format("Enter memory block size (KB): [%d] ");
+  path = new bx_param_filename_c(ram,
+      "file",
+      "RAM backing file",
+      "Pathname of the file (could be on hugetlbfs) mapped as guest RAM",
+      "", BX_PATHNAME_LEN);
+  path->set_ask_format("Enter RAM backing file: [%s] ");
   ram->set_options(ram->SERIES_ASK);
 
   path = new bx_param_filename_c(rom,
@@ -1029,6 +1065,10 @@ void bx_init_options()
       "rtc_sync", "Sync RTC speed with realtime",
       "If enabled, the RTC runs at realtime speed",
       0);
+  new bx_param_bool_c(clock_cmos,
+      "idle_skip", "Skip idle time",
+      "If enabled, the time jumps to the next timer event when all CPUs are halted",
+      0);
   deplist = new bx_list_c(NULL);
   deplist->add(rtc_sync);
   clock_sync->set_dependent_list(deplist, 0);
@@ -1420,7 +1460,7 @@ void bx_init_options()
     14, 15, 11, 9
   };
 
-  #define BXP_PARAMS_PER_ATA_DEVICE 12
+  #define BXP_PARAMS_PER_ATA_DEVICE 13
 
   bx_list_c *ata_menu[BX_MAX_ATA_CHANNEL];
   bx_list_c *ata_res[BX_MAX_ATA_CHANNEL];
@@ -1590,6 +1630,13 @@ void bx_init_options()
         BX_ATA_TRANSLATION_NONE);
       translation->set_ask_format("Enter translation type: [%s]");
 
+      bx_param_bool_c *async = new bx_param_bool_c(menu,
+        "async",
+        "Asynchronous DMA I/O",
+        "Execute the disk I/O of DMA transfers on a host thread",
+        0);
+      async->set_ask_format("Use asynchronous I/O for DMA transfers? [%s] ");
+
       // the master/slave menu depends on the ATA channel's enabled flag
       enabled->get_dependent_list()->add(menu);
       // the type selector depends on the ATA channel's enabled flag
@@ -1597,7 +1644,7 @@ void bx_init_options()
 
       // all items depend on the drive type
       type->set_dependent_list(menu->clone(), 0);
-      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0xfe6);
+      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0x1fe6);
       type->set_dependent_bitmap(BX_ATA_DEVICE_CDROM, 0x60a);
 
       type->set_handler(bx_param_handler);
@@ -1847,6 +1894,12 @@ void bx_init_options()
   path->set_ask_format("Enter log filename: [%s] ");
   path->set_extension("txt");
 
+  new bx_param_bool_c(menu,
+      "async",
+      "Asynchronous log writer",
+      "Write the log file from a separate thread",
+      0);
+
   bx_param_string_c *prefix = new bx_param_string_c(menu,
       "prefix",
       "Log output prefix",
@@ -2936,10 +2989,16 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       PARSE_ERR(("%s: floppy_bootsig_check directive malformed.", context));
     }
   } else if (!strcmp(params[0], "log")) {
-    if (num_params != 2) {
+    if ((num_params < 2) || (num_params > 3)) {
       PARSE_ERR(("%s: log directive has wrong # args.", context));
     }
     SIM->get_param_string(BXPN_LOG_FILENAME)->set(params[1]);
+    if (num_params == 3) {
+      if (strncmp(params[2], "async=", 6) ||
+          (parse_param_bool(params[2], 6, BXPN_LOG_ASYNC) < 0)) {
+        PARSE_ERR(("%s: log directive malformed.", context));
+      }
+    }
   } else if (!strcmp(params[0], "logprefix")) {
     if (num_params != 2) {
       PARSE_ERR(("%s: logprefix directive has wrong # args.", context));
@@ -3247,6 +3306,9 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       else if (!strncmp(params[i], "rtc_sync=", 9)) {
         SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->set(atol(&params[i][9]));
       }
+      else if (!strncmp(params[i], "idle_skip=", 10)) {
+        SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->set(atol(&params[i][10]));
+      }
       else if (!strcmp(params[i], "time0=local")) {
         SIM->get_param_num(BXPN_CLOCK_TIME0)->set(BX_CLOCK_TIME0_LOCAL);
       }
@@ -3591,7 +3653,8 @@ int bx_write_clock_cmos_options(FILE *fp)
       fprintf(fp, ", time0=" FMT_LL "d", SIM->get_param_num(BXPN_CLOCK_TIME0)->get64());
   }
 
-  fprintf(fp, ", rtc_sync=%d\n", SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->get());
+  fprintf(fp, ", rtc_sync=%d", SIM->get_param_bool(BXPN_CLOCK_RTC_SYNC)->get());
+  fprintf(fp, ", idle_skip=%d\n", SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->get());
 
   if (strlen(SIM->get_param_string(BXPN_CMOSIMAGE_PATH)->getptr()) > 0) {
     fprintf(fp, "cmosimage: file=%s, ", SIM->get_param_string(BXPN_CMOSIMAGE_PATH)->getptr());
@@ -3609,7 +3672,8 @@ int bx_write_log_options(FILE *fp, bx_list_c *base)
   bx_param_num_c *mparam;
   int action, def_action, level, mod;
 
-  fprintf(fp, "log: %s\n", SIM->get_param_string("filename", base)->getptr());
+  fprintf(fp, "log: %s, async=%d\n", SIM->get_param_string("filename", base)->getptr(),
+          SIM->get_param_bool("async", base)->get());
   fprintf(fp, "logprefix: %s\n", SIM->get_param_string("prefix", base)->getptr());
 
   strcpy(pname, "general.logfn");
@@ -3767,6 +3831,16 @@ int bx_write_configuration(const char *rc, int overwrite)
 #if BX_SUPPORT_MONITOR_MWAIT
   fprintf(fp, ", mwait_is_nop=%d", SIM->get_param_bool(BXPN_MWAIT_IS_NOP)->get());
 #endif
+  fprintf(fp, ", dtlb_entries=%d, itlb_entries=%d, tlb_ways=%d",
+    SIM->get_param_num(BXPN_DTLB_ENTRIES)->get(),
+    SIM->get_param_num(BXPN_ITLB_ENTRIES)->get(),
+    SIM->get_param_num(BXPN_TLB_WAYS)->get());
+  fprintf(fp, ", icache_entries=%d, icache_ways=%d",
+    SIM->get_param_num(BXPN_ICACHE_ENTRIES)->get(),
+    SIM->get_param_num(BXPN_ICACHE_WAYS)->get());
+  sparam = SIM->get_param_string(BXPN_TRACE_CACHE_PATH);
+  if (!sparam->isempty())
+    fprintf(fp, ", trace_cache=\"%s\"", sparam->getptr());
 #if BX_CONFIGURE_MSRS
   sparam = SIM->get_param_string(BXPN_CONFIGURABLE_MSRS_PATH);
   if (!sparam->isempty())
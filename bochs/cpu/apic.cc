@@ -33,6 +33,8 @@
 extern bool simulate_xapic;
 
 #define LOG_THIS this->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 #define BX_CPU_APIC(i) (BX_CPU(i)->lapic)
 
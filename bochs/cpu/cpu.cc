@@ -218,10 +218,41 @@ void BX_CPU_C::cpu_run_trace(void)
 #endif // BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
 }
 
+// Length of the trace cpu_run_trace() would execute next, or 0 if it is
+// not known without fetching and decoding
+unsigned BX_CPU_C::nextTraceLength(void)
+{
+  bx_address eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
+  if (eipBiased >= BX_CPU_THIS_PTR eipPageWindowSize)
+    return 0;
+
+  bx_phy_address pAddr = BX_CPU_THIS_PTR pAddrFetchPage + eipBiased;
+  bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.find_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
+  return (entry != NULL) ? entry->tlen : 0;
+}
+
 #endif
 
 #include "decoder/ia_opcodes.h"
 
+#if BX_SUPPORT_TRACE_OPTIMIZER
+
+// Counts the executions of a trace until it gets hot and is optimized.
+// Returns true when the trace is hot.
+BX_CPP_INLINE bool BX_CPU_C::countTraceExecution(bxICacheEntry_c *entry)
+{
+  if (entry->execCount >= BX_HOT_TRACE_THRESHOLD)
+    return true;
+
+  if (++entry->execCount < BX_HOT_TRACE_THRESHOLD)
+    return false;
+
+  optimizeHotTrace(entry);
+  return true;
+}
+
+#endif
+
 bxICacheEntry_c* BX_CPU_C::getICacheEntry(void)
 {
   bx_address eipBiased = RIP + BX_CPU_THIS_PTR eipPageBias;
@@ -244,6 +275,10 @@ bxICacheEntry_c* BX_CPU_C::getICacheEntry(void)
     entry = serveICacheMiss((Bit32u) eipBiased, pAddr);
   }
 
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  countTraceExecution(entry);
+#endif
+
 #if BX_SUPPORT_CET
   if (WaitingForEndbranch(CPL)) {
     bxInstruction_c *i = entry->i;
@@ -317,7 +352,11 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::linkTrace(bxInstruction_c *i)
 
   if (entry != NULL) // link traces - handle only hit cases
   {
-    i->setNextTrace(entry->i, BX_CPU_THIS_PTR iCache.traceLinkTimeStamp);
+#if BX_SUPPORT_TRACE_OPTIMIZER
+    // linked traces are no longer counted, link only once the trace is hot
+    if (countTraceExecution(entry))
+#endif
+      i->setNextTrace(entry->i, BX_CPU_THIS_PTR iCache.traceLinkTimeStamp);
     i = entry->i;
     BX_EXECUTE_INSTRUCTION(i);
   }
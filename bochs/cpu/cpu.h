@@ -695,6 +695,7 @@ typedef struct
 #include "descriptor.h"
 #include "decoder/instr.h"
 #include "lazy_flags.h"
+#include "cpustats.h"
 #include "tlb.h"
 #include "icache.h"
 
@@ -1292,10 +1293,21 @@ public: // for now...
 #define BX_INSTR_FAR_BRANCH_ORIGIN()
 #endif
 
-#define BX_DTLB_SIZE 2048
-#define BX_ITLB_SIZE 1024
   TLB<BX_DTLB_SIZE> DTLB BX_CPP_AlignN(32);
   TLB<BX_ITLB_SIZE> ITLB BX_CPP_AlignN(32);
+#if BX_CPU_LEVEL >= 5
+  bx_large_TLB largeTLB;
+#endif
+
+#if BX_CPU_LEVEL >= 6
+  bx_TLB_context tlb_context[BX_TLB_CONTEXTS];
+  unsigned tlb_ctx; // active TLB address space context
+  Bit64u tlb_context_stamp;
+#endif
+
+#if BX_SUPPORT_X86_64
+  bx_PWC PWC;
+#endif
 
 #if BX_CPU_LEVEL >= 6
   struct {
@@ -1385,6 +1397,8 @@ public: // for now...
  ~BX_CPU_C();
 
   void initialize(void);
+  void init_TLB(void);
+  void init_ICache(void);
   void init_statistics(void);
   void after_restore_state(void);
   void register_state(void);
@@ -1654,6 +1668,10 @@ public: // for now...
   BX_SMF void JNL_Jd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void JLE_Jd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void JNLE_Jd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  template <unsigned kind, unsigned cc>
+  BX_SMF void CMP_Jcc_EdJd(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#endif
 
   BX_SMF void SETO_EbR(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void SETNO_EbR(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
@@ -4039,6 +4057,12 @@ public: // for now...
   BX_SMF void JNL_Jq(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void JLE_Jq(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void JNLE_Jq(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  template <unsigned kind, unsigned cc>
+  BX_SMF void CMP_Jcc_EdJq(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+  template <unsigned kind, unsigned cc>
+  BX_SMF void CMP_Jcc_EqJq(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
+#endif
 
   BX_SMF void ENTER64_IwIb(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
   BX_SMF void LEAVE64(bxInstruction_c *) BX_CPP_AttrRegparmN(1);
@@ -4320,6 +4344,7 @@ public: // for now...
   BX_SMF void cpu_loop(void);
 #if BX_SUPPORT_SMP
   BX_SMF void cpu_run_trace(void);
+  BX_SMF unsigned nextTraceLength(void);
 #endif
   BX_SMF bool handleAsyncEvent(void);
   BX_SMF bool handleWaitForEvent(void);
@@ -4331,8 +4356,17 @@ public: // for now...
   BX_SMF bxICacheEntry_c *serveICacheMiss(Bit32u eipBiased, bx_phy_address pAddr);
   BX_SMF bxICacheEntry_c* getICacheEntry(void);
   BX_SMF bool mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_address pAddr);
+  BX_SMF bool loadStoredTrace(bxICacheEntry_c *entry, const Bit8u *fetchPtr, unsigned remainingInPage);
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS && BX_ENABLE_TRACE_LINKING
   BX_SMF void linkTrace(bxInstruction_c *i) BX_CPP_AttrRegparmN(1);
+#endif
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  BX_SMF BX_CPP_INLINE bool countTraceExecution(bxICacheEntry_c *entry);
+  BX_SMF void optimizeHotTrace(bxICacheEntry_c *entry);
+  BX_SMF BxExecutePtr_tR fusedBranch32(BxExecutePtr_tR first, BxExecutePtr_tR branch);
+#if BX_SUPPORT_X86_64
+  BX_SMF BxExecutePtr_tR fusedBranch64(BxExecutePtr_tR first, BxExecutePtr_tR branch);
+#endif
 #endif
   BX_SMF void prefetch(void);
   BX_SMF void updateFetchModeMask(void);
@@ -4561,6 +4595,12 @@ public: // for now...
   BX_SMF bx_phy_address translate_linear_legacy(bx_address laddr, Bit32u &lpf_mask, unsigned user, unsigned rw);
   BX_SMF void update_access_dirty(bx_phy_address *entry_addr, Bit32u *entry, BxMemtype *entry_memtype, unsigned leaf, unsigned write);
   BX_SMF Bit32u check_leaf_entry_faults(bx_address laddr, Bit64u leaf_entry, Bit32u combined_access, unsigned user, unsigned rw, bool nx_page = false);
+#if BX_CPU_LEVEL >= 5
+  BX_SMF bool large_page_access_ok(const bx_large_TLB_entry *largeEntry, unsigned user, unsigned rw);
+#endif
+#if BX_SUPPORT_PKEYS
+  BX_SMF bool page_walk_evaluates_pkey(unsigned user, unsigned rw);
+#endif
 #if BX_CPU_LEVEL >= 6
   BX_SMF bx_phy_address translate_linear_load_PDPTR(bx_address laddr, unsigned user, unsigned rw);
   BX_SMF bx_phy_address translate_linear_PAE(bx_address laddr, Bit32u &lpf_mask, unsigned user, unsigned rw);
@@ -4595,9 +4635,14 @@ public: // for now...
 
 #if BX_CPU_LEVEL >= 6
   BX_SMF void TLB_flushNonGlobal(void);
+  BX_SMF void TLB_get_context(bx_TLB_context *ctx);
+  BX_SMF void TLB_label_context(void);
+  BX_SMF void TLB_switchContext(bool flush);
+  BX_SMF void TLB_flushPCID(unsigned pcid);
 #endif
   BX_SMF void TLB_flush(void);
   BX_SMF void TLB_invlpg(bx_address laddr);
+  BX_SMF void TLB_invalidatePhysRange(bx_phy_address begin, bx_phy_address end);
   BX_SMF void inhibit_interrupts(unsigned mask);
   BX_SMF bool interrupts_inhibited(unsigned mask);
   BX_SMF const char *strseg(bx_segment_reg_t *seg);
@@ -4616,7 +4661,7 @@ public: // for now...
 
   BX_SMF bool SetCR0(bxInstruction_c *i, bx_address val);
   BX_SMF bool check_CR0(bx_address val) BX_CPP_AttrRegparmN(1);
-  BX_SMF bool SetCR3(bx_address val) BX_CPP_AttrRegparmN(1);
+  BX_SMF bool SetCR3(bx_address val, bool noflush = false) BX_CPP_AttrRegparmN(2);
 #if BX_CPU_LEVEL >= 5
   BX_SMF bool SetCR4(bxInstruction_c *i, bx_address val);
   BX_SMF bool check_CR4(bx_address val) BX_CPP_AttrRegparmN(1);
@@ -4646,7 +4691,7 @@ public: // for now...
   BX_SMF void shutdown(void);
   BX_SMF void enter_sleep_state(unsigned state);
   BX_SMF void handleCpuModeChange(void);
-  BX_SMF void handleCpuContextChange(void);
+  BX_SMF void handleCpuContextChange(bool flushTLB = true);
   BX_SMF void handleInterruptMaskChange(void);
 #if BX_CPU_LEVEL >= 4
   BX_SMF void handleAlignmentCheck(void);
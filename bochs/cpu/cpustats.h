@@ -39,6 +39,11 @@ struct bx_cpu_statistics
   Bit64u iCacheLookups;
   Bit64u iCachePrefetch;
   Bit64u iCacheMisses;
+  Bit64u iCacheEvictions;       // mpool segment evictions (avoided full flushes)
+  Bit64u iCacheEvictedTraces;
+  Bit64u iCacheStoredTraces;    // traces loaded from the decoded trace cache file
+  Bit64u iCacheHotTraces;       // traces optimized by the hot trace optimizer
+  Bit64u iCacheFusedBranches;   // compare and branch pairs fused in hot traces
 
   // tlb lookup statistics
   Bit64u tlbLookups;
@@ -47,23 +52,29 @@ struct bx_cpu_statistics
   Bit64u tlbMisses;
   Bit64u tlbExecuteMisses;
   Bit64u tlbWriteMisses;
+  Bit64u tlbLargePageHits;
 
   // tlb flush statistics
   Bit64u tlbGlobalFlushes;
   Bit64u tlbNonGlobalFlushes;
+  Bit64u tlbContextSwitches;
 
   // stack prefetch statistics
   Bit64u stackPrefetch;
 
   // self modifying code statistics
   Bit64u smc;
+  Bit64u smcInvalidatedTraces;
+  Bit64u smcTimeUsec;
 
   bx_cpu_statistics():
       iCacheLookups(0), iCachePrefetch(0), iCacheMisses(0),
+      iCacheEvictions(0), iCacheEvictedTraces(0), iCacheStoredTraces(0),
+      iCacheHotTraces(0), iCacheFusedBranches(0),
       tlbLookups(0), tlbExecuteLookups(0), tlbWriteLookups(0),
-      tlbMisses(0), tlbExecuteMisses(0), tlbWriteMisses(0),
-      tlbGlobalFlushes(0), tlbNonGlobalFlushes(0),
-      stackPrefetch(0), smc(0) {}
+      tlbMisses(0), tlbExecuteMisses(0), tlbWriteMisses(0), tlbLargePageHits(0),
+      tlbGlobalFlushes(0), tlbNonGlobalFlushes(0), tlbContextSwitches(0),
+      stackPrefetch(0), smc(0), smcInvalidatedTraces(0), smcTimeUsec(0) {}
 
 };
 
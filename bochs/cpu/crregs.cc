@@ -717,12 +717,14 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::MOV_CR3Rq(bxInstruction_c *i)
 #endif
 
   // allow bit 63 (hint that TLB doesn't need to be cleared) to be set when
-  // PCIDE is set, but ignore the hint if given
+  // PCIDE is set, mappings of the new PCID are kept in the TLB if given
+  bool noflush = false;
   if (BX_CPU_THIS_PTR cr4.get_PCIDE()) {
+    noflush = (val_64 >> 63) != 0;
     val_64 &= ~(BX_CONST64(1)<<63);
   }
 
-  if (! SetCR3(val_64))
+  if (! SetCR3(val_64, noflush))
     exception(BX_GP_EXCEPTION, 0);
 
   BX_INSTR_TLB_CNTRL(BX_CPU_ID, BX_INSTR_MOV_CR3, val_64);
@@ -1415,7 +1417,7 @@ bool BX_CPU_C::SetCR4(bxInstruction_c *i, bx_address val)
 }
 #endif // BX_CPU_LEVEL >= 5
 
-bool BX_CPP_AttrRegparmN(1) BX_CPU_C::SetCR3(bx_address val)
+bool BX_CPP_AttrRegparmN(2) BX_CPU_C::SetCR3(bx_address val, bool noflush)
 {
 #if BX_SUPPORT_X86_64
   if (long_mode()) {
@@ -1430,11 +1432,12 @@ bool BX_CPP_AttrRegparmN(1) BX_CPU_C::SetCR3(bx_address val)
 
   // flush TLB even if value does not change
 #if BX_CPU_LEVEL >= 6
-  if (BX_CPU_THIS_PTR cr4.get_PGE())
-    TLB_flushNonGlobal(); // Don't flush Global entries.
-  else
+  // Don't flush Global entries. Without CR4.PGE there are no Global entries
+  // in the TLB, mappings of the other PCIDs and VPIDs are kept as well.
+  TLB_switchContext(! noflush);
+#else
+  TLB_flush();          // Flush Global entries also.
 #endif
-    TLB_flush();          // Flush Global entries also.
 
   return true;
 }
@@ -1466,6 +1469,11 @@ bool BX_CPP_AttrRegparmN(1) BX_CPU_C::SetEFER(bx_address val_64)
   }
 #endif
 
+  // EFER.NXE affects reserved bits checking of the cached paging-structure
+  // entries and it is part of the TLB address space context
+  if ((BX_CPU_THIS_PTR efer.get32() ^ val32) & BX_EFER_NXE_MASK)
+    TLB_flush();
+
   BX_CPU_THIS_PTR efer.set32((val32 & BX_CPU_THIS_PTR efer_suppmask & ~BX_EFER_LMA_MASK)
         | (BX_CPU_THIS_PTR efer.get32() & BX_EFER_LMA_MASK)); // keep LMA untouched
 
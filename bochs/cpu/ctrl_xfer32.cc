@@ -22,6 +22,7 @@
 #define NEED_CPU_REG_SHORTCUTS 1
 #include "bochs.h"
 #include "cpu.h"
+#include "fused_branch.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
 #if BX_CPU_LEVEL >= 3
@@ -773,4 +774,96 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::LOOP32_Jb(bxInstruction_c *i)
   BX_NEXT_TRACE(i);
 }
 
+
+#if BX_SUPPORT_TRACE_OPTIMIZER
+
+// register compare or test fused with the following near conditional branch
+template <unsigned kind, unsigned cc>
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_Jcc_EdJd(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  Bit32u op2_32 = BX_FUSED_IMM(kind) ? i->Id() : BX_READ_32BIT_REG(i->src());
+
+  if (BX_FUSED_TEST(kind)) {
+    Bit32u result_32 = op1_32 & op2_32;
+    SET_FLAGS_OSZAPC_LOGIC_32(result_32);
+  }
+  else {
+    Bit32u diff_32 = op1_32 - op2_32;
+    SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+  }
+
+  bool taken = fused_branch_taken<Bit32u, Bit32s, kind, cc>(op1_32, op2_32);
+
+  // the compare retires on its own exactly as without fusion
+  BX_COMMIT_INSTRUCTION(i);
+  if (BX_CPU_THIS_PTR async_event) return;
+
+  ++i;
+  BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);
+  RIP += i->ilen();
+
+  if (taken) {
+    Bit32u new_EIP = EIP + (Bit32s) i->Id();
+    branch_near32(new_EIP);
+    BX_INSTR_CNEAR_BRANCH_TAKEN(BX_CPU_ID, PREV_RIP, new_EIP);
+    BX_LINK_TRACE(i);
+  }
+
+  BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(BX_CPU_ID, PREV_RIP);
+  BX_NEXT_INSTR(i); // trace can continue over non-taken branch
+}
+
+#define BX_FUSED_JCC(handler, cc) \
+  { &BX_CPU_C::handler, { &BX_CPU_C::CMP_Jcc_EdJd<BX_FUSED_CMP_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJd<BX_FUSED_CMP_IMM, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJd<BX_FUSED_TEST_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJd<BX_FUSED_TEST_IMM, cc> } }
+
+static const struct bxFusedBranch {
+  BxExecutePtr_tR branch;
+  BxExecutePtr_tR fused[BX_FUSED_KINDS];
+} fusedBranchJd[] = {
+  BX_FUSED_JCC(JB_Jd,   BX_FUSED_B),
+  BX_FUSED_JCC(JNB_Jd,  BX_FUSED_NB),
+  BX_FUSED_JCC(JZ_Jd,   BX_FUSED_Z),
+  BX_FUSED_JCC(JNZ_Jd,  BX_FUSED_NZ),
+  BX_FUSED_JCC(JBE_Jd,  BX_FUSED_BE),
+  BX_FUSED_JCC(JNBE_Jd, BX_FUSED_NBE),
+  BX_FUSED_JCC(JS_Jd,   BX_FUSED_S),
+  BX_FUSED_JCC(JNS_Jd,  BX_FUSED_NS),
+  BX_FUSED_JCC(JL_Jd,   BX_FUSED_L),
+  BX_FUSED_JCC(JNL_Jd,  BX_FUSED_NL),
+  BX_FUSED_JCC(JLE_Jd,  BX_FUSED_LE),
+  BX_FUSED_JCC(JNLE_Jd, BX_FUSED_NLE)
+};
+
+#undef BX_FUSED_JCC
+
+// returns the handler executing both instructions or NULL if they can't be fused
+BxExecutePtr_tR BX_CPU_C::fusedBranch32(BxExecutePtr_tR first, BxExecutePtr_tR branch)
+{
+  unsigned kind;
+
+  if (first == &BX_CPU_C::CMP_GdEdR)
+    kind = BX_FUSED_CMP_REG;
+  else if (first == &BX_CPU_C::CMP_EdIdR)
+    kind = BX_FUSED_CMP_IMM;
+  else if (first == &BX_CPU_C::TEST_EdGdR)
+    kind = BX_FUSED_TEST_REG;
+  else if (first == &BX_CPU_C::TEST_EdIdR)
+    kind = BX_FUSED_TEST_IMM;
+  else
+    return NULL;
+
+  for (unsigned n=0; n < sizeof(fusedBranchJd) / sizeof(fusedBranchJd[0]); n++) {
+    if (fusedBranchJd[n].branch == branch)
+      return fusedBranchJd[n].fused[kind];
+  }
+
+  return NULL;
+}
+
+#endif // BX_SUPPORT_TRACE_OPTIMIZER
+
 #endif
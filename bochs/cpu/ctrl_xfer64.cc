@@ -22,6 +22,7 @@
 #define NEED_CPU_REG_SHORTCUTS 1
 #include "bochs.h"
 #include "cpu.h"
+#include "fused_branch.h"
 #define LOG_THIS BX_CPU_THIS_PTR
 
 #if BX_SUPPORT_X86_64
@@ -641,4 +642,136 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::LOOP64_Jb(bxInstruction_c *i)
   BX_NEXT_TRACE(i);
 }
 
+
+#if BX_SUPPORT_TRACE_OPTIMIZER
+
+// fused near conditional branch tail shared by the 32-bit and 64-bit forms
+#define BX_FUSED_JCC_JQ(i, taken) {                           \
+  BX_COMMIT_INSTRUCTION(i);                                   \
+  if (BX_CPU_THIS_PTR async_event) return;                    \
+  ++i;                                                        \
+  BX_INSTR_BEFORE_EXECUTION(BX_CPU_ID, i);                    \
+  RIP += i->ilen();                                           \
+  if (taken) {                                                \
+    branch_near64(i);                                         \
+    BX_INSTR_CNEAR_BRANCH_TAKEN(BX_CPU_ID, PREV_RIP, RIP);    \
+    BX_LINK_TRACE(i);                                         \
+  }                                                           \
+  BX_INSTR_CNEAR_BRANCH_NOT_TAKEN(BX_CPU_ID, PREV_RIP);       \
+  BX_NEXT_INSTR(i);                                           \
+}
+
+// 32-bit register compare or test fused with the following branch
+template <unsigned kind, unsigned cc>
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_Jcc_EdJq(bxInstruction_c *i)
+{
+  Bit32u op1_32 = BX_READ_32BIT_REG(i->dst());
+  Bit32u op2_32 = BX_FUSED_IMM(kind) ? i->Id() : BX_READ_32BIT_REG(i->src());
+
+  if (BX_FUSED_TEST(kind)) {
+    Bit32u result_32 = op1_32 & op2_32;
+    SET_FLAGS_OSZAPC_LOGIC_32(result_32);
+  }
+  else {
+    Bit32u diff_32 = op1_32 - op2_32;
+    SET_FLAGS_OSZAPC_SUB_32(op1_32, op2_32, diff_32);
+  }
+
+  bool taken = fused_branch_taken<Bit32u, Bit32s, kind, cc>(op1_32, op2_32);
+
+  BX_FUSED_JCC_JQ(i, taken);
+}
+
+// 64-bit register compare or test fused with the following branch
+template <unsigned kind, unsigned cc>
+void BX_CPP_AttrRegparmN(1) BX_CPU_C::CMP_Jcc_EqJq(bxInstruction_c *i)
+{
+  Bit64u op1_64 = BX_READ_64BIT_REG(i->dst());
+  Bit64u op2_64 = BX_FUSED_IMM(kind) ? (Bit64u)(Bit32s) i->Id() : BX_READ_64BIT_REG(i->src());
+
+  if (BX_FUSED_TEST(kind)) {
+    Bit64u result_64 = op1_64 & op2_64;
+    SET_FLAGS_OSZAPC_LOGIC_64(result_64);
+  }
+  else {
+    Bit64u diff_64 = op1_64 - op2_64;
+    SET_FLAGS_OSZAPC_SUB_64(op1_64, op2_64, diff_64);
+  }
+
+  bool taken = fused_branch_taken<Bit64u, Bit64s, kind, cc>(op1_64, op2_64);
+
+  BX_FUSED_JCC_JQ(i, taken);
+}
+
+#undef BX_FUSED_JCC_JQ
+
+#define BX_FUSED_JCC(handler, cc) \
+  { &BX_CPU_C::handler, { &BX_CPU_C::CMP_Jcc_EdJq<BX_FUSED_CMP_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJq<BX_FUSED_CMP_IMM, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJq<BX_FUSED_TEST_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EdJq<BX_FUSED_TEST_IMM, cc> }, \
+                        { &BX_CPU_C::CMP_Jcc_EqJq<BX_FUSED_CMP_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EqJq<BX_FUSED_CMP_IMM, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EqJq<BX_FUSED_TEST_REG, cc>, \
+                          &BX_CPU_C::CMP_Jcc_EqJq<BX_FUSED_TEST_IMM, cc> } }
+
+static const struct bxFusedBranch64 {
+  BxExecutePtr_tR branch;
+  BxExecutePtr_tR fused32[BX_FUSED_KINDS];
+  BxExecutePtr_tR fused64[BX_FUSED_KINDS];
+} fusedBranchJq[] = {
+  BX_FUSED_JCC(JB_Jq,   BX_FUSED_B),
+  BX_FUSED_JCC(JNB_Jq,  BX_FUSED_NB),
+  BX_FUSED_JCC(JZ_Jq,   BX_FUSED_Z),
+  BX_FUSED_JCC(JNZ_Jq,  BX_FUSED_NZ),
+  BX_FUSED_JCC(JBE_Jq,  BX_FUSED_BE),
+  BX_FUSED_JCC(JNBE_Jq, BX_FUSED_NBE),
+  BX_FUSED_JCC(JS_Jq,   BX_FUSED_S),
+  BX_FUSED_JCC(JNS_Jq,  BX_FUSED_NS),
+  BX_FUSED_JCC(JL_Jq,   BX_FUSED_L),
+  BX_FUSED_JCC(JNL_Jq,  BX_FUSED_NL),
+  BX_FUSED_JCC(JLE_Jq,  BX_FUSED_LE),
+  BX_FUSED_JCC(JNLE_Jq, BX_FUSED_NLE)
+};
+
+#undef BX_FUSED_JCC
+
+// returns the handler executing both instructions or NULL if they can't be fused
+BxExecutePtr_tR BX_CPU_C::fusedBranch64(BxExecutePtr_tR first, BxExecutePtr_tR branch)
+{
+  unsigned kind;
+  bool os64 = false;
+
+  if (first == &BX_CPU_C::CMP_GdEdR)
+    kind = BX_FUSED_CMP_REG;
+  else if (first == &BX_CPU_C::CMP_EdIdR)
+    kind = BX_FUSED_CMP_IMM;
+  else if (first == &BX_CPU_C::TEST_EdGdR)
+    kind = BX_FUSED_TEST_REG;
+  else if (first == &BX_CPU_C::TEST_EdIdR)
+    kind = BX_FUSED_TEST_IMM;
+  else {
+    os64 = true;
+    if (first == &BX_CPU_C::CMP_GqEqR)
+      kind = BX_FUSED_CMP_REG;
+    else if (first == &BX_CPU_C::CMP_EqIdR)
+      kind = BX_FUSED_CMP_IMM;
+    else if (first == &BX_CPU_C::TEST_EqGqR)
+      kind = BX_FUSED_TEST_REG;
+    else if (first == &BX_CPU_C::TEST_EqIdR)
+      kind = BX_FUSED_TEST_IMM;
+    else
+      return NULL;
+  }
+
+  for (unsigned n=0; n < sizeof(fusedBranchJq) / sizeof(fusedBranchJq[0]); n++) {
+    if (fusedBranchJq[n].branch == branch)
+      return os64 ? fusedBranchJq[n].fused64[kind] : fusedBranchJq[n].fused32[kind];
+  }
+
+  return NULL;
+}
+
+#endif // BX_SUPPORT_TRACE_OPTIMIZER
+
 #endif /* if BX_SUPPORT_X86_64 */
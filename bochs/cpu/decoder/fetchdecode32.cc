@@ -2398,7 +2398,7 @@ int decoder_ud32(const Bit8u *iptr, unsigned &remain, bxInstruction_c *i, unsign
   return BX_IA_ERROR;
 }
 
-Bit16u findOpcode(const Bit64u *opMap, Bit32u decmask)
+static Bit16u findOpcodeSlow(const Bit64u *opMap, Bit32u decmask)
 {
   Bit16u ia_opcode = BX_IA_ERROR;
   Bit64u op;
@@ -2416,6 +2416,47 @@ Bit16u findOpcode(const Bit64u *opMap, Bit32u decmask)
   return ia_opcode;
 }
 
+// The opcode maps are constant so the result of the lookup depends only on
+// the opcode map and decode mask. Results of lookups which require scanning
+// beyond the first opcode map entry are kept in direct mapped cache indexed
+// by hash of the (opMap, decmask) pair.
+
+#define BX_OPCODE_LOOKUP_CACHE_BITS 12
+#define BX_OPCODE_LOOKUP_CACHE_SIZE (1 << BX_OPCODE_LOOKUP_CACHE_BITS)
+
+static struct bxOpcodeLookupEntry {
+  const Bit64u *opMap;
+  Bit32u decmask;
+  Bit16u ia_opcode;
+} opcodeLookupCache[BX_OPCODE_LOOKUP_CACHE_SIZE];
+
+BX_CPP_INLINE unsigned opcodeLookupHash(const Bit64u *opMap, Bit32u decmask)
+{
+  Bit32u hash = Bit32u(((bx_ptr_equiv_t) opMap) >> 3) ^ decmask;
+  return (hash * 0x9E3779B1) >> (32 - BX_OPCODE_LOOKUP_CACHE_BITS);
+}
+
+Bit16u findOpcode(const Bit64u *opMap, Bit32u decmask)
+{
+  // most of the opcode maps have single entry or match the first one
+  Bit64u op = *opMap;
+  Bit32u ignmsk = Bit32u(op) & 0xFFFFFF;
+  Bit32u opmsk  = Bit32u(op >> 24);
+  if ((opmsk & ignmsk) == (decmask & ignmsk))
+    return Bit16u(op >> 48) & 0x7FFF;
+  if (Bit64s(op) <= 0)
+    return BX_IA_ERROR;
+
+  bxOpcodeLookupEntry *e = &opcodeLookupCache[opcodeLookupHash(opMap, decmask)];
+  if (e->opMap != opMap || e->decmask != decmask) {
+    e->opMap = opMap;
+    e->decmask = decmask;
+    e->ia_opcode = findOpcodeSlow(opMap + 1, decmask);
+  }
+
+  return e->ia_opcode;
+}
+
 int fetchDecode32(const Bit8u *iptr, bool is_32, bxInstruction_c *i, unsigned remainingInPage)
 {
   if (remainingInPage > 15) remainingInPage = 15;
@@ -2655,6 +2696,91 @@ int assignHandler(bxInstruction_c *i, Bit32u fetchModeMask)
   return(0);
 }
 
+// Sanity check of a decoded instruction which was not produced by the
+// decoder in this run (persistent trace cache): the opcode and every register
+// or segment index must be in range of the tables and register files they
+// are used to index.
+bool validateInstruction(const bxInstruction_c *i)
+{
+  unsigned ia_opcode = i->getIaOpcode();
+  if (ia_opcode >= BX_IA_LAST)
+    return false;
+
+  if (i->ilen() == 0 || i->ilen() > 15 || i->seg() > BX_SEG_REG_GS)
+    return false;
+
+  unsigned maxIndex = BX_NIL_REGISTER;
+
+  for (unsigned n = 0; n <= 3; n++) {
+    unsigned src = (unsigned) BxOpcodesTable[ia_opcode].src[n];
+    unsigned type = BX_DISASM_SRC_TYPE(src);
+    unsigned reg = i->getSrcReg(n), limit;
+
+    switch(BX_DISASM_SRC_ORIGIN(src)) {
+    case BX_SRC_NONE:
+    case BX_SRC_IMM:
+    case BX_SRC_BRANCH_OFFSET:
+    case BX_SRC_IMPLICIT:
+      continue;
+    case BX_SRC_VSIB:
+      maxIndex = BX_XMM_REGISTERS - 1;
+      continue;
+    case BX_SRC_VECTOR_RM:
+      type = BX_VMM_REG;
+      // fall through
+    case BX_SRC_RM:
+      if (! i->modC0() && reg == ((type == BX_VMM_REG) ? BX_VECTOR_TMP_REGISTER : BX_TMP_REGISTER))
+        continue;
+      break;
+    default:
+      break;
+    }
+
+    switch(type) {
+    case BX_VMM_REG:
+      limit = BX_XMM_REGISTERS;
+      break;
+    case BX_FPU_REG:
+    case BX_MMX_REG:
+    case BX_MMX_HALF_REG:
+    case BX_KMASK_REG:
+    case BX_KMASK_REG_PAIR:
+    case BX_TMM_REG:
+      limit = 8;
+      break;
+    case BX_SEGREG:
+      limit = BX_SEG_REG_GS + 1;
+      break;
+    case BX_CREG:
+    case BX_DREG:
+      limit = 16;
+      break;
+    default:
+      limit = BX_GENERAL_REGISTERS + 4;
+      break;
+    }
+
+    if (reg >= limit)
+      return false;
+  }
+
+  // base and index are only set for memory references
+  if (! i->modC0() && (i->sibBase() > BX_NIL_REGISTER || i->sibIndex() > maxIndex))
+    return false;
+
+#if BX_SUPPORT_AVX
+  Bit32u op_flags = BxOpcodesTable[ia_opcode].opflags;
+  if ((op_flags & (BX_PREPARE_AVX | BX_PREPARE_EVEX)) != 0 && i->getVL() > BX_VLMAX)
+    return false;
+#if BX_SUPPORT_EVEX
+  if ((op_flags & BX_PREPARE_EVEX) != 0 && i->opmask() > 7)
+    return false;
+#endif
+#endif
+
+  return true;
+}
+
 void BX_CPU_C::init_FetchDecodeTables(void)
 {
   static Bit8u BxOpcodeFeatures[BX_IA_LAST] =
@@ -107,7 +107,10 @@ bool BX_CPU_C::handleWaitForEvent(void)
       return 1; // Return to caller of cpu_loop.
     }
 
-    BX_TICKN(10); // when in HLT run time faster for single CPU
+    if (bx_pc_system.idle_skip && !BX_HRQ)
+      bx_pc_system.tick_next_event(); // nothing to do until next timer event
+    else
+      BX_TICKN(10); // when in HLT run time faster for single CPU
   }
 
   return 0;
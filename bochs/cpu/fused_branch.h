@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA B 02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_FUSED_BRANCH_H
+#define BX_FUSED_BRANCH_H
+
+#if BX_SUPPORT_TRACE_OPTIMIZER
+
+// The hot trace optimizer replaces a register compare or test instruction
+// followed by a conditional branch with one handler. The handler still
+// updates the lazy flags, but the branch condition is computed directly from
+// the operands instead of being evaluated from the lazy flags.
+
+// compare or test instruction kind
+#define BX_FUSED_CMP_REG   0
+#define BX_FUSED_CMP_IMM   1
+#define BX_FUSED_TEST_REG  2
+#define BX_FUSED_TEST_IMM  3
+
+#define BX_FUSED_KINDS     4
+
+#define BX_FUSED_IMM(kind)  ((kind) & 1)
+#define BX_FUSED_TEST(kind) ((kind) & 2)
+
+// condition codes of the branches which can be fused (low nibble of the
+// Jcc opcode); overflow and parity branches are not fused
+#define BX_FUSED_B    0x2
+#define BX_FUSED_NB   0x3
+#define BX_FUSED_Z    0x4
+#define BX_FUSED_NZ   0x5
+#define BX_FUSED_BE   0x6
+#define BX_FUSED_NBE  0x7
+#define BX_FUSED_S    0x8
+#define BX_FUSED_NS   0x9
+#define BX_FUSED_L    0xC
+#define BX_FUSED_NL   0xD
+#define BX_FUSED_LE   0xE
+#define BX_FUSED_NLE  0xF
+
+// returns the condition the flags of 'op1 - op2' (compare) or 'op1 & op2'
+// (test) would give; T is the unsigned and ST the signed operand type
+template <typename T, typename ST, unsigned kind, unsigned cc>
+BX_CPP_INLINE bool fused_branch_taken(T op1, T op2)
+{
+  if (BX_FUSED_TEST(kind)) {
+    // test clears CF and OF
+    T result = op1 & op2;
+    switch (cc) {
+      case BX_FUSED_B:   return false;
+      case BX_FUSED_NB:  return true;
+      case BX_FUSED_Z:   return result == 0;
+      case BX_FUSED_NZ:  return result != 0;
+      case BX_FUSED_BE:  return result == 0;
+      case BX_FUSED_NBE: return result != 0;
+      case BX_FUSED_S:
+      case BX_FUSED_L:   return (ST) result < 0;
+      case BX_FUSED_NS:
+      case BX_FUSED_NL:  return (ST) result >= 0;
+      case BX_FUSED_LE:  return (ST) result <= 0;
+      case BX_FUSED_NLE: return (ST) result > 0;
+    }
+  }
+  else {
+    switch (cc) {
+      case BX_FUSED_B:   return op1 < op2;
+      case BX_FUSED_NB:  return op1 >= op2;
+      case BX_FUSED_Z:   return op1 == op2;
+      case BX_FUSED_NZ:  return op1 != op2;
+      case BX_FUSED_BE:  return op1 <= op2;
+      case BX_FUSED_NBE: return op1 > op2;
+      case BX_FUSED_S:   return (ST)(op1 - op2) < 0;
+      case BX_FUSED_NS:  return (ST)(op1 - op2) >= 0;
+      case BX_FUSED_L:   return (ST) op1 < (ST) op2;
+      case BX_FUSED_NL:  return (ST) op1 >= (ST) op2;
+      case BX_FUSED_LE:  return (ST) op1 <= (ST) op2;
+      case BX_FUSED_NLE: return (ST) op1 > (ST) op2;
+    }
+  }
+  return false;
+}
+
+#endif // BX_SUPPORT_TRACE_OPTIMIZER
+
+#endif
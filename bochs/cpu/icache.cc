@@ -32,13 +32,18 @@
 
 #include "decoder/ia_opcodes.h"
 
+Bit32u bxPageWriteStampTable::zeroChunk[BX_WRITE_STAMP_CHUNK_PAGES];
+
 bxPageWriteStampTable pageWriteStampTable;
 
+bxTraceStore traceStore;
+
 extern int fetchDecode32(const Bit8u *fetchPtr, bool is_32, bxInstruction_c *i, unsigned remainingInPage);
 #if BX_SUPPORT_X86_64
 extern int fetchDecode64(const Bit8u *fetchPtr, bxInstruction_c *i, unsigned remainingInPage);
 #endif
 extern int assignHandler(bxInstruction_c *i, Bit32u fetchModeMask);
+extern bool validateInstruction(const bxInstruction_c *i);
 
 void flushICaches(void)
 {
@@ -52,12 +57,25 @@ void flushICaches(void)
 
 void handleSMC(bx_phy_address pAddr, Bit32u mask)
 {
-  INC_SMC_STAT(smc);
+#if InstrumentSMC
+  Bit64u start = bx_get_realtime64_usec();
+#endif
 
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++) {
     BX_CPU(i)->async_event |= BX_ASYNC_EVENT_STOP_TRACE;
+#if InstrumentSMC
+    BX_CPU(i)->stats->smcInvalidatedTraces += BX_CPU(i)->iCache.handleSMC(pAddr, mask);
+#else
     BX_CPU(i)->iCache.handleSMC(pAddr, mask);
+#endif
   }
+
+#if InstrumentSMC
+  // the SMC event is shared by all processors, account it only once
+  bx_cpu_statistics *stats = BX_CPU(0)->stats;
+  stats->smc++;
+  stats->smcTimeUsec += bx_get_realtime64_usec() - start;
+#endif
 }
 
 #if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
@@ -80,6 +98,16 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
 {
   bxICacheEntry_c *entry = BX_CPU_THIS_PTR iCache.get_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
 
+  if (BX_CPU_THIS_PTR iCache.mpoolSegmentFull()) {
+    // evict only the oldest mpool segment instead of flushing whole icache
+#if InstrumentICACHE
+    INC_ICACHE_STAT(iCacheEvictions);
+    BX_CPU_THIS_PTR stats->iCacheEvictedTraces += BX_CPU_THIS_PTR iCache.evictNextSegment();
+#else
+    BX_CPU_THIS_PTR iCache.evictNextSegment();
+#endif
+  }
+
   BX_CPU_THIS_PTR iCache.alloc_trace(entry);
 
   // Cache miss. We weren't so lucky, but let's be optimistic - try to build
@@ -101,6 +129,11 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
     invalidate_stack_cache();
 #endif
 
+  if (traceStore.enabled()) {
+    if (loadStoredTrace(entry, fetchPtr, remainingInPage))
+      return entry;
+  }
+
   // Don't allow traces longer than cpu_loop can execute
   static unsigned quantum =
 #if BX_SUPPORT_SMP
@@ -175,7 +208,10 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
       if (mergeTraces(entry, i, pAddr)) {
           entry->traceMask |= traceMask;
           pageWriteStampTable.markICacheMask(pAddr, entry->traceMask);
-          BX_CPU_THIS_PTR iCache.commit_trace(entry->tlen);
+          if (traceStore.enabled())
+            traceStore.insert(entry->pAddr, BX_CPU_THIS_PTR fetchModeMask, entry->traceMask,
+                BX_CPU_THIS_PTR eipFetchPtr + eipBiased, entry->i, entry->tlen);
+          BX_CPU_THIS_PTR iCache.commit_trace(entry);
           return entry;
       }
     }
@@ -190,11 +226,56 @@ bxICacheEntry_c* BX_CPU_C::serveICacheMiss(Bit32u eipBiased, bx_phy_address pAdd
   genDummyICacheEntry(i);
 #endif
 
-  BX_CPU_THIS_PTR iCache.commit_trace(entry->tlen);
+  if (traceStore.enabled())
+    traceStore.insert(entry->pAddr, BX_CPU_THIS_PTR fetchModeMask, entry->traceMask,
+        BX_CPU_THIS_PTR eipFetchPtr + eipBiased, entry->i, entry->tlen);
+
+  BX_CPU_THIS_PTR iCache.commit_trace(entry);
 
   return entry;
 }
 
+bool BX_CPU_C::loadStoredTrace(bxICacheEntry_c *entry, const Bit8u *fetchPtr, unsigned remainingInPage)
+{
+  const bxStoredTrace *t = traceStore.find(entry->pAddr, BX_CPU_THIS_PTR fetchModeMask, fetchPtr, remainingInPage);
+  if (t == NULL || t->tlen > BX_MAX_TRACE_LENGTH)
+    return false;
+
+  bxInstruction_c *i = entry->i;
+  memcpy(i, t->i, sizeof(bxInstruction_c) * t->tlen);
+
+  // handler pointers are not kept in the store, only the last instruction
+  // of the trace is allowed to end it
+  for (unsigned n=0; n < t->tlen; n++) {
+    if (assignHandler(&i[n], BX_CPU_THIS_PTR fetchModeMask) && (n + 1) < t->tlen) {
+      BX_ERROR(("trace cache file: inconsistent trace at 0x" FMT_PHY_ADDRX " dropped", entry->pAddr));
+      traceStore.drop(t);
+      return false;
+    }
+  }
+
+  INC_ICACHE_STAT(iCacheStoredTraces);
+
+  for (unsigned n=0; n < t->tlen; n++, i++) {
+    BX_INSTR_OPCODE(BX_CPU_ID, i, fetchPtr, i->ilen(),
+       BX_CPU_THIS_PTR sregs[BX_SEG_REG_CS].cache.u.segment.d_b, long64_mode());
+    fetchPtr += i->ilen();
+  }
+
+  entry->tlen = t->tlen;
+  entry->traceMask = t->traceMask;
+  pageWriteStampTable.markICacheMask(entry->pAddr, entry->traceMask);
+
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
+  entry->tlen++; /* Add the inserted end of trace opcode */
+  genDummyICacheEntry(i);
+#endif
+
+  BX_CPU_THIS_PTR iCache.commit_trace(entry);
+
+  return true;
+}
+
 bool BX_CPU_C::mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_address pAddr)
 {
   bxICacheEntry_c *e = BX_CPU_THIS_PTR iCache.find_entry(pAddr, BX_CPU_THIS_PTR fetchModeMask);
@@ -225,6 +306,33 @@ bool BX_CPU_C::mergeTraces(bxICacheEntry_c *entry, bxInstruction_c *i, bx_phy_ad
   return false;
 }
 
+#if BX_SUPPORT_TRACE_OPTIMIZER
+
+// Replace register compare or test instructions followed by a conditional
+// branch with fused handlers. Only the handler pointers change, the trace is
+// still invalidated by self modifying code like any other.
+void BX_CPU_C::optimizeHotTrace(bxICacheEntry_c *entry)
+{
+  bxInstruction_c *i = entry->i;
+
+  INC_ICACHE_STAT(iCacheHotTraces);
+
+  for (unsigned n=0; n+1 < entry->tlen; n++) {
+    BxExecutePtr_tR fused = fusedBranch32(i[n].execute1, i[n+1].execute1);
+#if BX_SUPPORT_X86_64
+    if (fused == NULL)
+      fused = fusedBranch64(i[n].execute1, i[n+1].execute1);
+#endif
+    if (fused != NULL) {
+      i[n].execute1 = fused;
+      INC_ICACHE_STAT(iCacheFusedBranches);
+      n++; // skip the branch
+    }
+  }
+}
+
+#endif
+
 void BX_CPU_C::boundaryFetch(const Bit8u *fetchPtr, unsigned remainingInPage, bxInstruction_c *i)
 {
   unsigned j, k;
@@ -292,3 +400,256 @@ void BX_CPU_C::boundaryFetch(const Bit8u *fetchPtr, unsigned remainingInPage, bx
   BX_INSTR_OPCODE(BX_CPU_ID, i, fetchBuffer, i->ilen(),
       BX_CPU_THIS_PTR sregs[BX_SEG_REG_CS].cache.u.segment.d_b, long64_mode());
 }
+
+// FNV-1a hash
+Bit64u bxTraceStore::hashBytes(const void *data, unsigned len, Bit64u hash)
+{
+  const Bit8u *p = (const Bit8u *) data;
+  while (len--) {
+    hash ^= *p++;
+    hash *= BX_CONST64(0x100000001b3);
+  }
+  return hash;
+}
+
+bxStoredTrace* bxTraceStore::lookup(bx_phy_address pAddr, Bit32u fetchModeMask, Bit64u hash, Bit32u bytes) const
+{
+  for (bxStoredTrace *t = buckets[bucket(pAddr, fetchModeMask)]; t != NULL; t = t->next) {
+    if (t->pAddr == pAddr && t->fetchModeMask == fetchModeMask && t->hash == hash && t->bytes == bytes)
+      return t;
+  }
+  return NULL;
+}
+
+void bxTraceStore::add(bxStoredTrace *t)
+{
+  bxStoredTrace **head = &buckets[bucket(t->pAddr, t->fetchModeMask)];
+  t->next = *head;
+  *head = t;
+  instructions += t->tlen;
+  traces++;
+}
+
+void bxTraceStore::drop(const bxStoredTrace *t)
+{
+  for (bxStoredTrace **p = &buckets[bucket(t->pAddr, t->fetchModeMask)]; *p != NULL; p = &(*p)->next) {
+    if (*p == t) {
+      *p = t->next;
+      instructions -= t->tlen;
+      traces--;
+      delete [] t->i;
+      delete t;
+      dirty = 1;
+      return;
+    }
+  }
+}
+
+// the stored instructions are used as is, make sure none of them could
+// index the opcode tables or register files out of bounds
+bool bxTraceStore::validate(const bxStoredTrace *t)
+{
+  Bit32u bytes = 0;
+  for (unsigned n=0; n < t->tlen; n++) {
+    if (! validateInstruction(&t->i[n]))
+      return false;
+    bytes += t->i[n].ilen();
+  }
+  return bytes == t->bytes;
+}
+
+void bxTraceStore::clear(void)
+{
+  if (buckets) {
+    for (unsigned n=0; n < BX_TRACE_STORE_BUCKETS; n++) {
+      bxStoredTrace *t = buckets[n];
+      while (t) {
+        bxStoredTrace *next = t->next;
+        delete [] t->i;
+        delete t;
+        t = next;
+      }
+    }
+    delete [] buckets;
+    buckets = NULL;
+  }
+  instructions = traces = 0;
+}
+
+static const char bx_trace_store_magic[8] = { 'B', 'X', 'T', 'R', 'A', 'C', 'E', '1' };
+
+struct bx_trace_store_header {
+  char magic[8];
+  Bit64u fingerprint;
+  Bit32u traces;
+  Bit32u instr_size;
+};
+
+struct bx_trace_store_record {
+  Bit64u pAddr;
+  Bit32u fetchModeMask;
+  Bit32u traceMask;
+  Bit64u hash;
+  Bit32u bytes;
+  Bit32u tlen;
+};
+
+int bxTraceStore::open(const char *filename, Bit64u cpu_fingerprint)
+{
+  clear();
+  delete [] path;
+  path = new char[strlen(filename) + 1];
+  strcpy(path, filename);
+  fingerprint = cpu_fingerprint;
+  dirty = 0;
+
+  buckets = new bxStoredTrace*[BX_TRACE_STORE_BUCKETS];
+  for (unsigned n=0; n < BX_TRACE_STORE_BUCKETS; n++)
+    buckets[n] = NULL;
+
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) return 0; // start with empty store
+
+  bx_trace_store_header header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, bx_trace_store_magic, sizeof(header.magic)) ||
+      header.fingerprint != fingerprint || header.instr_size != sizeof(bxInstruction_c)) {
+    // created by another Bochs build or CPU configuration, will be rewritten
+    fclose(fp);
+    dirty = 1;
+    return -1;
+  }
+
+  for (Bit32u n=0; n < header.traces; n++) {
+    bx_trace_store_record record;
+    if (fread(&record, sizeof(record), 1, fp) != 1 || record.tlen == 0 ||
+        record.tlen > BX_MAX_TRACE_LENGTH || (instructions + record.tlen) > BX_TRACE_STORE_MAX_INSTR)
+      break;
+
+    bxStoredTrace *t = new bxStoredTrace;
+    t->pAddr = (bx_phy_address) record.pAddr;
+    t->fetchModeMask = record.fetchModeMask;
+    t->traceMask = record.traceMask;
+    t->hash = record.hash;
+    t->bytes = record.bytes;
+    t->tlen = record.tlen;
+    t->i = new bxInstruction_c[t->tlen];
+    if (fread(t->i, sizeof(bxInstruction_c), t->tlen, fp) != t->tlen) {
+      delete [] t->i;
+      delete t;
+      break;
+    }
+    if (! validate(t)) {
+      // drop the whole trace, the file will be rewritten without it
+      delete [] t->i;
+      delete t;
+      dirty = 1;
+      continue;
+    }
+    add(t);
+  }
+
+  fclose(fp);
+  return traces;
+}
+
+int bxTraceStore::save(void)
+{
+  if (! enabled() || ! dirty) return 0;
+
+  // write into temporary file first, so concurrent Bochs instances sharing
+  // the store never see partially written file
+  size_t len = strlen(path);
+  char *tmp_path = new char[len + 5];
+  strcpy(tmp_path, path);
+  strcpy(tmp_path + len, ".tmp");
+
+  FILE *fp = fopen(tmp_path, "wb");
+  if (fp == NULL) {
+    delete [] tmp_path;
+    return -1;
+  }
+
+  bx_trace_store_header header;
+  memcpy(header.magic, bx_trace_store_magic, sizeof(header.magic));
+  header.fingerprint = fingerprint;
+  header.traces = traces;
+  header.instr_size = sizeof(bxInstruction_c);
+  bool ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+
+  for (unsigned n=0; ok && n < BX_TRACE_STORE_BUCKETS; n++) {
+    for (bxStoredTrace *t = buckets[n]; ok && t != NULL; t = t->next) {
+      bx_trace_store_record record;
+      memset(&record, 0, sizeof(record));
+      record.pAddr = t->pAddr;
+      record.fetchModeMask = t->fetchModeMask;
+      record.traceMask = t->traceMask;
+      record.hash = t->hash;
+      record.bytes = t->bytes;
+      record.tlen = t->tlen;
+      ok = (fwrite(&record, sizeof(record), 1, fp) == 1) &&
+           (fwrite(t->i, sizeof(bxInstruction_c), t->tlen, fp) == t->tlen);
+    }
+  }
+
+  if (fclose(fp) != 0) ok = 0;
+  if (ok) {
+    if (rename(tmp_path, path) != 0) {
+      // rename cannot replace existing file on some hosts
+      remove(path);
+      ok = (rename(tmp_path, path) == 0);
+    }
+  }
+  if (! ok) remove(tmp_path);
+  delete [] tmp_path;
+
+  if (! ok) return -1;
+  dirty = 0;
+  return traces;
+}
+
+const bxStoredTrace* bxTraceStore::find(bx_phy_address pAddr, Bit32u fetchModeMask, const Bit8u *code, unsigned remainingInPage) const
+{
+  for (bxStoredTrace *t = buckets[bucket(pAddr, fetchModeMask)]; t != NULL; t = t->next) {
+    if (t->pAddr == pAddr && t->fetchModeMask == fetchModeMask && t->bytes <= remainingInPage) {
+      if (hashBytes(code, t->bytes) == t->hash)
+        return t;
+    }
+  }
+  return NULL;
+}
+
+void bxTraceStore::insert(bx_phy_address pAddr, Bit32u fetchModeMask, Bit32u traceMask, const Bit8u *code, const bxInstruction_c *i, unsigned tlen)
+{
+#if BX_SUPPORT_HANDLERS_CHAINING_SPEEDUPS
+  // the end of trace opcode is regenerated when the trace is loaded
+  while (tlen > 0 && i[tlen-1].getIaOpcode() == BX_INSERTED_OPCODE) tlen--;
+#endif
+  if (tlen == 0 || (instructions + tlen) > BX_TRACE_STORE_MAX_INSTR)
+    return;
+
+  Bit32u bytes = 0;
+  for (unsigned n=0; n < tlen; n++)
+    bytes += i[n].ilen();
+
+  Bit64u hash = hashBytes(code, bytes);
+  if (lookup(pAddr, fetchModeMask, hash, bytes) != NULL)
+    return;
+
+  bxStoredTrace *t = new bxStoredTrace;
+  t->pAddr = pAddr;
+  t->fetchModeMask = fetchModeMask;
+  t->traceMask = traceMask;
+  t->hash = hash;
+  t->bytes = bytes;
+  t->tlen = tlen;
+  t->i = new bxInstruction_c[tlen];
+  memcpy(t->i, i, sizeof(bxInstruction_c) * tlen);
+  // handler pointers and trace links are only valid in this run
+  for (unsigned n=0; n < tlen; n++) {
+    t->i[n].execute1 = NULL;
+    t->i[n].handlers.execute2 = NULL;
+  }
+  add(t);
+  dirty = 1;
+}
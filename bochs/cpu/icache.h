@@ -26,26 +26,77 @@
 
 extern void handleSMC(bx_phy_address pAddr, Bit32u mask);
 
+// Fine granularity write stamps are kept in a two level table. The 1st level
+// covers the whole emulated physical memory (at least 4G space, rounded up to
+// power of two) in 4M chunks. 2nd level chunks are allocated on demand, the
+// first time code is fetched from them; until then all their entries are
+// pointing to the shared zero chunk.
+
+#define BX_WRITE_STAMP_CHUNK_SHIFT 10 /* 1024 pages per chunk */
+#define BX_WRITE_STAMP_CHUNK_PAGES (1 << BX_WRITE_STAMP_CHUNK_SHIFT)
+
 class bxPageWriteStampTable
 {
-  const Bit32u PHY_MEM_PAGES_IN_4G_SPACE;
-  Bit32u *fineGranularityMapping;
+  Bit32u pagesMask;
+  Bit32u chunks;
+  Bit32u **fineGranularityMapping;
+
+  static Bit32u zeroChunk[BX_WRITE_STAMP_CHUNK_PAGES];
+
+  Bit32u* allocChunk(Bit32u index) {
+    Bit32u *chunk = new Bit32u[BX_WRITE_STAMP_CHUNK_PAGES];
+    memset(chunk, 0, sizeof(Bit32u) * BX_WRITE_STAMP_CHUNK_PAGES);
+    fineGranularityMapping[index >> BX_WRITE_STAMP_CHUNK_SHIFT] = chunk;
+    return chunk;
+  }
+
+  BX_CPP_INLINE Bit32u& stamp(Bit32u index) const {
+    return fineGranularityMapping[index >> BX_WRITE_STAMP_CHUNK_SHIFT][index & (BX_WRITE_STAMP_CHUNK_PAGES-1)];
+  }
+
+  BX_CPP_INLINE Bit32u& stampForUpdate(Bit32u index) {
+    Bit32u *chunk = fineGranularityMapping[index >> BX_WRITE_STAMP_CHUNK_SHIFT];
+    if (chunk == zeroChunk) chunk = allocChunk(index);
+    return chunk[index & (BX_WRITE_STAMP_CHUNK_PAGES-1)];
+  }
+
+  void freeChunks(void) {
+    for (Bit32u n=0; n<chunks; n++) {
+      if (fineGranularityMapping[n] != zeroChunk)
+        delete [] fineGranularityMapping[n];
+    }
+    delete [] fineGranularityMapping;
+  }
 
 public:
-  bxPageWriteStampTable(): PHY_MEM_PAGES_IN_4G_SPACE(1024*1024) {
-    fineGranularityMapping = new Bit32u[PHY_MEM_PAGES_IN_4G_SPACE];
-    resetWriteStamps();
+  bxPageWriteStampTable(): fineGranularityMapping(NULL) {
+    init(BX_CONST64(1) << 32);
   }
- ~bxPageWriteStampTable() { delete [] fineGranularityMapping; }
+ ~bxPageWriteStampTable() { freeChunks(); }
 
-  BX_CPP_INLINE static Bit32u hash(bx_phy_address pAddr) {
-    // can share writeStamps between multiple pages if >32 bit phy address
-    return ((Bit32u) pAddr) >> 12;
+  // size the table for emulated physical memory of 'memSize' bytes
+  void init(Bit64u memSize) {
+    Bit64u pages = BX_CONST64(1) << 20; // at least entire 4G space
+    while ((pages << 12) < memSize) pages <<= 1;
+
+    if (fineGranularityMapping) freeChunks();
+
+    pagesMask = (Bit32u)(pages - 1);
+    chunks = (Bit32u)(pages >> BX_WRITE_STAMP_CHUNK_SHIFT);
+    fineGranularityMapping = new Bit32u*[chunks];
+    for (Bit32u n=0; n<chunks; n++)
+      fineGranularityMapping[n] = zeroChunk;
+  }
+
+  BX_CPP_INLINE Bit32u hash(bx_phy_address pAddr) const {
+    // can share writeStamps between multiple pages only if pAddr is beyond
+    // emulated physical memory
+    return ((Bit32u)(pAddr >> 12)) & pagesMask;
   }
 
   BX_CPP_INLINE Bit32u getFineGranularityMapping(bx_phy_address pAddr) const
   {
-    return fineGranularityMapping[hash(pAddr)];
+    return stamp(hash(pAddr));
   }
 
   BX_CPP_INLINE void markICache(bx_phy_address pAddr, unsigned len)
@@ -53,38 +104,38 @@ public:
     Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
            mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
 
-    fineGranularityMapping[hash(pAddr)] |= mask;
+    stampForUpdate(hash(pAddr)) |= mask;
   }
 
   BX_CPP_INLINE void markICacheMask(bx_phy_address pAddr, Bit32u mask)
   {
-    fineGranularityMapping[hash(pAddr)] |= mask;
+    stampForUpdate(hash(pAddr)) |= mask;
   }
 
   // whole page is being altered
   BX_CPP_INLINE void decWriteStamp(bx_phy_address pAddr)
   {
-    Bit32u index = hash(pAddr);
+    Bit32u &writeStamp = stamp(hash(pAddr));
 
-    if (fineGranularityMapping[index]) {
+    if (writeStamp) {
       handleSMC(pAddr, 0xffffffff); // one of the CPUs might be running trace from this page
-      fineGranularityMapping[index] = 0;
+      writeStamp = 0;
     }
   }
 
   // assumption: write does not split 4K page
   BX_CPP_INLINE void decWriteStamp(bx_phy_address pAddr, unsigned len)
   {
-    Bit32u index = hash(pAddr);
+    Bit32u &writeStamp = stamp(hash(pAddr));
 
-    if (fineGranularityMapping[index]) {
+    if (writeStamp) {
        Bit32u mask  = 1 << (PAGE_OFFSET((Bit32u) pAddr) >> 7);
               mask |= 1 << (PAGE_OFFSET((Bit32u) pAddr + len - 1) >> 7);
 
-       if (fineGranularityMapping[index] & mask) {
+       if (writeStamp & mask) {
           // one of the CPUs might be running trace from this page
           handleSMC(pAddr, mask);
-          fineGranularityMapping[index] &= ~mask;
+          writeStamp &= ~mask;
        }
     }
   }
@@ -94,15 +145,24 @@ public:
 
 BX_CPP_INLINE void bxPageWriteStampTable::resetWriteStamps(void)
 {
-  for (Bit32u i=0; i<PHY_MEM_PAGES_IN_4G_SPACE; i++) {
-    fineGranularityMapping[i] = 0;
+  for (Bit32u n=0; n<chunks; n++) {
+    if (fineGranularityMapping[n] != zeroChunk)
+      memset(fineGranularityMapping[n], 0, sizeof(Bit32u) * BX_WRITE_STAMP_CHUNK_PAGES);
   }
 }
 
 extern bxPageWriteStampTable pageWriteStampTable;
 
-#define BxICacheEntries (64  * 1024)  // Must be a power of 2.
-#define BxICacheMemPool (576 * 1024)
+// The trace cache geometry is selected at runtime (cpu: icache_entries and
+// icache_ways options), the memory pool is sized proportionally to the number
+// of entries (576K instructions for the default 64K entries).
+#define BxICacheEntries (64  * 1024)  // Default, must be a power of 2.
+#define BxICacheMemPoolPerEntry 9
+
+// The instruction memory pool is filled one segment after another. When the
+// current segment is exhausted only the traces living in the next (oldest)
+// segment are evicted instead of flushing the whole trace cache.
+#define BX_ICACHE_MEMPOOL_SEGMENTS 8
 
 struct bxICacheEntry_c
 {
@@ -111,10 +171,23 @@ struct bxICacheEntry_c
 
   Bit32u tlen;          // Trace length in instructions
   bxInstruction_c *i;
+
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  Bit32u execCount;     // Executions counted until the trace becomes hot
+#endif
+
+  // Reverse physical page index used for SMC invalidation
+  bxICacheEntry_c  *pageNext;
+  bxICacheEntry_c **pagePrev;   // NULL when the entry is not indexed
 };
 
 #define BX_MAX_TRACE_LENGTH 32
 
+#if BX_SUPPORT_TRACE_OPTIMIZER
+// number of executions after which a trace is optimized
+#define BX_HOT_TRACE_THRESHOLD 64
+#endif
+
 static const bx_phy_address BX_ICACHE_INVALID_PHY_ADDRESS = bx_phy_address(-1);
 
 BX_CPP_INLINE void flushSMC(bxICacheEntry_c *e)
@@ -132,9 +205,16 @@ BX_CPP_INLINE void flushSMC(bxICacheEntry_c *e)
 
 class BOCHSAPI bxICache_c {
 public:
-  bxICacheEntry_c entry[BxICacheEntries];
-  bxInstruction_c mpool[BxICacheMemPool];
+  bxICacheEntry_c *entry;
+  bxInstruction_c *mpool;
+  unsigned entries;     // total number of entries, power of 2
+  unsigned waysShift;   // log2 of number of ways in a set
+  unsigned setMask;
+  unsigned hashShift;   // log2 of number of sets
+  Bit8u *lruWay;        // way to replace next in each set, for 2-way icache
+  unsigned mpSegmentSize;
   unsigned mpindex;
+  unsigned mpSegment;   // mpool segment traces are currently allocated from
 
   Bit32u traceLinkTimeStamp;
 
@@ -145,30 +225,104 @@ public:
   } pageSplitIndex[BX_ICACHE_PAGE_SPLIT_ENTRIES];
   int nextPageSplitIndex;
 
+  // Traces indexed by the physical page they were decoded from. Pages which
+  // share the same pageWriteStampTable entry always share the same bucket.
+#define BX_ICACHE_PAGE_INDEX_ENTRIES 4096 /* must be power of two */
+  bxICacheEntry_c *pageIndex[BX_ICACHE_PAGE_INDEX_ENTRIES];
+
 public:
-  bxICache_c() { flushICacheEntries(); }
+  bxICache_c(): entry(NULL), mpool(NULL), lruWay(NULL) { configure(BxICacheEntries, 1); }
+ ~bxICache_c() { free_entries(); }
 
-  BX_CPP_INLINE static unsigned hash(bx_phy_address pAddr, unsigned fetchModeMask)
+  void free_entries(void) {
+    delete [] entry;
+    delete [] mpool;
+    delete [] lruWay;
+  }
+
+  // n_entries must be power of 2 and n_entries / n_ways at least 256
+  void configure(unsigned n_entries, unsigned n_ways) {
+    free_entries();
+    entries = n_entries;
+    waysShift = (n_ways > 1);
+    setMask = (entries >> waysShift) - 1;
+    hashShift = 0;
+    while ((1U << hashShift) <= setMask) hashShift++;
+    entry = new bxICacheEntry_c[entries];
+    lruWay = new Bit8u[setMask + 1];
+    mpSegmentSize = (entries * BxICacheMemPoolPerEntry) / BX_ICACHE_MEMPOOL_SEGMENTS;
+    mpool = new bxInstruction_c[mpSegmentSize * BX_ICACHE_MEMPOOL_SEGMENTS];
+    flushICacheEntries();
+  }
+
+  unsigned get_entries() const { return entries; }
+  unsigned get_ways() const { return 1 << waysShift; }
+
+  // returns set index
+  BX_CPP_INLINE unsigned hash(bx_phy_address pAddr, unsigned fetchModeMask) const
   {
-//  return ((pAddr + (pAddr << 2) + (pAddr>>6)) & (BxICacheEntries-1)) ^ fetchModeMask;
-    return ((pAddr) & (BxICacheEntries-1)) ^ fetchModeMask;
+    // fold upper address bits into the set index so the code placed at power
+    // of 2 strides doesn't collide into the same set; fetchModeMask keeps the
+    // traces decoded in different modes apart (it must be below 256)
+    Bit64u addr = pAddr;
+    Bit32u h = (Bit32u)(addr ^ (addr >> hashShift) ^ (addr >> (2*hashShift)));
+    return (h & setMask) ^ fetchModeMask;
   }
 
-  BX_CPP_INLINE void alloc_trace(bxICacheEntry_c *e)
+  BX_CPP_INLINE static unsigned pageIndexHash(bx_phy_address pAddr)
   {
-    // took +1 garbend for instruction chaining speedup (end-of-trace opcode)
-    if ((mpindex + BX_MAX_TRACE_LENGTH + 1) > BxICacheMemPool) {
-      flushICacheEntries();
+    return pageWriteStampTable.hash(pAddr) & (BX_ICACHE_PAGE_INDEX_ENTRIES-1);
+  }
+
+  BX_CPP_INLINE void linkPageIndex(bxICacheEntry_c *e)
+  {
+    bxICacheEntry_c **head = &pageIndex[pageIndexHash(e->pAddr)];
+
+    e->pageNext = *head;
+    if (e->pageNext) e->pageNext->pagePrev = &e->pageNext;
+    e->pagePrev = head;
+    *head = e;
+  }
+
+  BX_CPP_INLINE void unlinkPageIndex(bxICacheEntry_c *e)
+  {
+    if (e->pagePrev) {
+      *(e->pagePrev) = e->pageNext;
+      if (e->pageNext) e->pageNext->pagePrev = e->pagePrev;
+      e->pagePrev = NULL;
     }
+  }
+
+  BX_CPP_INLINE bool mpoolSegmentFull() const
+  {
+    // took +1 garbend for instruction chaining speedup (end-of-trace opcode)
+    return (mpindex + BX_MAX_TRACE_LENGTH + 1) > (mpSegment + 1) * mpSegmentSize;
+  }
+
+  BX_CPP_INLINE unsigned evictNextSegment(void);
+
+  // the caller must evict the next segment first if mpoolSegmentFull()
+  BX_CPP_INLINE void alloc_trace(bxICacheEntry_c *e)
+  {
+    // the entry is going to be reused for another trace
+    unlinkPageIndex(e);
     e->i = &mpool[mpindex];
     e->tlen = 0;
+#if BX_SUPPORT_TRACE_OPTIMIZER
+    e->execCount = 0;
+#endif
   }
 
-  BX_CPP_INLINE void commit_trace(unsigned len) { mpindex += len; }
+  BX_CPP_INLINE void commit_trace(bxICacheEntry_c *e)
+  {
+    mpindex += e->tlen;
+    linkPageIndex(e);
+  }
 
   BX_CPP_INLINE void commit_page_split_trace(bx_phy_address paddr, bxICacheEntry_c *e)
   {
     mpindex += e->tlen;
+    linkPageIndex(e);
 
     // register page split entry
     if (pageSplitIndex[nextPageSplitIndex].ppf != BX_ICACHE_INVALID_PHY_ADDRESS)
@@ -180,22 +334,39 @@ public:
     nextPageSplitIndex = (nextPageSplitIndex+1) & (BX_ICACHE_PAGE_SPLIT_ENTRIES-1);
   }
 
-  BX_CPP_INLINE void handleSMC(bx_phy_address pAddr, Bit32u mask);
+  BX_CPP_INLINE unsigned handleSMC(bx_phy_address pAddr, Bit32u mask);
 
   BX_CPP_INLINE void flushICacheEntries(void);
 
+  // returns the entry to be replaced by a new trace
   BX_CPP_INLINE bxICacheEntry_c* get_entry(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-    return &(entry[hash(pAddr, fetchModeMask)]);
+    unsigned set = hash(pAddr, fetchModeMask);
+    bxICacheEntry_c* e = &entry[set << waysShift];
+    if (waysShift) {
+      // prefer invalid way, otherwise replace the least recently used one
+      unsigned way = lruWay[set];
+      if (e[0].pAddr == BX_ICACHE_INVALID_PHY_ADDRESS) way = 0;
+      else if (e[1].pAddr == BX_ICACHE_INVALID_PHY_ADDRESS) way = 1;
+      lruWay[set] = way ^ 1;
+      e += way;
+    }
+    return e;
   }
 
   BX_CPP_INLINE bxICacheEntry_c* find_entry(bx_phy_address pAddr, unsigned fetchModeMask)
   {
-    bxICacheEntry_c* e = get_entry(pAddr, fetchModeMask);
-    if (e->pAddr != pAddr)
-       return NULL;
-
-    return e;
+    unsigned set = hash(pAddr, fetchModeMask);
+    bxICacheEntry_c* e = &entry[set << waysShift];
+    if (e->pAddr == pAddr) {
+      if (waysShift) lruWay[set] = 1;
+      return e;
+    }
+    if (waysShift && e[1].pAddr == pAddr) {
+      lruWay[set] = 0;
+      return e+1;
+    }
+    return NULL;
   }
 
   BX_CPP_INLINE bool breakLinks()
@@ -214,26 +385,69 @@ BX_CPP_INLINE void bxICache_c::flushICacheEntries(void)
   bxICacheEntry_c* e = entry;
   unsigned i;
 
-  for (i=0; i<BxICacheEntries; i++, e++) {
+  for (i=0; i<entries; i++, e++) {
     e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
     e->traceMask = 0;
+    e->pagePrev = NULL;
   }
 
+  for (i=0; i<=setMask; i++)
+    lruWay[i] = 0;
+
+  for (i=0; i<BX_ICACHE_PAGE_INDEX_ENTRIES; i++)
+    pageIndex[i] = NULL;
+
   nextPageSplitIndex = 0;
   for (i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++)
     pageSplitIndex[i].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
 
   mpindex = 0;
+  mpSegment = 0;
 
   traceLinkTimeStamp = 0;
 }
 
-BX_CPP_INLINE void bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
+// returns amount of evicted traces
+BX_CPP_INLINE unsigned bxICache_c::evictNextSegment(void)
 {
-  Bit32u pAddrIndex = bxPageWriteStampTable::hash(pAddr);
+  if (++mpSegment == BX_ICACHE_MEMPOOL_SEGMENTS) mpSegment = 0;
+  mpindex = mpSegment * mpSegmentSize;
+
+  const bxInstruction_c *start = &mpool[mpindex];
+  const bxInstruction_c *end = start + mpSegmentSize;
+  bxICacheEntry_c* e = entry;
+  unsigned i, evicted = 0;
+
+  for (i=0; i<entries; i++, e++) {
+    if (e->pAddr == BX_ICACHE_INVALID_PHY_ADDRESS && ! e->pagePrev) continue;
+    if (e->i >= start && e->i < end) {
+      if (e->pAddr != BX_ICACHE_INVALID_PHY_ADDRESS) evicted++;
+      e->pAddr = BX_ICACHE_INVALID_PHY_ADDRESS;
+      e->traceMask = 0;
+      unlinkPageIndex(e);
+    }
+  }
+
+  for (i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++) {
+    if (pageSplitIndex[i].ppf != BX_ICACHE_INVALID_PHY_ADDRESS &&
+        pageSplitIndex[i].e->pAddr == BX_ICACHE_INVALID_PHY_ADDRESS)
+      pageSplitIndex[i].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
+  }
+
+  // traces from other segments might be linked into the evicted ones
+  breakLinks();
+
+  return evicted;
+}
+
+// returns amount of invalidated traces
+BX_CPP_INLINE unsigned bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
+{
+  Bit32u pAddrIndex = pageWriteStampTable.hash(pAddr);
+  unsigned invalidated = 0;
 
   // break all links bewteen traces
-  if (breakLinks()) return;
+  if (breakLinks()) return 0;
 
   // Need to invalidate all traces in the trace cache that might include an
   // instruction that was modified.  But this is not enough, it is possible
@@ -250,28 +464,87 @@ BX_CPP_INLINE void bxICache_c::handleSMC(bx_phy_address pAddr, Bit32u mask)
     // page split traces to invalidate.
     for (unsigned i=0;i<BX_ICACHE_PAGE_SPLIT_ENTRIES;i++) {
       if (pageSplitIndex[i].ppf != BX_ICACHE_INVALID_PHY_ADDRESS) {
-        if (pAddrIndex == bxPageWriteStampTable::hash(pageSplitIndex[i].ppf)) {
+        if (pAddrIndex == pageWriteStampTable.hash(pageSplitIndex[i].ppf)) {
           pageSplitIndex[i].ppf = BX_ICACHE_INVALID_PHY_ADDRESS;
           flushSMC(pageSplitIndex[i].e);
+          invalidated++;
         }
       }
     }
   }
 
-  bxICacheEntry_c *e = get_entry(LPFOf(pAddr), 0);
+  // visit only the traces decoded from the modified page (and the pages
+  // aliasing it in pageWriteStampTable)
+  bxICacheEntry_c *e = pageIndex[pageIndexHash(pAddr)];
 
-  // go over 32 "cache lines" of 128 byte each
-  for (unsigned n=0; n < 32; n++) {
-    Bit32u line_mask = (1 << n);
-    if (line_mask > mask) break;
-    for (unsigned index=0; index < 128; index++, e++) {
-      if (pAddrIndex == bxPageWriteStampTable::hash(e->pAddr) && (e->traceMask & mask) != 0) {
-        flushSMC(e);
-      }
+  while (e) {
+    bxICacheEntry_c *next = e->pageNext;
+    if (pAddrIndex == pageWriteStampTable.hash(e->pAddr) && (e->traceMask & mask) != 0) {
+      unlinkPageIndex(e);
+      flushSMC(e);
+      invalidated++;
     }
+    e = next;
   }
+
+  return invalidated;
 }
 
 extern void flushICaches(void);
 
+// Decoded traces could be kept in a file between Bochs runs (cpu: trace_cache
+// option). A stored trace is looked up on trace cache miss by its physical
+// address and fetch mode and used only if the code bytes hash still matches.
+// The file is tied to the CPU configuration and Bochs build it was created by.
+
+#define BX_TRACE_STORE_BUCKETS   (64 * 1024) /* must be power of two */
+#define BX_TRACE_STORE_MAX_INSTR (1024 * 1024)
+
+struct bxStoredTrace {
+  bx_phy_address pAddr;
+  Bit32u fetchModeMask;
+  Bit32u traceMask;
+  Bit64u hash;          // hash of the trace code bytes
+  Bit32u bytes;         // length of the trace code bytes
+  Bit32u tlen;          // trace length in instructions, without end-of-trace opcode
+  bxInstruction_c *i;
+  bxStoredTrace *next;
+};
+
+class BOCHSAPI bxTraceStore {
+  char *path;
+  Bit64u fingerprint;
+  Bit32u instructions;
+  Bit32u traces;
+  bool dirty;
+  bxStoredTrace **buckets;
+
+  BX_CPP_INLINE static unsigned bucket(bx_phy_address pAddr, Bit32u fetchModeMask) {
+    return ((Bit32u)(pAddr ^ (pAddr >> 16)) ^ (fetchModeMask << 8)) & (BX_TRACE_STORE_BUCKETS-1);
+  }
+
+  bxStoredTrace* lookup(bx_phy_address pAddr, Bit32u fetchModeMask, Bit64u hash, Bit32u bytes) const;
+  void add(bxStoredTrace *t);
+  void clear(void);
+  static bool validate(const bxStoredTrace *t);
+
+public:
+  bxTraceStore(): path(NULL), instructions(0), traces(0), dirty(0), buckets(NULL) {}
+ ~bxTraceStore() { clear(); delete [] path; }
+
+  BX_CPP_INLINE bool enabled() const { return path != NULL; }
+
+  static Bit64u hashBytes(const void *data, unsigned len, Bit64u hash = BX_CONST64(0xcbf29ce484222325));
+
+  // both return amount of traces loaded/saved or -1 on error
+  int open(const char *filename, Bit64u cpu_fingerprint);
+  int save(void);
+
+  const bxStoredTrace* find(bx_phy_address pAddr, Bit32u fetchModeMask, const Bit8u *code, unsigned remainingInPage) const;
+  void insert(bx_phy_address pAddr, Bit32u fetchModeMask, Bit32u traceMask, const Bit8u *code, const bxInstruction_c *i, unsigned tlen);
+  void drop(const bxStoredTrace *t);
+};
+
+extern bxTraceStore traceStore;
+
 #endif
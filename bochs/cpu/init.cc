@@ -28,6 +28,9 @@
 #include "gui/siminterface.h"
 #include "param_names.h"
 #include "cpustats.h"
+#include "bxversion.h"
+
+#include "decoder/ia_opcodes.h"
 
 #if BX_SUPPORT_APIC
 #include "apic.h"
@@ -172,9 +175,84 @@ void BX_CPU_C::initialize(void)
   init_VMCS();
 #endif
 
+  init_TLB();
+  init_ICache();
+
   init_statistics();
 }
 
+// select TLB geometry, could be tuned per workload using TLB statistics
+void BX_CPU_C::init_TLB(void)
+{
+  unsigned dtlb_entries = SIM->get_param_num(BXPN_DTLB_ENTRIES)->get();
+  unsigned itlb_entries = SIM->get_param_num(BXPN_ITLB_ENTRIES)->get();
+  unsigned tlb_ways = SIM->get_param_num(BXPN_TLB_WAYS)->get();
+
+  if ((dtlb_entries & (dtlb_entries-1)) || (itlb_entries & (itlb_entries-1)) || (tlb_ways & (tlb_ways-1)))
+    BX_PANIC(("cpu: TLB entries and ways must be power of 2"));
+
+  BX_CPU_THIS_PTR DTLB.configure(dtlb_entries, tlb_ways);
+  BX_CPU_THIS_PTR ITLB.configure(itlb_entries, tlb_ways);
+
+  BX_INFO(("DTLB: %u entries, ITLB: %u entries, %u-way set associative", dtlb_entries, itlb_entries, tlb_ways));
+}
+
+// select trace cache geometry, could be tuned per workload using icache statistics
+void BX_CPU_C::init_ICache(void)
+{
+  unsigned icache_entries = SIM->get_param_num(BXPN_ICACHE_ENTRIES)->get();
+  unsigned icache_ways = SIM->get_param_num(BXPN_ICACHE_WAYS)->get();
+
+  if (icache_entries & (icache_entries-1))
+    BX_PANIC(("cpu: icache entries must be power of 2"));
+
+  if (icache_entries != BX_CPU_THIS_PTR iCache.get_entries() || icache_ways != BX_CPU_THIS_PTR iCache.get_ways())
+    BX_CPU_THIS_PTR iCache.configure(icache_entries, icache_ways);
+
+  BX_INFO(("ICache: %u entries, %u-way set associative", icache_entries, icache_ways));
+
+  // decoded trace cache file is shared by all processors
+  bx_param_string_c *trace_cache = SIM->get_param_string(BXPN_TRACE_CACHE_PATH);
+  if (BX_CPU_ID == 0 && ! trace_cache->isempty()) {
+    // stored traces are valid only for the same Bochs version and CPU features
+    Bit64u fingerprint = bxTraceStore::hashBytes(VERSION, strlen(VERSION));
+    Bit32u opcodes = BX_IA_LAST;
+    fingerprint = bxTraceStore::hashBytes(&opcodes, sizeof(opcodes), fingerprint);
+    fingerprint = bxTraceStore::hashBytes(BX_CPU_THIS_PTR ia_extensions_bitmask,
+        sizeof(BX_CPU_THIS_PTR ia_extensions_bitmask), fingerprint);
+
+    int traces = traceStore.open(trace_cache->getptr(), fingerprint);
+    if (traces < 0)
+      BX_INFO(("decoded trace cache '%s' doesn't match this Bochs version or CPU, ignored", trace_cache->getptr()));
+    else
+      BX_INFO(("decoded trace cache '%s': %d traces loaded", trace_cache->getptr(), traces));
+  }
+}
+
+#if InstrumentICACHE
+// miss rate of icache lookups in 1/1000000 units since the last statistics dump
+static Bit64s icache_miss_rate_handler(bx_param_c *param, bool set, Bit64s val)
+{
+  if (set) return 0;
+
+  bx_cpu_statistics *stats = (bx_cpu_statistics *) param->get_device_param();
+  if (! stats->iCacheLookups) return 0;
+  return (Bit64s)((stats->iCacheMisses * 1000000) / stats->iCacheLookups);
+}
+#endif
+
+#if InstrumentTLB
+// hit rate of TLB lookups in 1/1000 units since the last statistics dump
+static Bit64s tlb_hit_rate_handler(bx_param_c *param, bool set, Bit64s val)
+{
+  if (set) return 0;
+
+  bx_TLB_statistics *tlb_stats = (bx_TLB_statistics *) param->get_device_param();
+  if (! tlb_stats->lookups) return 0;
+  return (Bit64s)((tlb_stats->hits * 1000) / tlb_stats->lookups);
+}
+#endif
+
 // statistics
 void BX_CPU_C::init_statistics(void)
 {
@@ -184,9 +262,20 @@ void BX_CPU_C::init_statistics(void)
   bx_list_c *cpu = new bx_list_c(SIM->get_statistics_root(), get_name(), get_name());
 
 #if InstrumentICACHE
+  // miss rate should be evaluated before the lookup counters are cleared
+  bx_param_num_c *miss_rate = new bx_param_num_c(cpu, "iCacheMissRate", "", "", 0, 1000000, 0);
+  miss_rate->set_device_param(stats);
+  miss_rate->set_handler(icache_miss_rate_handler);
   new bx_shadow_num_c(cpu, "iCacheLookups", &stats->iCacheLookups);
   new bx_shadow_num_c(cpu, "iCachePrefetch", &stats->iCachePrefetch);
   new bx_shadow_num_c(cpu, "iCacheMisses", &stats->iCacheMisses);
+  new bx_shadow_num_c(cpu, "iCacheEvictions", &stats->iCacheEvictions);
+  new bx_shadow_num_c(cpu, "iCacheEvictedTraces", &stats->iCacheEvictedTraces);
+  new bx_shadow_num_c(cpu, "iCacheStoredTraces", &stats->iCacheStoredTraces);
+#if BX_SUPPORT_TRACE_OPTIMIZER
+  new bx_shadow_num_c(cpu, "iCacheHotTraces", &stats->iCacheHotTraces);
+  new bx_shadow_num_c(cpu, "iCacheFusedBranches", &stats->iCacheFusedBranches);
+#endif
 #endif
 
 #if InstrumentTLB
@@ -196,11 +285,26 @@ void BX_CPU_C::init_statistics(void)
   new bx_shadow_num_c(cpu, "tlbMisses", &stats->tlbMisses);
   new bx_shadow_num_c(cpu, "tlbExecuteMisses", &stats->tlbExecuteMisses);
   new bx_shadow_num_c(cpu, "tlbWriteMisses", &stats->tlbWriteMisses);
+  new bx_shadow_num_c(cpu, "tlbLargePageHits", &stats->tlbLargePageHits);
+
+  // hit rate should be evaluated before the lookup counters are cleared
+  bx_param_num_c *hit_rate = new bx_param_num_c(cpu, "dtlbHitRate", "", "", 0, 1000, 0);
+  hit_rate->set_device_param(&DTLB.stats);
+  hit_rate->set_handler(tlb_hit_rate_handler);
+  new bx_shadow_num_c(cpu, "dtlbLookups", &DTLB.stats.lookups);
+  new bx_shadow_num_c(cpu, "dtlbHits", &DTLB.stats.hits);
+
+  hit_rate = new bx_param_num_c(cpu, "itlbHitRate", "", "", 0, 1000, 0);
+  hit_rate->set_device_param(&ITLB.stats);
+  hit_rate->set_handler(tlb_hit_rate_handler);
+  new bx_shadow_num_c(cpu, "itlbLookups", &ITLB.stats.lookups);
+  new bx_shadow_num_c(cpu, "itlbHits", &ITLB.stats.hits);
 #endif
 
 #if InstrumentTLBFlush
   new bx_shadow_num_c(cpu, "tlbGlobalFlushes", &stats->tlbGlobalFlushes);
   new bx_shadow_num_c(cpu, "tlbNonGlobalFlushes", &stats->tlbNonGlobalFlushes);
+  new bx_shadow_num_c(cpu, "tlbContextSwitches", &stats->tlbContextSwitches);
 #endif
 
 #if InstrumentStackPrefetch
@@ -209,6 +313,8 @@ void BX_CPU_C::init_statistics(void)
 
 #if InstrumentSMC
   new bx_shadow_num_c(cpu, "smc", &stats->smc);
+  new bx_shadow_num_c(cpu, "smcInvalidatedTraces", &stats->smcInvalidatedTraces);
+  new bx_shadow_num_c(cpu, "smcTimeUsec", &stats->smcTimeUsec);
 #endif
 
 #endif
@@ -598,6 +704,9 @@ void BX_CPU_C::register_state(void)
 #endif
 #if BX_SUPPORT_MEMTYPE
     BXRS_HEX_PARAM_FIELD(tlb_entry, memtype, DTLB.entry[n].memtype);
+#endif
+#if BX_CPU_LEVEL >= 6
+    BXRS_HEX_PARAM_FIELD(tlb_entry, ctx, DTLB.entry[n].ctx);
 #endif
   }
 
@@ -617,6 +726,9 @@ void BX_CPU_C::register_state(void)
 #endif
 #if BX_SUPPORT_MEMTYPE
     BXRS_HEX_PARAM_FIELD(tlb_entry, memtype, ITLB.entry[n].memtype);
+#endif
+#if BX_CPU_LEVEL >= 6
+    BXRS_HEX_PARAM_FIELD(tlb_entry, ctx, ITLB.entry[n].ctx);
 #endif
   }
 #endif
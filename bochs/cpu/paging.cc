@@ -25,6 +25,8 @@
 #include "cpuid.h"
 #include "msr.h"
 #define LOG_THIS BX_CPU_THIS_PTR
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 #if BX_SUPPORT_APIC
 #include "apic.h"
@@ -384,8 +386,6 @@ const Bit64u BX_CR3_PAGING_MASK = BX_CONST64(0x000ffffffffff000);
 //       result when the direct access is not allowed.
 //
 
-const Bit32u TLB_NoHostPtr = 0x800; /* set this bit when direct access is NOT allowed */
-
 #include "cpustats.h"
 
 // ==============================================================
@@ -399,6 +399,21 @@ void BX_CPU_C::TLB_flush(void)
 
   BX_CPU_THIS_PTR DTLB.flush();
   BX_CPU_THIS_PTR ITLB.flush();
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR largeTLB.flush();
+#endif
+#if BX_SUPPORT_X86_64
+  BX_CPU_THIS_PTR PWC.flush();
+#endif
+
+#if BX_CPU_LEVEL >= 6
+  // all address space contexts are empty now, the active context will be
+  // labeled when first TLB entry is filled
+  for (unsigned n=0; n < BX_TLB_CONTEXTS; n++)
+    BX_CPU_THIS_PTR tlb_context[n].invalidate();
+  BX_CPU_THIS_PTR tlb_ctx = 0;
+  BX_CPU_THIS_PTR tlb_context_stamp = 0;
+#endif
 
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB might change translation for monitored page
@@ -420,6 +435,157 @@ void BX_CPU_C::TLB_flushNonGlobal(void)
 
   BX_CPU_THIS_PTR DTLB.flushNonGlobal();
   BX_CPU_THIS_PTR ITLB.flushNonGlobal();
+  BX_CPU_THIS_PTR largeTLB.flushNonGlobal();
+#if BX_SUPPORT_X86_64
+  BX_CPU_THIS_PTR PWC.flush();
+#endif
+
+#if BX_SUPPORT_MONITOR_MWAIT
+  // invalidating of the TLB might change translation for monitored page
+  // and cause subsequent MWAIT instruction to wait forever
+  BX_CPU_THIS_PTR wakeup_monitor();
+#endif
+
+  // break all links bewteen traces
+  BX_CPU_THIS_PTR iCache.breakLinks();
+}
+
+void BX_CPU_C::TLB_get_context(bx_TLB_context *ctx)
+{
+  Bit32u vpid = 0, pcid = 0;
+
+  ctx->root = 0;
+
+#if BX_SUPPORT_VMX >= 2
+  if (BX_CPU_THIS_PTR in_vmx_guest) {
+    vpid = VMX_Get_Current_VPID();
+    if (BX_CPU_THIS_PTR vmcs.vmexec_ctrls2.EPT_ENABLE())
+      ctx->root = BX_CPU_THIS_PTR vmcs.eptptr;
+  }
+#endif
+
+#if BX_SUPPORT_SVM
+  if (BX_CPU_THIS_PTR in_svm_guest) {
+    vpid = BX_CPU_THIS_PTR vmcb->ctrls.guest_asid;
+    if (SVM_NESTED_PAGING_ENABLED)
+      ctx->root = BX_CPU_THIS_PTR vmcb->ctrls.ncr3;
+  }
+#endif
+
+#if BX_SUPPORT_X86_64
+  if (BX_CPU_THIS_PTR cr4.get_PCIDE())
+    pcid = BX_CPU_THIS_PTR cr3 & 0xfff;
+#endif
+
+  ctx->id = ((vpid & 0xfffff) << 12) | pcid;
+
+  // paging controls which affect the TLB entries, any change of them not
+  // through VMX/SVM transition flushes the TLB
+  ctx->mode = (BX_CPU_THIS_PTR cr0.get32() & 0x80010001) |
+              (BX_CPU_THIS_PTR efer.get32() & (BX_EFER_LMA_MASK | BX_EFER_NXE_MASK)) |
+     ((Bit64u) (BX_CPU_THIS_PTR cr4.get32() & BX_CR4_FLUSH_TLB_MASK) << 32);
+}
+
+void BX_CPU_C::TLB_label_context(void)
+{
+  bx_TLB_context *ctx = &BX_CPU_THIS_PTR tlb_context[BX_CPU_THIS_PTR tlb_ctx];
+
+  TLB_get_context(ctx);
+  ctx->stamp = ++BX_CPU_THIS_PTR tlb_context_stamp;
+}
+
+// Activate TLB address space context for current PCID and VPID/ASID.
+// Mappings of the other contexts are kept in the TLB but hidden from the
+// lookups. Non-global mappings of the new context are flushed if requested.
+void BX_CPU_C::TLB_switchContext(bool flush)
+{
+  INC_TLBFLUSH_STAT(tlbContextSwitches);
+  if (flush)
+    INC_TLBFLUSH_STAT(tlbNonGlobalFlushes);
+
+  invalidate_prefetch_q();
+  invalidate_stack_cache();
+
+  bx_TLB_context context;
+  TLB_get_context(&context);
+
+  unsigned ctx = BX_CPU_THIS_PTR tlb_ctx;
+  if (! BX_CPU_THIS_PTR tlb_context[ctx].same(context)) {
+    // look for the context in the TLB, replace least recently used one if not found
+    unsigned victim = 0;
+    for (ctx = 0; ctx < BX_TLB_CONTEXTS; ctx++) {
+      if (BX_CPU_THIS_PTR tlb_context[ctx].same(context)) break;
+      if (BX_CPU_THIS_PTR tlb_context[ctx].stamp < BX_CPU_THIS_PTR tlb_context[victim].stamp)
+        victim = ctx;
+    }
+
+    if (ctx == BX_TLB_CONTEXTS) {
+      ctx = victim;
+      BX_CPU_THIS_PTR DTLB.flushContext(ctx, true);
+      BX_CPU_THIS_PTR ITLB.flushContext(ctx, true);
+      BX_CPU_THIS_PTR largeTLB.flushContext(ctx, true);
+      BX_CPU_THIS_PTR tlb_context[ctx] = context;
+      flush = false; // the context is empty already
+    }
+
+    // global mappings are shared by all contexts with the same VPID
+    Bit32u global_ctx_mask = 0;
+    for (unsigned n = 0; n < BX_TLB_CONTEXTS; n++) {
+      if (BX_CPU_THIS_PTR tlb_context[n].valid() && BX_CPU_THIS_PTR tlb_context[n].same_vpid(context))
+        global_ctx_mask |= (1 << n);
+    }
+
+    BX_CPU_THIS_PTR tlb_ctx = ctx;
+    BX_CPU_THIS_PTR DTLB.switchContext(ctx, global_ctx_mask);
+    BX_CPU_THIS_PTR ITLB.switchContext(ctx, global_ctx_mask);
+  }
+
+  BX_CPU_THIS_PTR tlb_context[ctx].stamp = ++BX_CPU_THIS_PTR tlb_context_stamp;
+
+  if (flush) {
+    BX_CPU_THIS_PTR DTLB.flushContext(ctx, false);
+    BX_CPU_THIS_PTR ITLB.flushContext(ctx, false);
+    BX_CPU_THIS_PTR largeTLB.flushContext(ctx, false);
+  }
+
+#if BX_SUPPORT_X86_64
+  // paging-structure cache is not tagged
+  BX_CPU_THIS_PTR PWC.flush();
+#endif
+
+#if BX_SUPPORT_MONITOR_MWAIT
+  // invalidating of the TLB might change translation for monitored page
+  // and cause subsequent MWAIT instruction to wait forever
+  BX_CPU_THIS_PTR wakeup_monitor();
+#endif
+
+  // break all links bewteen traces
+  BX_CPU_THIS_PTR iCache.breakLinks();
+}
+
+// Invalidate all non-global mappings of the PCID in current VPID/ASID
+void BX_CPU_C::TLB_flushPCID(unsigned pcid)
+{
+  INC_TLBFLUSH_STAT(tlbNonGlobalFlushes);
+
+  invalidate_prefetch_q();
+  invalidate_stack_cache();
+
+  bx_TLB_context context;
+  TLB_get_context(&context);
+  context.id = (context.id & ~0xfff) | pcid;
+
+  for (unsigned ctx = 0; ctx < BX_TLB_CONTEXTS; ctx++) {
+    if (BX_CPU_THIS_PTR tlb_context[ctx].same(context)) {
+      BX_CPU_THIS_PTR DTLB.flushContext(ctx, false);
+      BX_CPU_THIS_PTR ITLB.flushContext(ctx, false);
+      BX_CPU_THIS_PTR largeTLB.flushContext(ctx, false);
+    }
+  }
+
+#if BX_SUPPORT_X86_64
+  BX_CPU_THIS_PTR PWC.flush();
+#endif
 
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB might change translation for monitored page
@@ -440,6 +606,13 @@ void BX_CPU_C::TLB_invlpg(bx_address laddr)
   BX_DEBUG(("TLB_invlpg(0x" FMT_ADDRX "): invalidate TLB entry", laddr));
   BX_CPU_THIS_PTR DTLB.invlpg(laddr);
   BX_CPU_THIS_PTR ITLB.invlpg(laddr);
+#if BX_CPU_LEVEL >= 5
+  BX_CPU_THIS_PTR largeTLB.invlpg(laddr);
+#endif
+#if BX_SUPPORT_X86_64
+  // INVLPG invalidates all paging-structure cache entries
+  BX_CPU_THIS_PTR PWC.flush();
+#endif
 
 #if BX_SUPPORT_MONITOR_MWAIT
   // invalidating of the TLB entry might change translation for monitored
@@ -451,6 +624,22 @@ void BX_CPU_C::TLB_invlpg(bx_address laddr)
   BX_CPU_THIS_PTR iCache.breakLinks();
 }
 
+// Invalidate TLB entries of the physical pages in range [begin, end], used
+// when handling of the physical memory range is changed (memory handlers
+// registered or removed, PAM registers updated). The translations stay
+// valid, only the cached host pointers of the pages have to be dropped.
+void BX_CPU_C::TLB_invalidatePhysRange(bx_phy_address begin, bx_phy_address end)
+{
+  invalidate_prefetch_q();
+  invalidate_stack_cache();
+
+  BX_CPU_THIS_PTR DTLB.invalidatePhysRange(begin, end);
+  BX_CPU_THIS_PTR ITLB.invalidatePhysRange(begin, end);
+
+  // break all links bewteen traces
+  BX_CPU_THIS_PTR iCache.breakLinks();
+}
+
 void BX_CPP_AttrRegparmN(1) BX_CPU_C::INVLPG(bxInstruction_c* i)
 {
   // CPL is always 0 in real mode
@@ -750,6 +939,76 @@ Bit32u BX_CPU_C::check_leaf_entry_faults(bx_address laddr, Bit64u leaf_entry, Bi
   return combined_access;
 }
 
+#if BX_CPU_LEVEL >= 5
+
+#if BX_SUPPORT_PKEYS
+// the long mode page walk checks protection key of the page for data
+// accesses when the protection keys are enabled for the access privilege
+bool BX_CPU_C::page_walk_evaluates_pkey(unsigned user, unsigned rw)
+{
+  if (! long_mode() || rw == BX_EXECUTE) return false;
+
+  return BX_CPU_THIS_PTR cr4.get_PKE() || (BX_CPU_THIS_PTR cr4.get_PKS() && !user);
+}
+#endif
+
+// returns true if the access would be completed by the page walk for the
+// large page without page fault and without Accessed/Dirty bits update
+bool BX_CPU_C::large_page_access_ok(const bx_large_TLB_entry *largeEntry, unsigned user, unsigned rw)
+{
+  // shadow stack accesses always walk the paging structures
+  if (rw & 4) return false;
+
+  bool isWrite = (rw & 1); // write or r-m-w
+  if (isWrite && ! largeEntry->dirty) return false;
+
+  Bit32u combined_access = Bit32u(largeEntry->paddr) & largeEntry->lpf_mask;
+
+  unsigned priv_index =
+#if BX_CPU_LEVEL >= 4
+        (BX_CPU_THIS_PTR cr0.get_WP() << 4) |   // bit 4
+#endif
+        (user<<3) |                             // bit 3
+        (combined_access & (BX_COMBINED_ACCESS_WRITE | BX_COMBINED_ACCESS_USER)) |
+        (unsigned) isWrite;                     // bit 2,1,0
+
+  if (!priv_check[priv_index] || (IS_NX_PAGE(combined_access) && rw == BX_EXECUTE))
+    return false;
+
+#if BX_CPU_LEVEL >= 6
+  if (IS_USER_PAGE(combined_access) && !user) {
+    if (BX_CPU_THIS_PTR cr4.get_SMEP() && rw == BX_EXECUTE)
+      return false;
+    if (BX_CPU_THIS_PTR cr4.get_SMAP() && ! BX_CPU_THIS_PTR get_AC() && rw != BX_EXECUTE)
+      return false;
+  }
+#endif
+
+#if BX_SUPPORT_PKEYS
+  if (page_walk_evaluates_pkey(user, rw)) {
+    if (! largeEntry->pkey_valid) return false;
+
+    unsigned pkey = largeEntry->pkey;
+    if (BX_CPU_THIS_PTR cr4.get_PKE()) {
+      if (user && (BX_CPU_THIS_PTR pkru & (1<<(pkey*2))))
+        return false;
+      if ((BX_CPU_THIS_PTR pkru & (1<<(pkey*2+1))) && isWrite && (user || BX_CPU_THIS_PTR cr0.get_WP()))
+        return false;
+    }
+    if (BX_CPU_THIS_PTR cr4.get_PKS() && !user) {
+      if (BX_CPU_THIS_PTR pkrs & (1<<(pkey*2)))
+        return false;
+      if ((BX_CPU_THIS_PTR pkrs & (1<<(pkey*2+1))) && isWrite && BX_CPU_THIS_PTR cr0.get_WP())
+        return false;
+    }
+  }
+#endif
+
+  return true;
+}
+
+#endif
+
 #if BX_CPU_LEVEL >= 6
 
 #if BX_SUPPORT_MEMTYPE
@@ -843,6 +1102,24 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
 
   int start_leaf = BX_CPU_THIS_PTR cr4.get_LA57() ? BX_LEVEL_PML5 : BX_LEVEL_PML4, leaf = start_leaf;
 
+  // combined access rights up to every non-leaf level, for the paging-structure cache
+  Bit32u level_access[5];
+  bool level_nx[5];
+
+  // skip the upper levels of the page walk if they are in paging-structure cache
+  unsigned pwc_level;
+  bx_PWC_entry *pwc = BX_CPU_THIS_PTR PWC.lookup(laddr, start_leaf, pwc_level);
+  if (pwc) {
+    curr_entry = pwc->entry;
+    combined_access = pwc->combined_access;
+    nx_page = pwc->nx_page;
+    ppf = curr_entry & BX_CONST64(0x000ffffffffff000);
+    offset_mask = (BX_CONST64(1) << (12 + 9*pwc_level)) - 1;
+    leaf = pwc_level - 1;
+  }
+
+  int walk_leaf = leaf; // the first paging level read from memory
+
   for (;; --leaf) {
     entry_addr[leaf] = ppf + ((laddr >> (9 + 9*leaf)) & 0xff8);
 #if BX_SUPPORT_VMX >= 2
@@ -886,6 +1163,9 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
     }
 
     combined_access &= curr_entry; // U/S and R/W
+
+    level_access[leaf] = combined_access;
+    level_nx[leaf] = nx_page;
   }
 
 #if BX_SUPPORT_PKEYS
@@ -905,7 +1185,11 @@ bx_phy_address BX_CPU_C::translate_linear_long_mode(bx_address laddr, Bit32u &lp
   bool isWrite = (rw & 1); // write or r-m-w
 
   // Update A/D bits if needed
-  update_access_dirty_PAE(entry_addr, entry, entry_memtype, start_leaf, leaf, isWrite);
+  update_access_dirty_PAE(entry_addr, entry, entry_memtype, walk_leaf, leaf, isWrite);
+
+  // remember non-leaf entries of the page walk
+  for (int level = walk_leaf; level > leaf; level--)
+    BX_CPU_THIS_PTR PWC.insert(laddr, level, entry[level], level_access[level], level_nx[level]);
 
   return (ppf | combined_access);
 }
@@ -1313,19 +1597,53 @@ bx_phy_address BX_CPU_C::translate_linear(bx_TLB_entry *tlbEntry, bx_address lad
 
   if(BX_CPU_THIS_PTR cr0.get_PG())
   {
-    BX_DEBUG(("page walk for%s address 0x" FMT_LIN_ADDRX, isShadowStack ? " shadow stack" : "", laddr));
-
+#if BX_CPU_LEVEL >= 5
 #if BX_CPU_LEVEL >= 6
-#if BX_SUPPORT_X86_64
-    if (long_mode())
-      paddress = translate_linear_long_mode(laddr, lpf_mask, pkey, user, rw);
+    unsigned ctx = BX_CPU_THIS_PTR tlb_ctx;
+#else
+    unsigned ctx = 0;
+#endif
+    // 4K TLB miss, look for the large page translation before walking the paging structures
+    bx_large_TLB_entry *largeEntry = BX_CPU_THIS_PTR largeTLB.lookup(laddr, ctx);
+    if (largeEntry && large_page_access_ok(largeEntry, user, rw)) {
+      INC_TLB_STAT(tlbLargePageHits);
+      paddress = largeEntry->paddr;
+      lpf_mask = largeEntry->lpf_mask;
+#if BX_SUPPORT_PKEYS
+      if (page_walk_evaluates_pkey(user, rw))
+        pkey = largeEntry->pkey;
+#endif
+    }
     else
 #endif
-      if (BX_CPU_THIS_PTR cr4.get_PAE())
-        paddress = translate_linear_PAE(laddr, lpf_mask, user, rw);
+    {
+      BX_DEBUG(("page walk for%s address 0x" FMT_LIN_ADDRX, isShadowStack ? " shadow stack" : "", laddr));
+
+#if BX_CPU_LEVEL >= 6
+#if BX_SUPPORT_X86_64
+      if (long_mode())
+        paddress = translate_linear_long_mode(laddr, lpf_mask, pkey, user, rw);
       else
 #endif
-        paddress = translate_linear_legacy(laddr, lpf_mask, user, rw);
+        if (BX_CPU_THIS_PTR cr4.get_PAE())
+          paddress = translate_linear_PAE(laddr, lpf_mask, user, rw);
+        else
+#endif
+          paddress = translate_linear_legacy(laddr, lpf_mask, user, rw);
+
+#if BX_CPU_LEVEL >= 5
+      if (lpf_mask > 0xfff) {
+        largeEntry = BX_CPU_THIS_PTR largeTLB.insert(laddr, lpf_mask, ctx);
+        largeEntry->paddr = paddress;
+        largeEntry->dirty = isWrite;
+        largeEntry->global = (paddress & BX_COMBINED_ACCESS_GLOBAL_PAGE) != 0;
+#if BX_SUPPORT_PKEYS
+        largeEntry->pkey = pkey;
+        largeEntry->pkey_valid = page_walk_evaluates_pkey(user, rw);
+#endif
+      }
+#endif
+    }
 
     // translate_linear functions return combined U/S, R/W bits, Global Page bit
     // and also effective page tables memory type in lower 12 bits of the physical address.
@@ -1373,6 +1691,11 @@ bx_phy_address BX_CPU_C::translate_linear(bx_TLB_entry *tlbEntry, bx_address lad
   paddress = A20ADDR(paddress);
   ppf = PPFOf(paddress);
 
+  if (isExecute)
+    BX_CPU_THIS_PTR ITLB.fill(tlbEntry);
+  else
+    BX_CPU_THIS_PTR DTLB.fill(tlbEntry);
+
   // direct memory access is NOT allowed by default
   tlbEntry->lpf = lpf | TLB_NoHostPtr;
   tlbEntry->lpf_mask = lpf_mask;
@@ -1381,6 +1704,11 @@ bx_phy_address BX_CPU_C::translate_linear(bx_TLB_entry *tlbEntry, bx_address lad
 #endif
   tlbEntry->ppf = ppf;
   tlbEntry->accessBits = 0;
+#if BX_CPU_LEVEL >= 6
+  if (! BX_CPU_THIS_PTR tlb_context[BX_CPU_THIS_PTR tlb_ctx].valid())
+    TLB_label_context();
+  tlbEntry->ctx = BX_CPU_THIS_PTR tlb_ctx;
+#endif
 
   if (isExecute) {
     tlbEntry->accessBits |= TLB_SysExecuteOK;
@@ -2607,7 +2935,7 @@ bool BX_CPU_C::check_addr_in_tlb_buffers(const Bit8u *addr, const Bit8u *end)
   }
 #endif
 
-  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_DTLB_SIZE; tlb_entry_num++) {
+  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_CPU_THIS_PTR DTLB.entries; tlb_entry_num++) {
     bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR DTLB.entry[tlb_entry_num];
     if (tlbEntry->valid()) {
       if ((tlbEntry->hostPageAddr >= (const bx_hostpageaddr_t)addr) &&
@@ -2616,7 +2944,7 @@ bool BX_CPU_C::check_addr_in_tlb_buffers(const Bit8u *addr, const Bit8u *end)
     }
   }
 
-  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_ITLB_SIZE; tlb_entry_num++) {
+  for (unsigned tlb_entry_num=0; tlb_entry_num < BX_CPU_THIS_PTR ITLB.entries; tlb_entry_num++) {
     bx_TLB_entry *tlbEntry = &BX_CPU_THIS_PTR ITLB.entry[tlb_entry_num];
     if (tlbEntry->valid()) {
       if ((tlbEntry->hostPageAddr >= (const bx_hostpageaddr_t)addr) &&
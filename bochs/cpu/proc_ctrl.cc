@@ -606,9 +606,12 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::BxNoAMX(bxInstruction_c *i)
 
 #endif
 
-void BX_CPU_C::handleCpuContextChange(void)
+void BX_CPU_C::handleCpuContextChange(bool flushTLB)
 {
-  TLB_flush();
+  // VMX/SVM transitions with TLB tagged by VPID/ASID switch the TLB
+  // address space context by themselves
+  if (flushTLB)
+    TLB_flush();
 
   invalidate_prefetch_q();
   invalidate_stack_cache();
@@ -310,6 +310,9 @@ struct SVM_CONTROLS
   bool nested_paging;
   Bit64u ncr3;
 
+  Bit32u guest_asid;
+  Bit8u tlb_control;
+
   Bit16u pause_filter_count;
 //Bit16u pause_filter_threshold;
 };
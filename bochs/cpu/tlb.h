@@ -51,10 +51,10 @@ BX_CPP_INLINE bx_address AlignedAccessLPFOf(bx_address laddr, unsigned alignment
 
 // BX_TLB_INDEX_OF(lpf): This macro is passed the linear page frame
 //   (top bits of the linear address).  It must map these bits to
-//   one of the TLB cache slots, given the size of BX_TLB_SIZE.
-//   There will be a many-to-one mapping to each TLB cache slot.
-//   When there are collisions, the old entry is overwritten with
-//   one for the newest access.
+//   one of the TLB sets, given the number of sets in use.
+//   There will be a many-to-one mapping to each TLB set.
+//   When all ways of the set are occupied, the least recently used
+//   entry is overwritten with one for the newest access.
 #define BX_DTLB_ENTRY_OF(lpf, len) (BX_CPU_THIS_PTR DTLB.get_entry_of((lpf), (len)))
 #define BX_DTLB_INDEX_OF(lpf, len) (BX_CPU_THIS_PTR DTLB.get_index_of((lpf), (len)))
 
@@ -86,6 +86,14 @@ const Bit32u TLB_UserExecuteOK = 0x02;
 // global
 const Bit32u TLB_GlobalPage    = 0x80000000;
 
+// bit [11] of the TLB lpf is set when direct access through host pointer
+// is NOT allowed for the page
+const bx_address TLB_NoHostPtr = 0x800;
+
+// bits [10:0] of the TLB lpf are set for entries which belong to inactive
+// address space context, such entries never match any TLB lookup
+const bx_address TLB_HiddenEntry = 0x7ff;
+
 #if BX_SUPPORT_PKEYS
 
 // check if page from a TLB entry can be written
@@ -162,6 +170,9 @@ struct bx_TLB_entry
 #if BX_SUPPORT_MEMTYPE
   Bit32u memtype;       // keep it Bit32u for alignment
 #endif
+#if BX_CPU_LEVEL >= 6
+  Bit32u ctx;           // address space context the entry belongs to
+#endif
 
   bx_TLB_entry() { invalidate(); }
 
@@ -175,32 +186,137 @@ struct bx_TLB_entry
   BX_CPP_INLINE Bit32u get_memtype() const { return MEMTYPE(memtype); }
 };
 
+// The TLB is organized as 'entries / ways' sets of 'ways' entries each. The
+// set is selected by low bits of the linear page frame, inside the set the
+// page is looked up associatively and the least recently used way is
+// replaced on a miss. The TLB template size defines the maximal capacity,
+// the geometry in use is chosen at runtime using configure() method.
+// Direct mapped TLB (ways = 1) keeps the lookup as cheap as a single compare.
+
+#if BX_TLB_MAX_WAYS > 4
+  #error "LRU order of TLB set is kept in Bit8u, TLB associativity is limited to 4"
+#endif
+
+#if InstrumentTLB
+struct bx_TLB_statistics {
+  Bit64u lookups;
+  Bit64u hits;
+};
+#endif
+
 template <unsigned size>
 struct TLB {
   bx_TLB_entry entry[size];
+  Bit8u lru[size];            // ways of the set, most recently used first
+  unsigned entries;           // number of TLB entries in use
+  unsigned ways_shift;        // log2 of TLB associativity
+  Bit32u index_mask;
 #if BX_CPU_LEVEL >= 5
   bool split_large;
 #endif
+#if InstrumentTLB
+  bx_TLB_statistics stats;
+#endif
 
 public:
-  TLB() { flush(); }
+  TLB() {
+#if InstrumentTLB
+    stats.lookups = stats.hits = 0;
+#endif
+    configure(size, 1);
+  }
+
+  // both 'n_entries' and 'ways' must be power of 2
+  void configure(unsigned n_entries, unsigned ways)
+  {
+    entries = n_entries;
+    for (ways_shift = 0; (1U << ways_shift) < ways; ways_shift++);
+    index_mask = ((entries >> ways_shift) - 1) << 12;
+    flush();
+  }
+
+  BX_CPP_INLINE unsigned get_ways(void) const { return 1 << ways_shift; }
 
+  // returns TLB set number
   BX_CPP_INLINE unsigned get_index_of(bx_address lpf, unsigned len = 0)
   {
-    const Bit32u tlb_mask = ((size-1) << 12);
-    return (((unsigned(lpf) + len) & tlb_mask) >> 12);
+    return (((unsigned(lpf) + len) & index_mask) >> 12);
   }
 
   BX_CPP_INLINE bx_TLB_entry *get_entry_of(bx_address lpf, unsigned len = 0)
   {
-    return &entry[get_index_of(lpf, len)];
+    unsigned set = get_index_of(lpf, len);
+    bx_TLB_entry *tlbEntry = &entry[set << ways_shift];
+#if InstrumentTLB
+    stats.lookups++;
+#endif
+    if (ways_shift == 0) {
+#if InstrumentTLB
+      if ((tlbEntry->lpf & ~TLB_NoHostPtr) == LPFOf(lpf)) stats.hits++;
+#endif
+      return tlbEntry;
+    }
+    return lookup_set(set, tlbEntry, LPFOf(lpf));
+  }
+
+  // search all ways of the set for the page, if not found return the way
+  // to be replaced by the page; the LRU order is updated only on a hit, the
+  // replaced way is promoted by fill() once it holds the new page
+  bx_TLB_entry *lookup_set(unsigned set, bx_TLB_entry *tlbEntry, bx_address lpf)
+  {
+    unsigned ways = get_ways(), way;
+
+    for (way = 0; way < ways; way++) {
+      // hidden entries never match, invalid entries have all lpf bits set
+      if ((tlbEntry[way].lpf & ~TLB_NoHostPtr) == lpf) {
+#if InstrumentTLB
+        stats.hits++;
+#endif
+        touch(set, way);
+        return &tlbEntry[way];
+      }
+    }
+
+    // miss: the page will be loaded into an invalid or least recently used way
+    for (way = 0; way < ways; way++)
+      if (! tlbEntry[way].valid()) return &tlbEntry[way];
+
+    return &tlbEntry[(lru[set] >> (2*(ways-1))) & 3];
+  }
+
+  // the entry is (re)loaded by page walk, make it the most recently used
+  // way of its set
+  BX_CPP_INLINE void fill(bx_TLB_entry *tlbEntry)
+  {
+    if (ways_shift != 0) {
+      unsigned n = (unsigned)(tlbEntry - entry);
+      touch(n >> ways_shift, n & (get_ways() - 1));
+    }
+  }
+
+  // move the way to the front of LRU order of the set
+  BX_CPP_INLINE void touch(unsigned set, unsigned way)
+  {
+    Bit32u order = lru[set];
+
+    if ((order & 3) != way) {
+      unsigned pos = 1;
+      while (((order >> (2*pos)) & 3) != way) pos++;
+      Bit32u below = order & ((1 << (2*pos)) - 1);
+      Bit32u above = order & ~((4 << (2*pos)) - 1);
+      lru[set] = (Bit8u)(above | (below << 2) | way);
+    }
   }
 
   BX_CPP_INLINE void flush(void)
   {
-    for (unsigned n=0; n < size; n++)
+    for (unsigned n=0; n < entries; n++)
       entry[n].invalidate();
 
+    // initial LRU order of every set is 0,1,2,3
+    for (unsigned n=0; n < (entries >> ways_shift); n++)
+      lru[n] = 0xE4;
+
 #if BX_CPU_LEVEL >= 5
     split_large = false;  // flushing whole TLB
 #endif
@@ -211,7 +327,7 @@ public:
   {
     Bit32u lpf_mask = 0;
 
-    for (unsigned n=0; n<size; n++) {
+    for (unsigned n=0; n<entries; n++) {
       bx_TLB_entry *tlbEntry = &entry[n];
       if (tlbEntry->valid()) {
         if (!(tlbEntry->accessBits & TLB_GlobalPage))
@@ -223,8 +339,61 @@ public:
 
     split_large = (lpf_mask > 0xfff);
   }
+
+  // make visible only entries of address space context 'ctx' and global
+  // entries of the contexts set in 'global_ctx_mask', hide all the others
+  BX_CPP_INLINE void switchContext(unsigned ctx, Bit32u global_ctx_mask)
+  {
+    Bit32u lpf_mask = 0;
+
+    for (unsigned n=0; n<entries; n++) {
+      bx_TLB_entry *tlbEntry = &entry[n];
+      if (tlbEntry->valid()) {
+        if (tlbEntry->ctx == ctx || ((tlbEntry->accessBits & TLB_GlobalPage) && (global_ctx_mask & (1 << tlbEntry->ctx))))
+          tlbEntry->lpf &= ~TLB_HiddenEntry;
+        else
+          tlbEntry->lpf |= TLB_HiddenEntry;
+
+        // hidden large pages are accounted as well, so INVLPG will find them
+        lpf_mask |= tlbEntry->lpf_mask;
+      }
+    }
+
+    split_large = (lpf_mask > 0xfff);
+  }
+
+  // invalidate entries of address space context 'ctx', keep global entries
+  // unless 'global' is set
+  BX_CPP_INLINE void flushContext(unsigned ctx, bool global)
+  {
+    Bit32u lpf_mask = 0;
+
+    for (unsigned n=0; n<entries; n++) {
+      bx_TLB_entry *tlbEntry = &entry[n];
+      if (tlbEntry->valid()) {
+        if (tlbEntry->ctx == ctx && (global || !(tlbEntry->accessBits & TLB_GlobalPage)))
+          tlbEntry->invalidate();
+        else
+          lpf_mask |= tlbEntry->lpf_mask;
+      }
+    }
+
+    split_large = (lpf_mask > 0xfff);
+  }
 #endif
 
+  // invalidate entries of all contexts mapping physical pages in range
+  // [begin, end], the large page accounting remains conservative
+  BX_CPP_INLINE void invalidatePhysRange(bx_phy_address begin, bx_phy_address end)
+  {
+    begin = PPFOf(begin);
+    for (unsigned n=0; n<entries; n++) {
+      bx_TLB_entry *tlbEntry = &entry[n];
+      if (tlbEntry->valid() && tlbEntry->ppf >= begin && tlbEntry->ppf <= end)
+        tlbEntry->invalidate();
+    }
+  }
+
   BX_CPP_INLINE void invlpg(bx_address laddr)
   {
 #if BX_CPU_LEVEL >= 5
@@ -232,7 +401,7 @@ public:
       Bit32u lpf_mask = 0;
 
       // make sure INVLPG handles correctly large pages
-      for (unsigned n=0; n<size; n++) {
+      for (unsigned n=0; n<entries; n++) {
         bx_TLB_entry *tlbEntry = &entry[n];
         if (tlbEntry->valid()) {
           bx_address entry_lpf_mask = tlbEntry->lpf_mask;
@@ -250,11 +419,260 @@ public:
     else
 #endif
     {
-      bx_TLB_entry *tlbEntry = get_entry_of(laddr);
-      if (LPFOf(tlbEntry->lpf) == LPFOf(laddr))
-        tlbEntry->invalidate();
+      // hidden entries of the set must be invalidated as well
+      bx_TLB_entry *tlbEntry = &entry[get_index_of(laddr) << ways_shift];
+      for (unsigned way=0; way < get_ways(); way++) {
+        if (LPFOf(tlbEntry[way].lpf) == LPFOf(laddr))
+          tlbEntry[way].invalidate();
+      }
+    }
+  }
+};
+
+#if BX_CPU_LEVEL >= 6
+
+// TLB entries are tagged with address space context, so mappings of
+// several PCIDs and VPIDs (or SVM ASIDs) could stay in the TLB at the same
+// time. Only entries of the active context (and global entries of the
+// contexts sharing its VPID) are visible to TLB lookups, the others are
+// kept hidden until their context is activated again.
+//
+// Besides the PCID and VPID the context is identified by the paging
+// controls and the nested paging root the mappings were created with,
+// as some of them are evaluated when the TLB entry is filled.
+
+#define BX_TLB_CONTEXTS 16 // must not exceed 32
+
+const Bit32u BX_TLB_CONTEXT_INVALID = 0xffffffff;
+
+struct bx_TLB_context
+{
+  Bit32u id;            // (VPID << 12) | PCID
+  Bit64u mode;          // paging controls from CR0, CR4 and EFER
+  Bit64u root;          // EPTP or SVM nested CR3, zero without nested paging
+  Bit64u stamp;         // last activation, for LRU replacement
+
+  BX_CPP_INLINE bool valid() const { return id != BX_TLB_CONTEXT_INVALID; }
+  BX_CPP_INLINE void invalidate() { id = BX_TLB_CONTEXT_INVALID; stamp = 0; }
+
+  BX_CPP_INLINE bool same_vpid(const bx_TLB_context &ctx) const {
+    return (id >> 12) == (ctx.id >> 12) && mode == ctx.mode && root == ctx.root;
+  }
+
+  BX_CPP_INLINE bool same(const bx_TLB_context &ctx) const {
+    return id == ctx.id && mode == ctx.mode && root == ctx.root;
+  }
+};
+
+#endif
+
+#if BX_CPU_LEVEL >= 5
+
+// Large page TLB: one entry covers whole 2M, 4M or 1G page. The DTLB and
+// ITLB still keep separate entry for every 4K page accessed (it carries
+// the host pointer of the page), but after the 4K TLB miss the large page
+// TLB is looked up and the page walk result is taken from it instead of
+// walking the paging structures again.
+//
+// The entry keeps the page walk result (physical address of the large page
+// with combined access bits in the low bits) and is shared by data and code
+// accesses. The permissions of every access are checked against the combined
+// access bits, the page walk is still done when the access cannot be proven
+// to succeed without Accessed/Dirty bits update or page fault.
+
+#define BX_LARGE_TLB_SIZE 32
+
+struct bx_large_TLB_entry
+{
+  bx_address lpf;         // linear address of the large page
+  bx_phy_address paddr;   // page walk result
+  Bit32u lpf_mask;        // linear address mask of the page size
+  Bit32u pkey;
+  bool pkey_valid;        // the page walk evaluated protection key of the page
+  bool dirty;             // the page walk was done for write, Dirty bit is set
+  bool global;            // global page
+#if BX_CPU_LEVEL >= 6
+  Bit32u ctx;             // address space context the entry belongs to
+#endif
+
+  BX_CPP_INLINE bool valid() const { return lpf != BX_INVALID_TLB_ENTRY; }
+  BX_CPP_INLINE void invalidate() { lpf = BX_INVALID_TLB_ENTRY; }
+};
+
+struct bx_large_TLB
+{
+  bx_large_TLB_entry entry[BX_LARGE_TLB_SIZE];
+  unsigned next;          // round robin replacement
+  unsigned used;          // number of entries ever filled since last flush
+
+public:
+  bx_large_TLB() { used = BX_LARGE_TLB_SIZE; flush(); }
+
+  BX_CPP_INLINE bx_large_TLB_entry *lookup(bx_address laddr, unsigned ctx)
+  {
+    for (unsigned n=0; n < used; n++) {
+      bx_large_TLB_entry *e = &entry[n];
+      if ((laddr & ~((bx_address) e->lpf_mask)) == e->lpf) {
+#if BX_CPU_LEVEL >= 6
+        if (e->ctx == ctx)
+#endif
+          return e;
+      }
+    }
+
+    return NULL;
+  }
+
+  bx_large_TLB_entry *insert(bx_address laddr, Bit32u lpf_mask, unsigned ctx)
+  {
+    bx_address lpf = laddr & ~((bx_address) lpf_mask);
+    bx_large_TLB_entry *e = NULL;
+
+    // replace the old mapping of the same page
+    for (unsigned n=0; n < used; n++) {
+      if (entry[n].lpf == lpf && entry[n].lpf_mask == lpf_mask
+#if BX_CPU_LEVEL >= 6
+          && entry[n].ctx == ctx
+#endif
+      ) {
+        e = &entry[n];
+        break;
+      }
+    }
+
+    if (! e) {
+      e = &entry[next];
+      next = (next + 1) % BX_LARGE_TLB_SIZE;
+      if (used < next) used = next;
+      if (! next) used = BX_LARGE_TLB_SIZE;
+    }
+
+    e->lpf = lpf;
+    e->lpf_mask = lpf_mask;
+#if BX_CPU_LEVEL >= 6
+    e->ctx = ctx;
+#endif
+    return e;
+  }
+
+  BX_CPP_INLINE void flush(void)
+  {
+    for (unsigned n=0; n < used; n++)
+      entry[n].invalidate();
+
+    next = used = 0;
+  }
+
+  // invalidate entries of the large pages which include 'laddr' in all
+  // address space contexts
+  BX_CPP_INLINE void invlpg(bx_address laddr)
+  {
+    for (unsigned n=0; n < used; n++) {
+      bx_large_TLB_entry *e = &entry[n];
+      if ((laddr & ~((bx_address) e->lpf_mask)) == e->lpf)
+        e->invalidate();
+    }
+  }
+
+#if BX_CPU_LEVEL >= 6
+  BX_CPP_INLINE void flushNonGlobal(void)
+  {
+    for (unsigned n=0; n < used; n++) {
+      if (! entry[n].global)
+        entry[n].invalidate();
+    }
+  }
+
+  // invalidate entries of address space context 'ctx', keep global entries
+  // unless 'global' is set
+  BX_CPP_INLINE void flushContext(unsigned ctx, bool global)
+  {
+    for (unsigned n=0; n < used; n++) {
+      if (entry[n].ctx == ctx && (global || ! entry[n].global))
+        entry[n].invalidate();
     }
   }
+#endif
+};
+
+#endif
+
+#if BX_SUPPORT_X86_64
+
+// Paging-structure cache: keeps recently used long mode non-leaf paging
+// entries (PML5E, PML4E, PDPTE and PDE referencing a page table) so the page
+// walk after TLB miss could skip reading the upper levels of the paging
+// structures from memory. Entries are kept only for page walks which were
+// completed successfully, with the Accessed bits already set.
+//
+// Like the TLB it is not snooping memory, the paging-structure cache is
+// flushed on every TLB flush and INVLPG (as INVLPG invalidates entire
+// paging-structure cache on real hardware).
+
+#define BX_PWC_SIZE 32 // entries per paging level, must be power of two
+
+struct bx_PWC_entry
+{
+  bx_address tag;           // linear address bits translated by the entry
+  Bit64u entry;             // the paging structure entry itself
+  Bit32u combined_access;   // U/S and R/W combined from all levels up to the entry
+  bool nx_page;             // XD bit set at any level up to the entry
 };
 
+struct bx_PWC
+{
+  // paging levels PDE, PDPTE, PML4 and PML5
+  bx_PWC_entry entry[4][BX_PWC_SIZE];
+  bool empty;
+
+public:
+  bx_PWC() { empty = false; flush(); }
+
+  BX_CPP_INLINE static bx_address get_tag(bx_address laddr, unsigned level)
+  {
+    return laddr >> (12 + 9*level);
+  }
+
+  BX_CPP_INLINE bx_PWC_entry *get_entry_of(bx_address laddr, unsigned level)
+  {
+    return &entry[level-1][unsigned(get_tag(laddr, level)) & (BX_PWC_SIZE-1)];
+  }
+
+  // find the lowest paging level up to 'max_level' which has cached entry for 'laddr'
+  BX_CPP_INLINE bx_PWC_entry *lookup(bx_address laddr, unsigned max_level, unsigned &level)
+  {
+    if (empty) return NULL;
+
+    for (level = 1; level <= max_level; level++) {
+      bx_PWC_entry *e = get_entry_of(laddr, level);
+      if (e->tag == get_tag(laddr, level)) return e;
+    }
+
+    return NULL;
+  }
+
+  BX_CPP_INLINE void insert(bx_address laddr, unsigned level, Bit64u pentry, Bit32u combined_access, bool nx_page)
+  {
+    bx_PWC_entry *e = get_entry_of(laddr, level);
+    e->tag = get_tag(laddr, level);
+    e->entry = pentry;
+    e->combined_access = combined_access;
+    e->nx_page = nx_page;
+    empty = false;
+  }
+
+  BX_CPP_INLINE void flush(void)
+  {
+    if (empty) return;
+
+    for (unsigned level=0; level < 4; level++)
+      for (unsigned n=0; n < BX_PWC_SIZE; n++)
+        entry[level][n].tag = BX_INVALID_TLB_ENTRY;
+
+    empty = true;
+  }
+};
+
+#endif
+
 #endif
@@ -2236,7 +2236,8 @@ Bit32u BX_CPU_C::VMenterLoadCheckGuestState(Bit64u *qualification)
   if (vm->vmexec_ctrls1.INTERRUPT_WINDOW_VMEXIT())
     signal_event(BX_EVENT_VMX_INTERRUPT_WINDOW_EXITING);
 
-  handleCpuContextChange();
+  // VM entry flushes the TLB only if guest mappings are not tagged by VPID
+  handleCpuContextChange(! vm->vmexec_ctrls2.VPID_ENABLE());
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_CPU_THIS_PTR monitor.reset_monitor();
@@ -2830,7 +2831,10 @@ void BX_CPU_C::VMexitLoadHostState(void)
 
   BX_CPU_THIS_PTR activity_state = BX_ACTIVITY_STATE_ACTIVE;
 
-  handleCpuContextChange();
+  // VM exit flushes the TLB only if guest mappings are not tagged by VPID
+  handleCpuContextChange(! vm->vmexec_ctrls2.VPID_ENABLE());
+  if (vm->vmexec_ctrls2.VPID_ENABLE())
+    TLB_switchContext(false);
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_CPU_THIS_PTR monitor.reset_monitor();
@@ -3301,6 +3305,9 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::VMLAUNCH(bxInstruction_c *i)
 
   BX_CPU_THIS_PTR in_vmx_guest = true;
 
+  if (vm->vmexec_ctrls2.VPID_ENABLE())
+    TLB_switchContext(false);
+
   unmask_event(BX_EVENT_INIT);
 
   if (vm->vmexec_ctrls1.TSC_OFFSET())
@@ -3967,7 +3974,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::INVVPID(bxInstruction_c *i)
       BX_NEXT_TRACE(i);
     }
 
-    TLB_flush(); // invalidate all mappings for address LADDR tagged with VPID
+    TLB_invlpg((bx_address) invvpid_desc.xmm64u(1)); // invalidate all mappings for address LADDR tagged with any VPID
     break;
 
   case BX_INVEPT_INVVPID_SINGLE_CONTEXT_INVALIDATION:
@@ -4073,7 +4080,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::INVPCID(bxInstruction_c *i)
       BX_ERROR(("INVPCID: invalid PCID"));
       exception(BX_GP_EXCEPTION, 0);
     }
-    TLB_flushNonGlobal(); // Invalidate all mappings for LADDR tagged with PCID except globals
+    TLB_invlpg((bx_address) invpcid_desc.xmm64u(1)); // Invalidate mappings for LADDR tagged with any PCID
     break;
 
   case BX_INVPCID_SINGLE_CONTEXT_NON_GLOBAL_INVALIDATION:
@@ -4081,7 +4088,7 @@ void BX_CPP_AttrRegparmN(1) BX_CPU_C::INVPCID(bxInstruction_c *i)
       BX_ERROR(("INVPCID: invalid PCID"));
       exception(BX_GP_EXCEPTION, 0);
     }
-    TLB_flushNonGlobal(); // Invalidate all mappings tagged with PCID except globals
+    TLB_flushPCID(pcid); // Invalidate all mappings tagged with PCID except globals
     break;
 
   case BX_INVPCID_ALL_CONTEXT_INVALIDATION:
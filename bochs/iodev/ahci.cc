@@ -0,0 +1,1226 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+//
+// AHCI 1.3 SATA controller (Intel ICH9 style) with native command queuing
+//
+// Each port has one SATA hard disk attached, using the disk image backends
+// of the ATA emulation. Commands are fetched from the command list in guest
+// memory, data moves through the PRD table of the command. NCQ commands
+// (READ/WRITE FPDMA QUEUED) are accepted at once and completed in LBA order
+// on the next timer tick, with one Set Device Bits FIS per batch.
+//
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI && BX_SUPPORT_AHCI
+
+#include "pci.h"
+#include "ioapic.h"
+#include "hdimage/hdimage.h"
+#include "ahci.h"
+
+#define LOG_THIS theAHCIController->
+
+bx_ahci_c *theAHCIController = NULL;
+
+// HBA registers
+#define AHCI_CAP        0x00
+#define AHCI_GHC        0x04
+#define AHCI_IS         0x08
+#define AHCI_PI         0x0c
+#define AHCI_VS         0x10
+#define AHCI_CAP2       0x24
+
+#define AHCI_GHC_HR     0x00000001
+#define AHCI_GHC_IE     0x00000002
+#define AHCI_GHC_AE     0x80000000
+
+// port registers (offset from 0x100 + port * 0x80)
+#define PORT_CLB        0x00
+#define PORT_CLBU       0x04
+#define PORT_FB         0x08
+#define PORT_FBU        0x0c
+#define PORT_IS         0x10
+#define PORT_IE         0x14
+#define PORT_CMD        0x18
+#define PORT_TFD        0x20
+#define PORT_SIG        0x24
+#define PORT_SSTS       0x28
+#define PORT_SCTL       0x2c
+#define PORT_SERR       0x30
+#define PORT_SACT       0x34
+#define PORT_CI         0x38
+#define PORT_SNTF       0x3c
+
+#define PORT_CMD_ST     0x00000001
+#define PORT_CMD_SUD    0x00000002
+#define PORT_CMD_POD    0x00000004
+#define PORT_CMD_CLO    0x00000008
+#define PORT_CMD_FRE    0x00000010
+#define PORT_CMD_CCS    0x00001f00
+#define PORT_CMD_FR     0x00004000
+#define PORT_CMD_CR     0x00008000
+
+#define PORT_IRQ_DHRS   0x00000001
+#define PORT_IRQ_PSS    0x00000002
+#define PORT_IRQ_SDBS   0x00000008
+#define PORT_IRQ_TFES   0x40000000
+#define PORT_IRQ_MASK   0xfdc000ff
+
+// received FIS area layout
+#define RX_FIS_PIO      0x20
+#define RX_FIS_D2H      0x40
+#define RX_FIS_SDB      0x58
+
+#define FIS_TYPE_REG_H2D   0x27
+#define FIS_TYPE_REG_D2H   0x34
+#define FIS_TYPE_SDB       0xa1
+#define FIS_TYPE_PIO_SETUP 0x5f
+
+// ATA status / error bits
+#define ATA_STAT_BSY    0x80
+#define ATA_STAT_DRDY   0x40
+#define ATA_STAT_DSC    0x10
+#define ATA_STAT_DRQ    0x08
+#define ATA_STAT_ERR    0x01
+#define ATA_ERR_ABRT    0x04
+
+#define AHCI_SIG_DISK   0x00000101
+#define AHCI_CMD_DELAY  10
+#define AHCI_MSI_CAP    0x80
+
+// builtin configuration handling functions
+
+void ahci_init_options(void)
+{
+  char name[16], descr[40];
+
+  bx_param_c *ata = SIM->get_param("ata");
+  bx_list_c *menu = new bx_list_c(ata, "ahci", "AHCI SATA controller");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable AHCI emulation",
+    "Enables the AHCI SATA controller emulation",
+    0);
+  bx_list_c *deplist = new bx_list_c(NULL);
+  for (int i = 0; i < BX_AHCI_MAX_PORTS; i++) {
+    sprintf(name, "port%d", i);
+    sprintf(descr, "Port %d disk image", i);
+    bx_param_filename_c *path = new bx_param_filename_c(menu,
+      name,
+      descr,
+      "Pathname of the hard disk image attached to this port",
+      "", BX_PATHNAME_LEN);
+    sprintf(name, "mode%d", i);
+    sprintf(descr, "Port %d image mode", i);
+    bx_param_enum_c *mode = new bx_param_enum_c(menu,
+      name,
+      descr,
+      "Mode of the hard disk image",
+      bx_hdimage_ctl.get_mode_names(),
+      0, 0);
+    sprintf(name, "journal%d", i);
+    sprintf(descr, "Port %d redolog", i);
+    bx_param_filename_c *journal = new bx_param_filename_c(menu,
+      name,
+      descr,
+      "Pathname of the journal file",
+      "", BX_PATHNAME_LEN);
+    deplist->add(path);
+    deplist->add(mode);
+    deplist->add(journal);
+  }
+  enabled->set_dependent_list(deplist);
+}
+
+Bit32s ahci_options_parser(const char *context, int num_params, char *params[])
+{
+  if (!strcmp(params[0], "ahci")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_AHCI);
+    for (int i = 1; i < num_params; i++) {
+      if (SIM->parse_param_from_list(context, params[i], base) < 0) {
+        BX_ERROR(("%s: unknown parameter for ahci ignored.", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s ahci_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_AHCI), NULL, 1);
+}
+
+// device plugin entry point
+
+PLUGIN_ENTRY_FOR_MODULE(ahci)
+{
+  if (mode == PLUGIN_INIT) {
+    theAHCIController = new bx_ahci_c();
+    BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theAHCIController, BX_PLUGIN_AHCI);
+    // add new configuration parameter for the config interface
+    ahci_init_options();
+    // register add-on option for bochsrc and command line
+    SIM->register_addon_option("ahci", ahci_options_parser, ahci_options_save);
+  } else if (mode == PLUGIN_FINI) {
+    SIM->unregister_addon_option("ahci");
+    bx_list_c *menu = (bx_list_c*)SIM->get_param("ata");
+    menu->remove("ahci");
+    delete theAHCIController;
+  } else if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_OPTIONAL;
+  } else if (mode == PLUGIN_FLAGS) {
+    return PLUGFLAG_PCI;
+  }
+  return 0; // Success
+}
+
+// the device object
+
+bx_ahci_c::bx_ahci_c()
+{
+  put("AHCI");
+  memset(&s, 0, sizeof(bx_ahci_t));
+  s.cmd_timer_index = BX_NULL_TIMER_HANDLE;
+  buffer = NULL;
+}
+
+bx_ahci_c::~bx_ahci_c()
+{
+  for (int p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+    if (s.port[p].hdimage != NULL) {
+      s.port[p].hdimage->close();
+      delete s.port[p].hdimage;
+    }
+  }
+  delete [] buffer;
+  SIM->get_bochs_root()->remove("ahci");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_ahci_c::init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_AHCI);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get()) {
+    BX_INFO(("AHCI disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("ahci"))->set(0);
+    return;
+  }
+  BX_AHCI_THIS s.devfunc = 0x00;
+  DEV_register_pci_handlers(this, &BX_AHCI_THIS s.devfunc, BX_PLUGIN_AHCI,
+                            "AHCI SATA controller");
+
+  // initialize readonly registers
+  init_pci_conf(0x8086, 0x2922, 0x02, 0x010601, 0x00, BX_PCI_INTA);
+  BX_AHCI_THIS init_bar_mem(5, AHCI_ABAR_SIZE, mem_read_handler, mem_write_handler);
+
+  BX_AHCI_THIS buffer = new Bit8u[AHCI_XFER_SECTORS * 512];
+  for (unsigned p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+    init_port(p, base);
+  }
+  // 64-bit addressing, NCQ, command list override, 3 Gbps, AHCI only,
+  // 32 command slots
+  BX_AHCI_THIS s.cap = (1 << 31) | (1 << 30) | (1 << 24) | (2 << 20) | (1 << 18) |
+                       ((BX_AHCI_MAX_SLOTS - 1) << 8) | (BX_AHCI_MAX_PORTS - 1);
+  BX_AHCI_THIS s.pi = (1 << BX_AHCI_MAX_PORTS) - 1;
+
+  if (BX_AHCI_THIS s.cmd_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_AHCI_THIS s.cmd_timer_index =
+      DEV_register_timer(this, cmd_timer_handler, AHCI_CMD_DELAY, 0, 0, "ahci"); // one-shot, inactive
+  }
+  BX_INFO(("AHCI SATA controller initialized (%d ports)", BX_AHCI_MAX_PORTS));
+}
+
+void bx_ahci_c::init_port(unsigned p, bx_list_c *base)
+{
+  char pname[16], sbtext[10];
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+
+  sprintf(pname, "port%d", p);
+  bx_param_string_c *path = SIM->get_param_string(pname, base);
+  if (path->isempty()) {
+    return;
+  }
+  sprintf(pname, "mode%d", p);
+  const char *image_mode = SIM->get_param_enum(pname, base)->get_selected();
+  sprintf(pname, "journal%d", p);
+  port->hdimage = DEV_hdimage_init_image(image_mode, 0,
+                                         SIM->get_param_string(pname, base)->getptr());
+  if (port->hdimage == NULL) {
+    return;
+  }
+  port->hdimage->sect_size = 512;
+  if (port->hdimage->open(path->getptr()) < 0) {
+    BX_PANIC(("port %d: could not open hard drive image file '%s'", p, path->getptr()));
+    delete port->hdimage;
+    port->hdimage = NULL;
+    return;
+  }
+  if ((port->hdimage->get_capabilities() & HDIMAGE_HAS_GEOMETRY) == 0) {
+    port->hdimage->heads = 16;
+    port->hdimage->spt = 63;
+    port->hdimage->cylinders = (unsigned)(port->hdimage->hd_size / 16 / 63 / 512);
+  }
+  port->sectors = port->hdimage->hd_size / 512;
+  sprintf(sbtext, "SATA:%d", p);
+  port->statusbar_id = bx_gui->register_statusitem(sbtext, 1);
+  BX_INFO(("port %d: '%s', '%s' mode, %u sectors", p, path->getptr(),
+           image_mode, (Bit32u)port->sectors));
+}
+
+void bx_ahci_c::reset(unsigned type)
+{
+  unsigned i;
+
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x04, 0x00 }, { 0x05, 0x00 }, // command_io
+    { 0x06, 0x10 }, { 0x07, 0x02 }, // status: capabilities list, medium timing
+    { 0x24, 0x00 }, { 0x25, 0x00 }, // AHCI base address (ABAR)
+    { 0x26, 0x00 }, { 0x27, 0x00 },
+    { 0x3c, 0x00 },                 // IRQ
+    { 0x34, AHCI_MSI_CAP },         // capabilities pointer
+  };
+  for (i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+    BX_AHCI_THIS pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+  // MSI capability: 32-bit address, single message
+  memset(&BX_AHCI_THIS pci_conf[AHCI_MSI_CAP], 0, 10);
+  BX_AHCI_THIS pci_conf[AHCI_MSI_CAP] = 0x05;
+#if !BX_SUPPORT_APIC
+  // MSI requires a local APIC to deliver the message to
+  BX_AHCI_THIS pci_conf[0x06] = 0x00;
+  BX_AHCI_THIS pci_conf[0x34] = 0x00;
+#endif
+
+  BX_AHCI_THIS s.ghc = AHCI_GHC_AE;
+  BX_AHCI_THIS s.is = 0;
+  for (i = 0; i < BX_AHCI_MAX_PORTS; i++) {
+    reset_port(i);
+  }
+  BX_AHCI_THIS s.cmd_pending = 0;
+  BX_AHCI_THIS s.irq_level = 0;
+  DEV_pci_set_irq(BX_AHCI_THIS s.devfunc, BX_AHCI_THIS pci_conf[0x3d], 0);
+}
+
+void bx_ahci_c::reset_port(unsigned p)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+
+  port->clb = 0;
+  port->fb = 0;
+  port->is = 0;
+  port->ie = 0;
+  port->cmd = PORT_CMD_SUD | PORT_CMD_POD;
+  port->serr = 0;
+  port->sact = 0;
+  port->ci = 0;
+  port->sctl = 0;
+  port->halted = 0;
+  port->multiple_sectors = 0;
+  port->ncq_pending = 0;
+  port->ncq_error = 0x80;
+  if (port->hdimage != NULL) {
+    port->tfd = ATA_STAT_DRDY | ATA_STAT_DSC;
+    port->sig = AHCI_SIG_DISK;
+    // device present, Gen2 speed, interface active
+    port->ssts = 0x123;
+  } else {
+    port->tfd = 0x7f;
+    port->sig = 0xffffffff;
+    port->ssts = 0;
+  }
+}
+
+void bx_ahci_c::register_state(void)
+{
+  char pname[8];
+
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "ahci", "AHCI State");
+  BXRS_HEX_PARAM_FIELD(list, ghc, BX_AHCI_THIS s.ghc);
+  BXRS_HEX_PARAM_FIELD(list, is, BX_AHCI_THIS s.is);
+  BXRS_PARAM_BOOL(list, irq_level, BX_AHCI_THIS s.irq_level);
+  BXRS_PARAM_BOOL(list, cmd_pending, BX_AHCI_THIS s.cmd_pending);
+  for (unsigned p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+    bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+    sprintf(pname, "port%d", p);
+    bx_list_c *plist = new bx_list_c(list, pname, "");
+    BXRS_HEX_PARAM_FIELD(plist, clb, port->clb);
+    BXRS_HEX_PARAM_FIELD(plist, fb, port->fb);
+    BXRS_HEX_PARAM_FIELD(plist, is, port->is);
+    BXRS_HEX_PARAM_FIELD(plist, ie, port->ie);
+    BXRS_HEX_PARAM_FIELD(plist, cmd, port->cmd);
+    BXRS_HEX_PARAM_FIELD(plist, tfd, port->tfd);
+    BXRS_HEX_PARAM_FIELD(plist, sig, port->sig);
+    BXRS_HEX_PARAM_FIELD(plist, ssts, port->ssts);
+    BXRS_HEX_PARAM_FIELD(plist, sctl, port->sctl);
+    BXRS_HEX_PARAM_FIELD(plist, serr, port->serr);
+    BXRS_HEX_PARAM_FIELD(plist, sact, port->sact);
+    BXRS_HEX_PARAM_FIELD(plist, ci, port->ci);
+    BXRS_PARAM_BOOL(plist, halted, port->halted);
+    BXRS_DEC_PARAM_FIELD(plist, multiple_sectors, port->multiple_sectors);
+    BXRS_HEX_PARAM_FIELD(plist, ncq_pending, port->ncq_pending);
+    BXRS_HEX_PARAM_FIELD(plist, ncq_error, port->ncq_error);
+    new bx_shadow_data_c(plist, "ncq", (Bit8u*)port->ncq, sizeof(port->ncq));
+    if (port->hdimage != NULL) {
+      port->hdimage->register_state(plist);
+    }
+  }
+  register_pci_state(list);
+}
+
+void bx_ahci_c::after_restore_state(void)
+{
+  bx_pci_device_c::after_restore_pci_state(NULL);
+}
+
+// interrupt handling
+
+void bx_ahci_c::update_irq(void)
+{
+  bool level;
+
+  for (unsigned p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+    if (BX_AHCI_THIS s.port[p].is & BX_AHCI_THIS s.port[p].ie) {
+      BX_AHCI_THIS s.is |= (1 << p);
+    }
+  }
+  level = ((BX_AHCI_THIS s.ghc & AHCI_GHC_IE) != 0) && (BX_AHCI_THIS s.is != 0);
+  if (BX_AHCI_THIS pci_conf[AHCI_MSI_CAP + 2] & 0x01) {
+    // MSI is edge triggered: send one message for each new interrupt
+    if (level && !BX_AHCI_THIS s.irq_level) {
+      send_msi();
+    }
+  } else {
+    DEV_pci_set_irq(BX_AHCI_THIS s.devfunc, BX_AHCI_THIS pci_conf[0x3d], level);
+  }
+  BX_AHCI_THIS s.irq_level = level;
+}
+
+void bx_ahci_c::raise_port_irq(unsigned p, Bit32u bits)
+{
+  BX_AHCI_THIS s.port[p].is |= bits;
+  update_irq();
+}
+
+void bx_ahci_c::send_msi(void)
+{
+#if BX_SUPPORT_APIC
+  Bit32u addr = ReadHostDWordFromLittleEndian((Bit32u*)&BX_AHCI_THIS pci_conf[AHCI_MSI_CAP + 4]);
+  Bit16u data = ReadHostWordFromLittleEndian((Bit16u*)&BX_AHCI_THIS pci_conf[AHCI_MSI_CAP + 8]);
+
+  if ((addr & 0xfff00000) != 0xfee00000) {
+    BX_ERROR(("MSI address 0x%08x is not in the APIC range", addr));
+    return;
+  }
+  BX_DEBUG(("MSI: address=0x%08x data=0x%04x", addr, data));
+  apic_bus_deliver_interrupt(data & 0xff, (addr >> 12) & 0xff, (data >> 8) & 0x07,
+                             (addr >> 2) & 0x01, (data >> 14) & 0x01, (data >> 15) & 0x01);
+#endif
+}
+
+// FIS handling
+
+void bx_ahci_c::post_fis(unsigned p, unsigned offset, Bit8u *fis, unsigned len)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+
+  if (port->cmd & PORT_CMD_FRE) {
+    DEV_MEM_WRITE_PHYSICAL_DMA(port->fb + offset, len, fis);
+  }
+}
+
+void bx_ahci_c::post_d2h_fis(unsigned p, Bit8u status, Bit8u error, Bit64u lba,
+                             Bit16u count, bool irq)
+{
+  Bit8u fis[20];
+
+  memset(fis, 0, sizeof(fis));
+  fis[0] = FIS_TYPE_REG_D2H;
+  fis[1] = irq ? 0x40 : 0x00;
+  fis[2] = status;
+  fis[3] = error;
+  fis[4] = (Bit8u)lba;
+  fis[5] = (Bit8u)(lba >> 8);
+  fis[6] = (Bit8u)(lba >> 16);
+  fis[7] = 0x40;
+  fis[8] = (Bit8u)(lba >> 24);
+  fis[9] = (Bit8u)(lba >> 32);
+  fis[10] = (Bit8u)(lba >> 40);
+  fis[12] = (Bit8u)count;
+  fis[13] = (Bit8u)(count >> 8);
+  post_fis(p, RX_FIS_D2H, fis, sizeof(fis));
+  BX_AHCI_THIS s.port[p].tfd = (error << 8) | status;
+  if (irq) {
+    raise_port_irq(p, PORT_IRQ_DHRS);
+  }
+}
+
+void bx_ahci_c::post_pio_setup_fis(unsigned p, Bit8u status, Bit16u count)
+{
+  Bit8u fis[20];
+
+  memset(fis, 0, sizeof(fis));
+  fis[0] = FIS_TYPE_PIO_SETUP;
+  fis[1] = 0x60; // device to host, interrupt
+  fis[2] = ATA_STAT_DRDY | ATA_STAT_DSC | ATA_STAT_DRQ;
+  fis[15] = status;
+  fis[16] = (Bit8u)count;
+  fis[17] = (Bit8u)(count >> 8);
+  post_fis(p, RX_FIS_PIO, fis, sizeof(fis));
+  raise_port_irq(p, PORT_IRQ_PSS);
+}
+
+void bx_ahci_c::post_sdb_fis(unsigned p, Bit32u done, Bit8u status, Bit8u error)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  Bit8u fis[8];
+
+  fis[0] = FIS_TYPE_SDB;
+  fis[1] = 0x40;
+  fis[2] = status & 0x77;
+  fis[3] = error;
+  WriteHostDWordToLittleEndian((Bit32u*)&fis[4], done);
+  post_fis(p, RX_FIS_SDB, fis, sizeof(fis));
+  port->tfd = (error << 8) | (port->tfd & 0x88) | (status & 0x77);
+  port->sact &= ~done;
+  raise_port_irq(p, PORT_IRQ_SDBS);
+}
+
+// command processing
+
+void bx_ahci_c::cmd_timer_handler(void *this_ptr)
+{
+  bx_ahci_c *class_ptr = (bx_ahci_c *) this_ptr;
+  class_ptr->cmd_timer();
+}
+
+void bx_ahci_c::cmd_timer(void)
+{
+  bool more = 0;
+
+  BX_AHCI_THIS s.cmd_pending = 0;
+  for (unsigned p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+    bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+    // complete the NCQ commands accepted on the previous tick first, the
+    // commands issued since then are accepted now and served on the next one
+    if (port->ncq_pending != 0) {
+      execute_ncq(p);
+    }
+    if (port->ci != 0) {
+      process_port(p);
+    }
+    more |= (port->ncq_pending != 0);
+  }
+  if (more) {
+    BX_AHCI_THIS s.cmd_pending = 1;
+    bx_pc_system.activate_timer(BX_AHCI_THIS s.cmd_timer_index, AHCI_CMD_DELAY, 0);
+  }
+}
+
+void bx_ahci_c::process_port(unsigned p)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  Bit8u cmdhdr[16], cfis[20];
+  Bit32u flags, mask;
+  Bit64u ctba;
+  Bit16u prdtl;
+  Bit8u tag;
+
+  if (!(port->cmd & PORT_CMD_ST) || port->halted) {
+    return;
+  }
+  for (unsigned slot = 0; slot < BX_AHCI_MAX_SLOTS; slot++) {
+    mask = 1 << slot;
+    if (!(port->ci & mask)) continue;
+
+    DEV_MEM_READ_PHYSICAL_DMA(port->clb + slot * 32, 16, cmdhdr);
+    flags = ReadHostDWordFromLittleEndian((Bit32u*)cmdhdr);
+    ctba = ReadHostQWordFromLittleEndian((Bit64u*)&cmdhdr[8]) & ~BX_CONST64(0x7f);
+    prdtl = flags >> 16;
+    DEV_MEM_READ_PHYSICAL_DMA(ctba, sizeof(cfis), cfis);
+    port->cmd = (port->cmd & ~PORT_CMD_CCS) | (slot << 8);
+
+    if (cfis[0] != FIS_TYPE_REG_H2D) {
+      BX_ERROR(("port %d: unsupported FIS type 0x%02x in slot %d", p, cfis[0], slot));
+      port->ci &= ~mask;
+      continue;
+    }
+    if (!(cfis[1] & 0x80)) {
+      // device control register update (software reset)
+      if (cfis[15] & 0x04) {
+        port->tfd = ATA_STAT_BSY;
+      } else if (port->hdimage != NULL) {
+        post_d2h_fis(p, ATA_STAT_DRDY | ATA_STAT_DSC, 0x01, 1, 1, 0);
+      }
+      port->ci &= ~mask;
+      continue;
+    }
+    if (port->hdimage == NULL) {
+      port->ci &= ~mask;
+      continue;
+    }
+    if ((cfis[2] == 0x60) || (cfis[2] == 0x61)) {
+      // READ / WRITE FPDMA QUEUED: accept the command, release the slot and
+      // complete it later by a Set Device Bits FIS
+      tag = cfis[12] >> 3;
+      if ((tag != slot) || !(port->sact & mask)) {
+        BX_ERROR(("port %d: NCQ command in slot %d with tag %d not active", p, slot, tag));
+        command_aborted(p, slot, cfis[2]);
+        return;
+      }
+      bx_ahci_ncq_t *ncq = &port->ncq[slot];
+      ncq->write = (cfis[2] == 0x61);
+      ncq->lba = (Bit64s)cfis[4] | ((Bit64s)cfis[5] << 8) | ((Bit64s)cfis[6] << 16) |
+                 ((Bit64s)cfis[8] << 24) | ((Bit64s)cfis[9] << 32) | ((Bit64s)cfis[10] << 40);
+      ncq->count = cfis[3] | (cfis[11] << 8);
+      if (ncq->count == 0) ncq->count = 65536;
+      ncq->ctba = ctba;
+      ncq->prdtl = prdtl;
+      port->ncq_pending |= mask;
+      port->ci &= ~mask;
+      post_d2h_fis(p, ATA_STAT_DRDY | ATA_STAT_DSC, 0, 0, 0, 0);
+      continue;
+    }
+    if (!execute_command(p, slot, cfis, ctba, prdtl)) {
+      return;
+    }
+    port->ci &= ~mask;
+  }
+}
+
+// Serve all accepted NCQ commands in LBA order and report them done with a
+// single Set Device Bits FIS.
+void bx_ahci_c::execute_ncq(unsigned p)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  Bit8u order[BX_AHCI_MAX_SLOTS];
+  unsigned i, j, n = 0;
+  Bit32u done = 0, bytes;
+  Bit8u tag;
+
+  for (i = 0; i < BX_AHCI_MAX_SLOTS; i++) {
+    if (port->ncq_pending & (1 << i)) {
+      for (j = n; (j > 0) && (port->ncq[order[j-1]].lba > port->ncq[i].lba); j--) {
+        order[j] = order[j-1];
+      }
+      order[j] = i;
+      n++;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    tag = order[i];
+    bx_ahci_ncq_t *ncq = &port->ncq[tag];
+    if (!transfer(p, ncq->write, ncq->lba, ncq->count, ncq->ctba, ncq->prdtl, &bytes)) {
+      BX_ERROR(("port %d: NCQ %s failed (tag %d, lba=" FMT_LL "d, count=%d)", p,
+                ncq->write ? "write" : "read", tag, ncq->lba, ncq->count));
+      port->ncq_pending = 0;
+      port->ncq_error = tag;
+      port->halted = 1;
+      if (done != 0) {
+        post_sdb_fis(p, done, ATA_STAT_DRDY | ATA_STAT_DSC, 0);
+      }
+      post_sdb_fis(p, 0, ATA_STAT_DRDY | ATA_STAT_ERR, ATA_ERR_ABRT);
+      raise_port_irq(p, PORT_IRQ_TFES);
+      return;
+    }
+    done |= (1 << tag);
+  }
+  port->ncq_pending = 0;
+  post_sdb_fis(p, done, ATA_STAT_DRDY | ATA_STAT_DSC, 0);
+}
+
+// Returns 0 if the command failed and the port has been halted
+bool bx_ahci_c::execute_command(unsigned p, unsigned slot, Bit8u *cfis,
+                                Bit64u ctba, Bit16u prdtl)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  Bit8u cmd = cfis[2];
+  bool lba48 = 0, write = 0, pio = 0;
+  Bit64s lba;
+  Bit32u count, bytes = 0;
+  unsigned prd = 0;
+  Bit32u prd_offset = 0;
+  Bit8u status = ATA_STAT_DRDY | ATA_STAT_DSC;
+  Bit16u id[256];
+  Bit8u log[512];
+
+  switch (cmd) {
+    case 0x24: // READ SECTORS EXT
+    case 0x29: // READ MULTIPLE EXT
+    case 0x34: // WRITE SECTORS EXT
+    case 0x39: // WRITE MULTIPLE EXT
+      pio = 1;
+    case 0x25: // READ DMA EXT
+    case 0x35: // WRITE DMA EXT
+    case 0x42: // READ VERIFY SECTORS EXT
+      lba48 = 1;
+      break;
+    case 0x20: // READ SECTORS
+    case 0x21:
+    case 0x30: // WRITE SECTORS
+    case 0x31:
+    case 0xc4: // READ MULTIPLE
+    case 0xc5: // WRITE MULTIPLE
+      pio = 1;
+      break;
+  }
+
+  switch (cmd) {
+    case 0xec: // IDENTIFY DEVICE
+      identify_device(p, id);
+      for (int i = 0; i < 256; i++) {
+        WriteHostWordToLittleEndian(&id[i], id[i]);
+      }
+      if (!prdt_copy(ctba, prdtl, &prd, &prd_offset, (Bit8u*)id, 512, 1)) {
+        command_aborted(p, slot, cmd);
+        return 0;
+      }
+      bytes = 512;
+      post_pio_setup_fis(p, status, 1);
+      break;
+
+    case 0x20:
+    case 0x21:
+    case 0x24:
+    case 0x25:
+    case 0x29:
+    case 0xc4:
+    case 0xc8: // READ DMA
+    case 0xc9:
+    case 0x30:
+    case 0x31:
+    case 0x34:
+    case 0x35:
+    case 0x39:
+    case 0xc5:
+    case 0xca: // WRITE DMA
+    case 0xcb:
+    case 0x40: // READ VERIFY SECTORS
+    case 0x41:
+    case 0x42:
+      write = (cmd == 0x30) || (cmd == 0x31) || (cmd == 0x34) || (cmd == 0x35) ||
+              (cmd == 0x39) || (cmd == 0xc5) || (cmd == 0xca) || (cmd == 0xcb);
+      if (lba48) {
+        lba = (Bit64s)cfis[4] | ((Bit64s)cfis[5] << 8) | ((Bit64s)cfis[6] << 16) |
+              ((Bit64s)cfis[8] << 24) | ((Bit64s)cfis[9] << 32) | ((Bit64s)cfis[10] << 40);
+        count = cfis[12] | (cfis[13] << 8);
+        if (count == 0) count = 65536;
+      } else {
+        if (cfis[7] & 0x40) {
+          lba = (Bit64s)cfis[4] | ((Bit64s)cfis[5] << 8) | ((Bit64s)cfis[6] << 16) |
+                ((Bit64s)(cfis[7] & 0x0f) << 24);
+        } else {
+          lba = ((Bit64s)((cfis[6] << 8) | cfis[5]) * port->hdimage->heads +
+                 (cfis[7] & 0x0f)) * port->hdimage->spt + cfis[4] - 1;
+        }
+        count = cfis[12];
+        if (count == 0) count = 256;
+      }
+      if ((cmd >= 0x40) && (cmd <= 0x42)) {
+        if ((Bit64u)(lba + count) > port->sectors) {
+          command_aborted(p, slot, cmd);
+          return 0;
+        }
+      } else if (!transfer(p, write, lba, count, ctba, prdtl, &bytes)) {
+        BX_ERROR(("port %d: %s failed (lba=" FMT_LL "d, count=%d)", p,
+                  write ? "write" : "read", lba, count));
+        command_aborted(p, slot, cmd);
+        return 0;
+      }
+      if (pio) {
+        post_pio_setup_fis(p, status, count);
+      }
+      break;
+
+    case 0x2f: // READ LOG EXT
+      // only the NCQ command error log is supported
+      if ((cfis[4] != 0x10) || !prdtl) {
+        command_aborted(p, slot, cmd);
+        return 0;
+      }
+      memset(log, 0, sizeof(log));
+      log[0] = port->ncq_error;
+      if (port->ncq_error != 0x80) {
+        log[2] = ATA_STAT_DRDY | ATA_STAT_ERR;
+        log[3] = ATA_ERR_ABRT;
+        port->ncq_error = 0x80;
+      }
+      for (int i = 0; i < 511; i++) {
+        log[511] -= log[i];
+      }
+      prdt_copy(ctba, prdtl, &prd, &prd_offset, log, 512, 1);
+      bytes = 512;
+      post_pio_setup_fis(p, status, 1);
+      break;
+
+    case 0x27: // READ NATIVE MAX ADDRESS EXT
+    case 0xf8: // READ NATIVE MAX ADDRESS
+      post_d2h_fis(p, status, 0, port->sectors - 1, 0, 1);
+      return 1;
+
+    case 0xe5: // CHECK POWER MODE
+      post_d2h_fis(p, status, 0, 0, 0xff, 1);
+      return 1;
+
+    case 0xc6: // SET MULTIPLE MODE
+      if ((cfis[12] > 16) || (cfis[12] & (cfis[12] - 1))) {
+        command_aborted(p, slot, cmd);
+        return 0;
+      }
+      port->multiple_sectors = cfis[12];
+      break;
+
+    case 0xe7: // FLUSH CACHE
+    case 0xea: // FLUSH CACHE EXT
+    case 0xef: // SET FEATURES
+    case 0x91: // INITIALIZE DEVICE PARAMETERS
+    case 0xe0: // STANDBY IMMEDIATE
+    case 0xe1: // IDLE IMMEDIATE
+    case 0xe2: // STANDBY
+    case 0xe3: // IDLE
+      break;
+
+    case 0xa1: // IDENTIFY PACKET DEVICE
+      // not a packet device: abort as real ATA disks do
+      command_aborted(p, slot, cmd);
+      return 0;
+
+    default:
+      BX_ERROR(("port %d: unsupported command 0x%02x", p, cmd));
+      command_aborted(p, slot, cmd);
+      return 0;
+  }
+  // store the number of bytes transferred in the command header
+  WriteHostDWordToLittleEndian(&bytes, bytes);
+  DEV_MEM_WRITE_PHYSICAL_DMA(port->clb + slot * 32 + 4, 4, (Bit8u*)&bytes);
+  post_d2h_fis(p, status, 0, 0, 0, 1);
+  return 1;
+}
+
+void bx_ahci_c::command_aborted(unsigned p, unsigned slot, Bit8u cmd)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+
+  BX_DEBUG(("port %d: command 0x%02x in slot %d aborted", p, cmd, slot));
+  // the HBA stops processing the command list until the host clears PxCMD.ST
+  port->halted = 1;
+  post_d2h_fis(p, ATA_STAT_DRDY | ATA_STAT_ERR, ATA_ERR_ABRT, 0, 0, 1);
+  raise_port_irq(p, PORT_IRQ_TFES);
+}
+
+bool bx_ahci_c::transfer(unsigned p, bool write, Bit64s lba, Bit32u count,
+                         Bit64u ctba, Bit16u prdtl, Bit32u *bytes)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  unsigned prd = 0;
+  Bit32u prd_offset = 0, n, len;
+
+  *bytes = 0;
+  if ((lba < 0) || ((Bit64u)(lba + count) > port->sectors)) {
+    return 0;
+  }
+  bx_gui->statusbar_setitem(port->statusbar_id, 1, write);
+  while (count > 0) {
+    n = (count > AHCI_XFER_SECTORS) ? AHCI_XFER_SECTORS : count;
+    len = n * 512;
+    if (write) {
+      if (!prdt_copy(ctba, prdtl, &prd, &prd_offset, BX_AHCI_THIS buffer, len, 0) ||
+          (port->hdimage->write_at(lba * 512, BX_AHCI_THIS buffer, len) != (ssize_t)len)) {
+        return 0;
+      }
+    } else {
+      if ((port->hdimage->read_at(lba * 512, BX_AHCI_THIS buffer, len) != (ssize_t)len) ||
+          !prdt_copy(ctba, prdtl, &prd, &prd_offset, BX_AHCI_THIS buffer, len, 1)) {
+        return 0;
+      }
+    }
+    lba += n;
+    count -= n;
+    *bytes += len;
+  }
+  return 1;
+}
+
+// Copy len bytes between buf and the guest memory described by the PRD table,
+// starting at the current position (prd / prd_offset).
+bool bx_ahci_c::prdt_copy(Bit64u ctba, Bit16u prdtl, unsigned *prd,
+                          Bit32u *prd_offset, Bit8u *buf, Bit32u len, bool to_mem)
+{
+  Bit8u entry[16];
+  Bit64u dba;
+  Bit32u dbc, n;
+
+  while (len > 0) {
+    if (*prd >= prdtl) {
+      BX_ERROR(("PRD table too small for the transfer"));
+      return 0;
+    }
+    DEV_MEM_READ_PHYSICAL_DMA(ctba + 0x80 + *prd * 16, 16, entry);
+    dba = ReadHostQWordFromLittleEndian((Bit64u*)entry) & ~BX_CONST64(1);
+    dbc = (ReadHostDWordFromLittleEndian((Bit32u*)&entry[12]) & 0x3fffff) + 1;
+    n = dbc - *prd_offset;
+    if (n > len) n = len;
+    if (to_mem) {
+      DEV_MEM_WRITE_PHYSICAL_DMA(dba + *prd_offset, n, buf);
+    } else {
+      DEV_MEM_READ_PHYSICAL_DMA(dba + *prd_offset, n, buf);
+    }
+    buf += n;
+    len -= n;
+    *prd_offset += n;
+    if (*prd_offset == dbc) {
+      (*prd)++;
+      *prd_offset = 0;
+    }
+  }
+  return 1;
+}
+
+void bx_ahci_c::identify_device(unsigned p, Bit16u *id)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+  char serial[21], firmware[9], model[41];
+  Bit32u lba28;
+  Bit8u sum = 0;
+  int i;
+
+  memset(id, 0, 512);
+  id[0] = 0x0040;
+  id[1] = (port->hdimage->cylinders > 16383) ? 16383 : port->hdimage->cylinders;
+  id[3] = port->hdimage->heads;
+  id[6] = port->hdimage->spt;
+  sprintf(serial, "BXAHCI%014d", p + 1);
+  sprintf(firmware, "%-8s", "1.0");
+  sprintf(model, "%-40s", "BOCHS AHCI HARDDISK");
+  for (i = 0; i < 10; i++) {
+    id[10+i] = (serial[i*2] << 8) | serial[i*2+1];
+  }
+  for (i = 0; i < 4; i++) {
+    id[23+i] = (firmware[i*2] << 8) | firmware[i*2+1];
+  }
+  for (i = 0; i < 20; i++) {
+    id[27+i] = (model[i*2] << 8) | model[i*2+1];
+  }
+  id[47] = 0x8000 | 16;
+  id[49] = (1 << 9) | (1 << 8); // LBA and DMA supported
+  id[50] = 0x4000;
+  id[53] = 0x0006;
+  if (port->multiple_sectors > 0) {
+    id[59] = 0x0100 | port->multiple_sectors;
+  }
+  lba28 = (port->sectors > 0x0fffffff) ? 0x0fffffff : (Bit32u)port->sectors;
+  id[60] = (Bit16u)lba28;
+  id[61] = (Bit16u)(lba28 >> 16);
+  id[63] = 0x0007;
+  id[64] = 0x0003;
+  id[65] = 120;
+  id[66] = 120;
+  id[67] = 120;
+  id[68] = 120;
+  // NCQ queue depth and SATA capabilities (Gen1, Gen2, NCQ)
+  id[75] = BX_AHCI_MAX_SLOTS - 1;
+  id[76] = (1 << 8) | (1 << 2) | (1 << 1);
+  id[80] = 0x01f0;
+  // 48-bit address, FLUSH CACHE and FLUSH CACHE EXT
+  id[83] = 0x4000 | (1 << 13) | (1 << 12) | (1 << 10);
+  id[84] = 0x4000;
+  id[86] = (1 << 13) | (1 << 12) | (1 << 10);
+  id[87] = 0x4000;
+  id[88] = 0x203f;
+  id[100] = (Bit16u)port->sectors;
+  id[101] = (Bit16u)(port->sectors >> 16);
+  id[102] = (Bit16u)(port->sectors >> 32);
+  id[103] = (Bit16u)(port->sectors >> 48);
+  // integrity word: signature and checksum
+  id[255] = 0x00a5;
+  for (i = 0; i < 255; i++) {
+    sum += (id[i] & 0xff) + (id[i] >> 8);
+  }
+  sum += 0xa5;
+  id[255] |= ((Bit8u)-sum) << 8;
+}
+
+// register access
+
+void bx_ahci_c::write_port_reg(unsigned p, unsigned reg, Bit32u value)
+{
+  bx_ahci_port_t *port = &BX_AHCI_THIS s.port[p];
+
+  switch (reg) {
+    case PORT_CLB:
+      port->clb = (port->clb & BX_CONST64(0xffffffff00000000)) | (value & ~0x3ff);
+      break;
+    case PORT_CLBU:
+      port->clb = (port->clb & 0xffffffff) | ((Bit64u)value << 32);
+      break;
+    case PORT_FB:
+      port->fb = (port->fb & BX_CONST64(0xffffffff00000000)) | (value & ~0xff);
+      break;
+    case PORT_FBU:
+      port->fb = (port->fb & 0xffffffff) | ((Bit64u)value << 32);
+      break;
+    case PORT_IS:
+      port->is &= ~value;
+      update_irq();
+      break;
+    case PORT_IE:
+      port->ie = value & PORT_IRQ_MASK;
+      update_irq();
+      break;
+    case PORT_CMD:
+      if ((value & PORT_CMD_ST) && !(port->cmd & PORT_CMD_ST)) {
+        port->cmd |= PORT_CMD_CR;
+      } else if (!(value & PORT_CMD_ST) && (port->cmd & PORT_CMD_ST)) {
+        // stopping the DMA engine releases all command slots
+        port->cmd &= ~(PORT_CMD_CR | PORT_CMD_CCS);
+        port->ci = 0;
+        port->sact = 0;
+        port->ncq_pending = 0;
+        port->halted = 0;
+      }
+      if (value & PORT_CMD_FRE) {
+        port->cmd |= PORT_CMD_FR;
+      } else {
+        port->cmd &= ~PORT_CMD_FR;
+      }
+      if (value & PORT_CMD_CLO) {
+        port->tfd &= ~(ATA_STAT_BSY | ATA_STAT_DRQ);
+      }
+      port->cmd = (port->cmd & (PORT_CMD_CR | PORT_CMD_FR | PORT_CMD_CCS)) |
+                  (value & ~(PORT_CMD_CR | PORT_CMD_FR | PORT_CMD_CCS | PORT_CMD_CLO)) |
+                  PORT_CMD_SUD | PORT_CMD_POD;
+      break;
+    case PORT_SCTL:
+      if (((port->sctl & 0x0f) == 1) && ((value & 0x0f) == 0)) {
+        // COMRESET finished: the device sends its signature
+        reset_port(p);
+        port->cmd = (port->cmd & ~0xffff) | PORT_CMD_SUD | PORT_CMD_POD;
+        if (port->hdimage != NULL) {
+          post_d2h_fis(p, ATA_STAT_DRDY | ATA_STAT_DSC, 0x01, 1, 1, 0);
+        }
+      } else if ((value & 0x0f) == 1) {
+        port->ssts &= ~0x0f;
+      }
+      port->sctl = value;
+      break;
+    case PORT_SERR:
+      port->serr &= ~value;
+      break;
+    case PORT_SACT:
+      if (port->cmd & PORT_CMD_ST) {
+        port->sact |= value;
+      }
+      break;
+    case PORT_CI:
+      if (port->cmd & PORT_CMD_ST) {
+        port->ci |= value;
+        if (!BX_AHCI_THIS s.cmd_pending) {
+          BX_AHCI_THIS s.cmd_pending = 1;
+          bx_pc_system.activate_timer(BX_AHCI_THIS s.cmd_timer_index, AHCI_CMD_DELAY, 0);
+        }
+      }
+      break;
+    case PORT_SNTF:
+      break;
+    default:
+      BX_DEBUG(("port %d: write to read-only register 0x%02x ignored", p, reg));
+  }
+}
+
+bool bx_ahci_c::mem_read_handler(bx_phy_address addr, unsigned len,
+                                 void *data, void *param)
+{
+  bx_ahci_c *class_ptr = (bx_ahci_c *) param;
+
+  return class_ptr->mem_read(addr, len, data);
+}
+
+bool bx_ahci_c::mem_read(bx_phy_address addr, unsigned len, void *data)
+{
+  Bit32u offset = (Bit32u)addr & (AHCI_ABAR_SIZE - 1);
+  Bit32u reg = offset & ~3, value = 0;
+
+  if (reg < 0x100) {
+    switch (reg) {
+      case AHCI_CAP:
+        value = BX_AHCI_THIS s.cap;
+        break;
+      case AHCI_GHC:
+        value = BX_AHCI_THIS s.ghc;
+        break;
+      case AHCI_IS:
+        value = BX_AHCI_THIS s.is;
+        break;
+      case AHCI_PI:
+        value = BX_AHCI_THIS s.pi;
+        break;
+      case AHCI_VS:
+        value = 0x00010300;
+        break;
+    }
+  } else if (reg < (0x100 + BX_AHCI_MAX_PORTS * 0x80)) {
+    bx_ahci_port_t *port = &BX_AHCI_THIS s.port[(reg - 0x100) >> 7];
+    switch (reg & 0x7f) {
+      case PORT_CLB:  value = (Bit32u)port->clb; break;
+      case PORT_CLBU: value = (Bit32u)(port->clb >> 32); break;
+      case PORT_FB:   value = (Bit32u)port->fb; break;
+      case PORT_FBU:  value = (Bit32u)(port->fb >> 32); break;
+      case PORT_IS:   value = port->is; break;
+      case PORT_IE:   value = port->ie; break;
+      case PORT_CMD:  value = port->cmd; break;
+      case PORT_TFD:  value = port->tfd; break;
+      case PORT_SIG:  value = port->sig; break;
+      case PORT_SSTS: value = port->ssts; break;
+      case PORT_SCTL: value = port->sctl; break;
+      case PORT_SERR: value = port->serr; break;
+      case PORT_SACT: value = port->sact; break;
+      case PORT_CI:   value = port->ci; break;
+    }
+  }
+  BX_DEBUG(("mem read from offset 0x%03x - value = 0x%08x", reg, value));
+  value >>= (offset & 3) * 8;
+  switch (len) {
+    case 1:
+      *((Bit8u*)data) = (Bit8u)value;
+      break;
+    case 2:
+      *((Bit16u*)data) = (Bit16u)value;
+      break;
+    case 8:
+      *((Bit64u*)data) = value;
+      break;
+    default:
+      *((Bit32u*)data) = value;
+  }
+  return 1;
+}
+
+bool bx_ahci_c::mem_write_handler(bx_phy_address addr, unsigned len,
+                                  void *data, void *param)
+{
+  bx_ahci_c *class_ptr = (bx_ahci_c *) param;
+
+  return class_ptr->mem_write(addr, len, data);
+}
+
+bool bx_ahci_c::mem_write(bx_phy_address addr, unsigned len, void *data)
+{
+  Bit32u offset = (Bit32u)addr & (AHCI_ABAR_SIZE - 1);
+  Bit32u value = *((Bit32u*)data);
+
+  if ((len != 4) || (offset & 3)) {
+    BX_ERROR(("unsupported mem write to offset 0x%03x, len=%d", offset, len));
+    return 1;
+  }
+  BX_DEBUG(("mem write to offset 0x%03x - value = 0x%08x", offset, value));
+  if (offset < 0x100) {
+    switch (offset) {
+      case AHCI_GHC:
+        if (value & AHCI_GHC_HR) {
+          BX_AHCI_THIS s.ghc = AHCI_GHC_AE;
+          BX_AHCI_THIS s.is = 0;
+          for (unsigned p = 0; p < BX_AHCI_MAX_PORTS; p++) {
+            reset_port(p);
+          }
+        } else {
+          BX_AHCI_THIS s.ghc = AHCI_GHC_AE | (value & AHCI_GHC_IE);
+        }
+        update_irq();
+        break;
+      case AHCI_IS:
+        BX_AHCI_THIS s.is &= ~value;
+        // ports still requesting service raise a new message
+        BX_AHCI_THIS s.irq_level = 0;
+        update_irq();
+        break;
+      default:
+        BX_DEBUG(("write to read-only register 0x%02x ignored", offset));
+    }
+  } else if (offset < (0x100 + BX_AHCI_MAX_PORTS * 0x80)) {
+    write_port_reg((offset - 0x100) >> 7, offset & 0x7f, value);
+  }
+  return 1;
+}
+
+// pci configuration space write callback handler
+void bx_ahci_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  Bit8u value8, oldval;
+  bool msi_change = 0;
+
+  if ((address >= 0x10) && (address < 0x34))
+    return;
+
+  BX_DEBUG_PCI_WRITE(address, value, io_len);
+  for (unsigned i=0; i<io_len; i++) {
+    value8 = (value >> (i*8)) & 0xFF;
+    oldval = BX_AHCI_THIS pci_conf[address+i];
+    switch (address+i) {
+      case 0x04:
+        value8 &= 0x06;
+        break;
+      case 0x05:
+        value8 &= 0x04;
+        break;
+#if BX_SUPPORT_APIC
+      case AHCI_MSI_CAP + 2:
+        value8 &= 0x01;
+        msi_change = (value8 != oldval);
+        break;
+      case AHCI_MSI_CAP + 4:
+        value8 &= 0xfc;
+      case AHCI_MSI_CAP + 5:
+      case AHCI_MSI_CAP + 6:
+      case AHCI_MSI_CAP + 7:
+      case AHCI_MSI_CAP + 8:
+      case AHCI_MSI_CAP + 9:
+        break;
+#endif
+      default:
+        value8 = oldval;
+    }
+    BX_AHCI_THIS pci_conf[address+i] = value8;
+  }
+  if (msi_change) {
+    BX_INFO(("MSI %s", (BX_AHCI_THIS pci_conf[AHCI_MSI_CAP + 2] & 0x01) ? "enabled" : "disabled"));
+    // switching between INTx and MSI: drop the pin and re-evaluate
+    DEV_pci_set_irq(BX_AHCI_THIS s.devfunc, BX_AHCI_THIS pci_conf[0x3d], 0);
+    BX_AHCI_THIS s.irq_level = 0;
+    update_irq();
+  }
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_AHCI
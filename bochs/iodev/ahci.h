@@ -0,0 +1,143 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_AHCI_H
+#define BX_IODEV_AHCI_H
+
+#if BX_USE_AHCI_SMF
+#  define BX_AHCI_SMF  static
+#  define BX_AHCI_THIS theAHCIController->
+#  define BX_AHCI_THIS_PTR theAHCIController
+#else
+#  define BX_AHCI_SMF
+#  define BX_AHCI_THIS this->
+#  define BX_AHCI_THIS_PTR this
+#endif
+
+#define BX_AHCI_MAX_PORTS  4
+#define BX_AHCI_MAX_SLOTS  32
+
+// size of the HBA memory registers (ABAR)
+#define AHCI_ABAR_SIZE     0x1000
+// sectors moved through the bounce buffer at once
+#define AHCI_XFER_SECTORS  128
+
+class device_image_t;
+
+typedef struct {
+  // NCQ command accepted by the device, but not completed yet
+  bool   write;
+  Bit64s lba;
+  Bit32u count;
+  Bit64u ctba;
+  Bit16u prdtl;
+} bx_ahci_ncq_t;
+
+typedef struct {
+  // port registers
+  Bit64u clb;
+  Bit64u fb;
+  Bit32u is;
+  Bit32u ie;
+  Bit32u cmd;
+  Bit32u tfd;
+  Bit32u sig;
+  Bit32u ssts;
+  Bit32u sctl;
+  Bit32u serr;
+  Bit32u sact;
+  Bit32u ci;
+  // task file error: command processing halted until PxCMD.ST is cleared
+  bool   halted;
+  Bit8u  multiple_sectors;
+  bx_ahci_ncq_t ncq[BX_AHCI_MAX_SLOTS];
+  Bit32u ncq_pending;
+  // NCQ command error log: tag of the failed command or 0x80 (none)
+  Bit8u  ncq_error;
+
+  device_image_t *hdimage;
+  Bit64u sectors;
+  int statusbar_id;
+} bx_ahci_port_t;
+
+typedef struct {
+  Bit32u cap;
+  Bit32u ghc;
+  Bit32u is;
+  Bit32u pi;
+  bx_ahci_port_t port[BX_AHCI_MAX_PORTS];
+  Bit8u  devfunc;
+  bool   irq_level;
+  bool   cmd_pending;
+  int    cmd_timer_index;
+} bx_ahci_t;
+
+class bx_ahci_c : public bx_pci_device_c {
+public:
+  bx_ahci_c();
+  virtual ~bx_ahci_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+  virtual void pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+private:
+  bx_ahci_t s;
+  Bit8u *buffer;
+
+  BX_AHCI_SMF void init_port(unsigned p, bx_list_c *base);
+  BX_AHCI_SMF void reset_port(unsigned p);
+  BX_AHCI_SMF void update_irq(void);
+  BX_AHCI_SMF void raise_port_irq(unsigned p, Bit32u bits);
+  BX_AHCI_SMF void send_msi(void);
+  BX_AHCI_SMF void write_port_reg(unsigned p, unsigned reg, Bit32u value);
+
+  BX_AHCI_SMF void post_fis(unsigned p, unsigned offset, Bit8u *fis, unsigned len);
+  BX_AHCI_SMF void post_d2h_fis(unsigned p, Bit8u status, Bit8u error, Bit64u lba,
+                               Bit16u count, bool irq);
+  BX_AHCI_SMF void post_pio_setup_fis(unsigned p, Bit8u status, Bit16u count);
+  BX_AHCI_SMF void post_sdb_fis(unsigned p, Bit32u done, Bit8u status, Bit8u error);
+
+  BX_AHCI_SMF void process_port(unsigned p);
+  BX_AHCI_SMF bool execute_command(unsigned p, unsigned slot, Bit8u *cfis,
+                                   Bit64u ctba, Bit16u prdtl);
+  BX_AHCI_SMF void execute_ncq(unsigned p);
+  BX_AHCI_SMF bool transfer(unsigned p, bool write, Bit64s lba, Bit32u count,
+                            Bit64u ctba, Bit16u prdtl, Bit32u *bytes);
+  BX_AHCI_SMF bool prdt_copy(Bit64u ctba, Bit16u prdtl, unsigned *prd,
+                             Bit32u *prd_offset, Bit8u *buf, Bit32u len,
+                             bool to_mem);
+  BX_AHCI_SMF void identify_device(unsigned p, Bit16u *id);
+  BX_AHCI_SMF void command_aborted(unsigned p, unsigned slot, Bit8u cmd);
+
+  static void cmd_timer_handler(void *);
+  void cmd_timer(void);
+
+  static bool mem_read_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+  static bool mem_write_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+  bool mem_read(bx_phy_address addr, unsigned len, void *data);
+  bool mem_write(bx_phy_address addr, unsigned len, void *data);
+};
+
+#endif
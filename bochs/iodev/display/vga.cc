@@ -85,6 +85,7 @@ bool bx_vga_c::init_vga_extension(void)
   BX_VGA_THIS vbe.dac_8bit = 0;
   BX_VGA_THIS vbe.ddc_enabled = 0;
   BX_VGA_THIS vbe.base_address = 0x0000;
+  memset(BX_VGA_THIS vbe_page_dirty, 0, sizeof(BX_VGA_THIS vbe_page_dirty));
   if (!strcmp(BX_VGA_THIS vga_ext->get_selected(), "vbe")) {
     BX_VGA_THIS put("BXVGA");
     for (addr=VBE_DISPI_IOPORT_INDEX; addr<=VBE_DISPI_IOPORT_DATA; addr++) {
@@ -294,6 +295,83 @@ void bx_vga_c::write(Bit32u address, Bit32u value, unsigned io_len, bool no_log)
   }
 }
 
+// Fast paths for converting a row of the VBE framebuffer to the common host
+// pixel formats. The loops are simple enough to be vectorized by the compiler.
+
+typedef void (*vbe_row_conv_t)(Bit8u *dst, const Bit8u *src, unsigned w);
+
+static void vbe_row_copy_16(Bit8u *dst, const Bit8u *src, unsigned w)
+{
+  memcpy(dst, src, w << 1);
+}
+
+static void vbe_row_15_to_32(Bit8u *dst, const Bit8u *src, unsigned w)
+{
+  const Bit16u *s = (const Bit16u*)src;
+  Bit32u *d = (Bit32u*)dst;
+
+  for (unsigned c = 0; c < w; c++) {
+    Bit32u colour = s[c];
+    d[c] = ((colour & 0x7c00) << 9) | ((colour & 0x03e0) << 6) | ((colour & 0x001f) << 3);
+  }
+}
+
+static void vbe_row_16_to_32(Bit8u *dst, const Bit8u *src, unsigned w)
+{
+  const Bit16u *s = (const Bit16u*)src;
+  Bit32u *d = (Bit32u*)dst;
+
+  for (unsigned c = 0; c < w; c++) {
+    Bit32u colour = s[c];
+    d[c] = ((colour & 0xf800) << 8) | ((colour & 0x07e0) << 5) | ((colour & 0x001f) << 3);
+  }
+}
+
+static void vbe_row_32_to_32(Bit8u *dst, const Bit8u *src, unsigned w)
+{
+  const Bit32u *s = (const Bit32u*)src;
+  Bit32u *d = (Bit32u*)dst;
+
+  for (unsigned c = 0; c < w; c++) {
+    d[c] = s[c] & 0x00ffffff;
+  }
+}
+
+// returns the fast path for the guest / host format pair or NULL if the
+// generic conversion has to be used. The rows are stored in host byte order,
+// so the display must use the little endian byte order of the host as well.
+static vbe_row_conv_t vbe_get_row_converter(unsigned guest_bpp, const bx_svga_tileinfo_t *info)
+{
+#ifdef BX_LITTLE_ENDIAN
+  if (!info->is_little_endian)
+    return NULL;
+
+  if ((info->bpp == 32) && (info->red_shift == 24) && (info->green_shift == 16) &&
+      (info->blue_shift == 8) && (info->red_mask == 0xff0000) &&
+      (info->green_mask == 0x00ff00) && (info->blue_mask == 0x0000ff)) {
+    switch (guest_bpp) {
+      case 15:
+        return vbe_row_15_to_32;
+      case 16:
+        return vbe_row_16_to_32;
+      case 32:
+        return vbe_row_32_to_32;
+    }
+  } else if ((info->bpp == 16) && (guest_bpp == 16) && (info->red_shift == 16) &&
+             (info->green_shift == 11) && (info->blue_shift == 5) &&
+             (info->red_mask == 0xf800) && (info->green_mask == 0x07e0) &&
+             (info->blue_mask == 0x001f)) {
+    return vbe_row_copy_16;
+  } else if ((info->bpp == 15) && (guest_bpp == 15) && (info->red_shift == 15) &&
+             (info->green_shift == 10) && (info->blue_shift == 5) &&
+             (info->red_mask == 0x7c00) && (info->green_mask == 0x03e0) &&
+             (info->blue_mask == 0x001f)) {
+    return vbe_row_copy_16;
+  }
+#endif
+  return NULL;
+}
+
 void bx_vga_c::update(void)
 {
   unsigned iHeight, iWidth;
@@ -331,6 +409,8 @@ void bx_vga_c::update(void)
       pitch = BX_VGA_THIS vbe.line_offset;
       Bit8u *disp_ptr = &BX_VGA_THIS s.memory[BX_VGA_THIS vbe.virtual_start];
 
+      BX_VGA_THIS vbe_update_dirty_tiles();
+
       if (bx_gui->graphics_tile_info_common(&info)) {
         if (info.snapshot_mode) {
           vid_ptr = disp_ptr;
@@ -386,6 +466,7 @@ void bx_vga_c::update(void)
               break;
           }
         } else {
+          vbe_row_conv_t row_conv = vbe_get_row_converter(BX_VGA_THIS vbe.bpp, &info);
           switch (BX_VGA_THIS vbe.bpp) {
             case 4:
               BX_ERROR(("cannot draw 4bpp SVGA"));
@@ -431,22 +512,26 @@ void bx_vga_c::update(void)
                     vid_ptr = disp_ptr + (yc * pitch + (xc<<1));
                     tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
                     for (r=0; r<h; r++) {
-                      vid_ptr2  = vid_ptr;
-                      tile_ptr2 = tile_ptr;
-                      for (c=0; c<w; c++) {
-                        colour = *(vid_ptr2++);
-                        colour |= *(vid_ptr2++) << 8;
-                        colour = MAKE_COLOUR(
-                          colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                          colour & 0x03e0, 10, info.green_shift, info.green_mask,
-                          colour & 0x7c00, 15, info.red_shift, info.red_mask);
-                        if (info.is_little_endian) {
-                          for (i=0; i<info.bpp; i+=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
-                          }
-                        } else {
-                          for (i=info.bpp-8; i>-8; i-=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
+                      if (row_conv != NULL) {
+                        row_conv(tile_ptr, vid_ptr, w);
+                      } else {
+                        vid_ptr2  = vid_ptr;
+                        tile_ptr2 = tile_ptr;
+                        for (c=0; c<w; c++) {
+                          colour = *(vid_ptr2++);
+                          colour |= *(vid_ptr2++) << 8;
+                          colour = MAKE_COLOUR(
+                            colour & 0x001f, 5, info.blue_shift, info.blue_mask,
+                            colour & 0x03e0, 10, info.green_shift, info.green_mask,
+                            colour & 0x7c00, 15, info.red_shift, info.red_mask);
+                          if (info.is_little_endian) {
+                            for (i=0; i<info.bpp; i+=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
+                          } else {
+                            for (i=info.bpp-8; i>-8; i-=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
                           }
                         }
                       }
@@ -466,22 +551,26 @@ void bx_vga_c::update(void)
                     vid_ptr = disp_ptr + (yc * pitch + (xc<<1));
                     tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
                     for (r=0; r<h; r++) {
-                      vid_ptr2  = vid_ptr;
-                      tile_ptr2 = tile_ptr;
-                      for (c=0; c<w; c++) {
-                        colour = *(vid_ptr2++);
-                        colour |= *(vid_ptr2++) << 8;
-                        colour = MAKE_COLOUR(
-                          colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                          colour & 0x07e0, 11, info.green_shift, info.green_mask,
-                          colour & 0xf800, 16, info.red_shift, info.red_mask);
-                        if (info.is_little_endian) {
-                          for (i=0; i<info.bpp; i+=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
-                          }
-                        } else {
-                          for (i=info.bpp-8; i>-8; i-=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
+                      if (row_conv != NULL) {
+                        row_conv(tile_ptr, vid_ptr, w);
+                      } else {
+                        vid_ptr2  = vid_ptr;
+                        tile_ptr2 = tile_ptr;
+                        for (c=0; c<w; c++) {
+                          colour = *(vid_ptr2++);
+                          colour |= *(vid_ptr2++) << 8;
+                          colour = MAKE_COLOUR(
+                            colour & 0x001f, 5, info.blue_shift, info.blue_mask,
+                            colour & 0x07e0, 11, info.green_shift, info.green_mask,
+                            colour & 0xf800, 16, info.red_shift, info.red_mask);
+                          if (info.is_little_endian) {
+                            for (i=0; i<info.bpp; i+=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
+                          } else {
+                            for (i=info.bpp-8; i>-8; i-=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
                           }
                         }
                       }
@@ -537,24 +626,28 @@ void bx_vga_c::update(void)
                     vid_ptr = disp_ptr + (yc * pitch + (xc<<2));
                     tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
                     for (r=0; r<h; r++) {
-                      vid_ptr2  = vid_ptr;
-                      tile_ptr2 = tile_ptr;
-                      for (c=0; c<w; c++) {
-                        blue = *(vid_ptr2++);
-                        green = *(vid_ptr2++);
-                        red = *(vid_ptr2++);
-                        vid_ptr2++;
-                        colour = MAKE_COLOUR(
-                          red, 8, info.red_shift, info.red_mask,
-                          green, 8, info.green_shift, info.green_mask,
-                          blue, 8, info.blue_shift, info.blue_mask);
-                        if (info.is_little_endian) {
-                          for (i=0; i<info.bpp; i+=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
-                          }
-                        } else {
-                          for (i=info.bpp-8; i>-8; i-=8) {
-                            *(tile_ptr2++) = (Bit8u)(colour >> i);
+                      if (row_conv != NULL) {
+                        row_conv(tile_ptr, vid_ptr, w);
+                      } else {
+                        vid_ptr2  = vid_ptr;
+                        tile_ptr2 = tile_ptr;
+                        for (c=0; c<w; c++) {
+                          blue = *(vid_ptr2++);
+                          green = *(vid_ptr2++);
+                          red = *(vid_ptr2++);
+                          vid_ptr2++;
+                          colour = MAKE_COLOUR(
+                            red, 8, info.red_shift, info.red_mask,
+                            green, 8, info.green_shift, info.green_mask,
+                            blue, 8, info.blue_shift, info.blue_mask);
+                          if (info.is_little_endian) {
+                            for (i=0; i<info.bpp; i+=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
+                          } else {
+                            for (i=info.bpp-8; i>-8; i-=8) {
+                              *(tile_ptr2++) = (Bit8u)(colour >> i);
+                            }
                           }
                         }
                       }
@@ -772,7 +865,6 @@ bx_vga_c::vbe_mem_read(bx_phy_address addr)
 bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
 {
   Bit32u offset;
-  unsigned x_tileno, y_tileno;
 
   if (addr >= BX_VGA_THIS vbe.base_address) {
     // LFB write
@@ -789,6 +881,7 @@ bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
   // check for out of memory write
   if (offset < VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES) {
     BX_VGA_THIS s.memory[offset] = value;
+    BX_VGA_THIS vbe_page_dirty[offset >> VBE_DIRTY_PAGE_SHIFT] = 1;
   } else {
     // make sure we don't flood the logfile
     static int count=0;
@@ -800,15 +893,57 @@ bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
 
   offset -= BX_VGA_THIS vbe.virtual_start;
 
-  // only update the UI when writing 'onscreen'
+  // only update the UI when writing 'onscreen', the tiles are marked
+  // from the dirty pages in vbe_update_dirty_tiles()
   if (offset < BX_VGA_THIS vbe.visible_screen_size) {
-    y_tileno = ((offset / BX_VGA_THIS vbe.bpp_multiplier) / BX_VGA_THIS vbe.virtual_xres) / Y_TILESIZE;
-    x_tileno = ((offset / BX_VGA_THIS vbe.bpp_multiplier) % BX_VGA_THIS vbe.virtual_xres) / X_TILESIZE;
+    BX_VGA_THIS s.vga_mem_updated = 1;
+  }
+}
 
-    if ((y_tileno < BX_VGA_THIS s.num_y_tiles) && (x_tileno < BX_VGA_THIS s.num_x_tiles))
-    {
-      BX_VGA_THIS s.vga_mem_updated = 1;
-      SET_TILE_UPDATED(BX_VGA_THIS, x_tileno, y_tileno, 1);
+void bx_vga_c::vbe_update_dirty_tiles(void)
+{
+  Bit32u start = BX_VGA_THIS vbe.virtual_start;
+  Bit32u end = start + BX_VGA_THIS vbe.visible_screen_size;
+  Bit32u page, last, s0, s1, x0, x1, y0, y1;
+  unsigned xti, yti, xtmax;
+
+  if (end > VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES)
+    end = VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES;
+  if ((end <= start) || (BX_VGA_THIS vbe.virtual_xres == 0))
+    return;
+
+  last = (end - 1) >> VBE_DIRTY_PAGE_SHIFT;
+  for (page = start >> VBE_DIRTY_PAGE_SHIFT; page <= last; page++) {
+    if (!BX_VGA_THIS vbe_page_dirty[page])
+      continue;
+    // handle a run of dirty pages at once
+    s0 = page << VBE_DIRTY_PAGE_SHIFT;
+    while ((page < last) && BX_VGA_THIS vbe_page_dirty[page + 1]) {
+      BX_VGA_THIS vbe_page_dirty[page++] = 0;
+    }
+    BX_VGA_THIS vbe_page_dirty[page] = 0;
+    s1 = (page + 1) << VBE_DIRTY_PAGE_SHIFT;
+    if (s0 < start) s0 = start;
+    if (s1 > end) s1 = end;
+    // convert the byte range to the first and last pixel
+    s0 = (s0 - start) / BX_VGA_THIS vbe.bpp_multiplier;
+    s1 = (s1 - start - 1) / BX_VGA_THIS vbe.bpp_multiplier;
+    y0 = s0 / BX_VGA_THIS vbe.virtual_xres;
+    y1 = s1 / BX_VGA_THIS vbe.virtual_xres;
+    if (y0 == y1) {
+      x0 = s0 % BX_VGA_THIS vbe.virtual_xres;
+      x1 = s1 % BX_VGA_THIS vbe.virtual_xres;
+    } else {
+      x0 = 0;
+      x1 = BX_VGA_THIS vbe.virtual_xres - 1;
+    }
+    xtmax = x1 / X_TILESIZE;
+    if (xtmax >= BX_VGA_THIS s.num_x_tiles)
+      xtmax = BX_VGA_THIS s.num_x_tiles - 1;
+    for (yti = y0 / Y_TILESIZE; yti <= y1 / Y_TILESIZE; yti++) {
+      for (xti = x0 / X_TILESIZE; xti <= xtmax; xti++) {
+        SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 1);
+      }
     }
   }
 }
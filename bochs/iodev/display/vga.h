@@ -81,6 +81,10 @@
 #define VBE_DISPI_TOTAL_VIDEO_MEMORY_KB  (VBE_DISPI_TOTAL_VIDEO_MEMORY_MB * 1024)
 #define VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES (VBE_DISPI_TOTAL_VIDEO_MEMORY_KB * 1024)
 
+// granularity of the VBE framebuffer dirty tracking
+#define VBE_DIRTY_PAGE_SHIFT             12
+#define VBE_DIRTY_PAGES (VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES >> VBE_DIRTY_PAGE_SHIFT)
+
 // End Bochs VBE definitions
 
 #if BX_USE_VGA_SMF
@@ -130,6 +134,7 @@ protected:
   // Bochs VBE section
   BX_VGA_SMF Bit8u vbe_mem_read(bx_phy_address addr) BX_CPP_AttrRegparmN(1);
   BX_VGA_SMF void  vbe_mem_write(bx_phy_address addr, Bit8u value) BX_CPP_AttrRegparmN(2);
+  BX_VGA_SMF void  vbe_update_dirty_tiles(void);
 
   static Bit32u vbe_read_handler(void *this_ptr, Bit32u address, unsigned io_len);
   static void   vbe_write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
@@ -166,6 +171,7 @@ private:
     bool    dac_8bit;
     bool    ddc_enabled;
   } vbe;  // VBE state information
+  Bit8u vbe_page_dirty[VBE_DIRTY_PAGES]; // written pages of the VBE framebuffer
 
   bx_ddc_c ddc;
 };
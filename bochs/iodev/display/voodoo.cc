@@ -84,6 +84,7 @@ bx_voodoo_vga_c* theVoodooVga = NULL;
 #include "voodoo_data.h"
 #include "voodoo_main.h"
 voodoo_state *v;
+#include "voodoo_raster.h"
 #include "voodoo_func.h"
 
 // builtin configuration handling functions
@@ -112,6 +113,23 @@ void voodoo_init_options(void)
     "Selects the Voodoo model to emulate.",
     voodoo_model_list,
     VOODOO_1, VOODOO_1);
+  new bx_param_num_c(menu,
+    "render_threads",
+    "Render threads",
+    "Number of host threads helping to rasterize triangles (0 = disabled)",
+    0, RASTER_MAX_THREADS,
+    0);
+  new bx_param_filename_c(menu,
+    "capture",
+    "Triangle capture file",
+    "Records the rendered triangles for the voodoo_replay benchmark (empty = disabled)",
+    "", BX_PATHNAME_LEN);
+  new bx_param_num_c(menu,
+    "capture_frames",
+    "Frames to capture",
+    "Number of frames recorded to the triangle capture file",
+    1, 1000000,
+    100);
   enabled->set_dependent_list(menu->clone());
 }
 
@@ -262,6 +280,8 @@ bx_voodoo_base_c::~bx_voodoo_base_c()
     bx_set_sem(&fifo_not_full);
     bx_set_sem(&vertical_sem);
     BX_THREAD_JOIN(fifo_thread_var);
+    raster_threads_stop();
+    raster_capture_close();
     BX_FINI_MUTEX(fifo_mutex);
     BX_FINI_MUTEX(render_mutex);
     if (s.model >= VOODOO_2) {
@@ -299,6 +319,7 @@ void bx_voodoo_base_c::init(void)
     return;
   }
   s.model = (Bit8u)SIM->get_param_enum("model", base)->get();
+  s.render_threads = (Bit8u)SIM->get_param_num("render_threads", base)->get();
   s.devfunc = 0x00;
   v = new voodoo_state;
   memset(v, 0, sizeof(voodoo_state));
@@ -339,6 +360,18 @@ void bx_voodoo_base_c::init(void)
 
   BX_INFO(("3dfx Voodoo Graphics adapter (model=%s) initialized",
            SIM->get_param_enum("model", base)->get_selected()));
+  if (s.render_threads > 0) {
+    BX_INFO(("Using %d render threads", s.render_threads));
+  }
+  BX_INFO(("Using %s span pipeline", raster_simd_name[raster_simd_select(RASTER_SIMD_AVX2)]));
+  const char *capture = SIM->get_param_string("capture", base)->getptr();
+  if (strlen(capture) > 0) {
+    if (raster_capture_open(capture, SIM->get_param_num("capture_frames", base)->get())) {
+      BX_INFO(("Recording triangles to '%s'", capture));
+    } else {
+      BX_ERROR(("could not create triangle capture file '%s'", capture));
+    }
+  }
 }
 
 void bx_voodoo_base_c::voodoo_register_state(bx_list_c *parent)
@@ -526,6 +559,7 @@ void bx_voodoo_base_c::start_fifo_thread(void)
   bx_set_sem(&fifo_not_full);
   BX_THREAD_CREATE(fifo_thread, this, fifo_thread_var);
   bx_create_sem(&vertical_sem);
+  raster_threads_start(s.render_threads);
 }
 
 void bx_voodoo_base_c::refresh_display(void *this_ptr, bool redraw)
@@ -28,6 +28,7 @@
 
 typedef struct {
   Bit8u model;
+  Bit8u render_threads;
   struct {
     Bit32u width;
     Bit32u height;
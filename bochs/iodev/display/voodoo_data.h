@@ -2354,6 +2354,31 @@ do                                                                \
 while (0)
 
 
+#if VOODOO_USE_SSE2
+/* SSE2 version of CLAMPED_ARGB: ITERARGB holds the B, G, R, A iterators */
+/* in the lanes 0 - 3, the saturating packs do the clamping to 0 - 0xff  */
+#define CLAMPED_ARGB_SSE2(ITERARGB, FBZCP, RESULT)                \
+do                                                                \
+{                                                                 \
+  __m128i c = _mm_srai_epi32((ITERARGB), 12);                     \
+                                                                  \
+  if (FBZCP_RGBZW_CLAMP(FBZCP) == 0)                              \
+  {                                                               \
+    /* wrap mode: 0xfff -> 0, 0x100 -> 0xff */                    \
+    c = _mm_and_si128(c, _mm_set1_epi32(0xfff));                  \
+    __m128i m0 = _mm_cmpeq_epi32(c, _mm_set1_epi32(0xfff));       \
+    __m128i m1 = _mm_cmpeq_epi32(c, _mm_set1_epi32(0x100));       \
+    c = _mm_or_si128(_mm_andnot_si128(m0, c), m1);                \
+    c = _mm_and_si128(c, _mm_set1_epi32(0xff));                   \
+  }                                                               \
+  c = _mm_packs_epi32(c, c);                                      \
+  c = _mm_packus_epi16(c, c);                                     \
+  RESULT.u = _mm_cvtsi128_si32(c);                                \
+}                                                                 \
+while (0)
+#endif
+
+
 #define CLAMPED_Z(ITERZ, FBZCP, RESULT)                 \
 do                                                      \
 {                                                       \
@@ -58,8 +58,6 @@ Bit32u voodoo_last_msg = 255;
 #define LOG_CMDFIFO     (0)
 #define LOG_CMDFIFO_VERBOSE (0)
 
-#define MODIFY_PIXEL(VV)
-
 /* fifo thread variable */
 BX_THREAD_VAR(fifo_thread_var);
 /* CMDFIFO thread mutex (Voodoo2) */
@@ -71,159 +69,27 @@ BX_MUTEX(fifo_mutex);
 bx_thread_sem_t fifo_wakeup;
 bx_thread_sem_t fifo_not_full;
 static bx_thread_sem_t vertical_sem;
-
-/* fast dither lookup */
-static Bit8u dither4_lookup[256*16*2];
-static Bit8u dither2_lookup[256*16*2];
-
-/* fast reciprocal+log2 lookup */
-Bit32u voodoo_reciplog[(2 << RECIPLOG_LOOKUP_BITS) + 2];
-
-
-void raster_function(int tmus, void *destbase, Bit32s y, const poly_extent *extent, const void *extradata, int threadid) {
-	const poly_extra_data *extra = (const poly_extra_data *) extradata;
-	voodoo_state *v = extra->state;
-	stats_block *stats = &v->thread_stats[threadid];
-	DECLARE_DITHER_POINTERS;
-	Bit32s startx = extent->startx;
-	Bit32s stopx = extent->stopx;
-	Bit32s iterr, iterg, iterb, itera;
-	Bit32s iterz;
-	Bit64s iterw, iterw0 = 0, iterw1 = 0;
-	Bit64s iters0 = 0, iters1 = 0;
-	Bit64s itert0 = 0, itert1 = 0;
-	Bit16u *depth;
-	Bit16u *dest;
-	Bit32s dx, dy;
-	Bit32s scry;
-	Bit32s x;
-
-	Bit32u fbzcolorpath= v->reg[fbzColorPath].u;
-	Bit32u fbzmode= v->reg[fbzMode].u;
-	Bit32u alphamode= v->reg[alphaMode].u;
-	Bit32u fogmode= v->reg[fogMode].u;
-	Bit32u texmode0= (tmus==0? 0 : v->tmu[0].reg[textureMode].u);
-	Bit32u texmode1= (tmus<=1? 0 : v->tmu[1].reg[textureMode].u);
-
-	/* determine the screen Y */
-	scry = y;
-	if (FBZMODE_Y_ORIGIN(fbzmode))
-		scry = (v->fbi.yorigin - y) & v->fbi.clip_mask;
-
-	/* compute dithering */
-	COMPUTE_DITHER_POINTERS(fbzmode, y);
-
-	/* apply clipping */
-	if (FBZMODE_ENABLE_CLIPPING(fbzmode)) {
-		Bit32s tempclip;
-
-		/* Y clipping buys us the whole scanline */
-		if (scry < (Bit32s) ((v->reg[clipLowYHighY].u >> 16) & v->fbi.clip_mask)
-				|| scry >= (Bit32s) (v->reg[clipLowYHighY].u & v->fbi.clip_mask)) {
-			stats->pixels_in += stopx - startx;
-			stats->clip_fail += stopx - startx;
-			return;
-		}
-
-		/* X clipping */
-		tempclip = (v->reg[clipLeftRight].u >> 16) & v->fbi.clip_mask;
-		if (startx < tempclip) {
-			stats->pixels_in += tempclip - startx;
-			startx = tempclip;
-		}
-		tempclip = v->reg[clipLeftRight].u & v->fbi.clip_mask;
-		if (stopx >= tempclip) {
-			stats->pixels_in += stopx - tempclip;
-			stopx = tempclip - 1;
-		}
-	}
-
-	/* get pointers to the target buffer and depth buffer */
-	dest = (Bit16u *) destbase + scry * v->fbi.rowpixels;
-	depth =
-			(v->fbi.auxoffs != (Bit32u) ~0) ?
-					((Bit16u *) (v->fbi.ram + v->fbi.auxoffs)
-							+ scry * v->fbi.rowpixels) :
-					NULL;
-
-	/* compute the starting parameters */
-	dx = startx - (extra->ax >> 4);
-	dy = y - (extra->ay >> 4);
-	iterr = extra->startr + dy * extra->drdy + dx * extra->drdx;
-	iterg = extra->startg + dy * extra->dgdy + dx * extra->dgdx;
-	iterb = extra->startb + dy * extra->dbdy + dx * extra->dbdx;
-	itera = extra->starta + dy * extra->dady + dx * extra->dadx;
-	iterz = extra->startz + dy * extra->dzdy + dx * extra->dzdx;
-	iterw = extra->startw + dy * extra->dwdy + dx * extra->dwdx;
-	if (tmus >= 1) {
-		iterw0 = extra->startw0 + dy * extra->dw0dy + dx * extra->dw0dx;
-		iters0 = extra->starts0 + dy * extra->ds0dy + dx * extra->ds0dx;
-		itert0 = extra->startt0 + dy * extra->dt0dy + dx * extra->dt0dx;
-	}
-	if (tmus >= 2) {
-		iterw1 = extra->startw1 + dy * extra->dw1dy + dx * extra->dw1dx;
-		iters1 = extra->starts1 + dy * extra->ds1dy + dx * extra->ds1dx;
-		itert1 = extra->startt1 + dy * extra->dt1dy + dx * extra->dt1dx;
-	}
-
-	/* loop in X */
-	for (x = startx; x < stopx; x++) {
-		rgb_union iterargb = { 0 };
-		rgb_union texel = { 0 };
-
-		/* pixel pipeline part 1 handles depth testing and stippling */
-		PIXEL_PIPELINE_BEGIN(v, stats, x, y, fbzcolorpath, fbzmode,
-				iterz, iterw)
-			;
-
-			/* run the texture pipeline on TMU1 to produce a value in texel */
-			/* note that they set LOD min to 8 to "disable" a TMU */
-			if (tmus >= 2 && v->tmu[1].lodmin < (8 << 8))
-				TEXTURE_PIPELINE(&v->tmu[1], x, dither4, texmode1, texel,
-						v->tmu[1].lookup, extra->lodbase1, iters1, itert1,
-						iterw1, texel);
-
-			/* run the texture pipeline on TMU0 to produce a final */
-			/* result in texel */
-			/* note that they set LOD min to 8 to "disable" a TMU */
-			if (tmus >= 1 && v->tmu[0].lodmin < (8 << 8)) {
-				if (v->send_config == 0)
-					TEXTURE_PIPELINE(&v->tmu[0], x, dither4, texmode0, texel,
-							v->tmu[0].lookup, extra->lodbase0, iters0, itert0,
-							iterw0, texel);
-				/* send config data to the frame buffer */
-				else
-					texel.u = v->tmu_config;
-			}
-			/* colorpath pipeline selects source colors and does blending */
-			CLAMPED_ARGB(iterr, iterg, iterb, itera, fbzcolorpath, iterargb);
-			COLORPATH_PIPELINE(v, stats, fbzcolorpath, fbzmode, alphamode,
-					texel, iterz, iterw, iterargb);
-
-			/* pixel pipeline part 2 handles fog, alpha, and final output */
-			PIXEL_PIPELINE_END(v, stats, dither, dither4, dither_lookup, x,
-					dest, depth, fbzmode, fbzcolorpath, alphamode, fogmode,
-					iterz, iterw, iterargb);
-
-		/* update the iterated parameters */
-		iterr += extra->drdx;
-		iterg += extra->dgdx;
-		iterb += extra->dbdx;
-		itera += extra->dadx;
-		iterz += extra->dzdx;
-		iterw += extra->dwdx;
-		if (tmus >= 1) {
-			iterw0 += extra->dw0dx;
-			iters0 += extra->ds0dx;
-			itert0 += extra->dt0dx;
-		}
-		if (tmus >= 2) {
-			iterw1 += extra->dw1dx;
-			iters1 += extra->ds1dx;
-			itert1 += extra->dt1dx;
-		}
-	}
-}
+/* scanline render threads */
+#define RASTER_MAX_THREADS   (WORK_MAX_THREADS - 1)
+#define RASTER_MAX_SCANLINES 4096
+#define RASTER_MIN_PIXELS    2048
+typedef struct
+{
+  void *dest;
+  int texcount;
+  const poly_extra_data *extra;
+  Bit32s startscan;
+  Bit32s numscans;
+} raster_job;
+static int raster_threads = 0;
+static bool raster_keep_alive = 0;
+static raster_job raster_work;
+static poly_extent raster_extents[RASTER_MAX_SCANLINES];
+static int raster_thread_id[RASTER_MAX_THREADS];
+BX_THREAD_VAR(raster_thread_var[RASTER_MAX_THREADS]);
+static bx_thread_sem_t raster_start[RASTER_MAX_THREADS];
+static bx_thread_sem_t raster_done[RASTER_MAX_THREADS];
+static BX_MUTEX(raster_mutex);
 
 /*************************************
  *
@@ -477,6 +343,278 @@ BX_CPP_INLINE Bit32s round_coordinate(float value)
   return result + (value - (float)result > 0.5f);
 }
 
+/*************************************
+ *
+ *  Scanline render threads
+ *
+ *************************************/
+
+/* render every stride'th scanline of the job, starting at scanline threadid */
+void raster_scanlines(const raster_job *job, int threadid, int stride)
+{
+  for (Bit32s i = threadid; i < job->numscans; i += stride)
+    raster_function(job->texcount, job->dest, job->startscan + i, &raster_extents[i], job->extra, threadid);
+}
+
+BX_THREAD_FUNC(raster_thread, indata)
+{
+  int threadid = *(int*)indata;
+
+  while (1) {
+    bx_wait_sem(&raster_start[threadid - 1]);
+    if (!raster_keep_alive) break;
+    raster_scanlines(&raster_work, threadid, raster_threads + 1);
+    bx_set_sem(&raster_done[threadid - 1]);
+  }
+  BX_THREAD_EXIT;
+}
+
+void raster_threads_start(int count)
+{
+  if (raster_keep_alive || (count <= 0))
+    return;
+  if (count > RASTER_MAX_THREADS)
+    count = RASTER_MAX_THREADS;
+  raster_threads = count;
+  raster_keep_alive = 1;
+  BX_INIT_MUTEX(raster_mutex);
+  for (int i = 0; i < raster_threads; i++) {
+    /* thread id 0 is the caller of poly_render_triangle() */
+    raster_thread_id[i] = i + 1;
+    bx_create_sem(&raster_start[i]);
+    bx_create_sem(&raster_done[i]);
+    BX_THREAD_CREATE(raster_thread, &raster_thread_id[i], raster_thread_var[i]);
+  }
+}
+
+void raster_threads_stop(void)
+{
+  if (!raster_keep_alive)
+    return;
+  raster_keep_alive = 0;
+  for (int i = 0; i < raster_threads; i++) {
+    bx_set_sem(&raster_start[i]);
+    BX_THREAD_JOIN(raster_thread_var[i]);
+    bx_destroy_sem(&raster_start[i]);
+    bx_destroy_sem(&raster_done[i]);
+  }
+  BX_FINI_MUTEX(raster_mutex);
+  raster_threads = 0;
+}
+
+/*************************************
+ *
+ *  Triangle stream capture
+ *
+ *************************************/
+
+static FILE *capture_file = NULL;
+static BX_MUTEX(capture_mutex);
+static bool capture_mutex_init = 0;
+static int capture_frames_left = 0;
+static bool capture_started = 0;
+static Bit8u *capture_tmu_ram[MAX_TMU];
+static const rgb_t *capture_lookup[MAX_TMU];
+static rgb_t capture_palette[MAX_TMU][256];
+
+static void raster_capture_write(Bit32u type, Bit32u size, const void *data, Bit32u datasize)
+{
+  raster_capture_chunk chunk;
+
+  chunk.type = type;
+  chunk.size = size;
+  fwrite(&chunk, sizeof(chunk), 1, capture_file);
+  if (datasize > 0)
+    fwrite(data, datasize, 1, capture_file);
+}
+
+/* stores the texture RAM of a TMU, or only its index if it is shared */
+static void raster_capture_tmu_ram(int tmu)
+{
+  Bit32u index = tmu;
+  Bit32u size = 0;
+
+  if (capture_tmu_ram[tmu] != NULL) {
+    size = v->tmu[tmu].mask + 1;
+    memcpy(capture_tmu_ram[tmu], v->tmu[tmu].ram, size);
+  }
+  raster_capture_write(RASTER_CAPTURE_TMU_RAM, sizeof(index) + size, &index, sizeof(index));
+  if (size > 0)
+    fwrite(capture_tmu_ram[tmu], size, 1, capture_file);
+}
+
+bool raster_capture_open(const char *path, int frames)
+{
+  raster_capture_header header;
+
+  capture_file = fopen(path, "wb");
+  if (capture_file == NULL)
+    return 0;
+  header.magic = RASTER_CAPTURE_MAGIC;
+  header.version = RASTER_CAPTURE_VERSION;
+  header.fbi_ram_size = v->fbi.mask + 1;
+  header.tmu_ram_size = v->tmu[0].mask + 1;
+  fwrite(&header, sizeof(header), 1, capture_file);
+  for (int i = 0; i < MAX_TMU; i++) {
+    capture_tmu_ram[i] = NULL;
+    if (v->tmu[i].ram != v->fbi.ram)
+      capture_tmu_ram[i] = (Bit8u*)malloc(v->tmu[i].mask + 1);
+    capture_lookup[i] = NULL;
+  }
+  capture_frames_left = frames;
+  capture_started = 0;
+  if (!capture_mutex_init) {
+    BX_INIT_MUTEX(capture_mutex);
+    capture_mutex_init = 1;
+  }
+  return 1;
+}
+
+/* the capture lock must be held */
+static void raster_capture_finish(void)
+{
+  fclose(capture_file);
+  capture_file = NULL;
+  for (int i = 0; i < MAX_TMU; i++) {
+    free(capture_tmu_ram[i]);
+    capture_tmu_ram[i] = NULL;
+  }
+}
+
+void raster_capture_close(void)
+{
+  if (!capture_mutex_init)
+    return;
+  BX_LOCK(capture_mutex);
+  if (capture_file != NULL)
+    raster_capture_finish();
+  BX_UNLOCK(capture_mutex);
+  BX_FINI_MUTEX(capture_mutex);
+  capture_mutex_init = 0;
+}
+
+/* stores the triangle parameters and the lookup tables it uses; returns 1 */
+/* with the capture lock held if the triangle is recorded, the spans follow */
+/* with raster_capture_span_write() and raster_capture_end() */
+static bool raster_capture_begin(void *dest, int texcount, Bit32s numscans, const poly_extra_data *extra)
+{
+  raster_capture_triangle tri;
+  unsigned i;
+
+  if (capture_file == NULL)
+    return 0;
+  BX_LOCK(capture_mutex);
+  /* the capture may have finished with a buffer swap meanwhile */
+  if (capture_file == NULL) {
+    BX_UNLOCK(capture_mutex);
+    return 0;
+  }
+
+  /* the memory contents are stored with the first triangle */
+  if (!capture_started) {
+    raster_capture_write(RASTER_CAPTURE_FBI_RAM, v->fbi.mask + 1, v->fbi.ram, v->fbi.mask + 1);
+    for (i = 0; i < MAX_TMU; i++)
+      raster_capture_tmu_ram(i);
+    capture_started = 1;
+  }
+
+  for (i = 0; i < (unsigned)texcount; i++) {
+    const rgb_t *lookup = v->tmu[i].lookup;
+    Bit32u format = TEXMODE_FORMAT(v->tmu[i].reg[textureMode].u);
+    Bit32u index = i;
+    Bit32u entries = ((format >= 10) && (format <= 12)) ? 65536 : 256;
+
+    if (lookup == NULL)
+      continue;
+    /* the palettes and NCC tables can change without a new lookup pointer */
+    if ((lookup != capture_lookup[i]) ||
+        ((entries == 256) && memcmp(capture_palette[i], lookup, sizeof(capture_palette[i])))) {
+      raster_capture_write(RASTER_CAPTURE_LOOKUP, sizeof(index) + entries * sizeof(rgb_t), &index, sizeof(index));
+      fwrite(lookup, entries * sizeof(rgb_t), 1, capture_file);
+      if (entries == 256)
+        memcpy(capture_palette[i], lookup, sizeof(capture_palette[i]));
+      capture_lookup[i] = lookup;
+    }
+  }
+
+  memset(&tri, 0, sizeof(tri));
+  tri.texcount = texcount;
+  tri.destoffs = (Bit32u)((Bit8u*)dest - v->fbi.ram);
+  tri.numscans = numscans;
+  for (i = 0; i < RASTER_CAPTURE_REGS; i++)
+    tri.reg[i] = v->reg[raster_capture_reg[i]].u;
+  tri.yorigin = v->fbi.yorigin;
+  tri.clip_mask = v->fbi.clip_mask;
+  tri.rowpixels = v->fbi.rowpixels;
+  tri.auxoffs = v->fbi.auxoffs;
+  tri.send_config = v->send_config;
+  tri.tmu_config = v->tmu_config;
+  memcpy(tri.fogblend, v->fbi.fogblend, sizeof(tri.fogblend));
+  memcpy(tri.fogdelta, v->fbi.fogdelta, sizeof(tri.fogdelta));
+  tri.fogdelta_mask = v->fbi.fogdelta_mask;
+  for (i = 0; i < MAX_TMU; i++) {
+    tmu_state *t = &v->tmu[i];
+    raster_capture_tmu *ct = &tri.tmu[i];
+
+    ct->texmode = t->reg[textureMode].u;
+    ct->lodmin = t->lodmin;
+    ct->lodmax = t->lodmax;
+    ct->lodbias = t->lodbias;
+    ct->lodmask = t->lodmask;
+    memcpy(ct->lodoffset, t->lodoffset, sizeof(ct->lodoffset));
+    ct->detailmax = t->detailmax;
+    ct->detailbias = t->detailbias;
+    ct->detailscale = t->detailscale;
+    ct->wmask = t->wmask;
+    ct->hmask = t->hmask;
+    ct->bilinear_mask = t->bilinear_mask;
+  }
+  tri.extra = *extra;
+  tri.extra.state = NULL;
+  raster_capture_write(RASTER_CAPTURE_TRIANGLE, sizeof(tri) + numscans * sizeof(raster_capture_span),
+                       &tri, sizeof(tri));
+  return 1;
+}
+
+static void raster_capture_span_write(Bit32s y, Bit32s startx, Bit32s stopx)
+{
+  raster_capture_span span;
+
+  span.y = y;
+  span.startx = startx;
+  span.stopx = stopx;
+  fwrite(&span, sizeof(span), 1, capture_file);
+}
+
+static void raster_capture_end(void)
+{
+  BX_UNLOCK(capture_mutex);
+}
+
+/* called on a buffer swap: stores changed texture RAM and counts the frames */
+static void raster_capture_swap(void)
+{
+  if (capture_file == NULL)
+    return;
+  BX_LOCK(capture_mutex);
+  if (capture_file == NULL) {
+    BX_UNLOCK(capture_mutex);
+    return;
+  }
+  if (capture_started) {
+    for (int i = 0; i < MAX_TMU; i++) {
+      if ((capture_tmu_ram[i] != NULL) &&
+          memcmp(capture_tmu_ram[i], v->tmu[i].ram, v->tmu[i].mask + 1))
+        raster_capture_tmu_ram(i);
+    }
+  }
+  if (--capture_frames_left <= 0) {
+    raster_capture_finish();
+    BX_INFO(("Triangle capture finished"));
+  }
+  BX_UNLOCK(capture_mutex);
+}
+
 Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount, int paramcount, const poly_vertex *v1, const poly_vertex *v2, const poly_vertex *v3, poly_extra_data *extra)
 {
   float dxdy_v1v2, dxdy_v1v3, dxdy_v2v3;
@@ -486,6 +624,8 @@ Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount,
   Bit32s v1yclip, v3yclip;
   Bit32s v1y, v3y;
   Bit32s pixels = 0;
+  Bit32s numscans;
+  bool threaded, capture;
 
   /* first sort by Y */
   if (v2->y < v1->y)
@@ -527,6 +667,18 @@ Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount,
   dxdy_v1v3 = (v3->y == v1->y) ? 0.0f : (v3->x - v1->x) / (v3->y - v1->y);
   dxdy_v2v3 = (v3->y == v2->y) ? 0.0f : (v3->x - v2->x) / (v3->y - v2->y);
 
+  /* the scanlines can be split across the render threads unless stipple */
+  /* rotate mode is active, since it updates the stipple register per pixel */
+  numscans = v3yclip - v1yclip;
+  Bit32u fbzmode = extra->state->reg[fbzMode].u;
+  threaded = raster_keep_alive && (numscans > raster_threads) &&
+             (numscans <= RASTER_MAX_SCANLINES) &&
+             (numscans <= (Bit32s)extra->state->fbi.clip_mask) &&
+             !(FBZMODE_ENABLE_STIPPLE(fbzmode) && (FBZMODE_STIPPLE_PATTERN(fbzmode) == 0));
+  if (threaded)
+    BX_LOCK(raster_mutex);
+  capture = raster_capture_begin(dest, texcount, numscans, extra);
+
   /* compute the X extents for each scanline */
   poly_extent extent;
   int extnum=0;
@@ -568,13 +720,42 @@ Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount,
       /* set the extent and update the total pixel count */
       if (istartx >= istopx)
         istartx = istopx = 0;
-      extent.startx = istartx;
-      extent.stopx = istopx;
-      raster_function(texcount,dest,curscan,&extent,extra,0);
+      if (capture)
+        raster_capture_span_write(curscan, istartx, istopx);
+      if (threaded) {
+        raster_extents[curscan - v1yclip].startx = istartx;
+        raster_extents[curscan - v1yclip].stopx = istopx;
+      } else {
+        extent.startx = istartx;
+        extent.stopx = istopx;
+        raster_function(texcount,dest,curscan,&extent,extra,0);
+      }
 
       pixels += istopx - istartx;
     }
   }
+  if (capture)
+    raster_capture_end();
+
+  if (threaded)
+  {
+    raster_work.dest = dest;
+    raster_work.texcount = texcount;
+    raster_work.extra = extra;
+    raster_work.startscan = v1yclip;
+    raster_work.numscans = numscans;
+    if (pixels < RASTER_MIN_PIXELS) {
+      /* not worth waking up the render threads */
+      raster_scanlines(&raster_work, 0, 1);
+    } else {
+      for (int i = 0; i < raster_threads; i++)
+        bx_set_sem(&raster_start[i]);
+      raster_scanlines(&raster_work, 0, raster_threads + 1);
+      for (int i = 0; i < raster_threads; i++)
+        bx_wait_sem(&raster_done[i]);
+    }
+    BX_UNLOCK(raster_mutex);
+  }
 
   return pixels;
 }
@@ -1113,6 +1294,9 @@ void swap_buffers(voodoo_state *v)
     count = 15;
   v->reg[fbiSwapHistory].u = (v->reg[fbiSwapHistory].u << 4) | count;
 
+  /* end of a frame for the triangle capture */
+  raster_capture_swap();
+
   /* rotate the buffers */
   if (v->type <= VOODOO_2)
   {
@@ -3932,7 +4116,6 @@ void banshee_bitblt_init()
 void voodoo_init(Bit8u _type)
 {
   int pen;
-  int val;
 
   v->reg[lfbMode].u = 0;
   v->reg[fbiInit0].u = (1 << 4) | (0x10 << 6);
@@ -3984,29 +4167,8 @@ void voodoo_init(Bit8u _type)
   v->pci.fifo.size = 64*2;
   v->pci.fifo.in = v->pci.fifo.out = 0;
 
-  /* create a table of precomputed 1/n and log2(n) values */
-  /* n ranges from 1.0000 to 2.0000 */
-  for (val = 0; val <= (1 << RECIPLOG_LOOKUP_BITS); val++) {
-    Bit32u value = (1 << RECIPLOG_LOOKUP_BITS) + val;
-    voodoo_reciplog[val*2 + 0] = (1 << (RECIPLOG_LOOKUP_PREC + RECIPLOG_LOOKUP_BITS)) / value;
-    voodoo_reciplog[val*2 + 1] = (Bit32u)(LOGB2((double)value / (double)(1 << RECIPLOG_LOOKUP_BITS)) * (double)(1 << RECIPLOG_LOOKUP_PREC));
-  }
-
-  /* create dithering tables */
-  for (int val = 0; val < 256*16*2; val++) {
-    int g = (val >> 0) & 1;
-    int x = (val >> 1) & 3;
-    int color = (val >> 3) & 0xff;
-    int y = (val >> 11) & 3;
-
-    if (!g) {
-      dither4_lookup[val] = DITHER_RB(color, dither_matrix_4x4[y * 4 + x]) >> 3;
-      dither2_lookup[val] = DITHER_RB(color, dither_matrix_2x2[y * 4 + x]) >> 3;
-    } else {
-      dither4_lookup[val] = DITHER_G(color, dither_matrix_4x4[y * 4 + x]) >> 2;
-      dither2_lookup[val] = DITHER_G(color, dither_matrix_2x2[y * 4 + x]) >> 2;
-    }
-  }
+  /* create the rasterizer lookup tables */
+  raster_init_tables();
 
   /* init the pens */
   v->fbi.clut_dirty = 1;
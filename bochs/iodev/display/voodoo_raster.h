@@ -0,0 +1,841 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+/*
+ *  Portion of this software comes with the following license
+ */
+
+/***************************************************************************
+
+    Copyright Aaron Giles
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+        * Redistributions of source code must retain the above copyright
+          notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+          notice, this list of conditions and the following disclaimer in
+          the documentation and/or other materials provided with the
+          distribution.
+        * Neither the name 'MAME' nor the names of its contributors may be
+          used to endorse or promote products derived from this software
+          without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY AARON GILES ''AS IS'' AND ANY EXPRESS OR
+    IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL AARON GILES BE LIABLE FOR ANY DIRECT,
+    INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+    HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+    STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+    IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+
+***************************************************************************/
+
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+
+/* scanline rasterizer, shared by the Voodoo device and voodoo_replay */
+
+#define MODIFY_PIXEL(VV)
+
+/* fast dither lookup */
+static Bit8u dither4_lookup[256*16*2];
+static Bit8u dither2_lookup[256*16*2];
+
+/* fast reciprocal+log2 lookup */
+Bit32u voodoo_reciplog[(2 << RECIPLOG_LOOKUP_BITS) + 2];
+
+
+
+/* create the lookup tables used by the rasterizer */
+void raster_init_tables(void)
+{
+  /* create a table of precomputed 1/n and log2(n) values */
+  /* n ranges from 1.0000 to 2.0000 */
+  for (int val = 0; val <= (1 << RECIPLOG_LOOKUP_BITS); val++) {
+    Bit32u value = (1 << RECIPLOG_LOOKUP_BITS) + val;
+    voodoo_reciplog[val*2 + 0] = (1 << (RECIPLOG_LOOKUP_PREC + RECIPLOG_LOOKUP_BITS)) / value;
+    voodoo_reciplog[val*2 + 1] = (Bit32u)(LOGB2((double)value / (double)(1 << RECIPLOG_LOOKUP_BITS)) * (double)(1 << RECIPLOG_LOOKUP_PREC));
+  }
+
+  /* create dithering tables */
+  for (int val = 0; val < 256*16*2; val++) {
+    int g = (val >> 0) & 1;
+    int x = (val >> 1) & 3;
+    int color = (val >> 3) & 0xff;
+    int y = (val >> 11) & 3;
+
+    if (!g) {
+      dither4_lookup[val] = DITHER_RB(color, dither_matrix_4x4[y * 4 + x]) >> 3;
+      dither2_lookup[val] = DITHER_RB(color, dither_matrix_2x2[y * 4 + x]) >> 3;
+    } else {
+      dither4_lookup[val] = DITHER_G(color, dither_matrix_4x4[y * 4 + x]) >> 2;
+      dither2_lookup[val] = DITHER_G(color, dither_matrix_2x2[y * 4 + x]) >> 2;
+    }
+  }
+}
+
+
+/*************************************
+ *
+ *  Vector span pipeline
+ *
+ *************************************/
+
+/*
+    The span pipeline runs 4 (SSE4.1) or 8 (AVX2) pixels per step for the
+    modes without stippling, fogging, alpha blending, chroma range keying
+    and W based depth values. Each color channel lives in its own vector of
+    32-bit lanes and a lane mask tracks the pixels that passed the depth,
+    chroma and alpha tests so far. The texels are still fetched per pixel
+    with TEXTURE_PIPELINE. The results are bit-identical to the scalar loop
+    in raster_function(), which handles the other modes and the pixels left
+    over at the end of a span.
+*/
+
+enum {
+  RASTER_SIMD_NONE,
+  RASTER_SIMD_SSE41,
+  RASTER_SIMD_AVX2
+};
+
+static const char *raster_simd_name[] = { "scalar", "SSE4.1", "AVX2" };
+
+#if VOODOO_USE_SIMD
+
+#define RASTER_VEC_INLINE inline __attribute__((always_inline))
+
+typedef struct _raster_span raster_span;
+struct _raster_span
+{
+  voodoo_state *v;
+  stats_block *stats;
+  const poly_extra_data *extra;
+  int tmus;
+  Bit32s y;
+  Bit32s startx, stopx;
+  Bit16u *dest;
+  Bit16u *depth;
+  const Bit8u *dither;
+  const Bit8u *dither4;
+};
+
+typedef Bit32s (*raster_span_func)(const raster_span *span);
+static raster_span_func raster_span_vector = NULL;
+
+template <int N> struct raster_vec
+{
+  typedef Bit32s s32 __attribute__((vector_size(N * 4)));
+  typedef Bit32u u32 __attribute__((vector_size(N * 4)));
+  typedef Bit16u u16 __attribute__((vector_size(N * 2)));
+};
+
+/* returns 1 if the vector pipeline supports the current raster mode */
+static bool raster_span_mode_ok(const voodoo_state *v, Bit32u fbzcp, Bit32u fbzmode,
+                                Bit32u alphamode, Bit32u fogmode,
+                                const Bit16u *dest, const Bit16u *depth)
+{
+  bool depthtest = FBZMODE_ENABLE_DEPTHBUF(fbzmode) != 0;
+
+  if (FBZMODE_ENABLE_STIPPLE(fbzmode) || FOGMODE_ENABLE_FOG(fogmode) ||
+      ALPHAMODE_ALPHABLEND(alphamode) || (FBZCP_CCA_LOCALSELECT(fbzcp) == 3))
+    return 0;
+  if (FBZMODE_ENABLE_CHROMAKEY(fbzmode) && CHROMARANGE_ENABLE(v->reg[chromaRange].u))
+    return 0;
+  if (depthtest && (depth == NULL))
+    return 0;
+  /* only the Z based depth value is computed */
+  if (FBZMODE_WBUFFER_SELECT(fbzmode) &&
+      ((depthtest && !FBZMODE_DEPTH_SOURCE_COMPARE(fbzmode)) ||
+       ((depth != NULL) && FBZMODE_AUX_BUFFER_MASK(fbzmode) &&
+        !FBZMODE_ENABLE_ALPHA_PLANES(fbzmode))))
+    return 0;
+  /* a block is read before it is written, so the buffers must not overlap */
+  if ((depth != NULL) && (depth > dest - 8) && (depth < dest + 8))
+    return 0;
+  return 1;
+}
+
+/* number of set lanes in a mask */
+template <int N> static RASTER_VEC_INLINE Bit32s raster_vec_count(const typename raster_vec<N>::s32 &mask)
+{
+  Bit32s count = 0;
+  for (int i = 0; i < N; i++)
+    count -= mask[i];
+  return count;
+}
+
+template <int N> static RASTER_VEC_INLINE void
+raster_vec_clamp(typename raster_vec<N>::s32 &val, Bit32s lo, Bit32s hi)
+{
+  typename raster_vec<N>::s32 zero = {};
+
+  val = (val < lo) ? zero + lo : val;
+  val = (val > hi) ? zero + hi : val;
+}
+
+/* CLAMPED_ARGB for one channel of the 12.12 iterated color */
+template <int N> static RASTER_VEC_INLINE void
+raster_vec_clamped_channel(typename raster_vec<N>::s32 &c, const typename raster_vec<N>::u32 &iter, Bit32u fbzcp)
+{
+  typename raster_vec<N>::s32 zero = {};
+
+  c = (typename raster_vec<N>::s32)iter >> 12;
+  if (FBZCP_RGBZW_CLAMP(fbzcp) == 0) {
+    c &= 0xfff;
+    c = (c == 0xfff) ? zero : (c == 0x100) ? zero + 0xff : (c & 0xff);
+  } else {
+    raster_vec_clamp<N>(c, 0, 0xff);
+  }
+}
+
+/* blend the new 16-bit values into the buffer for the lanes set in mask */
+template <int N> static RASTER_VEC_INLINE void
+raster_vec_store(Bit16u *buf, const typename raster_vec<N>::s32 &val, const typename raster_vec<N>::s32 &mask)
+{
+  typename raster_vec<N>::u16 old, res;
+
+  memcpy(&old, buf, sizeof(old));
+  res = __builtin_convertvector(mask ? val : __builtin_convertvector(old, typename raster_vec<N>::s32),
+                                typename raster_vec<N>::u16);
+  memcpy(buf, &res, sizeof(res));
+}
+
+/* runs whole blocks of N pixels and returns the first pixel not handled */
+template <int N> static RASTER_VEC_INLINE Bit32s raster_span_vec(const raster_span *span)
+{
+  typedef typename raster_vec<N>::s32 vs32;
+  typedef typename raster_vec<N>::u32 vu32;
+  typedef typename raster_vec<N>::u16 vu16;
+
+  voodoo_state *v = span->v;
+  stats_block *stats = span->stats;
+  const poly_extra_data *extra = span->extra;
+  const Bit8u *dither4 = span->dither4;
+  Bit16u *dest = span->dest;
+  Bit16u *depth = span->depth;
+  Bit32u fbzcolorpath = v->reg[fbzColorPath].u;
+  Bit32u fbzmode = v->reg[fbzMode].u;
+  Bit32u alphamode = v->reg[alphaMode].u;
+  Bit32u texmode0 = (span->tmus == 0) ? 0 : v->tmu[0].reg[textureMode].u;
+  Bit32u texmode1 = (span->tmus <= 1) ? 0 : v->tmu[1].reg[textureMode].u;
+  bool usetmu0 = (span->tmus >= 1) && (v->tmu[0].lodmin < (8 << 8));
+  bool usetmu1 = (span->tmus >= 2) && (v->tmu[1].lodmin < (8 << 8));
+  rgb_union col0 = v->reg[color0];
+  rgb_union col1 = v->reg[color1];
+  Bit64s iterw0 = 0, iters0 = 0, itert0 = 0;
+  Bit64s iterw1 = 0, iters1 = 0, itert1 = 0;
+  Bit32s x = span->startx;
+  Bit32s dx, dy;
+  vs32 zero = {}, ones = (zero == zero), dither = {};
+  vu32 lane, iterr, iterg, iterb, itera, iterz;
+  int k;
+
+  for (k = 0; k < N; k++) {
+    lane[k] = k;
+    /* N is a multiple of 4, so the dither pattern is the same for all blocks */
+    if (span->dither != NULL)
+      dither[k] = span->dither[(x + k) & 3];
+  }
+
+  /* compute the starting parameters of the lanes */
+  dx = x - (extra->ax >> 4);
+  dy = span->y - (extra->ay >> 4);
+  iterr = lane * (Bit32u)extra->drdx + (Bit32u)(extra->startr + dy * extra->drdy + dx * extra->drdx);
+  iterg = lane * (Bit32u)extra->dgdx + (Bit32u)(extra->startg + dy * extra->dgdy + dx * extra->dgdx);
+  iterb = lane * (Bit32u)extra->dbdx + (Bit32u)(extra->startb + dy * extra->dbdy + dx * extra->dbdx);
+  itera = lane * (Bit32u)extra->dadx + (Bit32u)(extra->starta + dy * extra->dady + dx * extra->dadx);
+  iterz = lane * (Bit32u)extra->dzdx + (Bit32u)(extra->startz + dy * extra->dzdy + dx * extra->dzdx);
+  if (span->tmus >= 1) {
+    iterw0 = extra->startw0 + dy * extra->dw0dy + dx * extra->dw0dx;
+    iters0 = extra->starts0 + dy * extra->ds0dy + dx * extra->ds0dx;
+    itert0 = extra->startt0 + dy * extra->dt0dy + dx * extra->dt0dx;
+  }
+  if (span->tmus >= 2) {
+    iterw1 = extra->startw1 + dy * extra->dw1dy + dx * extra->dw1dx;
+    iters1 = extra->starts1 + dy * extra->ds1dy + dx * extra->ds1dx;
+    itert1 = extra->startt1 + dy * extra->dt1dy + dx * extra->dt1dx;
+  }
+
+  for (; x + N <= span->stopx; x += N) {
+    stats->pixels_in += N;
+
+    do {
+      vs32 live = ones;
+      vs32 zval, depthval;
+
+      /* clamped iterated Z, also the depth value with the bias */
+      zval = (vs32)iterz >> 12;
+      if (FBZCP_RGBZW_CLAMP(fbzcolorpath) == 0) {
+        zval &= 0xfffff;
+        zval = (zval == 0xfffff) ? zero : (zval == 0x10000) ? zero + 0xffff : (zval & 0xffff);
+      } else {
+        raster_vec_clamp<N>(zval, 0, 0xffff);
+      }
+      depthval = zval;
+      if (FBZMODE_ENABLE_DEPTH_BIAS(fbzmode)) {
+        depthval += (Bit16s)v->reg[zaColor].u;
+        raster_vec_clamp<N>(depthval, 0, 0xffff);
+      }
+
+      /* depth buffer test */
+      if (FBZMODE_ENABLE_DEPTHBUF(fbzmode)) {
+        vs32 depthsource, dst;
+        vu16 dst16;
+
+        if (FBZMODE_DEPTH_SOURCE_COMPARE(fbzmode) == 0)
+          depthsource = depthval;
+        else
+          depthsource = zero + (Bit16u)v->reg[zaColor].u;
+        memcpy(&dst16, &depth[x], sizeof(dst16));
+        dst = __builtin_convertvector(dst16, vs32);
+        switch (FBZMODE_DEPTH_FUNCTION(fbzmode)) {
+          case 0: live = zero; break;
+          case 1: live = (depthsource < dst); break;
+          case 2: live = (depthsource == dst); break;
+          case 3: live = (depthsource <= dst); break;
+          case 4: live = (depthsource > dst); break;
+          case 5: live = (depthsource != dst); break;
+          case 6: live = (depthsource >= dst); break;
+          case 7: break;
+        }
+        stats->zfunc_fail += N - raster_vec_count<N>(live);
+        if (raster_vec_count<N>(live) == 0)
+          break;
+      }
+
+      /* fetch the texels of the live pixels through the TMUs */
+      vs32 texel = zero;
+      if (usetmu0 || usetmu1) {
+        Bit32u texels[N];
+        Bit64s s0 = iters0, t0 = itert0, w0 = iterw0;
+        Bit64s s1 = iters1, t1 = itert1, w1 = iterw1;
+
+        for (k = 0; k < N; k++) {
+          rgb_union tex = { 0 };
+
+          if (live[k]) {
+            if (usetmu1)
+              TEXTURE_PIPELINE(&v->tmu[1], x + k, dither4, texmode1, tex,
+                      v->tmu[1].lookup, extra->lodbase1, s1, t1, w1, tex);
+            if (usetmu0) {
+              if (v->send_config == 0)
+                TEXTURE_PIPELINE(&v->tmu[0], x + k, dither4, texmode0, tex,
+                        v->tmu[0].lookup, extra->lodbase0, s0, t0, w0, tex);
+              else
+                tex.u = v->tmu_config;
+            }
+          }
+          texels[k] = tex.u;
+          if (usetmu0) {
+            s0 += extra->ds0dx;
+            t0 += extra->dt0dx;
+            w0 += extra->dw0dx;
+          }
+          if (usetmu1) {
+            s1 += extra->ds1dx;
+            t1 += extra->dt1dx;
+            w1 += extra->dw1dx;
+          }
+        }
+        memcpy(&texel, texels, sizeof(texel));
+      }
+      vs32 texr = (texel >> 16) & 0xff;
+      vs32 texg = (texel >> 8) & 0xff;
+      vs32 texb = texel & 0xff;
+      vs32 texa = (texel >> 24) & 0xff;
+
+      /* iterated color */
+      vs32 iterr8, iterg8, iterb8, itera8;
+      raster_vec_clamped_channel<N>(iterr8, iterr, fbzcolorpath);
+      raster_vec_clamped_channel<N>(iterg8, iterg, fbzcolorpath);
+      raster_vec_clamped_channel<N>(iterb8, iterb, fbzcolorpath);
+      raster_vec_clamped_channel<N>(itera8, itera, fbzcolorpath);
+
+      /* the rest follows COLORPATH_PIPELINE and PIXEL_PIPELINE_END */
+      vs32 otherr, otherg, otherb, othera;
+      switch (FBZCP_CC_RGBSELECT(fbzcolorpath)) {
+        case 0:
+          otherr = iterr8; otherg = iterg8; otherb = iterb8;
+          break;
+        case 1:
+          otherr = texr; otherg = texg; otherb = texb;
+          break;
+        case 2:
+          otherr = zero + col1.rgb.r; otherg = zero + col1.rgb.g; otherb = zero + col1.rgb.b;
+          break;
+        default:
+          otherr = otherg = otherb = zero;
+          break;
+      }
+
+      if (FBZMODE_ENABLE_CHROMAKEY(fbzmode)) {
+        rgb_union key = v->reg[chromaKey];
+        vs32 hit = (otherr == key.rgb.r) & (otherg == key.rgb.g) & (otherb == key.rgb.b);
+        stats->chroma_fail += raster_vec_count<N>(hit & live);
+        live &= ~hit;
+      }
+
+      switch (FBZCP_CC_ASELECT(fbzcolorpath)) {
+        case 0: othera = itera8; break;
+        case 1: othera = texa; break;
+        case 2: othera = zero + col1.rgb.a; break;
+        default: othera = zero; break;
+      }
+
+      if (FBZMODE_ENABLE_ALPHA_MASK(fbzmode)) {
+        vs32 fail = ((othera & 1) == 0);
+        stats->afunc_fail += raster_vec_count<N>(fail & live);
+        live &= ~fail;
+      }
+
+      if (ALPHAMODE_ALPHATEST(alphamode)) {
+        Bit32s alpharef = v->reg[alphaMode].rgb.a;
+        vs32 pass = ones;
+        switch (ALPHAMODE_ALPHAFUNCTION(alphamode)) {
+          case 0: pass = zero; break;
+          case 1: pass = (othera < alpharef); break;
+          case 2: pass = (othera == alpharef); break;
+          case 3: pass = (othera <= alpharef); break;
+          case 4: pass = (othera > alpharef); break;
+          case 5: pass = (othera != alpharef); break;
+          case 6: pass = (othera >= alpharef); break;
+          case 7: break;
+        }
+        stats->afunc_fail += raster_vec_count<N>(~pass & live);
+        live &= pass;
+      }
+      if (raster_vec_count<N>(live) == 0)
+        break;
+
+      vs32 localr, localg, localb, locala;
+      if (FBZCP_CC_LOCALSELECT_OVERRIDE(fbzcolorpath) == 0) {
+        if (FBZCP_CC_LOCALSELECT(fbzcolorpath) == 0) {
+          localr = iterr8; localg = iterg8; localb = iterb8;
+        } else {
+          localr = zero + col0.rgb.r; localg = zero + col0.rgb.g; localb = zero + col0.rgb.b;
+        }
+      } else {
+        vs32 sel = ((texa & 0x80) != 0);
+        localr = sel ? zero + col0.rgb.r : iterr8;
+        localg = sel ? zero + col0.rgb.g : iterg8;
+        localb = sel ? zero + col0.rgb.b : iterb8;
+      }
+
+      switch (FBZCP_CCA_LOCALSELECT(fbzcolorpath)) {
+        default:
+        case 0: locala = itera8; break;
+        case 1: locala = zero + col0.rgb.a; break;
+        case 2: locala = zval & 0xff; break;
+      }
+
+      vs32 r, g, b, a;
+      if (FBZCP_CC_ZERO_OTHER(fbzcolorpath) == 0) {
+        r = otherr; g = otherg; b = otherb;
+      } else {
+        r = g = b = zero;
+      }
+      a = (FBZCP_CCA_ZERO_OTHER(fbzcolorpath) == 0) ? othera : zero;
+
+      if (FBZCP_CC_SUB_CLOCAL(fbzcolorpath)) {
+        r -= localr; g -= localg; b -= localb;
+      }
+      if (FBZCP_CCA_SUB_CLOCAL(fbzcolorpath))
+        a -= locala;
+
+      vs32 blendr, blendg, blendb, blenda;
+      switch (FBZCP_CC_MSELECT(fbzcolorpath)) {
+        default:
+        case 0: blendr = blendg = blendb = zero; break;
+        case 1: blendr = localr; blendg = localg; blendb = localb; break;
+        case 2: blendr = blendg = blendb = othera; break;
+        case 3: blendr = blendg = blendb = locala; break;
+        case 4: blendr = blendg = blendb = texa; break;
+        case 5: blendr = texr; blendg = texg; blendb = texb; break;
+      }
+      switch (FBZCP_CCA_MSELECT(fbzcolorpath)) {
+        default:
+        case 0: blenda = zero; break;
+        case 1: blenda = locala; break;
+        case 2: blenda = othera; break;
+        case 3: blenda = locala; break;
+        case 4: blenda = texa; break;
+      }
+      if (!FBZCP_CC_REVERSE_BLEND(fbzcolorpath)) {
+        blendr ^= 0xff; blendg ^= 0xff; blendb ^= 0xff;
+      }
+      if (!FBZCP_CCA_REVERSE_BLEND(fbzcolorpath))
+        blenda ^= 0xff;
+
+      r = (r * (blendr + 1)) >> 8;
+      g = (g * (blendg + 1)) >> 8;
+      b = (b * (blendb + 1)) >> 8;
+      a = (a * (blenda + 1)) >> 8;
+
+      switch (FBZCP_CC_ADD_ACLOCAL(fbzcolorpath)) {
+        case 1: r += localr; g += localg; b += localb; break;
+        case 2: r += locala; g += locala; b += locala; break;
+      }
+      if (FBZCP_CCA_ADD_ACLOCAL(fbzcolorpath))
+        a += locala;
+
+      raster_vec_clamp<N>(r, 0, 0xff);
+      raster_vec_clamp<N>(g, 0, 0xff);
+      raster_vec_clamp<N>(b, 0, 0xff);
+      raster_vec_clamp<N>(a, 0, 0xff);
+      if (FBZCP_CC_INVERT_OUTPUT(fbzcolorpath)) {
+        r ^= 0xff; g ^= 0xff; b ^= 0xff;
+      }
+      if (FBZCP_CCA_INVERT_OUTPUT(fbzcolorpath))
+        a ^= 0xff;
+
+      /* write to the frame buffer, dithering as the lookup tables do */
+      if (FBZMODE_RGB_BUFFER_MASK(fbzmode)) {
+        if (FBZMODE_ENABLE_DITHERING(fbzmode)) {
+          r = (((r << 1) - (r >> 4) + (r >> 7) + dither) >> 1) >> 3;
+          g = (((g << 2) - (g >> 4) + (g >> 6) + dither) >> 2) >> 2;
+          b = (((b << 1) - (b >> 4) + (b >> 7) + dither) >> 1) >> 3;
+        } else {
+          r >>= 3; g >>= 2; b >>= 3;
+        }
+        raster_vec_store<N>(&dest[x], (r << 11) | (g << 5) | b, live);
+      }
+
+      /* write to the aux buffer */
+      if ((depth != NULL) && FBZMODE_AUX_BUFFER_MASK(fbzmode))
+        raster_vec_store<N>(&depth[x], FBZMODE_ENABLE_ALPHA_PLANES(fbzmode) ? a : depthval, live);
+
+      stats->pixels_out += raster_vec_count<N>(live);
+    } while (0);
+
+    /* update the iterated parameters */
+    iterr += (Bit32u)extra->drdx * N;
+    iterg += (Bit32u)extra->dgdx * N;
+    iterb += (Bit32u)extra->dbdx * N;
+    itera += (Bit32u)extra->dadx * N;
+    iterz += (Bit32u)extra->dzdx * N;
+    if (span->tmus >= 1) {
+      iterw0 += extra->dw0dx * N;
+      iters0 += extra->ds0dx * N;
+      itert0 += extra->dt0dx * N;
+    }
+    if (span->tmus >= 2) {
+      iterw1 += extra->dw1dx * N;
+      iters1 += extra->ds1dx * N;
+      itert1 += extra->dt1dx * N;
+    }
+  }
+  return x;
+}
+
+__attribute__((target("sse4.1"))) static Bit32s raster_span_sse41(const raster_span *span)
+{
+  return raster_span_vec<4>(span);
+}
+
+__attribute__((target("avx2"))) static Bit32s raster_span_avx2(const raster_span *span)
+{
+  return raster_span_vec<8>(span);
+}
+
+#endif
+
+/* select the span pipeline for the host CPU, up to the given level */
+int raster_simd_select(int maxlevel)
+{
+#if VOODOO_USE_SIMD
+  __builtin_cpu_init();
+  if ((maxlevel >= RASTER_SIMD_AVX2) && __builtin_cpu_supports("avx2")) {
+    raster_span_vector = raster_span_avx2;
+    return RASTER_SIMD_AVX2;
+  }
+  if ((maxlevel >= RASTER_SIMD_SSE41) && __builtin_cpu_supports("sse4.1")) {
+    raster_span_vector = raster_span_sse41;
+    return RASTER_SIMD_SSE41;
+  }
+  raster_span_vector = NULL;
+#endif
+  return RASTER_SIMD_NONE;
+}
+
+
+/*************************************
+ *
+ *  Scanline rasterizer
+ *
+ *************************************/
+
+void raster_function(int tmus, void *destbase, Bit32s y, const poly_extent *extent, const void *extradata, int threadid) {
+	const poly_extra_data *extra = (const poly_extra_data *) extradata;
+	voodoo_state *v = extra->state;
+	stats_block *stats = &v->thread_stats[threadid];
+	DECLARE_DITHER_POINTERS;
+	Bit32s startx = extent->startx;
+	Bit32s stopx = extent->stopx;
+	Bit32s iterr, iterg, iterb, itera;
+#if VOODOO_USE_SSE2
+	__m128i iterargb4, dargbdx4;
+#endif
+	Bit32s iterz;
+	Bit64s iterw, iterw0 = 0, iterw1 = 0;
+	Bit64s iters0 = 0, iters1 = 0;
+	Bit64s itert0 = 0, itert1 = 0;
+	Bit16u *depth;
+	Bit16u *dest;
+	Bit32s dx, dy;
+	Bit32s scry;
+	Bit32s x;
+
+	Bit32u fbzcolorpath= v->reg[fbzColorPath].u;
+	Bit32u fbzmode= v->reg[fbzMode].u;
+	Bit32u alphamode= v->reg[alphaMode].u;
+	Bit32u fogmode= v->reg[fogMode].u;
+	Bit32u texmode0= (tmus==0? 0 : v->tmu[0].reg[textureMode].u);
+	Bit32u texmode1= (tmus<=1? 0 : v->tmu[1].reg[textureMode].u);
+
+	/* determine the screen Y */
+	scry = y;
+	if (FBZMODE_Y_ORIGIN(fbzmode))
+		scry = (v->fbi.yorigin - y) & v->fbi.clip_mask;
+
+	/* compute dithering */
+	COMPUTE_DITHER_POINTERS(fbzmode, y);
+
+	/* apply clipping */
+	if (FBZMODE_ENABLE_CLIPPING(fbzmode)) {
+		Bit32s tempclip;
+
+		/* Y clipping buys us the whole scanline */
+		if (scry < (Bit32s) ((v->reg[clipLowYHighY].u >> 16) & v->fbi.clip_mask)
+				|| scry >= (Bit32s) (v->reg[clipLowYHighY].u & v->fbi.clip_mask)) {
+			stats->pixels_in += stopx - startx;
+			stats->clip_fail += stopx - startx;
+			return;
+		}
+
+		/* X clipping */
+		tempclip = (v->reg[clipLeftRight].u >> 16) & v->fbi.clip_mask;
+		if (startx < tempclip) {
+			stats->pixels_in += tempclip - startx;
+			startx = tempclip;
+		}
+		tempclip = v->reg[clipLeftRight].u & v->fbi.clip_mask;
+		if (stopx >= tempclip) {
+			stats->pixels_in += stopx - tempclip;
+			stopx = tempclip - 1;
+		}
+	}
+
+	/* get pointers to the target buffer and depth buffer */
+	dest = (Bit16u *) destbase + scry * v->fbi.rowpixels;
+	depth =
+			(v->fbi.auxoffs != (Bit32u) ~0) ?
+					((Bit16u *) (v->fbi.ram + v->fbi.auxoffs)
+							+ scry * v->fbi.rowpixels) :
+					NULL;
+
+#if VOODOO_USE_SIMD
+	/* run whole blocks of pixels through the vector pipeline if it supports */
+	/* the mode; the loop below handles the remaining pixels */
+	if ((raster_span_vector != NULL) && (stopx - startx >= 4) &&
+			raster_span_mode_ok(v, fbzcolorpath, fbzmode, alphamode, fogmode, dest, depth)) {
+		raster_span span;
+		span.v = v;
+		span.stats = stats;
+		span.extra = extra;
+		span.tmus = tmus;
+		span.y = y;
+		span.startx = startx;
+		span.stopx = stopx;
+		span.dest = dest;
+		span.depth = depth;
+		span.dither = dither;
+		span.dither4 = dither4;
+		startx = raster_span_vector(&span);
+	}
+#endif
+
+	/* compute the starting parameters */
+	dx = startx - (extra->ax >> 4);
+	dy = y - (extra->ay >> 4);
+	iterr = extra->startr + dy * extra->drdy + dx * extra->drdx;
+	iterg = extra->startg + dy * extra->dgdy + dx * extra->dgdx;
+	iterb = extra->startb + dy * extra->dbdy + dx * extra->dbdx;
+	itera = extra->starta + dy * extra->dady + dx * extra->dadx;
+#if VOODOO_USE_SSE2
+	iterargb4 = _mm_set_epi32(itera, iterr, iterg, iterb);
+	dargbdx4 = _mm_set_epi32(extra->dadx, extra->drdx, extra->dgdx, extra->dbdx);
+#endif
+	iterz = extra->startz + dy * extra->dzdy + dx * extra->dzdx;
+	iterw = extra->startw + dy * extra->dwdy + dx * extra->dwdx;
+	if (tmus >= 1) {
+		iterw0 = extra->startw0 + dy * extra->dw0dy + dx * extra->dw0dx;
+		iters0 = extra->starts0 + dy * extra->ds0dy + dx * extra->ds0dx;
+		itert0 = extra->startt0 + dy * extra->dt0dy + dx * extra->dt0dx;
+	}
+	if (tmus >= 2) {
+		iterw1 = extra->startw1 + dy * extra->dw1dy + dx * extra->dw1dx;
+		iters1 = extra->starts1 + dy * extra->ds1dy + dx * extra->ds1dx;
+		itert1 = extra->startt1 + dy * extra->dt1dy + dx * extra->dt1dx;
+	}
+
+	/* loop in X */
+	for (x = startx; x < stopx; x++) {
+		rgb_union iterargb = { 0 };
+		rgb_union texel = { 0 };
+
+		/* pixel pipeline part 1 handles depth testing and stippling */
+		PIXEL_PIPELINE_BEGIN(v, stats, x, y, fbzcolorpath, fbzmode,
+				iterz, iterw)
+			;
+
+			/* run the texture pipeline on TMU1 to produce a value in texel */
+			/* note that they set LOD min to 8 to "disable" a TMU */
+			if (tmus >= 2 && v->tmu[1].lodmin < (8 << 8))
+				TEXTURE_PIPELINE(&v->tmu[1], x, dither4, texmode1, texel,
+						v->tmu[1].lookup, extra->lodbase1, iters1, itert1,
+						iterw1, texel);
+
+			/* run the texture pipeline on TMU0 to produce a final */
+			/* result in texel */
+			/* note that they set LOD min to 8 to "disable" a TMU */
+			if (tmus >= 1 && v->tmu[0].lodmin < (8 << 8)) {
+				if (v->send_config == 0)
+					TEXTURE_PIPELINE(&v->tmu[0], x, dither4, texmode0, texel,
+							v->tmu[0].lookup, extra->lodbase0, iters0, itert0,
+							iterw0, texel);
+				/* send config data to the frame buffer */
+				else
+					texel.u = v->tmu_config;
+			}
+			/* colorpath pipeline selects source colors and does blending */
+#if VOODOO_USE_SSE2
+			CLAMPED_ARGB_SSE2(iterargb4, fbzcolorpath, iterargb);
+#else
+			CLAMPED_ARGB(iterr, iterg, iterb, itera, fbzcolorpath, iterargb);
+#endif
+			COLORPATH_PIPELINE(v, stats, fbzcolorpath, fbzmode, alphamode,
+					texel, iterz, iterw, iterargb);
+
+			/* pixel pipeline part 2 handles fog, alpha, and final output */
+			PIXEL_PIPELINE_END(v, stats, dither, dither4, dither_lookup, x,
+					dest, depth, fbzmode, fbzcolorpath, alphamode, fogmode,
+					iterz, iterw, iterargb);
+
+		/* update the iterated parameters */
+#if VOODOO_USE_SSE2
+		iterargb4 = _mm_add_epi32(iterargb4, dargbdx4);
+#else
+		iterr += extra->drdx;
+		iterg += extra->dgdx;
+		iterb += extra->dbdx;
+		itera += extra->dadx;
+#endif
+		iterz += extra->dzdx;
+		iterw += extra->dwdx;
+		if (tmus >= 1) {
+			iterw0 += extra->dw0dx;
+			iters0 += extra->ds0dx;
+			itert0 += extra->dt0dx;
+		}
+		if (tmus >= 2) {
+			iterw1 += extra->dw1dx;
+			iters1 += extra->ds1dx;
+			itert1 += extra->dt1dx;
+		}
+	}
+}
+
+
+/*************************************
+ *
+ *  Triangle stream capture format
+ *
+ *************************************/
+
+/*
+    A capture file starts with a raster_capture_header, followed by chunks.
+    Each chunk has a raster_capture_chunk header and 'size' bytes of data.
+    The frame buffer RAM and the texture RAM are stored when the capture
+    starts; the texture RAM again after a buffer swap if it was changed.
+    A texel lookup table is stored when the TMU switches to another table
+    or the palette contents changed. Writes to the frame buffer by the CPU
+    are not recorded. The file uses the host byte order.
+*/
+
+#define RASTER_CAPTURE_MAGIC    0x50414356 /* "VCAP" */
+#define RASTER_CAPTURE_VERSION  1
+
+enum {
+  RASTER_CAPTURE_FBI_RAM = 1, /* frame buffer RAM */
+  RASTER_CAPTURE_TMU_RAM,     /* Bit32u TMU index + texture RAM (none if shared) */
+  RASTER_CAPTURE_LOOKUP,      /* Bit32u TMU index + texel lookup table */
+  RASTER_CAPTURE_TRIANGLE     /* raster_capture_triangle + raster_capture_span[] */
+};
+
+/* the registers used by raster_function() */
+static const Bit16u raster_capture_reg[] = {
+  fbzColorPath, fbzMode, alphaMode, fogMode, clipLeftRight, clipLowYHighY,
+  stipple, zaColor, chromaKey, chromaRange, color0, color1, fogColor
+};
+
+#define RASTER_CAPTURE_REGS  (sizeof(raster_capture_reg) / sizeof(raster_capture_reg[0]))
+
+typedef struct
+{
+  Bit32u magic;
+  Bit32u version;
+  Bit32u fbi_ram_size;
+  Bit32u tmu_ram_size;
+} raster_capture_header;
+
+typedef struct
+{
+  Bit32u type;
+  Bit32u size;
+} raster_capture_chunk;
+
+typedef struct
+{
+  Bit32u texmode;
+  Bit32s lodmin, lodmax, lodbias;
+  Bit32u lodmask;
+  Bit32u lodoffset[9];
+  Bit32s detailmax, detailbias;
+  Bit32u detailscale;
+  Bit32u wmask, hmask;
+  Bit32u bilinear_mask;
+} raster_capture_tmu;
+
+typedef struct
+{
+  Bit32u texcount;
+  Bit32u destoffs;     /* offset of the draw buffer in frame buffer RAM */
+  Bit32u numscans;     /* number of raster_capture_span entries */
+  Bit32u reg[RASTER_CAPTURE_REGS];
+  Bit32u yorigin;
+  Bit32u clip_mask;
+  Bit32u rowpixels;
+  Bit32u auxoffs;
+  Bit32u send_config;
+  Bit32u tmu_config;
+  Bit8u  fogblend[64];
+  Bit8u  fogdelta[64];
+  Bit32u fogdelta_mask;
+  raster_capture_tmu tmu[MAX_TMU];
+  poly_extra_data extra; /* the state pointer is not valid */
+} raster_capture_triangle;
+
+typedef struct
+{
+  Bit32s y;
+  Bit32s startx, stopx;
+} raster_capture_span;
@@ -4,6 +4,24 @@
 
 #include <math.h>
 
+/* the iterated ARGB channels are handled as one SSE2 vector if available */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOODOO_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define VOODOO_USE_SSE2 0
+#endif
+
+/* the span pipeline uses the GCC vector extensions, with SSE4.1 and AVX2 */
+/* versions of it selected by the host CPU features at runtime */
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    ((defined(__clang__) && (__clang_major__ >= 10)) || \
+     (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ >= 9)))
+#define VOODOO_USE_SIMD 1
+#else
+#define VOODOO_USE_SIMD 0
+#endif
+
 /***************************************************************************
     TYPE DEFINITIONS
 ***************************************************************************/
@@ -29,6 +29,8 @@
 #include "dma.h"
 
 #define LOG_THIS theDmaDevice->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 enum {
   DMA_MODE_DEMAND = 0,
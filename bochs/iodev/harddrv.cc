@@ -146,6 +146,10 @@ bx_hard_drive_c::~bx_hard_drive_c()
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
     for (Bit8u device=0; device<2; device ++) {
       if (channels[channel].drives[device].hdimage != NULL) {
+        if (channels[channel].drives[device].hdimage->aio != NULL) {
+          delete channels[channel].drives[device].hdimage->aio;
+          channels[channel].drives[device].hdimage->aio = NULL;
+        }
         channels[channel].drives[device].hdimage->close();
         delete channels[channel].drives[device].hdimage;
         channels[channel].drives[device].hdimage = NULL;
@@ -364,6 +368,11 @@ void bx_hard_drive_c::init(void)
         BX_HD_THIS channels[channel].drives[device].controller.buffer_total_size =
           MAX_MULTIPLE_SECTORS * sect_size;
         BX_HD_THIS channels[channel].drives[device].sect_size = sect_size;
+        if (SIM->get_param_bool("async", base)->get()) {
+          BX_HD_THIS channels[channel].drives[device].hdimage->aio =
+            new aio_queue_t(BX_HD_THIS channels[channel].drives[device].hdimage);
+          BX_INFO(("ata%d-%d: DMA transfers use asynchronous I/O", channel, device));
+        }
       } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
         bx_list_c *cdrom_rt = (bx_list_c*)SIM->get_param(BXPN_MENU_RUNTIME_CDROM);
         sprintf(pname, "cdrom%d", BX_HD_THIS cdrom_count + 1);
@@ -571,6 +580,9 @@ void bx_hard_drive_c::reset(unsigned type)
   for (unsigned channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
     if (BX_HD_THIS channels[channel].irq)
       DEV_pic_lower_irq(BX_HD_THIS channels[channel].irq);
+    for (Bit8u device=0; device<2; device++) {
+      ide_cancel_io(channel, device);
+    }
   }
 }
 
@@ -2636,6 +2648,8 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 
           BX_CONTROLLER(channel,id).control.disable_irq = 0;
           DEV_pic_lower_irq(BX_HD_THIS channels[channel].irq);
+
+          ide_cancel_io(channel, id);
         }
       } else if (controller->reset_in_progress &&
                 !controller->control.reset) {
@@ -3319,6 +3333,7 @@ void bx_hard_drive_c::command_aborted(Bit8u channel, unsigned value)
   controller->status.drq = 0;
   controller->status.corrected_data = 0;
   controller->buffer_index = 0;
+  ide_cancel_io(channel, BX_SLAVE_SELECTED(channel));
   raise_interrupt(channel);
 }
 
@@ -3383,15 +3398,24 @@ bool bx_hard_drive_c::bmdma_present(void)
 }
 
 #if BX_SUPPORT_PCI
+// On entry *sector_size is the number of bytes the PRD still needs. Disk
+// sectors are transferred as one multi-sector run of up to that size
+// (at least one sector), the size transferred is returned in *sector_size.
 bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size)
 {
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
 
   if ((controller->current_command == 0xC8) ||
       (controller->current_command == 0x25)) {
-    *sector_size = BX_SELECTED_DRIVE(channel).hdimage->sect_size;
+    Bit32u sect_size = BX_SELECTED_DRIVE(channel).hdimage->sect_size;
+    Bit32u count = *sector_size / sect_size;
+    *sector_size = sect_size;
     if (controller->num_sectors == 0)
       return 0;
+    if (count > controller->num_sectors)
+      count = controller->num_sectors;
+    if (count > 1)
+      *sector_size = count * sect_size;
     if (!ide_read_sector(channel, buffer, *sector_size)) {
       return 0;
     }
@@ -3443,7 +3467,13 @@ bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *se
   return 1;
 }
 
-bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer)
+// On entry *sector_size is the number of buffered bytes. All complete
+// sectors (up to the end of the command) are written as one multi-sector
+// run, the size written is returned in *sector_size.
+// Returns 1 if sectors have been written, 0 if less than one sector is
+// buffered (the data of the next PRD is required) and -1 if the command
+// has no more sectors to transfer or has been aborted.
+int bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size)
 {
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
 
@@ -3451,16 +3481,53 @@ bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer)
       (controller->current_command != 0x35)) {
     BX_ERROR(("DMA write not active"));
     command_aborted(channel, controller->current_command);
-    return 0;
+    return -1;
   }
   if (controller->num_sectors == 0)
+    return -1;
+  Bit32u sect_size = BX_SELECTED_DRIVE(channel).sect_size;
+  Bit32u count = *sector_size / sect_size;
+  if (count == 0)
     return 0;
-  if (!ide_write_sector(channel, buffer, BX_SELECTED_DRIVE(channel).sect_size)) {
-    return 0;
+  if (count > controller->num_sectors)
+    count = controller->num_sectors;
+  *sector_size = count * sect_size;
+  if (!ide_write_sector(channel, buffer, *sector_size)) {
+    return -1;
   }
   return 1;
 }
 
+// Returns the state of the disk I/O of the current BM-DMA step:
+// 1 = still in flight, 0 = done (always if the I/O is synchronous),
+// -1 = failed and the command has been aborted.
+int bx_hard_drive_c::bmdma_io_status(Bit8u channel, bool wait)
+{
+  if (!BX_SELECTED_IS_HD(channel)) {
+    return 0;
+  }
+  aio_queue_t *aio = BX_SELECTED_DRIVE(channel).hdimage->aio;
+  if (aio == NULL) {
+    return 0;
+  }
+  if (!aio->busy()) {
+    // start the disk I/O queued by the preceding bmdma_read_sector() or
+    // bmdma_write_sector() calls
+    aio->submit();
+  }
+  if (wait) {
+    aio->drain();
+  } else if (aio->busy()) {
+    return 1;
+  }
+  if (!aio->result()) {
+    BX_ERROR(("ata%d-%d: asynchronous disk I/O failed", channel, BX_SLAVE_SELECTED(channel)));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return -1;
+  }
+  return 0;
+}
+
 void bx_hard_drive_c::bmdma_complete(Bit8u channel)
 {
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
@@ -3504,35 +3571,42 @@ bool bx_hard_drive_c::ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u buffe
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
 
   Bit64s logical_sector = 0;
-  Bit64s ret;
+  Bit64s run_start = 0;
+  Bit32u run_len = 0;
 
   unsigned sect_size = BX_SELECTED_DRIVE(channel).sect_size;
   int sector_count = (buffer_size / sect_size);
-  Bit8u *bufptr = buffer;
+  Bit8u *bufptr = buffer, *run_ptr = buffer;
+  // collect runs of contiguous sectors and transfer each run at once
   do {
     if (!calculate_logical_address(channel, &logical_sector)) {
+      if (run_len > 0) {
+        ide_read_range(channel, run_start, run_ptr, run_len);
+      }
       command_aborted(channel, controller->current_command);
       return 0;
     }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file"));
-      command_aborted(channel, controller->current_command);
-      return 0;
+    if ((run_len > 0) && (logical_sector != (run_start + (run_len / sect_size)))) {
+      if (!ide_read_range(channel, run_start, run_ptr, run_len)) {
+        command_aborted(channel, controller->current_command);
+        return 0;
+      }
+      run_len = 0;
     }
-    /* set status bar conditions for device */
-    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)bufptr, sect_size);
-    if (ret < sect_size) {
-      BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
+    if (run_len == 0) {
+      run_start = logical_sector;
+      run_ptr = bufptr;
     }
+    run_len += sect_size;
     increment_address(channel, &logical_sector);
     BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
     bufptr += sect_size;
   } while (--sector_count > 0);
 
+  if (!ide_read_range(channel, run_start, run_ptr, run_len)) {
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
   return 1;
 }
 
@@ -3541,38 +3615,106 @@ bool bx_hard_drive_c::ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u buff
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
 
   Bit64s logical_sector = 0;
-  Bit64s ret;
+  Bit64s run_start = 0;
+  Bit32u run_len = 0;
 
   unsigned sect_size = BX_SELECTED_DRIVE(channel).sect_size;
   int sector_count = (buffer_size / sect_size);
-  Bit8u *bufptr = buffer;
+  Bit8u *bufptr = buffer, *run_ptr = buffer;
+  // collect runs of contiguous sectors and transfer each run at once
   do {
     if (!calculate_logical_address(channel, &logical_sector)) {
+      if (run_len > 0) {
+        ide_write_range(channel, run_start, run_ptr, run_len);
+      }
       command_aborted(channel, controller->current_command);
       return 0;
     }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
+    if ((run_len > 0) && (logical_sector != (run_start + (run_len / sect_size)))) {
+      if (!ide_write_range(channel, run_start, run_ptr, run_len)) {
+        command_aborted(channel, controller->current_command);
+        return 0;
+      }
+      run_len = 0;
     }
-    /* set status bar conditions for device */
-    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->write((bx_ptr_t)bufptr, sect_size);
-    if (ret < sect_size) {
-      BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
+    if (run_len == 0) {
+      run_start = logical_sector;
+      run_ptr = bufptr;
     }
+    run_len += sect_size;
     increment_address(channel, &logical_sector);
     BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
     bufptr += sect_size;
   } while (--sector_count > 0);
 
+  if (!ide_write_range(channel, run_start, run_ptr, run_len)) {
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  return 1;
+}
+
+bool bx_hard_drive_c::ide_read_range(Bit8u channel, Bit64s logical_sector, Bit8u *buffer, Bit32u len)
+{
+  Bit64s offset = logical_sector * BX_SELECTED_DRIVE(channel).sect_size;
+  Bit8u command = BX_SELECTED_CONTROLLER(channel).current_command;
+  aio_queue_t *aio = BX_SELECTED_DRIVE(channel).hdimage->aio;
+
+  /* set status bar conditions for device */
+  bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+  if (aio != NULL) {
+    if ((command == 0xC8) || (command == 0x25)) {
+      // READ DMA: completed by the I/O thread, see bmdma_io_status()
+      return aio->queue(0, offset, buffer, len);
+    }
+    aio->drain();
+  }
+  ssize_t ret = BX_SELECTED_DRIVE(channel).hdimage->read_at(offset, (bx_ptr_t)buffer, len);
+  if (ret < (ssize_t)len) {
+    BX_ERROR(("could not read() hard drive image file at byte " FMT_LL "d", offset));
+    return 0;
+  }
+  return 1;
+}
+
+bool bx_hard_drive_c::ide_write_range(Bit8u channel, Bit64s logical_sector, Bit8u *buffer, Bit32u len)
+{
+  Bit64s offset = logical_sector * BX_SELECTED_DRIVE(channel).sect_size;
+  Bit8u command = BX_SELECTED_CONTROLLER(channel).current_command;
+  aio_queue_t *aio = BX_SELECTED_DRIVE(channel).hdimage->aio;
+
+  /* set status bar conditions for device */
+  bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
+  if (aio != NULL) {
+    if ((command == 0xCA) || (command == 0x35)) {
+      // WRITE DMA: completed by the I/O thread, see bmdma_io_status()
+      return aio->queue(1, offset, buffer, len);
+    }
+    aio->drain();
+  }
+  ssize_t ret = BX_SELECTED_DRIVE(channel).hdimage->write_at(offset, (bx_ptr_t)buffer, len);
+  if (ret < (ssize_t)len) {
+    BX_ERROR(("could not write() hard drive image file at byte " FMT_LL "d", offset));
+    return 0;
+  }
   return 1;
 }
 
+// Drop the DMA transfers queued for the drive, but not submitted yet, when
+// the command is aborted or the drive is reset. Otherwise the next BM-DMA
+// command would submit them with stale offsets and buffer contents.
+void bx_hard_drive_c::ide_cancel_io(Bit8u channel, Bit8u device)
+{
+  if (!BX_DRIVE_IS_HD(channel, device) || (BX_DRIVE(channel, device).hdimage == NULL))
+    return;
+
+  aio_queue_t *aio = BX_DRIVE(channel, device).hdimage->aio;
+  if ((aio != NULL) && aio->queued()) {
+    BX_DEBUG(("ata%d-%d: dropping queued disk I/O", channel, device));
+    aio->cancel();
+  }
+}
+
 void bx_hard_drive_c::lba48_transform(controller_t *controller, bool lba48)
 {
   controller->lba48 = lba48;
@@ -172,7 +172,8 @@ public:
   virtual void     reset(unsigned type);
 #if BX_SUPPORT_PCI
   virtual bool     bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
-  virtual bool     bmdma_write_sector(Bit8u channel, Bit8u *buffer);
+  virtual int      bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
+  virtual int      bmdma_io_status(Bit8u channel, bool wait);
   virtual void     bmdma_complete(Bit8u channel);
 #endif
   virtual void     register_state(void);
@@ -218,6 +219,9 @@ private:
   BX_HD_SMF void set_signature(Bit8u channel, Bit8u id);
   BX_HD_SMF bool ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
   BX_HD_SMF bool ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
+  BX_HD_SMF bool ide_read_range(Bit8u channel, Bit64s logical_sector, Bit8u *buffer, Bit32u len);
+  BX_HD_SMF bool ide_write_range(Bit8u channel, Bit64s logical_sector, Bit8u *buffer, Bit32u len);
+  BX_HD_SMF void ide_cancel_io(Bit8u channel, Bit8u device);
   BX_HD_SMF void lba48_transform(controller_t *controller, bool lba48);
   BX_HD_SMF void start_seek(Bit8u channel);
 
@@ -490,7 +490,12 @@ Bit64s hdimage_save_handler(void *class_ptr, bx_param_c *param)
     return 0;
   }
   sprintf(path, "%s/%s", SIM->get_param_string(BXPN_RESTORE_PATH)->getptr(), imgname);
-  return ((device_image_t*)class_ptr)->save_state(path);
+  device_image_t *image = (device_image_t*)class_ptr;
+  if (image->aio != NULL) {
+    // the image and the DMA buffer must not change while saving
+    image->aio->drain();
+  }
+  return image->save_state(path);
 }
 
 void hdimage_restore_handler(void *class_ptr, bx_param_c *param, Bit64s value)
@@ -626,6 +631,9 @@ device_image_t::device_image_t()
   cylinders = 0;
   hd_size = 0;
   sect_size = 512;
+#ifndef BXIMAGE
+  aio = NULL;
+#endif
 }
 
 int device_image_t::open(const char* _pathname)
@@ -633,6 +641,22 @@ int device_image_t::open(const char* _pathname)
   return open(_pathname, O_RDWR);
 }
 
+ssize_t device_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+  if (lseek(offset, SEEK_SET) < 0) {
+    return -1;
+  }
+  return read(buf, count);
+}
+
+ssize_t device_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+  if (lseek(offset, SEEK_SET) < 0) {
+    return -1;
+  }
+  return write(buf, count);
+}
+
 Bit32u device_image_t::get_capabilities()
 {
   return (cylinders == 0) ? HDIMAGE_AUTO_GEOMETRY : 0;
@@ -649,6 +673,145 @@ void device_image_t::register_state(bx_list_c *parent)
   bx_param_bool_c *image = new bx_param_bool_c(parent, "image", NULL, NULL, 0);
   image->set_sr_handlers(this, hdimage_save_handler, hdimage_restore_handler);
 }
+
+/*** aio_queue_t function definitions ***/
+
+BX_THREAD_FUNC(aio_thread, indata)
+{
+  ((aio_queue_t*)indata)->thread_loop();
+  BX_THREAD_EXIT;
+}
+
+aio_queue_t::aio_queue_t(device_image_t *_image)
+{
+  image = _image;
+  nreq = 0;
+  in_flight = 0;
+  failed = 0;
+  keep_alive = 1;
+  BX_INIT_MUTEX(mutex);
+  bx_create_sem(&start_sem);
+  bx_create_sem(&done_sem);
+  BX_THREAD_CREATE(aio_thread, this, thread_var);
+}
+
+aio_queue_t::~aio_queue_t()
+{
+  drain();
+  keep_alive = 0;
+  bx_set_sem(&start_sem);
+  BX_THREAD_JOIN(thread_var);
+  bx_destroy_sem(&start_sem);
+  bx_destroy_sem(&done_sem);
+  BX_FINI_MUTEX(mutex);
+}
+
+bool aio_queue_t::queue(bool write, Bit64s offset, Bit8u *buf, Bit32u count)
+{
+  bool ret = 1;
+
+  if (busy()) {
+    drain();
+  }
+  if (nreq > 0) {
+    unsigned last = nreq - 1;
+    if ((req[last].write == write) &&
+        ((req[last].offset + req[last].count) == offset) &&
+        ((req[last].buf + req[last].count) == buf)) {
+      req[last].count += count;
+      return 1;
+    }
+    if (nreq == AIO_MAX_REQUESTS) {
+      ret = run();
+    }
+  }
+  req[nreq].write = write;
+  req[nreq].offset = offset;
+  req[nreq].buf = buf;
+  req[nreq].count = count;
+  nreq++;
+  return ret;
+}
+
+bool aio_queue_t::queued(void)
+{
+  // while busy the request list belongs to the worker thread
+  return !busy() && (nreq > 0);
+}
+
+void aio_queue_t::cancel(void)
+{
+  if (queued()) {
+    nreq = 0;
+  }
+}
+
+void aio_queue_t::submit(void)
+{
+  if (nreq > 0) {
+    BX_LOCK(mutex);
+    in_flight = 1;
+    BX_UNLOCK(mutex);
+    bx_set_sem(&start_sem);
+  }
+}
+
+bool aio_queue_t::busy(void)
+{
+  BX_LOCK(mutex);
+  bool ret = in_flight;
+  BX_UNLOCK(mutex);
+  return ret;
+}
+
+void aio_queue_t::drain(void)
+{
+  while (busy()) {
+    bx_wait_sem(&done_sem);
+  }
+}
+
+bool aio_queue_t::result(void)
+{
+  BX_LOCK(mutex);
+  bool ret = !failed;
+  failed = 0;
+  BX_UNLOCK(mutex);
+  return ret;
+}
+
+void aio_queue_t::thread_loop(void)
+{
+  while (1) {
+    bx_wait_sem(&start_sem);
+    if (!keep_alive) break;
+    bool ok = run();
+    BX_LOCK(mutex);
+    if (!ok) failed = 1;
+    in_flight = 0;
+    BX_UNLOCK(mutex);
+    bx_set_sem(&done_sem);
+  }
+}
+
+bool aio_queue_t::run(void)
+{
+  ssize_t ret;
+  bool ok = 1;
+
+  for (unsigned i = 0; i < nreq; i++) {
+    if (req[i].write) {
+      ret = image->write_at(req[i].offset, req[i].buf, req[i].count);
+    } else {
+      ret = image->read_at(req[i].offset, req[i].buf, req[i].count);
+    }
+    if (ret < (ssize_t)req[i].count) {
+      ok = 0;
+    }
+  }
+  nreq = 0;
+  return ok;
+}
 #endif
 
 /*** flat_image_t function definitions ***/
@@ -689,6 +852,24 @@ ssize_t flat_image_t::write(const void* buf, size_t count)
   return ::write(fd, (char*) buf, count);
 }
 
+ssize_t flat_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+#if BX_HAVE_PREAD
+  return ::pread(fd, (char*) buf, count, (off_t)offset);
+#else
+  return bx_read_image(fd, offset, buf, (int)count);
+#endif
+}
+
+ssize_t flat_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+#if BX_HAVE_PWRITE
+  return ::pwrite(fd, (char*) buf, count, (off_t)offset);
+#else
+  return bx_write_image(fd, offset, (void*)buf, (int)count);
+#endif
+}
+
 int flat_image_t::check_format(int fd, Bit64u imgsize)
 {
   char buffer[512];
@@ -1625,22 +1806,36 @@ Bit64s dll_image_t::lseek(Bit64s offset, int whence)
 
 ssize_t dll_image_t::read(void* buf, size_t count)
 {
+  char *cbuf = (char*)buf;
+  size_t n = 0;
+
   if ((vunit >= 0) && (hlib_vdisk != NULL)) {
-    if (vdisk_read(vunit, vblk, buf)) {
+    while (n < count) {
+      if (!vdisk_read(vunit, vblk, cbuf))
+        return -1;
       vblk++;
-      return count;
+      cbuf += 512;
+      n += 512;
     }
+    return count;
   }
   return -1;
 }
 
 ssize_t dll_image_t::write(const void* buf, size_t count)
 {
+  char *cbuf = (char*)buf;
+  size_t n = 0;
+
   if ((vunit >= 0) && (hlib_vdisk != 0)) {
-    if (vdisk_write(vunit, vblk, buf)) {
+    while (n < count) {
+      if (!vdisk_write(vunit, vblk, cbuf))
+        return -1;
       vblk++;
-      return count;
+      cbuf += 512;
+      n += 512;
     }
+    return count;
   }
   return -1;
 }
@@ -2201,6 +2396,58 @@ Bit64s growing_image_t::lseek(Bit64s offset, int whence)
   return redolog->lseek(offset, whence);
 }
 
+// Positional multi-sector access to a redolog. The redolog position is set
+// for each sector, since a read of a sector not present in the redolog does
+// not advance it. The missing sectors are read from ro_disk in contiguous
+// runs or zero-filled if there is no base disk.
+static ssize_t redolog_read_at(redolog_t *redolog, device_image_t *ro_disk,
+                               Bit64s offset, void* buf, size_t count)
+{
+  char *cbuf = (char*)buf;
+  size_t n, run_start = 0, run_len = 0;
+  ssize_t ret;
+
+  for (n = 0; n <= count; n += 512) {
+    if (n < count) {
+      if (redolog->lseek(offset + n, SEEK_SET) < 0)
+        return -1;
+      ret = redolog->read(cbuf + n, 512);
+      if (ret < 0)
+        return -1;
+      if (ret != 512) {
+        if (run_len == 0)
+          run_start = n;
+        run_len += 512;
+        continue;
+      }
+    }
+    if (run_len > 0) {
+      if (ro_disk != NULL) {
+        if (ro_disk->read_at(offset + run_start, cbuf + run_start, run_len) < (ssize_t)run_len)
+          return -1;
+      } else {
+        memset(cbuf + run_start, 0, run_len);
+      }
+      run_len = 0;
+    }
+  }
+  return count;
+}
+
+static ssize_t redolog_write_at(redolog_t *redolog, Bit64s offset,
+                                const void* buf, size_t count)
+{
+  const char *cbuf = (const char*)buf;
+
+  for (size_t n = 0; n < count; n += 512) {
+    if (redolog->lseek(offset + n, SEEK_SET) < 0)
+      return -1;
+    if (redolog->write(cbuf + n, 512) < 0)
+      return -1;
+  }
+  return count;
+}
+
 ssize_t growing_image_t::read(void* buf, size_t count)
 {
   char *cbuf = (char*)buf;
@@ -2232,6 +2479,16 @@ ssize_t growing_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
+ssize_t growing_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+  return redolog_read_at(redolog, NULL, offset, buf, count);
+}
+
+ssize_t growing_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+  return redolog_write_at(redolog, offset, buf, count);
+}
+
 Bit32u growing_image_t::get_timestamp()
 {
   return redolog->get_timestamp();
@@ -2433,6 +2690,16 @@ ssize_t undoable_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
+ssize_t undoable_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+  return redolog_read_at(redolog, ro_disk, offset, buf, count);
+}
+
+ssize_t undoable_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+  return redolog_write_at(redolog, offset, buf, count);
+}
+
 #ifndef BXIMAGE
 bool undoable_image_t::save_state(const char *backup_fname)
 {
@@ -2607,6 +2874,16 @@ ssize_t volatile_image_t::write(const void* buf, size_t count)
   return (ret < 0) ? ret : count;
 }
 
+ssize_t volatile_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+  return redolog_read_at(redolog, ro_disk, offset, buf, count);
+}
+
+ssize_t volatile_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+  return redolog_write_at(redolog, offset, buf, count);
+}
+
 #ifndef BXIMAGE
 bool volatile_image_t::save_state(const char *backup_fname)
 {
@@ -141,6 +141,9 @@
 class device_image_t;
 class redolog_t;
 class cdrom_base_c;
+#ifndef BXIMAGE
+class aio_queue_t;
+#endif
 
 #ifdef BXIMAGE
 int bx_create_image_file(const char *filename);
@@ -192,6 +195,16 @@ class BOCHSAPI_MSVCONLY device_image_t
       // written (count).
       virtual ssize_t write(const void* buf, size_t count) = 0;
 
+      // Read count bytes starting at the byte offset to the buffer buf.
+      // Used for multi-sector transfers. Return the number of bytes
+      // read (count). The default implementation uses lseek() and read().
+      virtual ssize_t read_at(Bit64s offset, void* buf, size_t count);
+
+      // Write count bytes from buf starting at the byte offset. Return the
+      // number of bytes written (count). The default implementation uses
+      // lseek() and write().
+      virtual ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
       // Get image capabilities
       virtual Bit32u get_capabilities();
 
@@ -216,6 +229,9 @@ class BOCHSAPI_MSVCONLY device_image_t
       unsigned spt;
       unsigned sect_size;
       Bit64u   hd_size;
+#ifndef BXIMAGE
+      aio_queue_t *aio; // asynchronous I/O queue (set by the device model)
+#endif
   protected:
 #ifndef WIN32
       time_t mtime;
@@ -246,6 +262,10 @@ class flat_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Positional multi-sector read / write
+      ssize_t read_at(Bit64s offset, void* buf, size_t count);
+      ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
       // Check image format
       static int check_format(int fd, Bit64u imgsize);
 
@@ -502,6 +522,10 @@ class growing_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Positional multi-sector read / write
+      ssize_t read_at(Bit64s offset, void* buf, size_t count);
+      ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
       // Get modification time in FAT format
       virtual Bit32u get_timestamp();
 
@@ -548,6 +572,10 @@ class undoable_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Positional multi-sector read / write
+      ssize_t read_at(Bit64s offset, void* buf, size_t count);
+      ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
       // Get image capabilities
       virtual Bit32u get_capabilities() {return caps;}
 
@@ -591,6 +619,10 @@ class volatile_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Positional multi-sector read / write
+      ssize_t read_at(Bit64s offset, void* buf, size_t count);
+      ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
       // Get image capabilities
       virtual Bit32u get_capabilities() {return caps;}
 
@@ -611,6 +643,65 @@ class volatile_image_t : public device_image_t
 
 #ifndef BXIMAGE
 
+#include "bxthread.h"
+
+#define AIO_MAX_REQUESTS 16
+
+// Asynchronous I/O queue of one disk image. The device model queues the
+// positional reads / writes of a DMA transfer and submits them at once, a host
+// worker thread executes them in order while the emulation continues.
+class BOCHSAPI_MSVCONLY aio_queue_t
+{
+  public:
+      aio_queue_t(device_image_t *_image);
+      virtual ~aio_queue_t();
+
+      // Queue a read or write of count bytes at the byte offset. Contiguous
+      // requests are merged. If the queue is full, the queued requests are
+      // executed directly. Returns 0 if that failed.
+      bool queue(bool write, Bit64s offset, Bit8u *buf, Bit32u count);
+
+      // Returns 1 if requests are queued, but not submitted yet
+      bool queued(void);
+
+      // Drop the requests queued, but not submitted yet
+      void cancel(void);
+
+      // Execute the queued requests on the worker thread
+      void submit(void);
+
+      // Returns 1 while the submitted requests are in flight
+      bool busy(void);
+
+      // Wait until the submitted requests are done
+      void drain(void);
+
+      // Returns 0 if a request failed since the last call
+      bool result(void);
+
+      // Worker thread main loop
+      void thread_loop(void);
+
+  private:
+      bool run(void);
+
+      struct {
+        bool   write;
+        Bit64s offset;
+        Bit8u  *buf;
+        Bit32u count;
+      } req[AIO_MAX_REQUESTS];
+      unsigned nreq;
+      device_image_t *image;
+      bool in_flight;
+      bool failed;
+      bool keep_alive;
+      BX_THREAD_VAR(thread_var);
+      BX_MUTEX(mutex);
+      bx_thread_sem_t start_sem;
+      bx_thread_sem_t done_sem;
+};
+
 #define DEV_hdimage_init_image(a,b,c) bx_hdimage_ctl.init_image(a,b,c)
 #define DEV_hdimage_init_cdrom(a)     bx_hdimage_ctl.init_cdrom(a)
 
@@ -0,0 +1,839 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+// QEMU copy-on-write image format version 2 and 3 (qcow2)
+//
+// The guest disk is split into clusters. The L1 table (kept in memory) points
+// to L2 tables holding the image file offsets of the clusters. The most
+// recently used L2 tables and refcount blocks are cached, so a lookup usually
+// needs no metadata read. Unallocated clusters are read from the backing file
+// (or return zeros). New clusters and L2 tables are appended to the image file
+// and the metadata is updated write-through. Shared clusters of internal
+// snapshots are copied on write. Compressed and encrypted images are not
+// supported.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#ifdef BXIMAGE
+#include "config.h"
+#include "misc/bxcompat.h"
+#include "osdep.h"
+#include "misc/bswap.h"
+#else
+#include "bochs.h"
+#include "plugin.h"
+#endif
+#include "hdimage.h"
+#include "qcow2.h"
+
+#define LOG_THIS bx_hdimage_ctl.
+
+// be*() : convert between disk (big) and host endianness
+#if defined (BX_LITTLE_ENDIAN)
+#define be16(val) bx_bswap16(val)
+#define be32(val) bx_bswap32(val)
+#define be64(val) bx_bswap64(val)
+#else
+#define be16(val) (val)
+#define be32(val) (val)
+#define be64(val) (val)
+#endif
+
+#ifndef BXIMAGE
+
+// disk image plugin entry point
+
+PLUGIN_ENTRY_FOR_IMG_MODULE(qcow2)
+{
+  if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_IMG;
+  }
+  return 0; // Success
+}
+
+#endif
+
+//
+// Define the static class that registers the derived device image class,
+// and allocates one on request.
+//
+class bx_qcow2_locator_c : public hdimage_locator_c {
+public:
+  bx_qcow2_locator_c(void) : hdimage_locator_c("qcow2") {}
+protected:
+  device_image_t *allocate(Bit64u disk_size, const char *journal) {
+    return (new qcow2_image_t());
+  }
+  int check_format(int fd, Bit64u disk_size) {
+    return (qcow2_image_t::check_format(fd, disk_size));
+  }
+} bx_qcow2_match;
+
+qcow2_image_t::qcow2_image_t()
+{
+  fd = -1;
+  pathname = NULL;
+  backing = NULL;
+  backing_path = NULL;
+  depth = 0;
+  l1_table = NULL;
+  rc_table = NULL;
+  cluster_buf = NULL;
+  for (int i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+    l2_cache[i].table = NULL;
+  }
+  for (int i = 0; i < QCOW2_RC_CACHE_SIZE; i++) {
+    rc_cache[i].block = NULL;
+  }
+}
+
+qcow2_image_t::~qcow2_image_t()
+{
+  close();
+}
+
+int qcow2_image_t::check_format(int fd, Bit64u imgsize)
+{
+  qcow2_header_t header;
+
+  if (bx_read_image(fd, 0, &header, QCOW2_HEADER_V2_SIZE) != QCOW2_HEADER_V2_SIZE) {
+    return HDIMAGE_READ_ERROR;
+  }
+  if (be32(header.magic) != QCOW2_MAGIC) {
+    return HDIMAGE_NO_SIGNATURE;
+  }
+  if ((be32(header.version) != 2) && (be32(header.version) != 3)) {
+    return HDIMAGE_VERSION_ERROR;
+  }
+  return HDIMAGE_FORMAT_OK;
+}
+
+int qcow2_image_t::open(const char* _pathname, int flags)
+{
+  qcow2_header_t header;
+  Bit64u imgsize = 0, l2_coverage, features = 0, rc_table_bytes;
+  Bit32u i;
+
+  close();
+  pathname = _pathname;
+  if ((fd = hdimage_open_file(pathname, flags, &imgsize, &mtime)) < 0) {
+    BX_ERROR(("QCOW2: cannot open hdimage file '%s'", pathname));
+    return -1;
+  }
+  switch (check_format(fd, imgsize)) {
+    case HDIMAGE_READ_ERROR:
+      BX_ERROR(("QCOW2: cannot read image file header of '%s'", pathname));
+      close();
+      return -1;
+    case HDIMAGE_NO_SIGNATURE:
+      BX_ERROR(("QCOW2: signature missed in file '%s'", pathname));
+      close();
+      return -1;
+    case HDIMAGE_VERSION_ERROR:
+      BX_ERROR(("QCOW2: unsupported version in file '%s'", pathname));
+      close();
+      return -1;
+  }
+  memset(&header, 0, sizeof(header));
+  version = 2;
+  read_only = ((flags & O_ACCMODE) == O_RDONLY);
+  bx_read_image(fd, 0, &header, QCOW2_HEADER_V2_SIZE);
+  if (be32(header.version) == 3) {
+    if (bx_read_image(fd, 0, &header, QCOW2_HEADER_V3_SIZE) != QCOW2_HEADER_V3_SIZE) {
+      BX_ERROR(("QCOW2: cannot read image file header of '%s'", pathname));
+      close();
+      return -1;
+    }
+    version = 3;
+    features = be64(header.incompatible_features);
+    if ((features & QCOW2_INCOMPAT_DIRTY) && !read_only) {
+      // the refcounts may be stale, allocating clusters could corrupt the image
+      BX_ERROR(("QCOW2: refcounts of '%s' marked dirty, repair it with 'qemu-img check -r all'", pathname));
+      close();
+      return -1;
+    }
+    if (features & ~(QCOW2_INCOMPAT_SUPPORTED | QCOW2_INCOMPAT_DIRTY)) {
+      BX_ERROR(("QCOW2: unsupported features 0x" FMT_LL "x in '%s'",
+                features & ~(QCOW2_INCOMPAT_SUPPORTED | QCOW2_INCOMPAT_DIRTY), pathname));
+      close();
+      return -1;
+    }
+    if (be32(header.refcount_order) != 4) {
+      BX_ERROR(("QCOW2: only 16-bit refcounts supported ('%s')", pathname));
+      close();
+      return -1;
+    }
+  }
+  cluster_bits = be32(header.cluster_bits);
+  if ((cluster_bits < QCOW2_MIN_CLUSTER_BITS) || (cluster_bits > QCOW2_MAX_CLUSTER_BITS)) {
+    BX_ERROR(("QCOW2: invalid cluster size in '%s'", pathname));
+    close();
+    return -1;
+  }
+  if (header.crypt_method != 0) {
+    BX_ERROR(("QCOW2: encrypted images not supported ('%s')", pathname));
+    close();
+    return -1;
+  }
+  cluster_size = 1 << cluster_bits;
+  l2_bits = cluster_bits - 3;
+  l2_size = 1 << l2_bits;
+  rc_bits = cluster_bits - 1;
+  hd_size = be64(header.size);
+  sect_size = 512;
+
+  // the L1 table has to cover the whole disk
+  l1_size = be32(header.l1_size);
+  l1_table_offset = be64(header.l1_table_offset);
+  l2_coverage = (Bit64u)cluster_size << l2_bits;
+  if ((Bit64u)l1_size * 8 > QCOW2_MAX_L1_SIZE) {
+    BX_ERROR(("QCOW2: L1 table too large in '%s'", pathname));
+    close();
+    return -1;
+  }
+  if ((Bit64u)l1_size * l2_coverage < hd_size) {
+    BX_ERROR(("QCOW2: L1 table too small in '%s'", pathname));
+    close();
+    return -1;
+  }
+  l1_table = new Bit64u[l1_size + 1];
+  if (bx_read_image(fd, l1_table_offset, l1_table, (int)(l1_size * 8)) != (int)(l1_size * 8)) {
+    BX_ERROR(("QCOW2: cannot read L1 table of '%s'", pathname));
+    close();
+    return -1;
+  }
+  for (i = 0; i < l1_size; i++) {
+    l1_table[i] = be64(l1_table[i]);
+  }
+  rc_table_offset = be64(header.refcount_table_offset);
+  rc_table_bytes = (Bit64u)be32(header.refcount_table_clusters) << cluster_bits;
+  if ((rc_table_bytes == 0) || (rc_table_bytes > QCOW2_MAX_REFTABLE_SIZE)) {
+    BX_ERROR(("QCOW2: invalid refcount table size in '%s'", pathname));
+    close();
+    return -1;
+  }
+  rc_table_size = (Bit32u)(rc_table_bytes / 8);
+  rc_table = new Bit64u[rc_table_size + 1];
+  if (bx_read_image(fd, rc_table_offset, rc_table, (int)rc_table_bytes) != (int)rc_table_bytes) {
+    BX_ERROR(("QCOW2: cannot read refcount table of '%s'", pathname));
+    close();
+    return -1;
+  }
+  for (i = 0; i < rc_table_size; i++) {
+    rc_table[i] = be64(rc_table[i]);
+  }
+  if (features & QCOW2_INCOMPAT_DIRTY) {
+    BX_INFO(("QCOW2: refcounts of '%s' marked dirty, opened read-only", pathname));
+  }
+
+  // new clusters are always appended to the image file
+  next_free = (imgsize + cluster_size - 1) & ~(Bit64u)(cluster_size - 1);
+  cluster_buf = new Bit8u[cluster_size];
+  lru_counter = 0;
+  for (i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+    l2_cache[i].offset = 0;
+    l2_cache[i].lru = 0;
+  }
+  for (i = 0; i < QCOW2_RC_CACHE_SIZE; i++) {
+    rc_cache[i].offset = 0;
+    rc_cache[i].lru = 0;
+  }
+  cur_offset = 0;
+
+  if (header.backing_file_offset != 0) {
+    if (open_backing_file(be64(header.backing_file_offset), be32(header.backing_file_size)) < 0) {
+      close();
+      return -1;
+    }
+  }
+
+  BX_INFO(("'qcow2' disk image opened: path is '%s', version %d, cluster size %d",
+           pathname, version, cluster_size));
+  return 0;
+}
+
+int qcow2_image_t::open_backing_file(Bit64u name_offset, Bit32u name_size)
+{
+  char name[QCOW2_MAX_BACKING_NAME + 1], *path;
+  const char *image_mode = NULL, *sep;
+  size_t dirlen = 0;
+
+  if (depth >= QCOW2_MAX_BACKING_DEPTH) {
+    BX_ERROR(("QCOW2: backing file chain too long"));
+    return -1;
+  }
+  if ((name_size == 0) || (name_size > QCOW2_MAX_BACKING_NAME)) {
+    BX_ERROR(("QCOW2: invalid backing file name in '%s'", pathname));
+    return -1;
+  }
+  if (bx_read_image(fd, name_offset, name, name_size) != (int)name_size) {
+    BX_ERROR(("QCOW2: cannot read backing file name of '%s'", pathname));
+    return -1;
+  }
+  name[name_size] = 0;
+  // a relative name is relative to the directory of this image
+  sep = strrchr(pathname, '/');
+#ifdef WIN32
+  const char *sep2 = strrchr(pathname, '\\');
+  if ((sep == NULL) || ((sep2 != NULL) && (sep2 > sep))) sep = sep2;
+  if ((name[0] != '/') && (name[0] != '\\') && (name[1] != ':') && (sep != NULL)) {
+#else
+  if ((name[0] != '/') && (sep != NULL)) {
+#endif
+    dirlen = sep - pathname + 1;
+  }
+  path = new char[dirlen + name_size + 1];
+  memcpy(path, pathname, dirlen);
+  strcpy(path + dirlen, name);
+
+  if (!hdimage_detect_image_mode(path, &image_mode)) {
+    BX_ERROR(("QCOW2: cannot detect format of backing file '%s'", path));
+    delete [] path;
+    return -1;
+  }
+  if (!strcmp(image_mode, "qcow2")) {
+    qcow2_image_t *parent = new qcow2_image_t();
+    parent->depth = depth + 1;
+    backing = parent;
+  } else {
+    backing = DEV_hdimage_init_image(image_mode, 0, NULL);
+  }
+  if (backing == NULL) {
+    BX_ERROR(("QCOW2: backing file mode '%s' not supported", image_mode));
+    delete [] path;
+    return -1;
+  }
+  // the backing file object keeps the pointer to its name
+  if (backing->open(path, O_RDONLY) < 0) {
+    BX_ERROR(("QCOW2: cannot open backing file '%s'", path));
+    delete backing;
+    backing = NULL;
+    delete [] path;
+    return -1;
+  }
+  backing_path = path;
+  BX_INFO(("QCOW2: backing file is '%s' ('%s' mode)", path, image_mode));
+  return 0;
+}
+
+void qcow2_image_t::close()
+{
+  int i;
+
+  if (backing != NULL) {
+    backing->close();
+    delete backing;
+    backing = NULL;
+    delete [] backing_path;
+    backing_path = NULL;
+  }
+  for (i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+    delete [] l2_cache[i].table;
+    l2_cache[i].table = NULL;
+  }
+  for (i = 0; i < QCOW2_RC_CACHE_SIZE; i++) {
+    delete [] rc_cache[i].block;
+    rc_cache[i].block = NULL;
+  }
+  delete [] l1_table;
+  l1_table = NULL;
+  delete [] rc_table;
+  rc_table = NULL;
+  delete [] cluster_buf;
+  cluster_buf = NULL;
+  if (fd > -1) {
+    bx_close_image(fd, pathname);
+    fd = -1;
+  }
+}
+
+// Returns the cached L2 table at the image file offset. The least recently
+// used table is replaced, it is read from the image file or zeroed.
+Bit64u* qcow2_image_t::get_l2_table(Bit64u l2_offset, bool read)
+{
+  int i, victim = 0;
+
+  for (i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+    if ((l2_cache[i].offset == l2_offset) && (l2_cache[i].table != NULL)) {
+      l2_cache[i].lru = ++lru_counter;
+      return l2_cache[i].table;
+    }
+    if (l2_cache[i].lru < l2_cache[victim].lru) {
+      victim = i;
+    }
+  }
+  if (l2_cache[victim].table == NULL) {
+    l2_cache[victim].table = new Bit64u[l2_size];
+  }
+  l2_cache[victim].offset = 0;
+  if (read) {
+    if (bx_read_image(fd, l2_offset, l2_cache[victim].table, cluster_size) != (int)cluster_size) {
+      BX_ERROR(("QCOW2: cannot read L2 table at 0x" FMT_LL "x", l2_offset));
+      return NULL;
+    }
+  } else {
+    memset(l2_cache[victim].table, 0, cluster_size);
+  }
+  l2_cache[victim].offset = l2_offset;
+  l2_cache[victim].lru = ++lru_counter;
+  return l2_cache[victim].table;
+}
+
+// Same for the refcount blocks
+Bit16u* qcow2_image_t::get_refcount_block(Bit64u block_offset, bool read)
+{
+  int i, victim = 0;
+
+  for (i = 0; i < QCOW2_RC_CACHE_SIZE; i++) {
+    if ((rc_cache[i].offset == block_offset) && (rc_cache[i].block != NULL)) {
+      rc_cache[i].lru = ++lru_counter;
+      return rc_cache[i].block;
+    }
+    if (rc_cache[i].lru < rc_cache[victim].lru) {
+      victim = i;
+    }
+  }
+  if (rc_cache[victim].block == NULL) {
+    rc_cache[victim].block = new Bit16u[cluster_size / 2];
+  }
+  rc_cache[victim].offset = 0;
+  if (read) {
+    if (bx_read_image(fd, block_offset, rc_cache[victim].block, cluster_size) != (int)cluster_size) {
+      BX_ERROR(("QCOW2: cannot read refcount block at 0x" FMT_LL "x", block_offset));
+      return NULL;
+    }
+  } else {
+    memset(rc_cache[victim].block, 0, cluster_size);
+  }
+  rc_cache[victim].offset = block_offset;
+  rc_cache[victim].lru = ++lru_counter;
+  return rc_cache[victim].block;
+}
+
+int qcow2_image_t::update_refcount(Bit64u offset, int delta)
+{
+  Bit64u cluster = offset >> cluster_bits;
+  Bit64u index = cluster >> rc_bits;
+  Bit32u block_index = (Bit32u)cluster & ((1 << rc_bits) - 1);
+  Bit64u block_offset, entry;
+  Bit16u *block;
+  Bit32s refcount;
+
+  if (index >= rc_table_size) {
+    BX_ERROR(("QCOW2: refcount table of '%s' full", pathname));
+    return -1;
+  }
+  if (rc_table[index] == 0) {
+    if (delta < 0) {
+      return 0;
+    }
+    // add a refcount block, it may describe its own cluster
+    block_offset = next_free;
+    next_free += cluster_size;
+    block = get_refcount_block(block_offset, 0);
+    if (bx_write_image(fd, block_offset, block, cluster_size) != (int)cluster_size) {
+      return -1;
+    }
+    rc_table[index] = block_offset;
+    entry = be64(block_offset);
+    if (bx_write_image(fd, rc_table_offset + index * 8, &entry, 8) != 8) {
+      return -1;
+    }
+    if (update_refcount(block_offset, 1) < 0) {
+      return -1;
+    }
+  }
+  block_offset = rc_table[index] & QCOW2_OFFSET_MASK;
+  block = get_refcount_block(block_offset, 1);
+  if (block == NULL) {
+    return -1;
+  }
+  refcount = be16(block[block_index]) + delta;
+  if ((refcount < 0) || (refcount > 0xffff)) {
+    BX_ERROR(("QCOW2: refcount overflow at 0x" FMT_LL "x", offset));
+    return -1;
+  }
+  block[block_index] = be16((Bit16u)refcount);
+  if (bx_write_image(fd, block_offset + block_index * 2, &block[block_index], 2) != 2) {
+    return -1;
+  }
+  return 0;
+}
+
+Bit64s qcow2_image_t::alloc_cluster(void)
+{
+  Bit64u offset = next_free;
+
+  next_free += cluster_size;
+  if (update_refcount(offset, 1) < 0) {
+    return -1;
+  }
+  return (Bit64s)offset;
+}
+
+int qcow2_image_t::get_l2_entry(Bit64u offset, Bit64u *entry)
+{
+  Bit64u l1_index = offset >> (cluster_bits + l2_bits);
+  Bit64u l2_offset;
+  Bit64u *l2_table;
+
+  *entry = 0;
+  if (l1_index >= l1_size) {
+    return 0;
+  }
+  l2_offset = l1_table[l1_index] & QCOW2_OFFSET_MASK;
+  if (l2_offset == 0) {
+    return 0;
+  }
+  l2_table = get_l2_table(l2_offset, 1);
+  if (l2_table == NULL) {
+    return -1;
+  }
+  *entry = be64(l2_table[(offset >> cluster_bits) & (l2_size - 1)]);
+  if ((version < 3) && (*entry & QCOW2_OFLAG_ZERO)) {
+    *entry &= ~QCOW2_OFLAG_ZERO;
+  }
+  return 0;
+}
+
+int qcow2_image_t::set_l2_entry(Bit64u offset, Bit64u entry)
+{
+  Bit64u l1_index = offset >> (cluster_bits + l2_bits);
+  Bit32u l2_index = (Bit32u)(offset >> cluster_bits) & (l2_size - 1);
+  Bit64u l2_offset, old_l2_offset, value;
+  Bit64u *l2_table, *old_l2_table;
+  Bit64s new_l2_offset;
+
+  l2_offset = l1_table[l1_index] & QCOW2_OFFSET_MASK;
+  if ((l2_offset == 0) || !(l1_table[l1_index] & QCOW2_OFLAG_COPIED)) {
+    // allocate a new L2 table or copy a table shared with a snapshot
+    old_l2_offset = l2_offset;
+    old_l2_table = NULL;
+    if (old_l2_offset != 0) {
+      old_l2_table = get_l2_table(old_l2_offset, 1);
+      if (old_l2_table == NULL) {
+        return -1;
+      }
+    }
+    new_l2_offset = alloc_cluster();
+    if (new_l2_offset < 0) {
+      return -1;
+    }
+    l2_table = get_l2_table(new_l2_offset, 0);
+    if (old_l2_table != NULL) {
+      memcpy(l2_table, old_l2_table, cluster_size);
+    }
+    if (bx_write_image(fd, new_l2_offset, l2_table, cluster_size) != (int)cluster_size) {
+      return -1;
+    }
+    l2_offset = (Bit64u)new_l2_offset;
+    l1_table[l1_index] = l2_offset | QCOW2_OFLAG_COPIED;
+    value = be64(l1_table[l1_index]);
+    if (bx_write_image(fd, l1_table_offset + l1_index * 8, &value, 8) != 8) {
+      return -1;
+    }
+    if ((old_l2_offset != 0) && (update_refcount(old_l2_offset, -1) < 0)) {
+      return -1;
+    }
+  }
+  l2_table = get_l2_table(l2_offset, 1);
+  if (l2_table == NULL) {
+    return -1;
+  }
+  l2_table[l2_index] = be64(entry);
+  if (bx_write_image(fd, l2_offset + l2_index * 8, &l2_table[l2_index], 8) != 8) {
+    return -1;
+  }
+  return 0;
+}
+
+void qcow2_image_t::read_backing(Bit64u offset, Bit8u *buf, Bit32u count)
+{
+  Bit32u len = 0;
+
+  if ((backing != NULL) && (offset < backing->hd_size)) {
+    len = count;
+    if ((offset + len) > backing->hd_size) {
+      len = (Bit32u)(backing->hd_size - offset);
+    }
+    if (backing->read_at((Bit64s)offset, buf, len) != (ssize_t)len) {
+      BX_ERROR(("QCOW2: read from backing file failed"));
+      len = 0;
+    }
+  }
+  memset(buf + len, 0, count - len);
+}
+
+// Write to a cluster that is not allocated or shared: the new cluster gets
+// the previous contents around the written part.
+int qcow2_image_t::write_cluster(Bit64u offset, Bit64u entry, const Bit8u *buf, Bit32u count)
+{
+  Bit64u cluster_start = offset & ~(Bit64u)(cluster_size - 1);
+  Bit32u in_cluster = (Bit32u)(offset - cluster_start);
+  Bit64u old_offset = entry & QCOW2_OFFSET_MASK;
+  Bit64s new_offset;
+  const Bit8u *data = buf;
+
+  if (entry & QCOW2_OFLAG_COMPRESSED) {
+    BX_ERROR(("QCOW2: compressed clusters not supported"));
+    return -1;
+  }
+  if (count < cluster_size) {
+    if (entry & QCOW2_OFLAG_ZERO) {
+      memset(cluster_buf, 0, cluster_size);
+    } else if (old_offset != 0) {
+      if (bx_read_image(fd, old_offset, cluster_buf, cluster_size) != (int)cluster_size) {
+        return -1;
+      }
+    } else {
+      read_backing(cluster_start, cluster_buf, cluster_size);
+    }
+    memcpy(cluster_buf + in_cluster, buf, count);
+    data = cluster_buf;
+  }
+  if ((old_offset != 0) && (entry & QCOW2_OFLAG_COPIED)) {
+    // preallocated zero cluster
+    new_offset = (Bit64s)old_offset;
+  } else {
+    new_offset = alloc_cluster();
+    if (new_offset < 0) {
+      return -1;
+    }
+  }
+  if (bx_write_image(fd, new_offset, (void*)data, cluster_size) != (int)cluster_size) {
+    return -1;
+  }
+  if (set_l2_entry(cluster_start, (Bit64u)new_offset | QCOW2_OFLAG_COPIED) < 0) {
+    return -1;
+  }
+  if ((old_offset != 0) && ((Bit64u)new_offset != old_offset)) {
+    return update_refcount(old_offset, -1);
+  }
+  return 0;
+}
+
+Bit64s qcow2_image_t::lseek(Bit64s offset, int whence)
+{
+  if (whence == SEEK_SET) {
+    cur_offset = offset;
+  } else if (whence == SEEK_CUR) {
+    cur_offset += offset;
+  } else {
+    BX_ERROR(("lseek: mode not supported yet"));
+    return -1;
+  }
+  if ((Bit64u)cur_offset >= hd_size)
+    return -1;
+  return cur_offset;
+}
+
+ssize_t qcow2_image_t::read(void* buf, size_t count)
+{
+  ssize_t ret = read_at(cur_offset, buf, count);
+  if (ret > 0) {
+    cur_offset += ret;
+  }
+  return ret;
+}
+
+ssize_t qcow2_image_t::write(const void* buf, size_t count)
+{
+  ssize_t ret = write_at(cur_offset, buf, count);
+  if (ret > 0) {
+    cur_offset += ret;
+  }
+  return ret;
+}
+
+ssize_t qcow2_image_t::read_at(Bit64s offset, void* buf, size_t count)
+{
+  Bit8u *cbuf = (Bit8u*)buf;
+  Bit64u pos = (Bit64u)offset, entry, host, next;
+  size_t left = count;
+  Bit32u len, run;
+
+  if ((offset < 0) || ((pos + count) > hd_size)) {
+    return -1;
+  }
+  while (left > 0) {
+    len = cluster_size - (Bit32u)(pos & (cluster_size - 1));
+    if (len > left) len = (Bit32u)left;
+    if (get_l2_entry(pos, &entry) < 0) {
+      return -1;
+    }
+    host = entry & QCOW2_OFFSET_MASK;
+    if (entry & QCOW2_OFLAG_COMPRESSED) {
+      BX_ERROR(("QCOW2: compressed clusters not supported"));
+      return -1;
+    } else if (entry & QCOW2_OFLAG_ZERO) {
+      memset(cbuf, 0, len);
+    } else if (host == 0) {
+      read_backing(pos, cbuf, len);
+    } else {
+      // merge the following clusters if they are contiguous in the file
+      host += pos & (cluster_size - 1);
+      run = len;
+      while ((run < left) && (run < 0x100000)) {
+        if (get_l2_entry(pos + run, &next) < 0) {
+          return -1;
+        }
+        if ((next & (QCOW2_OFLAG_COMPRESSED | QCOW2_OFLAG_ZERO)) ||
+            ((next & QCOW2_OFFSET_MASK) != (host + run))) {
+          break;
+        }
+        run += ((left - run) < cluster_size) ? (Bit32u)(left - run) : cluster_size;
+      }
+      len = run;
+      if (bx_read_image(fd, host, cbuf, len) != (int)len) {
+        return -1;
+      }
+    }
+    pos += len;
+    cbuf += len;
+    left -= len;
+  }
+  return count;
+}
+
+ssize_t qcow2_image_t::write_at(Bit64s offset, const void* buf, size_t count)
+{
+  const Bit8u *cbuf = (const Bit8u*)buf;
+  Bit64u pos = (Bit64u)offset, entry, host;
+  size_t left = count;
+  Bit32u len;
+
+  if (read_only || (offset < 0) || ((pos + count) > hd_size)) {
+    return -1;
+  }
+  while (left > 0) {
+    len = cluster_size - (Bit32u)(pos & (cluster_size - 1));
+    if (len > left) len = (Bit32u)left;
+    if (get_l2_entry(pos, &entry) < 0) {
+      return -1;
+    }
+    host = entry & QCOW2_OFFSET_MASK;
+    if ((host != 0) && ((entry & (QCOW2_OFLAG_COPIED | QCOW2_OFLAG_COMPRESSED |
+         QCOW2_OFLAG_ZERO)) == QCOW2_OFLAG_COPIED)) {
+      host += pos & (cluster_size - 1);
+      if (bx_write_image(fd, host, (void*)cbuf, len) != (int)len) {
+        return -1;
+      }
+    } else if (write_cluster(pos, entry, cbuf, len) < 0) {
+      return -1;
+    }
+    pos += len;
+    cbuf += len;
+    left -= len;
+  }
+  return count;
+}
+
+#ifdef BXIMAGE
+int qcow2_image_t::create_image(const char *pathname, Bit64u size)
+{
+  qcow2_header_t header;
+  Bit32u csize = 1 << QCOW2_DEFAULT_CLUSTER_BITS;
+  Bit64u l2_coverage = (Bit64u)csize << (QCOW2_DEFAULT_CLUSTER_BITS - 3);
+  Bit32u l1_entries, l1_clusters, i;
+  Bit8u *buf;
+  Bit64u entry;
+  Bit16u refcount;
+  int fd;
+
+  // layout: header, refcount table, refcount block, L1 table
+  l1_entries = (Bit32u)((size + l2_coverage - 1) / l2_coverage);
+  l1_clusters = (l1_entries * 8 + csize - 1) / csize;
+  if (l1_clusters == 0) l1_clusters = 1;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = be32(QCOW2_MAGIC);
+  header.version = be32(3);
+  header.cluster_bits = be32(QCOW2_DEFAULT_CLUSTER_BITS);
+  header.size = be64(size);
+  header.l1_size = be32(l1_entries);
+  header.l1_table_offset = be64((Bit64u)3 * csize);
+  header.refcount_table_offset = be64((Bit64u)csize);
+  header.refcount_table_clusters = be32(1);
+  header.refcount_order = be32(4);
+  header.header_length = be32(QCOW2_HEADER_V3_SIZE);
+
+  fd = bx_create_image_file(pathname);
+  if (fd < 0)
+    BX_FATAL(("ERROR: failed to create qcow2 image file"));
+  buf = new Bit8u[csize];
+  memset(buf, 0, csize);
+  for (i = 0; i < (3 + l1_clusters); i++) {
+    if (bx_write_image(fd, (Bit64s)i * csize, buf, csize) != (int)csize) {
+      ::close(fd);
+      delete [] buf;
+      BX_FATAL(("ERROR: The disk image is not complete"));
+    }
+  }
+  delete [] buf;
+  entry = be64((Bit64u)2 * csize);
+  if ((bx_write_image(fd, 0, &header, sizeof(header)) != sizeof(header)) ||
+      (bx_write_image(fd, csize, &entry, 8) != 8)) {
+    ::close(fd);
+    BX_FATAL(("ERROR: The disk image is not complete - could not write header!"));
+  }
+  refcount = be16(1);
+  for (i = 0; i < (3 + l1_clusters); i++) {
+    if (bx_write_image(fd, 2 * csize + i * 2, &refcount, 2) != 2) {
+      ::close(fd);
+      BX_FATAL(("ERROR: The disk image is not complete - could not write refcounts!"));
+    }
+  }
+  ::close(fd);
+  return 0;
+}
+#else
+bool qcow2_image_t::save_state(const char *backup_fname)
+{
+  return hdimage_backup_file(fd, backup_fname);
+}
+
+void qcow2_image_t::restore_state(const char *backup_fname)
+{
+  int temp_fd;
+  Bit64u imgsize;
+
+  if ((temp_fd = hdimage_open_file(backup_fname, O_RDONLY, &imgsize, NULL)) < 0) {
+    BX_PANIC(("cannot open qcow2 image backup '%s'", backup_fname));
+    return;
+  }
+  if (check_format(temp_fd, imgsize) < HDIMAGE_FORMAT_OK) {
+    ::close(temp_fd);
+    BX_PANIC(("Could not detect qcow2 image header"));
+    return;
+  }
+  ::close(temp_fd);
+  close();
+  if (!hdimage_copy_file(backup_fname, pathname)) {
+    BX_PANIC(("Failed to restore qcow2 image '%s'", pathname));
+    return;
+  }
+  device_image_t::open(pathname);
+}
+#endif
@@ -0,0 +1,178 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_QCOW2IMG_H
+#define BX_QCOW2IMG_H
+
+#define QCOW2_MAGIC             0x514649fb // "QFI\xfb"
+#define QCOW2_HEADER_V2_SIZE    72
+#define QCOW2_HEADER_V3_SIZE    104
+#define QCOW2_MIN_CLUSTER_BITS  9
+#define QCOW2_MAX_CLUSTER_BITS  21
+#define QCOW2_DEFAULT_CLUSTER_BITS 16
+
+// L1 / L2 table entry bits
+#define QCOW2_OFLAG_COPIED      BX_CONST64(0x8000000000000000)
+#define QCOW2_OFLAG_COMPRESSED  BX_CONST64(0x4000000000000000)
+#define QCOW2_OFLAG_ZERO        BX_CONST64(0x0000000000000001)
+#define QCOW2_OFFSET_MASK       BX_CONST64(0x00fffffffffffe00)
+
+// incompatible feature bits
+#define QCOW2_INCOMPAT_DIRTY    BX_CONST64(0x01)
+#define QCOW2_INCOMPAT_CORRUPT  BX_CONST64(0x02)
+#define QCOW2_INCOMPAT_COMPRESSION BX_CONST64(0x08)
+// dirty refcounts are accepted for read-only access only
+#define QCOW2_INCOMPAT_SUPPORTED QCOW2_INCOMPAT_COMPRESSION
+
+// maximum size of the L1 table and refcount table in bytes (same as Qemu)
+#define QCOW2_MAX_L1_SIZE       0x02000000
+#define QCOW2_MAX_REFTABLE_SIZE 0x00800000
+
+// number of L2 tables and refcount blocks kept in memory
+#define QCOW2_L2_CACHE_SIZE     16
+#define QCOW2_RC_CACHE_SIZE     4
+// maximum length of a backing file chain and of a backing file name
+#define QCOW2_MAX_BACKING_DEPTH 16
+#define QCOW2_MAX_BACKING_NAME  1023
+
+#if defined(_MSC_VER) && (_MSC_VER<1300)
+#pragma pack(push, 1)
+#elif defined(__MWERKS__) && defined(macintosh)
+#pragma options align=packed
+#endif
+
+// always big-endian
+typedef
+#if defined(_MSC_VER) && (_MSC_VER>=1300)
+__declspec(align(1))
+#endif
+struct qcow2_header_t {
+    Bit32u  magic;
+    Bit32u  version;
+    Bit64u  backing_file_offset;
+    Bit32u  backing_file_size;
+    Bit32u  cluster_bits;
+    Bit64u  size;
+    Bit32u  crypt_method;
+    Bit32u  l1_size;
+    Bit64u  l1_table_offset;
+    Bit64u  refcount_table_offset;
+    Bit32u  refcount_table_clusters;
+    Bit32u  nb_snapshots;
+    Bit64u  snapshots_offset;
+
+    // version 3 only
+    Bit64u  incompatible_features;
+    Bit64u  compatible_features;
+    Bit64u  autoclear_features;
+    Bit32u  refcount_order;
+    Bit32u  header_length;
+}
+#if !defined(_MSC_VER)
+GCC_ATTRIBUTE((packed))
+#endif
+qcow2_header_t;
+
+#if defined(_MSC_VER) && (_MSC_VER<1300)
+#pragma pack(pop)
+#elif defined(__MWERKS__) && defined(macintosh)
+#pragma options align=reset
+#endif
+
+class qcow2_image_t : public device_image_t
+{
+  public:
+    qcow2_image_t();
+    virtual ~qcow2_image_t();
+
+    int open(const char* pathname, int flags);
+    void close();
+    Bit64s lseek(Bit64s offset, int whence);
+    ssize_t read(void* buf, size_t count);
+    ssize_t write(const void* buf, size_t count);
+    ssize_t read_at(Bit64s offset, void* buf, size_t count);
+    ssize_t write_at(Bit64s offset, const void* buf, size_t count);
+
+    static int check_format(int fd, Bit64u imgsize);
+
+#ifdef BXIMAGE
+    int create_image(const char *pathname, Bit64u size);
+#else
+    bool save_state(const char *backup_fname);
+    void restore_state(const char *backup_fname);
+#endif
+
+  private:
+    int open_backing_file(Bit64u name_offset, Bit32u name_size);
+    void read_backing(Bit64u offset, Bit8u *buf, Bit32u count);
+
+    Bit64u *get_l2_table(Bit64u l2_offset, bool read);
+    Bit16u *get_refcount_block(Bit64u block_offset, bool read);
+    int update_refcount(Bit64u offset, int delta);
+    Bit64s alloc_cluster(void);
+
+    int get_l2_entry(Bit64u offset, Bit64u *entry);
+    int set_l2_entry(Bit64u offset, Bit64u entry);
+    int write_cluster(Bit64u offset, Bit64u entry, const Bit8u *buf, Bit32u count);
+
+    int fd;
+    const char *pathname;
+    device_image_t *backing;
+    char *backing_path;
+    int depth; // position in the backing file chain
+    bool read_only;
+    Bit32u version;
+
+    Bit64s cur_offset;
+    Bit64u next_free;
+
+    Bit32u cluster_bits;
+    Bit32u cluster_size;
+    Bit32u l2_bits;
+    Bit32u l2_size;
+    Bit32u rc_bits;
+
+    Bit32u l1_size;
+    Bit64u l1_table_offset;
+    Bit64u *l1_table;  // host endianness
+    Bit32u rc_table_size;
+    Bit64u rc_table_offset;
+    Bit64u *rc_table;  // host endianness
+
+    // least recently used cache of L2 tables (kept big-endian)
+    struct {
+      Bit64u offset;
+      Bit32u lru;
+      Bit64u *table;
+    } l2_cache[QCOW2_L2_CACHE_SIZE];
+    // least recently used cache of refcount blocks (kept big-endian)
+    struct {
+      Bit64u offset;
+      Bit32u lru;
+      Bit16u *block;
+    } rc_cache[QCOW2_RC_CACHE_SIZE];
+    Bit32u lru_counter;
+
+    Bit8u *cluster_buf;
+};
+
+#endif
@@ -31,6 +31,8 @@
 #include "ioapic.h"
 
 #define LOG_THIS theIOAPIC->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 bx_ioapic_c *theIOAPIC = NULL;
 
@@ -205,9 +205,12 @@ public:
   virtual bool bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_read_sector); return 0;
   }
-  virtual bool bmdma_write_sector(Bit8u channel, Bit8u *buffer) {
+  virtual int bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_write_sector); return 0;
   }
+  virtual int bmdma_io_status(Bit8u channel, bool wait) {
+    STUBFUNC(HD, bmdma_io_status); return 0;
+  }
   virtual void bmdma_complete(Bit8u channel) {
     STUBFUNC(HD, bmdma_complete);
   }
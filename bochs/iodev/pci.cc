@@ -342,7 +342,7 @@ void bx_pci_bridge_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io
             DEV_mem_set_memory_type(area, 1, (value8 >> 5) & 0x1);
           }
           BX_INFO(("%s write to PAM register %x (TLB Flush)", csname[BX_PCI_THIS chipset], address+i));
-          bx_pc_system.MemoryMappingChanged();
+          bx_pc_system.MemoryMappingChanged(0x000c0000, 0x000fffff);
         }
         break;
       case 0x60:
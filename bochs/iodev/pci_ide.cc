@@ -39,6 +39,9 @@
 
 bx_pci_ide_c *thePciIdeController = NULL;
 
+// interval for polling the completion of asynchronous disk I/O (usec)
+#define BMDMA_IO_POLL_INTERVAL 50
+
 const Bit8u bmdma_iomask[16] = {1, 0, 1, 0, 4, 0, 0, 0, 1, 0, 1, 0, 4, 0, 0, 0};
 
 PLUGIN_ENTRY_FOR_MODULE(pci_ide)
@@ -136,6 +139,7 @@ void bx_pci_ide_c::reset(unsigned type)
     BX_PIDE_THIS s.bmdma[i].buffer_top = BX_PIDE_THIS s.bmdma[i].buffer;
     BX_PIDE_THIS s.bmdma[i].buffer_idx = BX_PIDE_THIS s.bmdma[i].buffer;
     BX_PIDE_THIS s.bmdma[i].data_ready = 0;
+    BX_PIDE_THIS s.bmdma[i].io_wait = 0;
   }
 }
 
@@ -164,6 +168,7 @@ void bx_pci_ide_c::register_state(void)
     BXRS_PARAM_SPECIAL32(ctrl, buffer_idx,
        BX_PIDE_THIS param_save_handler, BX_PIDE_THIS param_restore_handler);
     BXRS_PARAM_BOOL(ctrl, data_ready, BX_PIDE_THIS s.bmdma[i].data_ready);
+    BXRS_PARAM_BOOL(ctrl, io_wait, BX_PIDE_THIS s.bmdma[i].io_wait);
   }
 }
 
@@ -242,7 +247,7 @@ void bx_pci_ide_c::timer_handler(void *this_ptr)
 
 void bx_pci_ide_c::timer()
 {
-  int count;
+  int count, io_status, write_status = 1;
   Bit32u size, sector_size;
   struct {
     Bit32u addr;
@@ -265,18 +270,55 @@ void bx_pci_ide_c::timer()
   if (size == 0) {
     size = 0x10000;
   }
+  bool io_async = BX_PIDE_THIS s.bmdma[channel].io_wait;
+  if (!io_async) {
+    if (BX_PIDE_THIS s.bmdma[channel].cmd_rwcon) {
+      BX_DEBUG(("READ DMA to addr=0x%08x, size=0x%08x", prd.addr, size));
+      count = (int)(size - (BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx));
+      while (count > 0) {
+        sector_size = count;
+        if (DEV_hd_bmdma_read_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_top, &sector_size)) {
+          BX_PIDE_THIS s.bmdma[channel].buffer_top += sector_size;
+          count -= sector_size;
+        } else {
+          break;
+        }
+      };
+    } else {
+      BX_DEBUG(("WRITE DMA from addr=0x%08x, size=0x%08x", prd.addr, size));
+      DEV_MEM_READ_PHYSICAL_DMA(prd.addr, size, BX_PIDE_THIS s.bmdma[channel].buffer_top);
+      BX_PIDE_THIS s.bmdma[channel].buffer_top += size;
+      count = (int)(BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx);
+      // a partial sector left over is written with the data of the next PRD
+      while (count > 0) {
+        sector_size = count;
+        write_status = DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx, &sector_size);
+        if (write_status > 0) {
+          BX_PIDE_THIS s.bmdma[channel].buffer_idx += sector_size;
+          count -= sector_size;
+        } else {
+          break;
+        }
+      };
+    }
+  }
+  // With the asynchronous disk backend the transfer continues when the
+  // I/O thread has finished, otherwise the I/O is already done here. If the
+  // write command ends here, wait for its I/O before completing it.
+  io_status = DEV_hd_bmdma_io_status(channel, write_status < 0);
+  if (io_status > 0) {
+    BX_PIDE_THIS s.bmdma[channel].io_wait = 1;
+    bx_pc_system.activate_timer(BX_PIDE_THIS s.bmdma[channel].timer_index, BMDMA_IO_POLL_INTERVAL, 0);
+    return;
+  }
+  BX_PIDE_THIS s.bmdma[channel].io_wait = 0;
+  if (io_status < 0) {
+    BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
+    BX_PIDE_THIS s.bmdma[channel].prd_current = 0;
+    return;
+  }
   if (BX_PIDE_THIS s.bmdma[channel].cmd_rwcon) {
-    BX_DEBUG(("READ DMA to addr=0x%08x, size=0x%08x", prd.addr, size));
     count = (int)(size - (BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx));
-    while (count > 0) {
-      sector_size = count;
-      if (DEV_hd_bmdma_read_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_top, &sector_size)) {
-        BX_PIDE_THIS s.bmdma[channel].buffer_top += sector_size;
-        count -= sector_size;
-      } else {
-        break;
-      }
-    };
     if (count > 0) {
       DEV_hd_bmdma_complete(channel);
       return;
@@ -284,23 +326,9 @@ void bx_pci_ide_c::timer()
       DEV_MEM_WRITE_PHYSICAL_DMA(prd.addr, size, BX_PIDE_THIS s.bmdma[channel].buffer_idx);
       BX_PIDE_THIS s.bmdma[channel].buffer_idx += size;
     }
-  } else {
-    BX_DEBUG(("WRITE DMA from addr=0x%08x, size=0x%08x", prd.addr, size));
-    DEV_MEM_READ_PHYSICAL_DMA(prd.addr, size, BX_PIDE_THIS s.bmdma[channel].buffer_top);
-    BX_PIDE_THIS s.bmdma[channel].buffer_top += size;
-    count = (int)(BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx);
-    while (count > 511) {
-      if (DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx)) {
-        BX_PIDE_THIS s.bmdma[channel].buffer_idx += 512;
-        count -= 512;
-      } else {
-        break;
-      }
-    };
-    if (count >= 512) {
-      DEV_hd_bmdma_complete(channel);
-      return;
-    }
+  } else if (write_status < 0) {
+    DEV_hd_bmdma_complete(channel);
+    return;
   }
   if (prd.size & 0x80000000) {
     BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
@@ -317,6 +345,11 @@ void bx_pci_ide_c::timer()
     BX_PIDE_THIS s.bmdma[channel].buffer_idx = BX_PIDE_THIS s.bmdma[channel].buffer;
     // Prepare for next PRD
     BX_PIDE_THIS s.bmdma[channel].prd_current += 8;
+    if (io_async) {
+      // the transfer is paced by the completion of the disk I/O
+      bx_pc_system.activate_timer(BX_PIDE_THIS s.bmdma[channel].timer_index, BMDMA_IO_POLL_INTERVAL, 0);
+      return;
+    }
     DEV_MEM_READ_PHYSICAL(BX_PIDE_THIS s.bmdma[channel].prd_current, 4, (Bit8u *)&prd.addr);
     DEV_MEM_READ_PHYSICAL(BX_PIDE_THIS s.bmdma[channel].prd_current+4, 4, (Bit8u *)&prd.size);
     size = prd.size & 0xfffe;
@@ -405,6 +438,11 @@ void bx_pci_ide_c::write(Bit32u address, Bit32u value, unsigned io_len)
         BX_PIDE_THIS s.bmdma[channel].cmd_ssbm = 0;
         BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
         BX_PIDE_THIS s.bmdma[channel].data_ready = 0;
+        if (BX_PIDE_THIS s.bmdma[channel].io_wait) {
+          // transfer aborted, the disk I/O in flight still uses the buffer
+          DEV_hd_bmdma_io_status(channel, 1);
+          BX_PIDE_THIS s.bmdma[channel].io_wait = 0;
+        }
       }
       break;
     case 0x02:
@@ -69,6 +69,7 @@ private:
       Bit8u *buffer_top;
       Bit8u *buffer_idx;
       bool data_ready;
+      bool io_wait;
     } bmdma[2];
   } s;
 
@@ -28,6 +28,8 @@
 #include "pic.h"
 
 #define LOG_THIS thePic->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 bx_pic_c *thePic = NULL;
 
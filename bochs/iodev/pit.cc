@@ -30,6 +30,8 @@
 
 
 #define LOG_THIS thePit->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 bx_pit_c *thePit = NULL;
 
@@ -50,6 +50,8 @@
 #include "iodev.h"
 #include "pit82c54.h"
 #define LOG_THIS this->
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 
 void pit_82C54::print_counter(counter_type &thisctr)
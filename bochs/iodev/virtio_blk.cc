@@ -0,0 +1,345 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+//
+// Virtio block device (paravirtual hard disk)
+//
+// The disk image backends of the ATA emulation are used. All requests
+// available in the queue are executed when the driver sends a notification
+// and completed together, so one interrupt usually covers several requests.
+//
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO
+
+#include "pci.h"
+#include "hdimage/hdimage.h"
+#include "virtio_pci.h"
+#include "virtio_blk.h"
+
+#define LOG_THIS theVirtioBlkDevice->
+
+bx_virtio_blk_c *theVirtioBlkDevice = NULL;
+
+// feature bits
+#define VIRTIO_BLK_F_SEG_MAX   2
+#define VIRTIO_BLK_F_GEOMETRY  4
+#define VIRTIO_BLK_F_RO        5
+#define VIRTIO_BLK_F_BLK_SIZE  6
+#define VIRTIO_BLK_F_FLUSH     9
+
+// request types
+#define VIRTIO_BLK_T_IN        0
+#define VIRTIO_BLK_T_OUT       1
+#define VIRTIO_BLK_T_FLUSH     4
+#define VIRTIO_BLK_T_GET_ID    8
+
+// request status
+#define VIRTIO_BLK_S_OK        0
+#define VIRTIO_BLK_S_IOERR     1
+#define VIRTIO_BLK_S_UNSUPP    2
+
+#define VIRTIO_BLK_CONFIG_SIZE 24
+#define VIRTIO_BLK_ID_BYTES    20
+
+// builtin configuration handling functions
+
+void virtio_blk_init_options(void)
+{
+  bx_param_c *ata = SIM->get_param("ata");
+  bx_list_c *menu = new bx_list_c(ata, "virtio_blk", "Virtio block device");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable virtio block device",
+    "Enables the paravirtual virtio block device",
+    0);
+  bx_param_filename_c *path = new bx_param_filename_c(menu,
+    "path",
+    "Path or physical device name",
+    "Pathname of the hard disk image",
+    "", BX_PATHNAME_LEN);
+  bx_param_enum_c *mode = new bx_param_enum_c(menu,
+    "mode",
+    "Type of disk image",
+    "Mode of the hard disk image",
+    bx_hdimage_ctl.get_mode_names(),
+    0, 0);
+  bx_param_filename_c *journal = new bx_param_filename_c(menu,
+    "journal",
+    "Path of journal file",
+    "Pathname of the journal file",
+    "", BX_PATHNAME_LEN);
+  bx_list_c *deplist = new bx_list_c(NULL);
+  deplist->add(path);
+  deplist->add(mode);
+  deplist->add(journal);
+  enabled->set_dependent_list(deplist);
+}
+
+Bit32s virtio_blk_options_parser(const char *context, int num_params, char *params[])
+{
+  if (!strcmp(params[0], "virtio_blk")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_BLK);
+    for (int i = 1; i < num_params; i++) {
+      if (SIM->parse_param_from_list(context, params[i], base) < 0) {
+        BX_ERROR(("%s: unknown parameter for virtio_blk ignored.", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s virtio_blk_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_VIRTIO_BLK), NULL, 0);
+}
+
+// device plugin entry point
+
+PLUGIN_ENTRY_FOR_MODULE(virtio_blk)
+{
+  if (mode == PLUGIN_INIT) {
+    theVirtioBlkDevice = new bx_virtio_blk_c();
+    BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theVirtioBlkDevice, BX_PLUGIN_VIRTIO_BLK);
+    // add new configuration parameter for the config interface
+    virtio_blk_init_options();
+    // register add-on option for bochsrc and command line
+    SIM->register_addon_option("virtio_blk", virtio_blk_options_parser, virtio_blk_options_save);
+  } else if (mode == PLUGIN_FINI) {
+    SIM->unregister_addon_option("virtio_blk");
+    bx_list_c *menu = (bx_list_c*)SIM->get_param("ata");
+    menu->remove("virtio_blk");
+    delete theVirtioBlkDevice;
+  } else if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_OPTIONAL;
+  } else if (mode == PLUGIN_FLAGS) {
+    return PLUGFLAG_PCI;
+  }
+  return 0; // Success
+}
+
+// the device object
+
+bx_virtio_blk_c::bx_virtio_blk_c()
+{
+  put("virtio_blk", "VBLK");
+  hdimage = NULL;
+  sectors = 0;
+  buffer = NULL;
+  statusbar_id = -1;
+}
+
+bx_virtio_blk_c::~bx_virtio_blk_c()
+{
+  if (hdimage != NULL) {
+    hdimage->close();
+    delete hdimage;
+  }
+  delete [] buffer;
+  SIM->get_bochs_root()->remove("virtio_blk");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_virtio_blk_c::init(void)
+{
+  Bit64u features;
+
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_BLK);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get()) {
+    BX_INFO(("virtio block device disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("virtio_blk"))->set(0);
+    return;
+  }
+  bx_param_string_c *path = SIM->get_param_string("path", base);
+  const char *image_mode = SIM->get_param_enum("mode", base)->get_selected();
+  BX_VIRTIO_BLK_THIS hdimage = DEV_hdimage_init_image(image_mode, 0,
+                                 SIM->get_param_string("journal", base)->getptr());
+  if (BX_VIRTIO_BLK_THIS hdimage == NULL) {
+    BX_PANIC(("disk image mode '%s' not available", image_mode));
+    return;
+  }
+  BX_VIRTIO_BLK_THIS hdimage->sect_size = 512;
+  if (BX_VIRTIO_BLK_THIS hdimage->open(path->getptr()) < 0) {
+    BX_PANIC(("could not open hard drive image file '%s'", path->getptr()));
+    delete BX_VIRTIO_BLK_THIS hdimage;
+    BX_VIRTIO_BLK_THIS hdimage = NULL;
+    return;
+  }
+  if ((BX_VIRTIO_BLK_THIS hdimage->get_capabilities() & HDIMAGE_HAS_GEOMETRY) == 0) {
+    BX_VIRTIO_BLK_THIS hdimage->heads = 16;
+    BX_VIRTIO_BLK_THIS hdimage->spt = 63;
+    BX_VIRTIO_BLK_THIS hdimage->cylinders =
+      (unsigned)(BX_VIRTIO_BLK_THIS hdimage->hd_size / 16 / 63 / 512);
+  }
+  BX_VIRTIO_BLK_THIS sectors = BX_VIRTIO_BLK_THIS hdimage->hd_size / 512;
+  BX_VIRTIO_BLK_THIS buffer = new Bit8u[VIRTIO_BLK_XFER_SIZE];
+
+  DEV_register_pci_handlers(this, &BX_VIRTIO_BLK_THIS devfunc, BX_PLUGIN_VIRTIO_BLK,
+                            "Virtio block device");
+  features = (1 << VIRTIO_BLK_F_SEG_MAX) | (1 << VIRTIO_BLK_F_GEOMETRY) |
+             (1 << VIRTIO_BLK_F_BLK_SIZE) | (1 << VIRTIO_BLK_F_FLUSH);
+  if (BX_VIRTIO_BLK_THIS hdimage->get_capabilities() & HDIMAGE_READONLY) {
+    features |= (1 << VIRTIO_BLK_F_RO);
+  }
+  init_virtio(VIRTIO_ID_BLOCK, 0x010000, 1, features, VIRTIO_BLK_CONFIG_SIZE);
+
+  // device configuration: capacity, seg_max, geometry and block size
+  WriteHostQWordToLittleEndian((Bit64u*)&config[0], BX_VIRTIO_BLK_THIS sectors);
+  WriteHostDWordToLittleEndian((Bit32u*)&config[12], VIRTIO_MAX_SG - 2);
+  WriteHostWordToLittleEndian((Bit16u*)&config[16],
+    (Bit16u)BX_VIRTIO_BLK_THIS hdimage->cylinders);
+  config[18] = (Bit8u)BX_VIRTIO_BLK_THIS hdimage->heads;
+  config[19] = (Bit8u)BX_VIRTIO_BLK_THIS hdimage->spt;
+  WriteHostDWordToLittleEndian((Bit32u*)&config[20], 512);
+
+  BX_VIRTIO_BLK_THIS statusbar_id = bx_gui->register_statusitem("VBLK", 1);
+  BX_INFO(("virtio block device: '%s', '%s' mode, %u sectors", path->getptr(),
+           image_mode, (Bit32u)BX_VIRTIO_BLK_THIS sectors));
+}
+
+void bx_virtio_blk_c::reset(unsigned type)
+{
+  reset_virtio();
+}
+
+void bx_virtio_blk_c::register_state(void)
+{
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "virtio_blk", "Virtio Block State");
+  virtio_register_state(list);
+  if (BX_VIRTIO_BLK_THIS hdimage != NULL) {
+    BX_VIRTIO_BLK_THIS hdimage->register_state(list);
+  }
+}
+
+void bx_virtio_blk_c::after_restore_state(void)
+{
+  virtio_after_restore_state(NULL);
+}
+
+void bx_virtio_blk_c::virtio_queue_notify(unsigned q)
+{
+  bx_virtq_elem_t elem;
+  Bit32u used_len;
+  Bit8u status;
+
+  while (virtio_queue_pop(q, &elem)) {
+    used_len = 0;
+    status = handle_request(&elem, &used_len);
+    if (elem.in_len > 0) {
+      virtio_elem_write(&elem, elem.in_len - 1, &status, 1);
+      used_len++;
+    }
+    virtio_queue_push(q, &elem, used_len);
+  }
+  virtio_queue_flush(q);
+}
+
+// Execute one request. Returns the request status, the number of data bytes
+// written to the guest (excluding the status byte) is stored in used_len.
+Bit8u bx_virtio_blk_c::handle_request(bx_virtq_elem_t *elem, Bit32u *used_len)
+{
+  Bit8u hdr[16], id[VIRTIO_BLK_ID_BYTES];
+  Bit32u type, len;
+  Bit64u sector;
+
+  if ((elem->in_len < 1) || (virtio_elem_read(elem, 0, hdr, 16) < 16)) {
+    BX_ERROR(("malformed request"));
+    return VIRTIO_BLK_S_IOERR;
+  }
+  type = ReadHostDWordFromLittleEndian((Bit32u*)hdr);
+  sector = ReadHostQWordFromLittleEndian((Bit64u*)&hdr[8]);
+  switch (type) {
+    case VIRTIO_BLK_T_IN:
+      len = elem->in_len - 1;
+      *used_len = len;
+      return transfer(elem, 0, sector, len);
+    case VIRTIO_BLK_T_OUT:
+      if (BX_VIRTIO_BLK_THIS hdimage->get_capabilities() & HDIMAGE_READONLY) {
+        return VIRTIO_BLK_S_IOERR;
+      }
+      return transfer(elem, 1, sector, elem->out_len - 16);
+    case VIRTIO_BLK_T_FLUSH:
+      // disk image writes are not cached in the emulator
+      return VIRTIO_BLK_S_OK;
+    case VIRTIO_BLK_T_GET_ID:
+      memset(id, 0, sizeof(id));
+      strncpy((char*)id, "BXVIRTIO0001", sizeof(id));
+      len = elem->in_len - 1;
+      if (len > VIRTIO_BLK_ID_BYTES) len = VIRTIO_BLK_ID_BYTES;
+      *used_len = virtio_elem_write(elem, 0, id, len);
+      return VIRTIO_BLK_S_OK;
+    default:
+      BX_DEBUG(("unsupported request type %d", type));
+      return VIRTIO_BLK_S_UNSUPP;
+  }
+}
+
+Bit8u bx_virtio_blk_c::transfer(bx_virtq_elem_t *elem, bool write, Bit64u sector,
+                                Bit32u len)
+{
+  Bit32u done = 0, n;
+  Bit64s offset = (Bit64s)(sector * 512);
+
+  if ((len & 511) || (sector > BX_VIRTIO_BLK_THIS sectors) ||
+      ((len >> 9) > (BX_VIRTIO_BLK_THIS sectors - sector))) {
+    BX_ERROR(("%s request out of range: sector=" FMT_LL "u, len=%u",
+              write ? "write" : "read", sector, len));
+    return VIRTIO_BLK_S_IOERR;
+  }
+  bx_gui->statusbar_setitem(BX_VIRTIO_BLK_THIS statusbar_id, 1, write);
+  while (done < len) {
+    n = len - done;
+    if (n > VIRTIO_BLK_XFER_SIZE) n = VIRTIO_BLK_XFER_SIZE;
+    if (write) {
+      virtio_elem_read(elem, 16 + done, BX_VIRTIO_BLK_THIS buffer, n);
+      if (BX_VIRTIO_BLK_THIS hdimage->write_at(offset + done,
+            BX_VIRTIO_BLK_THIS buffer, n) != (ssize_t)n) {
+        BX_ERROR(("could not write() hard drive image file at byte " FMT_LL "d",
+                  offset + done));
+        return VIRTIO_BLK_S_IOERR;
+      }
+    } else {
+      if (BX_VIRTIO_BLK_THIS hdimage->read_at(offset + done,
+            BX_VIRTIO_BLK_THIS buffer, n) != (ssize_t)n) {
+        BX_ERROR(("could not read() hard drive image file at byte " FMT_LL "d",
+                  offset + done));
+        return VIRTIO_BLK_S_IOERR;
+      }
+      virtio_elem_write(elem, done, BX_VIRTIO_BLK_THIS buffer, n);
+    }
+    done += n;
+  }
+  return VIRTIO_BLK_S_OK;
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO
@@ -0,0 +1,56 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_VIRTIO_BLK_H
+#define BX_IODEV_VIRTIO_BLK_H
+
+#define BX_VIRTIO_BLK_THIS this->
+
+// bytes moved through the bounce buffer at once
+#define VIRTIO_BLK_XFER_SIZE  (128 * 512)
+
+class device_image_t;
+
+class bx_virtio_blk_c : public bx_virtio_pci_c {
+public:
+  bx_virtio_blk_c();
+  virtual ~bx_virtio_blk_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+protected:
+  virtual void virtio_reset_device(void) {}
+  virtual void virtio_queue_notify(unsigned q);
+
+private:
+  device_image_t *hdimage;
+  Bit64u sectors;
+  Bit8u  *buffer;
+  int statusbar_id;
+
+  Bit8u handle_request(bx_virtq_elem_t *elem, Bit32u *used_len);
+  Bit8u transfer(bx_virtq_elem_t *elem, bool write, Bit64u sector, Bit32u len);
+};
+
+#endif
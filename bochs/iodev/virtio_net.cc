@@ -0,0 +1,367 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+//
+// Virtio network device (paravirtual ethernet adapter)
+//
+// Queue 0 receives, queue 1 transmits. All frames available in the transmit
+// queue are sent when the driver sends a notification. Checksum offload is
+// supported in both directions: the device fills in the checksum of partial
+// checksummed frames and marks received frames as already verified.
+//
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO && BX_NETWORKING
+
+#include "pci.h"
+#include "network/netmod.h"
+#include "virtio_pci.h"
+#include "virtio_net.h"
+
+#define LOG_THIS theVirtioNetDevice->
+
+bx_virtio_net_c *theVirtioNetDevice = NULL;
+
+// feature bits
+#define VIRTIO_NET_F_CSUM        0
+#define VIRTIO_NET_F_GUEST_CSUM  1
+#define VIRTIO_NET_F_MAC         5
+#define VIRTIO_NET_F_STATUS      16
+
+#define VIRTIO_NET_S_LINK_UP     1
+
+// virtio_net_hdr flags
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM  1
+#define VIRTIO_NET_HDR_F_DATA_VALID  2
+
+#define VIRTIO_NET_RXQ           0
+#define VIRTIO_NET_TXQ           1
+
+#define VIRTIO_NET_CONFIG_SIZE   8
+
+// builtin configuration handling functions
+
+void virtio_net_init_options(void)
+{
+  bx_param_c *network = SIM->get_param("network");
+  bx_list_c *menu = new bx_list_c(network, "virtio_net", "Virtio network device");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable virtio network device",
+    "Enables the paravirtual virtio network device",
+    1);
+  SIM->init_std_nic_options("Virtio NIC", menu);
+  enabled->set_dependent_list(menu->clone());
+}
+
+Bit32s virtio_net_options_parser(const char *context, int num_params, char *params[])
+{
+  int ret, valid = 0;
+
+  if (!strcmp(params[0], "virtio_net")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET);
+    if (!SIM->get_param_bool("enabled", base)->get()) {
+      SIM->get_param_enum("ethmod", base)->set_by_name("null");
+    }
+    if (!SIM->get_param_string("mac", base)->isempty()) {
+      // MAC address is already initialized
+      valid |= 0x04;
+    }
+    for (int i = 1; i < num_params; i++) {
+      ret = SIM->parse_nic_params(context, params[i], base);
+      if (ret > 0) {
+        valid |= ret;
+      }
+    }
+    if (!SIM->get_param_bool("enabled", base)->get()) {
+      if (valid == 0x04) {
+        SIM->get_param_bool("enabled", base)->set(1);
+      }
+    }
+    if (valid < 0x80) {
+      if ((valid & 0x04) == 0) {
+        BX_PANIC(("%s: 'virtio_net' directive incomplete (mac is required)", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s virtio_net_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET), NULL, 0);
+}
+
+// device plugin entry point
+
+PLUGIN_ENTRY_FOR_MODULE(virtio_net)
+{
+  if (mode == PLUGIN_INIT) {
+    theVirtioNetDevice = new bx_virtio_net_c();
+    BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theVirtioNetDevice, BX_PLUGIN_VIRTIO_NET);
+    // add new configuration parameter for the config interface
+    virtio_net_init_options();
+    // register add-on option for bochsrc and command line
+    SIM->register_addon_option("virtio_net", virtio_net_options_parser, virtio_net_options_save);
+  } else if (mode == PLUGIN_FINI) {
+    SIM->unregister_addon_option("virtio_net");
+    bx_list_c *menu = (bx_list_c*)SIM->get_param("network");
+    menu->remove("virtio_net");
+    delete theVirtioNetDevice;
+  } else if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_OPTIONAL;
+  } else if (mode == PLUGIN_FLAGS) {
+    return PLUGFLAG_PCI;
+  }
+  return 0; // Success
+}
+
+// helper function
+
+// Insert the internet checksum of data[start..len) at data[start + offset].
+static bool virtio_net_fill_csum(Bit8u *data, unsigned len, unsigned start,
+                                 unsigned offset)
+{
+  Bit32u sum = 0;
+  unsigned i;
+
+  if ((start >= len) || ((start + offset + 2) > len)) {
+    return 0;
+  }
+  for (i = start; (i + 1) < len; i += 2) {
+    sum += ((Bit32u)data[i] << 8) | data[i + 1];
+  }
+  if (i < len) {
+    sum += (Bit32u)data[i] << 8;
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  put_net2(&data[start + offset], (Bit16u)~sum);
+  return 1;
+}
+
+// the device object
+
+bx_virtio_net_c::bx_virtio_net_c()
+{
+  put("virtio_net", "VNET");
+  memset(macaddr, 0, sizeof(macaddr));
+  tx_buffer = NULL;
+  statusbar_id = -1;
+  ethdev = NULL;
+}
+
+bx_virtio_net_c::~bx_virtio_net_c()
+{
+  if (ethdev != NULL) {
+    delete ethdev;
+  }
+  delete [] tx_buffer;
+  SIM->get_bochs_root()->remove("virtio_net");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_virtio_net_c::init(void)
+{
+  bx_param_string_c *bootrom;
+
+  // Read in values from config interface
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get()) {
+    BX_INFO(("virtio network device disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("virtio_net"))->set(0);
+    return;
+  }
+  memcpy(BX_VIRTIO_NET_THIS macaddr, SIM->get_param_string("mac", base)->getptr(), 6);
+  BX_VIRTIO_NET_THIS tx_buffer = new Bit8u[VIRTIO_NET_MAX_FRAME];
+
+  DEV_register_pci_handlers(this, &BX_VIRTIO_NET_THIS devfunc, BX_PLUGIN_VIRTIO_NET,
+                            "Virtio network device");
+  init_virtio(VIRTIO_ID_NET, 0x020000, 2,
+              (1 << VIRTIO_NET_F_CSUM) | (1 << VIRTIO_NET_F_GUEST_CSUM) |
+              (1 << VIRTIO_NET_F_MAC) | (1 << VIRTIO_NET_F_STATUS),
+              VIRTIO_NET_CONFIG_SIZE);
+  // device configuration: MAC address and link status
+  memcpy(&config[0], BX_VIRTIO_NET_THIS macaddr, 6);
+  WriteHostWordToLittleEndian((Bit16u*)&config[6], VIRTIO_NET_S_LINK_UP);
+
+  BX_VIRTIO_NET_THIS pci_rom_address = 0;
+  BX_VIRTIO_NET_THIS pci_rom_read_handler = rom_read_handler;
+  bootrom = SIM->get_param_string("bootrom", base);
+  if (!bootrom->isempty()) {
+    BX_VIRTIO_NET_THIS load_pci_rom(bootrom->getptr());
+  }
+
+  BX_VIRTIO_NET_THIS statusbar_id = bx_gui->register_statusitem("VNET", 1);
+
+  // Attach to the selected ethernet module
+  BX_VIRTIO_NET_THIS ethdev = DEV_net_init_module(base, rx_handler, rx_status_handler, this);
+
+  BX_INFO(("virtio network device initialized"));
+}
+
+void bx_virtio_net_c::reset(unsigned type)
+{
+  reset_virtio();
+}
+
+void bx_virtio_net_c::register_state(void)
+{
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "virtio_net", "Virtio Network State");
+  virtio_register_state(list);
+}
+
+void bx_virtio_net_c::after_restore_state(void)
+{
+  virtio_after_restore_state(rom_read_handler);
+}
+
+bool bx_virtio_net_c::rom_read_handler(bx_phy_address addr, unsigned len,
+                                       void *data, void *param)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) param;
+  Bit8u  *data_ptr;
+
+  Bit32u mask = (class_ptr->pci_rom_size - 1);
+#ifdef BX_LITTLE_ENDIAN
+  data_ptr = (Bit8u *) data;
+#else // BX_BIG_ENDIAN
+  data_ptr = (Bit8u *) data + (len - 1);
+#endif
+  for (unsigned i = 0; i < len; i++) {
+    if (class_ptr->pci_conf[0x30] & 0x01) {
+      *data_ptr = class_ptr->pci_rom[addr & mask];
+    } else {
+      *data_ptr = 0xff;
+    }
+    addr++;
+#ifdef BX_LITTLE_ENDIAN
+    data_ptr++;
+#else // BX_BIG_ENDIAN
+    data_ptr--;
+#endif
+  }
+  return 1;
+}
+
+void bx_virtio_net_c::virtio_queue_notify(unsigned q)
+{
+  if (q == VIRTIO_NET_TXQ) {
+    transmit();
+  } else {
+    // new receive buffers: the ethernet module polls rx_status()
+    virtio_queue_flush(q);
+  }
+}
+
+// send all frames available in the transmit queue
+void bx_virtio_net_c::transmit(void)
+{
+  bx_virtq_elem_t elem;
+  Bit8u hdr[VIRTIO_NET_HDR_SIZE];
+  Bit32u len;
+
+  while (virtio_queue_pop(VIRTIO_NET_TXQ, &elem)) {
+    if ((elem.out_len <= VIRTIO_NET_HDR_SIZE) ||
+        ((elem.out_len - VIRTIO_NET_HDR_SIZE) > VIRTIO_NET_MAX_FRAME)) {
+      BX_ERROR(("TX: invalid frame size %u", elem.out_len));
+      virtio_queue_push(VIRTIO_NET_TXQ, &elem, 0);
+      continue;
+    }
+    len = elem.out_len - VIRTIO_NET_HDR_SIZE;
+    virtio_elem_read(&elem, 0, hdr, VIRTIO_NET_HDR_SIZE);
+    virtio_elem_read(&elem, VIRTIO_NET_HDR_SIZE, BX_VIRTIO_NET_THIS tx_buffer, len);
+    if (hdr[0] & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+      if (!virtio_net_fill_csum(BX_VIRTIO_NET_THIS tx_buffer, len,
+                                ReadHostWordFromLittleEndian((Bit16u*)&hdr[6]),
+                                ReadHostWordFromLittleEndian((Bit16u*)&hdr[8]))) {
+        BX_ERROR(("TX: invalid checksum offsets"));
+      }
+    }
+    BX_VIRTIO_NET_THIS ethdev->sendpkt(BX_VIRTIO_NET_THIS tx_buffer, len);
+    bx_gui->statusbar_setitem(BX_VIRTIO_NET_THIS statusbar_id, 1, 1);
+    virtio_queue_push(VIRTIO_NET_TXQ, &elem, 0);
+  }
+  virtio_queue_flush(VIRTIO_NET_TXQ);
+}
+
+Bit32u bx_virtio_net_c::rx_status_handler(void *arg)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) arg;
+  return class_ptr->rx_status();
+}
+
+Bit32u bx_virtio_net_c::rx_status()
+{
+  Bit32u status = BX_NETDEV_1GBIT;
+  if (!virtio_queue_empty(VIRTIO_NET_RXQ)) {
+    status |= BX_NETDEV_RXREADY;
+  }
+  return status;
+}
+
+void bx_virtio_net_c::rx_handler(void *arg, const void *buf, unsigned len)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) arg;
+  class_ptr->rx_frame(buf, len);
+}
+
+void bx_virtio_net_c::rx_frame(const void *buf, unsigned len)
+{
+  bx_virtq_elem_t elem;
+  Bit8u hdr[VIRTIO_NET_HDR_SIZE];
+
+  if (!virtio_queue_pop(VIRTIO_NET_RXQ, &elem)) {
+    BX_DEBUG(("RX: no receive buffer available, frame dropped"));
+    return;
+  }
+  if (elem.in_len < (len + VIRTIO_NET_HDR_SIZE)) {
+    BX_ERROR(("RX: receive buffer too small (%u bytes), frame dropped", elem.in_len));
+    virtio_queue_push(VIRTIO_NET_RXQ, &elem, 0);
+  } else {
+    memset(hdr, 0, sizeof(hdr));
+    if (virtio_has_feature(VIRTIO_NET_F_GUEST_CSUM)) {
+      // frames from the host side don't need to be verified again
+      hdr[0] = VIRTIO_NET_HDR_F_DATA_VALID;
+    }
+    WriteHostWordToLittleEndian((Bit16u*)&hdr[10], 1); // num_buffers
+    virtio_elem_write(&elem, 0, hdr, VIRTIO_NET_HDR_SIZE);
+    virtio_elem_write(&elem, VIRTIO_NET_HDR_SIZE, (Bit8u*)buf, len);
+    virtio_queue_push(VIRTIO_NET_RXQ, &elem, len + VIRTIO_NET_HDR_SIZE);
+    bx_gui->statusbar_setitem(BX_VIRTIO_NET_THIS statusbar_id, 1);
+  }
+  virtio_queue_flush(VIRTIO_NET_RXQ);
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO && BX_NETWORKING
@@ -0,0 +1,62 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_VIRTIO_NET_H
+#define BX_IODEV_VIRTIO_NET_H
+
+#define BX_VIRTIO_NET_THIS this->
+
+// size of struct virtio_net_hdr (version 1 layout)
+#define VIRTIO_NET_HDR_SIZE   12
+#define VIRTIO_NET_MAX_FRAME  0x10000
+
+class bx_virtio_net_c : public bx_virtio_pci_c {
+public:
+  bx_virtio_net_c();
+  virtual ~bx_virtio_net_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+protected:
+  virtual void virtio_reset_device(void) {}
+  virtual void virtio_queue_notify(unsigned q);
+
+private:
+  Bit8u  macaddr[6];
+  Bit8u  *tx_buffer;
+  int statusbar_id;
+
+  eth_pktmover_c *ethdev;
+
+  void transmit(void);
+
+  static bool rom_read_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+
+  static Bit32u rx_status_handler(void *arg);
+  Bit32u rx_status(void);
+  static void rx_handler(void *arg, const void *buf, unsigned len);
+  void rx_frame(const void *buf, unsigned len);
+};
+
+#endif
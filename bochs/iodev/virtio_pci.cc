@@ -0,0 +1,900 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+//
+// Virtio 1.0 PCI transport (modern interface, split virtqueues)
+//
+// All virtio structures are located in the memory BAR #0. The vendor
+// specific PCI capabilities tell the driver where to find them:
+//   0x0000 common configuration
+//   0x1000 ISR status
+//   0x2000 device specific configuration
+//   0x3000 queue notification (4 bytes per queue)
+//   0x4000 MSI-X table, 0x5000 MSI-X pending bits
+// The virtqueues are accessed with bulk DMA reads and writes: the new
+// entries of the available ring are read at once and the used ring entries
+// are written back in one go after the device processed a notification.
+//
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+
+#if BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO
+
+#include "pci.h"
+#include "ioapic.h"
+#include "virtio_pci.h"
+
+#define LOG_THIS
+
+#define VIRTIO_BAR_SIZE        0x8000
+#define VIRTIO_COMMON_OFFSET   0x0000
+#define VIRTIO_COMMON_SIZE     0x38
+#define VIRTIO_ISR_OFFSET      0x1000
+#define VIRTIO_DEVICE_OFFSET   0x2000
+#define VIRTIO_NOTIFY_OFFSET   0x3000
+#define VIRTIO_NOTIFY_MULT     4
+#define VIRTIO_MSIX_TABLE      0x4000
+#define VIRTIO_MSIX_PBA        0x5000
+
+// PCI capabilities
+#define VIRTIO_CAP_COMMON      0x40
+#define VIRTIO_CAP_NOTIFY      0x50
+#define VIRTIO_CAP_ISR         0x64
+#define VIRTIO_CAP_DEVICE      0x74
+#define VIRTIO_CAP_PCI_CFG     0x84
+#define VIRTIO_CAP_MSIX        0x98
+
+#define VIRTIO_PCI_CAP_COMMON_CFG  1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG  2
+#define VIRTIO_PCI_CAP_ISR_CFG     3
+#define VIRTIO_PCI_CAP_DEVICE_CFG  4
+#define VIRTIO_PCI_CAP_PCI_CFG     5
+
+// ISR status bits
+#define VIRTIO_ISR_QUEUE   0x01
+#define VIRTIO_ISR_CONFIG  0x02
+
+// descriptor flags
+#define VIRTQ_DESC_F_NEXT      1
+#define VIRTQ_DESC_F_WRITE     2
+#define VIRTQ_DESC_F_INDIRECT  4
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+
+static void virtio_set_cap(Bit8u *conf, Bit8u next, Bit8u len, Bit8u type,
+                           Bit32u offset, Bit32u length)
+{
+  conf[0] = 0x09; // vendor specific
+  conf[1] = next;
+  conf[2] = len;
+  conf[3] = type;
+  conf[4] = 0;    // BAR #0
+  WriteHostDWordToLittleEndian((Bit32u*)&conf[8], offset);
+  WriteHostDWordToLittleEndian((Bit32u*)&conf[12], length);
+}
+
+bx_virtio_pci_c::bx_virtio_pci_c()
+{
+  devfunc = 0x00;
+  num_queues = 0;
+  config_size = 0;
+  device_features = 0;
+  memset(config, 0, sizeof(config));
+  memset(msix_table, 0, sizeof(msix_table));
+  reset_transport();
+}
+
+bx_virtio_pci_c::~bx_virtio_pci_c()
+{
+}
+
+void bx_virtio_pci_c::init_virtio(Bit16u device_type, Bit32u classc, unsigned nqueues,
+                                  Bit64u features, unsigned cfg_size)
+{
+  num_queues = nqueues;
+  config_size = cfg_size;
+  device_features = features | ((Bit64u)1 << VIRTIO_F_VERSION_1) |
+                    (1 << VIRTIO_RING_F_INDIRECT_DESC) | (1 << VIRTIO_RING_F_EVENT_IDX);
+
+  init_pci_conf(VIRTIO_PCI_VENDOR, VIRTIO_PCI_DEVICE_BASE + device_type, 0x01,
+                classc, 0x00, BX_PCI_INTA);
+  // subsystem vendor / device
+  pci_conf[0x2c] = (Bit8u)(VIRTIO_PCI_VENDOR & 0xff);
+  pci_conf[0x2d] = (Bit8u)(VIRTIO_PCI_VENDOR >> 8);
+  pci_conf[0x2e] = 0x40;
+  pci_conf[0x2f] = 0x00;
+  init_bar_mem(0, VIRTIO_BAR_SIZE, mem_read_handler, mem_write_handler);
+
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_COMMON], VIRTIO_CAP_NOTIFY, 16,
+                 VIRTIO_PCI_CAP_COMMON_CFG, VIRTIO_COMMON_OFFSET, VIRTIO_COMMON_SIZE);
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_NOTIFY], VIRTIO_CAP_ISR, 20,
+                 VIRTIO_PCI_CAP_NOTIFY_CFG, VIRTIO_NOTIFY_OFFSET,
+                 num_queues * VIRTIO_NOTIFY_MULT);
+  WriteHostDWordToLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_NOTIFY + 16], VIRTIO_NOTIFY_MULT);
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_ISR], VIRTIO_CAP_DEVICE, 16,
+                 VIRTIO_PCI_CAP_ISR_CFG, VIRTIO_ISR_OFFSET, 1);
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_DEVICE], VIRTIO_CAP_PCI_CFG, 16,
+                 VIRTIO_PCI_CAP_DEVICE_CFG, VIRTIO_DEVICE_OFFSET, config_size);
+#if BX_SUPPORT_APIC
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_PCI_CFG], VIRTIO_CAP_MSIX, 20,
+                 VIRTIO_PCI_CAP_PCI_CFG, 0, 0);
+  // MSI-X: one vector per queue plus one for configuration changes
+  pci_conf[VIRTIO_CAP_MSIX] = 0x11;
+  pci_conf[VIRTIO_CAP_MSIX + 2] = (Bit8u)(num_queues);
+  WriteHostDWordToLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_MSIX + 4], VIRTIO_MSIX_TABLE);
+  WriteHostDWordToLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_MSIX + 8], VIRTIO_MSIX_PBA);
+#else
+  virtio_set_cap(&pci_conf[VIRTIO_CAP_PCI_CFG], 0x00, 20,
+                 VIRTIO_PCI_CAP_PCI_CFG, 0, 0);
+#endif
+}
+
+void bx_virtio_pci_c::reset_virtio(void)
+{
+  unsigned i;
+
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x04, 0x00 }, { 0x05, 0x00 }, // command
+    { 0x06, 0x10 }, { 0x07, 0x00 }, // status: capabilities list
+    { 0x10, 0x00 }, { 0x11, 0x00 }, // BAR #0
+    { 0x12, 0x00 }, { 0x13, 0x00 },
+    { 0x3c, 0x00 },                 // IRQ
+    { 0x34, VIRTIO_CAP_COMMON },    // capabilities pointer
+  };
+  for (i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+    pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+  memset(&pci_conf[VIRTIO_CAP_PCI_CFG + 4], 0, 16);
+  pci_conf[VIRTIO_CAP_MSIX + 3] = 0x00;
+  memset(msix_table, 0, sizeof(msix_table));
+  for (i = 0; i < VIRTIO_MSIX_VECTORS; i++) {
+    msix_table[i * 16 + 12] = 0x01; // masked
+  }
+  reset_transport();
+  virtio_reset_device();
+  update_irq();
+}
+
+void bx_virtio_pci_c::reset_transport(void)
+{
+  driver_features = 0;
+  device_feature_select = 0;
+  driver_feature_select = 0;
+  msix_config = VIRTIO_NO_VECTOR;
+  queue_select = 0;
+  status = 0;
+  config_generation = 0;
+  isr = 0;
+  msix_pending = 0;
+  for (unsigned q = 0; q < VIRTIO_MAX_QUEUES; q++) {
+    memset(&vq[q], 0, sizeof(bx_virtq_t));
+    vq[q].size = VIRTIO_QUEUE_MAX_SIZE;
+    vq[q].msix_vector = VIRTIO_NO_VECTOR;
+    avail_cached[q] = 0;
+    avail_pos[q] = 0;
+    used_cached[q] = 0;
+  }
+}
+
+void bx_virtio_pci_c::virtio_register_state(bx_list_c *parent)
+{
+  char qname[8];
+
+  bx_list_c *list = new bx_list_c(parent, "virtio", "Virtio PCI transport");
+  BXRS_HEX_PARAM_FIELD(list, driver_features, driver_features);
+  BXRS_HEX_PARAM_FIELD(list, device_feature_select, device_feature_select);
+  BXRS_HEX_PARAM_FIELD(list, driver_feature_select, driver_feature_select);
+  BXRS_HEX_PARAM_FIELD(list, msix_config, msix_config);
+  BXRS_DEC_PARAM_FIELD(list, queue_select, queue_select);
+  BXRS_HEX_PARAM_FIELD(list, status, status);
+  BXRS_DEC_PARAM_FIELD(list, config_generation, config_generation);
+  BXRS_HEX_PARAM_FIELD(list, isr, isr);
+  BXRS_HEX_PARAM_FIELD(list, msix_pending, msix_pending);
+  new bx_shadow_data_c(list, "msix_table", msix_table, sizeof(msix_table), 1);
+  for (unsigned q = 0; q < num_queues; q++) {
+    sprintf(qname, "queue%d", q);
+    bx_list_c *qlist = new bx_list_c(list, qname, "");
+    BXRS_DEC_PARAM_FIELD(qlist, size, vq[q].size);
+    BXRS_PARAM_BOOL(qlist, enabled, vq[q].enabled);
+    BXRS_HEX_PARAM_FIELD(qlist, msix_vector, vq[q].msix_vector);
+    BXRS_HEX_PARAM_FIELD(qlist, desc, vq[q].desc);
+    BXRS_HEX_PARAM_FIELD(qlist, avail, vq[q].avail);
+    BXRS_HEX_PARAM_FIELD(qlist, used, vq[q].used);
+    BXRS_DEC_PARAM_FIELD(qlist, last_avail_idx, vq[q].last_avail_idx);
+    BXRS_DEC_PARAM_FIELD(qlist, used_idx, vq[q].used_idx);
+  }
+  register_pci_state(parent);
+}
+
+void bx_virtio_pci_c::virtio_after_restore_state(memory_handler_t rom_read_handler)
+{
+  for (unsigned q = 0; q < VIRTIO_MAX_QUEUES; q++) {
+    avail_cached[q] = 0;
+    avail_pos[q] = 0;
+    used_cached[q] = 0;
+  }
+  bx_pci_device_c::after_restore_pci_state(rom_read_handler);
+}
+
+// interrupt handling
+
+bool bx_virtio_pci_c::msix_enabled(void)
+{
+#if BX_SUPPORT_APIC
+  return (pci_conf[VIRTIO_CAP_MSIX + 3] & 0x80) != 0;
+#else
+  return 0;
+#endif
+}
+
+void bx_virtio_pci_c::update_irq(void)
+{
+  bool level = (isr != 0) && !msix_enabled();
+
+  if (level) {
+    pci_conf[0x06] |= 0x08;
+  } else {
+    pci_conf[0x06] &= ~0x08;
+  }
+  if (pci_conf[0x05] & 0x04) {
+    level = 0; // INTx disabled
+  }
+  DEV_pci_set_irq(devfunc, pci_conf[0x3d], level);
+}
+
+void bx_virtio_pci_c::raise_irq(Bit8u isr_bit, Bit16u vector)
+{
+  if (msix_enabled()) {
+    // the ISR queue bit is only used with INTx
+    if (isr_bit == VIRTIO_ISR_CONFIG) {
+      isr |= isr_bit;
+    }
+    if (vector != VIRTIO_NO_VECTOR) {
+      send_msix(vector);
+    }
+  } else {
+    isr |= isr_bit;
+    update_irq();
+  }
+}
+
+void bx_virtio_pci_c::send_msix(unsigned vector)
+{
+#if BX_SUPPORT_APIC
+  if (vector >= VIRTIO_MSIX_VECTORS) {
+    return;
+  }
+  Bit8u *entry = &msix_table[vector * 16];
+  if ((pci_conf[VIRTIO_CAP_MSIX + 3] & 0x40) || (entry[12] & 0x01)) {
+    // function or vector masked
+    msix_pending |= (1 << vector);
+    return;
+  }
+  msix_pending &= ~(1 << vector);
+  Bit32u addr = ReadHostDWordFromLittleEndian((Bit32u*)entry);
+  Bit32u data = ReadHostDWordFromLittleEndian((Bit32u*)&entry[8]);
+  if ((addr & 0xfff00000) != 0xfee00000) {
+    BX_ERROR(("MSI-X address 0x%08x is not in the APIC range", addr));
+    return;
+  }
+  apic_bus_deliver_interrupt(data & 0xff, (addr >> 12) & 0xff, (data >> 8) & 0x07,
+                             (addr >> 2) & 0x01, (data >> 14) & 0x01, (data >> 15) & 0x01);
+#endif
+}
+
+void bx_virtio_pci_c::virtio_config_changed(void)
+{
+  config_generation++;
+  if (status & VIRTIO_STATUS_DRIVER_OK) {
+    raise_irq(VIRTIO_ISR_CONFIG, msix_config);
+  }
+}
+
+// virtqueue handling
+
+bool bx_virtio_pci_c::virtio_queue_ready(unsigned q)
+{
+  return (q < num_queues) && vq[q].enabled && (status & VIRTIO_STATUS_DRIVER_OK);
+}
+
+bool bx_virtio_pci_c::virtio_queue_empty(unsigned q)
+{
+  Bit16u idx;
+
+  if (!virtio_queue_ready(q)) {
+    return 1;
+  }
+  if (avail_pos[q] < avail_cached[q]) {
+    return 0;
+  }
+  DEV_MEM_READ_PHYSICAL_DMA(vq[q].avail + 2, 2, (Bit8u*)&idx);
+  return (ReadHostWordFromLittleEndian(&idx) == vq[q].last_avail_idx);
+}
+
+bool bx_virtio_pci_c::read_desc(Bit64u table, unsigned i, Bit64u *addr, Bit32u *len,
+                                Bit16u *flags, Bit16u *next)
+{
+  Bit8u desc[16];
+
+  DEV_MEM_READ_PHYSICAL_DMA(table + i * 16, 16, desc);
+  *addr = ReadHostQWordFromLittleEndian((Bit64u*)desc);
+  *len = ReadHostDWordFromLittleEndian((Bit32u*)&desc[8]);
+  *flags = ReadHostWordFromLittleEndian((Bit16u*)&desc[12]);
+  *next = ReadHostWordFromLittleEndian((Bit16u*)&desc[14]);
+  return 1;
+}
+
+bool bx_virtio_pci_c::add_desc(bx_virtq_elem_t *elem, Bit64u addr, Bit32u len, bool write)
+{
+  unsigned n = elem->out_num + elem->in_num;
+
+  if (n >= VIRTIO_MAX_SG) {
+    BX_ERROR(("descriptor chain too long"));
+    return 0;
+  }
+  if (write) {
+    elem->in_num++;
+    elem->in_len += len;
+  } else {
+    if (elem->in_num > 0) {
+      BX_ERROR(("device readable descriptor after a writable one"));
+      return 0;
+    }
+    elem->out_num++;
+    elem->out_len += len;
+  }
+  elem->addr[n] = addr;
+  elem->len[n] = len;
+  return 1;
+}
+
+bool bx_virtio_pci_c::virtio_queue_pop(unsigned q, bx_virtq_elem_t *elem)
+{
+  bx_virtq_t *queue = &vq[q];
+  Bit8u ring[VIRTIO_QUEUE_MAX_SIZE * 2], table[VIRTIO_MAX_SG * 16];
+  Bit64u addr;
+  Bit32u len;
+  Bit16u idx, flags, next;
+  unsigned i, j, n, start, count;
+
+  if (!virtio_queue_ready(q)) {
+    return 0;
+  }
+  if (avail_pos[q] >= avail_cached[q]) {
+    // fetch all new entries of the available ring at once
+    DEV_MEM_READ_PHYSICAL_DMA(queue->avail + 2, 2, (Bit8u*)&idx);
+    n = (Bit16u)(ReadHostWordFromLittleEndian(&idx) - queue->last_avail_idx);
+    if (n == 0) {
+      return 0;
+    }
+    if (n > queue->size) {
+      BX_ERROR(("queue %d: available index out of range", q));
+      status |= VIRTIO_STATUS_NEEDS_RESET;
+      return 0;
+    }
+    start = queue->last_avail_idx % queue->size;
+    count = (n > (unsigned)(queue->size - start)) ? (queue->size - start) : n;
+    DEV_MEM_READ_PHYSICAL_DMA(queue->avail + 4 + start * 2, count * 2, ring);
+    if (count < n) {
+      DEV_MEM_READ_PHYSICAL_DMA(queue->avail + 4, (n - count) * 2, &ring[count * 2]);
+    }
+    for (i = 0; i < n; i++) {
+      avail_cache[q][i] = ReadHostWordFromLittleEndian((Bit16u*)&ring[i * 2]);
+    }
+    avail_cached[q] = n;
+    avail_pos[q] = 0;
+  }
+  elem->head = avail_cache[q][avail_pos[q]++];
+  elem->out_num = 0;
+  elem->in_num = 0;
+  elem->out_len = 0;
+  elem->in_len = 0;
+  queue->last_avail_idx++;
+
+  i = elem->head;
+  for (count = 0; count < queue->size; count++) {
+    if (i >= queue->size) {
+      BX_ERROR(("queue %d: descriptor index %d out of range", q, i));
+      status |= VIRTIO_STATUS_NEEDS_RESET;
+      return 0;
+    }
+    read_desc(queue->desc, i, &addr, &len, &flags, &next);
+    if (flags & VIRTQ_DESC_F_INDIRECT) {
+      // the indirect table is read with one DMA access
+      n = len / 16;
+      if (!virtio_has_feature(VIRTIO_RING_F_INDIRECT_DESC) || (n == 0) ||
+          (n > VIRTIO_MAX_SG)) {
+        BX_ERROR(("queue %d: invalid indirect descriptor table", q));
+        status |= VIRTIO_STATUS_NEEDS_RESET;
+        return 0;
+      }
+      DEV_MEM_READ_PHYSICAL_DMA(addr, n * 16, table);
+      j = 0;
+      for (unsigned k = 0; k < n; k++) {
+        if (j >= n) {
+          BX_ERROR(("queue %d: indirect descriptor index out of range", q));
+          return 0;
+        }
+        Bit8u *desc = &table[j * 16];
+        flags = ReadHostWordFromLittleEndian((Bit16u*)&desc[12]);
+        if (!add_desc(elem, ReadHostQWordFromLittleEndian((Bit64u*)desc),
+                      ReadHostDWordFromLittleEndian((Bit32u*)&desc[8]),
+                      (flags & VIRTQ_DESC_F_WRITE) != 0)) {
+          return 0;
+        }
+        if (!(flags & VIRTQ_DESC_F_NEXT)) {
+          break;
+        }
+        j = ReadHostWordFromLittleEndian((Bit16u*)&desc[14]);
+      }
+      return 1;
+    }
+    if (!add_desc(elem, addr, len, (flags & VIRTQ_DESC_F_WRITE) != 0)) {
+      return 0;
+    }
+    if (!(flags & VIRTQ_DESC_F_NEXT)) {
+      return 1;
+    }
+    i = next;
+  }
+  BX_ERROR(("queue %d: descriptor loop detected", q));
+  status |= VIRTIO_STATUS_NEEDS_RESET;
+  return 0;
+}
+
+void bx_virtio_pci_c::virtio_queue_push(unsigned q, bx_virtq_elem_t *elem, Bit32u len)
+{
+  used_cache[q][used_cached[q]].id = elem->head;
+  used_cache[q][used_cached[q]].len = len;
+  if (++used_cached[q] >= vq[q].size) {
+    virtio_queue_flush(q);
+  }
+}
+
+// Write the completed chains back to the used ring, update the used index
+// and notify the driver if it asked for it.
+void bx_virtio_pci_c::virtio_queue_flush(unsigned q)
+{
+  bx_virtq_t *queue = &vq[q];
+  Bit8u ring[VIRTIO_QUEUE_MAX_SIZE * 8];
+  Bit16u idx, old_idx, event;
+  unsigned i, n = used_cached[q], start, count;
+  bool notify;
+
+  if (!virtio_queue_ready(q)) {
+    used_cached[q] = 0;
+    return;
+  }
+  if (n > 0) {
+    for (i = 0; i < n; i++) {
+      WriteHostDWordToLittleEndian((Bit32u*)&ring[i * 8], used_cache[q][i].id);
+      WriteHostDWordToLittleEndian((Bit32u*)&ring[i * 8 + 4], used_cache[q][i].len);
+    }
+    start = queue->used_idx % queue->size;
+    count = (n > (unsigned)(queue->size - start)) ? (queue->size - start) : n;
+    DEV_MEM_WRITE_PHYSICAL_DMA(queue->used + 4 + start * 8, count * 8, ring);
+    if (count < n) {
+      DEV_MEM_WRITE_PHYSICAL_DMA(queue->used + 4, (n - count) * 8, &ring[count * 8]);
+    }
+    old_idx = queue->used_idx;
+    queue->used_idx += n;
+    WriteHostWordToLittleEndian(&idx, queue->used_idx);
+    DEV_MEM_WRITE_PHYSICAL_DMA(queue->used + 2, 2, (Bit8u*)&idx);
+    used_cached[q] = 0;
+
+    if (virtio_has_feature(VIRTIO_RING_F_EVENT_IDX)) {
+      DEV_MEM_READ_PHYSICAL_DMA(queue->avail + 4 + queue->size * 2, 2, (Bit8u*)&event);
+      event = ReadHostWordFromLittleEndian(&event);
+      notify = (Bit16u)(queue->used_idx - event - 1) < (Bit16u)(queue->used_idx - old_idx);
+    } else {
+      DEV_MEM_READ_PHYSICAL_DMA(queue->avail, 2, (Bit8u*)&event);
+      notify = (ReadHostWordFromLittleEndian(&event) & VIRTQ_AVAIL_F_NO_INTERRUPT) == 0;
+    }
+    if (notify) {
+      raise_irq(VIRTIO_ISR_QUEUE, queue->msix_vector);
+    }
+  }
+  if (virtio_has_feature(VIRTIO_RING_F_EVENT_IDX)) {
+    // ask for a notification as soon as a new buffer is available
+    WriteHostWordToLittleEndian(&idx, queue->last_avail_idx);
+    DEV_MEM_WRITE_PHYSICAL_DMA(queue->used + 4 + queue->size * 8, 2, (Bit8u*)&idx);
+  }
+}
+
+// Copy data from the device readable buffers of a chain, starting at offset.
+Bit32u bx_virtio_pci_c::virtio_elem_read(bx_virtq_elem_t *elem, Bit32u offset,
+                                         Bit8u *buf, Bit32u len)
+{
+  Bit32u done = 0, n;
+
+  for (unsigned i = 0; (i < elem->out_num) && (done < len); i++) {
+    if (offset >= elem->len[i]) {
+      offset -= elem->len[i];
+      continue;
+    }
+    n = elem->len[i] - offset;
+    if (n > (len - done)) n = len - done;
+    DEV_MEM_READ_PHYSICAL_DMA(elem->addr[i] + offset, n, buf + done);
+    done += n;
+    offset = 0;
+  }
+  return done;
+}
+
+// Copy data to the device writable buffers of a chain, starting at offset.
+Bit32u bx_virtio_pci_c::virtio_elem_write(bx_virtq_elem_t *elem, Bit32u offset,
+                                          Bit8u *buf, Bit32u len)
+{
+  Bit32u done = 0, n;
+
+  for (unsigned i = elem->out_num; (i < elem->out_num + elem->in_num) && (done < len); i++) {
+    if (offset >= elem->len[i]) {
+      offset -= elem->len[i];
+      continue;
+    }
+    n = elem->len[i] - offset;
+    if (n > (len - done)) n = len - done;
+    DEV_MEM_WRITE_PHYSICAL_DMA(elem->addr[i] + offset, n, buf + done);
+    done += n;
+    offset = 0;
+  }
+  return done;
+}
+
+// register access
+
+Bit32u bx_virtio_pci_c::common_read(Bit32u offset, unsigned len)
+{
+  Bit8u regs[VIRTIO_COMMON_SIZE];
+  Bit32u value = 0;
+  bx_virtq_t *queue = NULL;
+
+  if (queue_select < num_queues) {
+    queue = &vq[queue_select];
+  }
+  memset(regs, 0, sizeof(regs));
+  WriteHostDWordToLittleEndian((Bit32u*)&regs[0x00], device_feature_select);
+  if (device_feature_select < 2) {
+    WriteHostDWordToLittleEndian((Bit32u*)&regs[0x04],
+      (Bit32u)(device_features >> (device_feature_select * 32)));
+  }
+  WriteHostDWordToLittleEndian((Bit32u*)&regs[0x08], driver_feature_select);
+  if (driver_feature_select < 2) {
+    WriteHostDWordToLittleEndian((Bit32u*)&regs[0x0c],
+      (Bit32u)(driver_features >> (driver_feature_select * 32)));
+  }
+  WriteHostWordToLittleEndian((Bit16u*)&regs[0x10], msix_config);
+  WriteHostWordToLittleEndian((Bit16u*)&regs[0x12], num_queues);
+  regs[0x14] = status;
+  regs[0x15] = config_generation;
+  WriteHostWordToLittleEndian((Bit16u*)&regs[0x16], queue_select);
+  if (queue != NULL) {
+    WriteHostWordToLittleEndian((Bit16u*)&regs[0x18], queue->size);
+    WriteHostWordToLittleEndian((Bit16u*)&regs[0x1a], queue->msix_vector);
+    WriteHostWordToLittleEndian((Bit16u*)&regs[0x1c], queue->enabled);
+    WriteHostWordToLittleEndian((Bit16u*)&regs[0x1e], queue_select);
+    WriteHostQWordToLittleEndian((Bit64u*)&regs[0x20], queue->desc);
+    WriteHostQWordToLittleEndian((Bit64u*)&regs[0x28], queue->avail);
+    WriteHostQWordToLittleEndian((Bit64u*)&regs[0x30], queue->used);
+  }
+  for (unsigned i = 0; (i < len) && ((offset + i) < VIRTIO_COMMON_SIZE); i++) {
+    value |= (Bit32u)regs[offset + i] << (i * 8);
+  }
+  return value;
+}
+
+void bx_virtio_pci_c::common_write(Bit32u offset, unsigned len, Bit32u value)
+{
+  bx_virtq_t *queue = NULL;
+  Bit8u old_status;
+
+  if (queue_select < num_queues) {
+    queue = &vq[queue_select];
+  }
+  switch (offset) {
+    case 0x00:
+      device_feature_select = value;
+      break;
+    case 0x08:
+      driver_feature_select = value;
+      break;
+    case 0x0c:
+      if (status & VIRTIO_STATUS_FEATURES_OK) {
+        BX_ERROR(("driver features written after FEATURES_OK"));
+      } else if (driver_feature_select == 0) {
+        driver_features = (driver_features & BX_CONST64(0xffffffff00000000)) | value;
+      } else if (driver_feature_select == 1) {
+        driver_features = (driver_features & 0xffffffff) | ((Bit64u)value << 32);
+      }
+      break;
+    case 0x10:
+      msix_config = (value <= num_queues) ? (Bit16u)value : VIRTIO_NO_VECTOR;
+      break;
+    case 0x14:
+      value &= 0xff;
+      if (value == 0) {
+        BX_DEBUG(("device reset"));
+        reset_transport();
+        virtio_reset_device();
+        update_irq();
+        break;
+      }
+      if ((value & VIRTIO_STATUS_FEATURES_OK) && !(status & VIRTIO_STATUS_FEATURES_OK)) {
+        if ((driver_features & ~device_features) != 0) {
+          BX_ERROR(("driver accepted unsupported features"));
+          value &= ~VIRTIO_STATUS_FEATURES_OK;
+        } else if (!virtio_has_feature(VIRTIO_F_VERSION_1)) {
+          BX_ERROR(("legacy driver not supported"));
+          value &= ~VIRTIO_STATUS_FEATURES_OK;
+        }
+      }
+      old_status = status;
+      status = (Bit8u)value | (status & VIRTIO_STATUS_NEEDS_RESET);
+      if ((status & VIRTIO_STATUS_DRIVER_OK) && !(old_status & VIRTIO_STATUS_DRIVER_OK)) {
+        BX_DEBUG(("driver ready, features = 0x" FMT_LL "x", driver_features));
+        virtio_driver_ok();
+      }
+      break;
+    case 0x16:
+      queue_select = (Bit16u)value;
+      break;
+    case 0x18:
+      if (queue != NULL) {
+        value &= 0xffff;
+        if ((value == 0) || (value > VIRTIO_QUEUE_MAX_SIZE) || (value & (value - 1))) {
+          BX_ERROR(("queue %d: invalid size %d", queue_select, value));
+        } else {
+          queue->size = (Bit16u)value;
+        }
+      }
+      break;
+    case 0x1a:
+      if (queue != NULL) {
+        value &= 0xffff;
+        queue->msix_vector = (value <= num_queues) ? (Bit16u)value : VIRTIO_NO_VECTOR;
+      }
+      break;
+    case 0x1c:
+      if ((queue != NULL) && ((value & 0xffff) == 1)) {
+        queue->enabled = 1;
+      }
+      break;
+    case 0x20: case 0x24: case 0x28: case 0x2c: case 0x30: case 0x34:
+      if (queue != NULL) {
+        Bit64u *addr = (offset < 0x28) ? &queue->desc :
+                       (offset < 0x30) ? &queue->avail : &queue->used;
+        if (offset & 4) {
+          *addr = (*addr & 0xffffffff) | ((Bit64u)value << 32);
+        } else {
+          *addr = (*addr & BX_CONST64(0xffffffff00000000)) | value;
+        }
+      }
+      break;
+    default:
+      BX_ERROR(("write to read-only common config register 0x%02x ignored", offset));
+  }
+}
+
+Bit32u bx_virtio_pci_c::bar_read(Bit32u offset, unsigned len)
+{
+  Bit32u value = 0;
+  unsigned i;
+
+  if (offset < VIRTIO_ISR_OFFSET) {
+    value = common_read(offset, len);
+  } else if (offset == VIRTIO_ISR_OFFSET) {
+    // reading the ISR status acknowledges the interrupt
+    value = isr;
+    isr = 0;
+    update_irq();
+  } else if ((offset >= VIRTIO_DEVICE_OFFSET) && (offset < VIRTIO_NOTIFY_OFFSET)) {
+    offset -= VIRTIO_DEVICE_OFFSET;
+    for (i = 0; (i < len) && ((offset + i) < config_size); i++) {
+      value |= (Bit32u)config[offset + i] << (i * 8);
+    }
+  } else if ((offset >= VIRTIO_MSIX_TABLE) && (offset < (VIRTIO_MSIX_TABLE + sizeof(msix_table)))) {
+    offset -= VIRTIO_MSIX_TABLE;
+    for (i = 0; (i < len) && ((offset + i) < sizeof(msix_table)); i++) {
+      value |= (Bit32u)msix_table[offset + i] << (i * 8);
+    }
+  } else if ((offset >= VIRTIO_MSIX_PBA) && (offset < (VIRTIO_MSIX_PBA + 8))) {
+    if (offset < (VIRTIO_MSIX_PBA + 4)) {
+      value = msix_pending >> ((offset - VIRTIO_MSIX_PBA) * 8);
+    }
+  }
+  if (len < 4) {
+    value &= (1 << (len * 8)) - 1;
+  }
+  return value;
+}
+
+void bx_virtio_pci_c::bar_write(Bit32u offset, unsigned len, Bit32u value)
+{
+  unsigned i;
+
+  if (offset < VIRTIO_COMMON_SIZE) {
+    common_write(offset, len, value);
+  } else if ((offset >= VIRTIO_DEVICE_OFFSET) && (offset < (VIRTIO_DEVICE_OFFSET + config_size))) {
+    virtio_config_write(offset - VIRTIO_DEVICE_OFFSET, len, value);
+  } else if ((offset >= VIRTIO_NOTIFY_OFFSET) &&
+             (offset < (VIRTIO_NOTIFY_OFFSET + num_queues * VIRTIO_NOTIFY_MULT))) {
+    unsigned q = (offset - VIRTIO_NOTIFY_OFFSET) / VIRTIO_NOTIFY_MULT;
+    if (virtio_queue_ready(q)) {
+      virtio_queue_notify(q);
+    }
+  } else if ((offset >= VIRTIO_MSIX_TABLE) && (offset < (VIRTIO_MSIX_TABLE + sizeof(msix_table)))) {
+    offset -= VIRTIO_MSIX_TABLE;
+    for (i = 0; (i < len) && ((offset + i) < sizeof(msix_table)); i++) {
+      msix_table[offset + i] = (Bit8u)(value >> (i * 8));
+    }
+    unsigned vector = offset / 16;
+    if ((msix_pending & (1 << vector)) && !(msix_table[vector * 16 + 12] & 0x01)) {
+      // vector unmasked: deliver the pending message
+      send_msix(vector);
+    }
+  } else if (offset != VIRTIO_ISR_OFFSET) {
+    BX_DEBUG(("write to unused BAR offset 0x%04x ignored", offset));
+  }
+}
+
+bool bx_virtio_pci_c::mem_read_handler(bx_phy_address addr, unsigned len,
+                                       void *data, void *param)
+{
+  bx_virtio_pci_c *class_ptr = (bx_virtio_pci_c *) param;
+  Bit32u offset = (Bit32u)addr & (VIRTIO_BAR_SIZE - 1);
+
+  switch (len) {
+    case 1:
+      *((Bit8u*)data) = (Bit8u)class_ptr->bar_read(offset, 1);
+      break;
+    case 2:
+      *((Bit16u*)data) = (Bit16u)class_ptr->bar_read(offset, 2);
+      break;
+    case 8:
+      *((Bit64u*)data) = class_ptr->bar_read(offset, 4) |
+                         ((Bit64u)class_ptr->bar_read(offset + 4, 4) << 32);
+      break;
+    default:
+      *((Bit32u*)data) = class_ptr->bar_read(offset, 4);
+  }
+  return 1;
+}
+
+bool bx_virtio_pci_c::mem_write_handler(bx_phy_address addr, unsigned len,
+                                        void *data, void *param)
+{
+  bx_virtio_pci_c *class_ptr = (bx_virtio_pci_c *) param;
+  Bit32u offset = (Bit32u)addr & (VIRTIO_BAR_SIZE - 1);
+
+  switch (len) {
+    case 1:
+      class_ptr->bar_write(offset, 1, *((Bit8u*)data));
+      break;
+    case 2:
+      class_ptr->bar_write(offset, 2, *((Bit16u*)data));
+      break;
+    case 8:
+      class_ptr->bar_write(offset, 4, (Bit32u)*((Bit64u*)data));
+      class_ptr->bar_write(offset + 4, 4, (Bit32u)(*((Bit64u*)data) >> 32));
+      break;
+    default:
+      class_ptr->bar_write(offset, 4, *((Bit32u*)data));
+  }
+  return 1;
+}
+
+// pci configuration space read callback handler
+Bit32u bx_virtio_pci_c::pci_read_handler(Bit8u address, unsigned io_len)
+{
+  if (((address + io_len) > (VIRTIO_CAP_PCI_CFG + 16)) && (address < (VIRTIO_CAP_PCI_CFG + 20))) {
+    // PCI configuration access window into BAR #0
+    Bit8u len = pci_conf[VIRTIO_CAP_PCI_CFG + 12];
+    Bit32u offset = ReadHostDWordFromLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_PCI_CFG + 8]);
+    if ((pci_conf[VIRTIO_CAP_PCI_CFG + 4] == 0) && ((len == 1) || (len == 2) || (len == 4))) {
+      WriteHostDWordToLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_PCI_CFG + 16],
+                                   bar_read(offset & (VIRTIO_BAR_SIZE - 1), len));
+    }
+  }
+  return bx_pci_device_c::pci_read_handler(address, io_len);
+}
+
+// pci configuration space write callback handler
+void bx_virtio_pci_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  Bit8u value8, oldval;
+  bool intx_change = 0, msix_change = 0, cfg_access = 0;
+
+  if ((address >= 0x10) && (address < 0x34))
+    return;
+
+  BX_DEBUG_PCI_WRITE(address, value, io_len);
+  for (unsigned i=0; i<io_len; i++) {
+    value8 = (value >> (i*8)) & 0xFF;
+    oldval = pci_conf[address+i];
+    switch (address+i) {
+      case 0x04:
+        value8 &= 0x06;
+        break;
+      case 0x05:
+        value8 &= 0x04;
+        intx_change = (value8 != oldval);
+        break;
+      case VIRTIO_CAP_PCI_CFG + 4:
+      case VIRTIO_CAP_PCI_CFG + 8:
+      case VIRTIO_CAP_PCI_CFG + 9:
+      case VIRTIO_CAP_PCI_CFG + 10:
+      case VIRTIO_CAP_PCI_CFG + 11:
+      case VIRTIO_CAP_PCI_CFG + 12:
+      case VIRTIO_CAP_PCI_CFG + 13:
+      case VIRTIO_CAP_PCI_CFG + 14:
+      case VIRTIO_CAP_PCI_CFG + 15:
+        break;
+      case VIRTIO_CAP_PCI_CFG + 16:
+      case VIRTIO_CAP_PCI_CFG + 17:
+      case VIRTIO_CAP_PCI_CFG + 18:
+      case VIRTIO_CAP_PCI_CFG + 19:
+        cfg_access = 1;
+        break;
+#if BX_SUPPORT_APIC
+      case VIRTIO_CAP_MSIX + 3:
+        value8 &= 0xc0;
+        msix_change = (value8 != oldval);
+        break;
+#endif
+      default:
+        value8 = oldval;
+    }
+    pci_conf[address+i] = value8;
+  }
+  if (cfg_access) {
+    Bit8u len = pci_conf[VIRTIO_CAP_PCI_CFG + 12];
+    Bit32u offset = ReadHostDWordFromLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_PCI_CFG + 8]);
+    if ((pci_conf[VIRTIO_CAP_PCI_CFG + 4] == 0) && ((len == 1) || (len == 2) || (len == 4))) {
+      bar_write(offset & (VIRTIO_BAR_SIZE - 1), len,
+                ReadHostDWordFromLittleEndian((Bit32u*)&pci_conf[VIRTIO_CAP_PCI_CFG + 16]));
+    }
+  }
+  if (intx_change) {
+    update_irq();
+  }
+  if (msix_change) {
+    BX_INFO(("MSI-X %s", msix_enabled() ? "enabled" : "disabled"));
+    update_irq();
+    if (!(pci_conf[VIRTIO_CAP_MSIX + 3] & 0x40)) {
+      for (unsigned v = 0; v < VIRTIO_MSIX_VECTORS; v++) {
+        if ((msix_pending & (1 << v)) && !(msix_table[v * 16 + 12] & 0x01)) {
+          send_msix(v);
+        }
+      }
+    }
+  }
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO
@@ -0,0 +1,161 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_VIRTIO_PCI_H
+#define BX_IODEV_VIRTIO_PCI_H
+
+#define VIRTIO_PCI_VENDOR      0x1af4
+#define VIRTIO_PCI_DEVICE_BASE 0x1040
+
+// device types
+#define VIRTIO_ID_NET    1
+#define VIRTIO_ID_BLOCK  2
+
+// device status
+#define VIRTIO_STATUS_ACKNOWLEDGE  0x01
+#define VIRTIO_STATUS_DRIVER       0x02
+#define VIRTIO_STATUS_DRIVER_OK    0x04
+#define VIRTIO_STATUS_FEATURES_OK  0x08
+#define VIRTIO_STATUS_NEEDS_RESET  0x40
+#define VIRTIO_STATUS_FAILED       0x80
+
+// transport feature bits
+#define VIRTIO_RING_F_INDIRECT_DESC  28
+#define VIRTIO_RING_F_EVENT_IDX      29
+#define VIRTIO_F_VERSION_1           32
+
+#define VIRTIO_MAX_QUEUES      4
+#define VIRTIO_QUEUE_MAX_SIZE  256
+#define VIRTIO_MSIX_VECTORS    (VIRTIO_MAX_QUEUES + 1)
+#define VIRTIO_NO_VECTOR       0xffff
+// maximum number of buffers in one descriptor chain
+#define VIRTIO_MAX_SG          (VIRTIO_QUEUE_MAX_SIZE + 2)
+#define VIRTIO_MAX_CONFIG      64
+
+// virtqueue state
+typedef struct {
+  Bit16u size;
+  bool   enabled;
+  Bit16u msix_vector;
+  Bit64u desc;
+  Bit64u avail;
+  Bit64u used;
+  Bit16u last_avail_idx;
+  Bit16u used_idx;
+} bx_virtq_t;
+
+// one descriptor chain taken from the available ring: the device readable
+// buffers (out) come first, followed by the device writable ones (in)
+typedef struct {
+  Bit16u head;
+  unsigned out_num;
+  unsigned in_num;
+  Bit32u out_len;
+  Bit32u in_len;
+  Bit64u addr[VIRTIO_MAX_SG];
+  Bit32u len[VIRTIO_MAX_SG];
+} bx_virtq_elem_t;
+
+typedef struct {
+  Bit32u id;
+  Bit32u len;
+} bx_virtq_used_t;
+
+class bx_virtio_pci_c : public bx_pci_device_c {
+public:
+  bx_virtio_pci_c();
+  virtual ~bx_virtio_pci_c();
+
+  virtual Bit32u pci_read_handler(Bit8u address, unsigned io_len);
+  virtual void pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+protected:
+  void init_virtio(Bit16u device_type, Bit32u classc, unsigned num_queues,
+                   Bit64u features, unsigned config_size);
+  void reset_virtio(void);
+  void virtio_register_state(bx_list_c *parent);
+  void virtio_after_restore_state(memory_handler_t rom_read_handler);
+
+  // called by the transport
+  virtual void virtio_reset_device(void) = 0;
+  virtual void virtio_queue_notify(unsigned q) = 0;
+  virtual void virtio_config_write(unsigned offset, unsigned len, Bit32u value) {}
+  virtual void virtio_driver_ok(void) {}
+
+  // virtqueue access for the device
+  bool virtio_queue_ready(unsigned q);
+  bool virtio_queue_empty(unsigned q);
+  bool virtio_queue_pop(unsigned q, bx_virtq_elem_t *elem);
+  void virtio_queue_push(unsigned q, bx_virtq_elem_t *elem, Bit32u len);
+  void virtio_queue_flush(unsigned q);
+  Bit32u virtio_elem_read(bx_virtq_elem_t *elem, Bit32u offset, Bit8u *buf, Bit32u len);
+  Bit32u virtio_elem_write(bx_virtq_elem_t *elem, Bit32u offset, Bit8u *buf, Bit32u len);
+  void virtio_config_changed(void);
+  bool virtio_has_feature(unsigned bit) {return (driver_features >> bit) & 1;}
+
+  Bit8u  devfunc;
+  Bit8u  config[VIRTIO_MAX_CONFIG];
+
+private:
+  unsigned num_queues;
+  unsigned config_size;
+  Bit64u device_features;
+  Bit64u driver_features;
+  Bit32u device_feature_select;
+  Bit32u driver_feature_select;
+  Bit16u msix_config;
+  Bit16u queue_select;
+  Bit8u  status;
+  Bit8u  config_generation;
+  Bit8u  isr;
+  bx_virtq_t vq[VIRTIO_MAX_QUEUES];
+  // MSI-X table and pending bits
+  Bit8u  msix_table[VIRTIO_MSIX_VECTORS * 16];
+  Bit32u msix_pending;
+
+  // available ring entries read ahead (not consumed yet) and used ring
+  // entries not written back yet
+  Bit16u avail_cache[VIRTIO_MAX_QUEUES][VIRTIO_QUEUE_MAX_SIZE];
+  unsigned avail_cached[VIRTIO_MAX_QUEUES];
+  unsigned avail_pos[VIRTIO_MAX_QUEUES];
+  bx_virtq_used_t used_cache[VIRTIO_MAX_QUEUES][VIRTIO_QUEUE_MAX_SIZE];
+  unsigned used_cached[VIRTIO_MAX_QUEUES];
+
+  void reset_transport(void);
+  void update_irq(void);
+  void raise_irq(Bit8u isr_bit, Bit16u vector);
+  void send_msix(unsigned vector);
+  bool msix_enabled(void);
+  bool read_desc(Bit64u table, unsigned i, Bit64u *addr, Bit32u *len,
+                 Bit16u *flags, Bit16u *next);
+  bool add_desc(bx_virtq_elem_t *elem, Bit64u addr, Bit32u len, bool write);
+
+  Bit32u common_read(Bit32u offset, unsigned len);
+  void common_write(Bit32u offset, unsigned len, Bit32u value);
+  Bit32u bar_read(Bit32u offset, unsigned len);
+  void bar_write(Bit32u offset, unsigned len, Bit32u value);
+
+  static bool mem_read_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+  static bool mem_write_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+};
+
+#endif
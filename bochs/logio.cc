@@ -26,6 +26,7 @@
 #include "bxthread.h"
 #include "cpu/cpu.h"
 #include <assert.h>
+#include <atomic>
 
 #if BX_WITH_CARBON
 #include <Carbon/Carbon.h>
@@ -38,6 +39,30 @@ const int MAGIC_LOGNUM = 0x12345678;
 static int Allocio=0;
 BX_MUTEX(logio_mutex);
 
+// Asynchronous log writer: the messages are formatted by the emulation
+// thread and queued in a ring buffer. A background thread writes them to
+// the log file. The producers are serialized by logio_mutex, the ring
+// itself is single producer / single consumer and needs no locking.
+#define BX_LOG_RING_SIZE (1 << 20)
+#define BX_LOG_RING_MASK (BX_LOG_RING_SIZE - 1)
+
+struct bx_log_ring_t {
+  char buf[BX_LOG_RING_SIZE];
+  std::atomic<Bit32u> head; // advanced by the producer
+  std::atomic<Bit32u> tail; // advanced by the writer thread
+  std::atomic<bool> stop;
+  std::atomic<bool> running;
+  std::atomic<bool> idle;   // the writer thread waits for new messages
+  bx_thread_sem_t data;     // signalled when new messages are queued
+  BX_THREAD_VAR(thread);
+};
+
+static BX_THREAD_FUNC(log_writer_thread, indata)
+{
+  ((iofunctions *) indata)->async_writer();
+  BX_THREAD_EXIT;
+}
+
 const char* iofunctions::getlevel(int i) const
 {
   static const char *loglevel[N_LOGLEV] = {
@@ -74,11 +99,100 @@ int iofunctions::isaction(const char *val) const
 
 void iofunctions::flush(void)
 {
+  if (ring != NULL) {
+    // wait until the writer thread has written all queued messages
+    while (ring->tail.load(std::memory_order_acquire) !=
+           ring->head.load(std::memory_order_relaxed)) {
+      bx_set_sem(&ring->data);
+      BX_MSLEEP(1);
+    }
+  }
   if(logfd && magic == MAGIC_LOGNUM) {
     fflush(logfd);
   }
 }
 
+void iofunctions::set_async(bool enabled)
+{
+  if (enabled && (ring == NULL)) {
+    bx_log_ring_t *r = new bx_log_ring_t;
+    r->head = 0;
+    r->tail = 0;
+    r->stop = 0;
+    r->running = 1;
+    r->idle = 0;
+    if (!bx_create_sem(&r->data)) {
+      log->error("Couldn't create semaphore, asynchronous logging disabled");
+      delete r;
+      return;
+    }
+    ring = r;
+    BX_THREAD_CREATE(log_writer_thread, this, ring->thread);
+  } else if (!enabled && (ring != NULL)) {
+    BX_LOCK(logio_mutex);
+    ring->stop = 1;
+    bx_set_sem(&ring->data);
+    BX_THREAD_JOIN(ring->thread);
+    while (ring->running) {
+      BX_MSLEEP(1);
+    }
+    bx_destroy_sem(&ring->data);
+    delete ring;
+    ring = NULL;
+    BX_UNLOCK(logio_mutex);
+  }
+}
+
+void iofunctions::async_writer(void)
+{
+  while (1) {
+    ring->idle = 1;
+    if (ring->head == ring->tail.load(std::memory_order_relaxed) && !ring->stop)
+      bx_wait_sem(&ring->data);
+    ring->idle = 0;
+    // all messages queued before 'stop' was set are written below
+    bool stop = ring->stop.load(std::memory_order_acquire);
+    Bit32u head = ring->head.load(std::memory_order_acquire);
+    Bit32u tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail != head) {
+      while (tail != head) {
+        Bit32u offset = tail & BX_LOG_RING_MASK;
+        Bit32u len = head - tail;
+        if (len > (BX_LOG_RING_SIZE - offset))
+          len = BX_LOG_RING_SIZE - offset;
+        fwrite(&ring->buf[offset], 1, len, logfd);
+        tail += len;
+      }
+      fflush(logfd);
+      ring->tail.store(tail, std::memory_order_release);
+    }
+    if (stop) break;
+  }
+  ring->running = 0;
+}
+
+void iofunctions::queue_msg(const char *msg, Bit32u len)
+{
+  Bit32u head = ring->head.load(std::memory_order_relaxed);
+  // the ring is full, wait for the writer thread
+  while ((BX_LOG_RING_SIZE - (head - ring->tail.load(std::memory_order_acquire))) < len) {
+    bx_set_sem(&ring->data);
+    BX_MSLEEP(1);
+  }
+  Bit32u offset = head & BX_LOG_RING_MASK;
+  Bit32u first = BX_LOG_RING_SIZE - offset;
+  if (first >= len) {
+    memcpy(&ring->buf[offset], msg, len);
+  } else {
+    memcpy(&ring->buf[offset], msg, first);
+    memcpy(&ring->buf[0], msg + first, len - first);
+  }
+  ring->head.store(head + len);
+  // wake up the writer thread only if it waits for messages
+  if (ring->idle.exchange(0))
+    bx_set_sem(&ring->data);
+}
+
 void iofunctions::init(void)
 {
   // iofunctions methods must not be called before this magic
@@ -90,6 +204,7 @@ void iofunctions::init(void)
   // sets the default logprefix
   strcpy(logprefix,"%t%e%d");
   n_logfn = 0;
+  ring = NULL;
   init_log(stderr);
   log = new logfunc_t(this);
   log->put("logio", "IO");
@@ -126,6 +241,7 @@ void iofunctions::set_log_action(int loglevel, int action)
 void iofunctions::init_log(const char *fn)
 {
   assert(magic==MAGIC_LOGNUM);
+  flush();
   // use newfd/newfn so that we can log the message to the OLD log
   // file descriptor.
   FILE *newfd = stderr;
@@ -148,6 +264,7 @@ void iofunctions::init_log(const char *fn)
 void iofunctions::init_log(FILE *fs)
 {
   assert(magic==MAGIC_LOGNUM);
+  flush();
   logfd = fs;
 
   if(fs == stderr) {
@@ -174,6 +291,7 @@ void iofunctions::init_log(int fd)
 // called at simulation exit
 void iofunctions::exit_log()
 {
+  set_async(0);
   flush();
   if (logfd != stderr) {
     fclose(logfd);
@@ -259,14 +377,24 @@ void iofunctions::out(int level, const char *prefix, const char *fmt, va_list ap
     s++;
   }
 
-  fprintf(logfd,"%s ", msgpfx);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  if (ring != NULL) {
+    char rec[sizeof(msgpfx) + sizeof(msg) + 16];
+    int len = snprintf(rec, sizeof(rec), "%s %s%s\n", msgpfx,
+                       (level==LOGLEV_PANIC) ? ">>PANIC<< " : "", msg);
+    if (len >= (int) sizeof(rec)) len = sizeof(rec) - 1;
+    queue_msg(rec, len);
+    // make sure a panic is in the log file before any further action
+    if (level==LOGLEV_PANIC) flush();
+  } else {
+    fprintf(logfd,"%s ", msgpfx);
 
-  if(level==LOGLEV_PANIC)
-    fprintf(logfd, ">>PANIC<< ");
+    if(level==LOGLEV_PANIC)
+      fprintf(logfd, ">>PANIC<< ");
 
-  vsnprintf(msg, sizeof(msg), fmt, ap);
-  fprintf(logfd, "%s\n", msg);
-  fflush(logfd);
+    fprintf(logfd, "%s\n", msg);
+    fflush(logfd);
+  }
   if (SIM->has_log_viewer()) {
     SIM->log_msg(msgpfx, level, msg);
   }
@@ -298,6 +426,7 @@ iofunctions::iofunctions()
 
 iofunctions::~iofunctions(void)
 {
+  set_async(0);
   BX_FINI_MUTEX(logio_mutex);
 
   // flush before erasing magic number, or flush does nothing.
@@ -511,6 +640,7 @@ void logfunctions::warn(int level, const char *prefix, const char *fmt, va_list
 
   // ensure the text screen is showing
   SIM->set_display_mode(DISP_MODE_CONFIG);
+  logio->flush();
   int val = SIM->log_dlg(prefix, level, buf1, BX_LOG_DLG_WARN);
   if (val == BX_LOG_ASK_CHOICE_CONTINUE_ALWAYS) {
     // user said continue, and don't "ask" for this facility again.
@@ -545,6 +675,7 @@ void logfunctions::ask(int level, const char *prefix, const char *fmt, va_list a
 
   // ensure the text screen is showing
   SIM->set_display_mode(DISP_MODE_CONFIG);
+  logio->flush();
   int val = SIM->log_dlg(prefix, level, buf1, BX_LOG_DLG_ASK);
   switch(val)
   {
@@ -95,8 +95,9 @@ class BOCHSAPI iofunctions {
   char logprefix[BX_LOGPREFIX_LEN + 1];
   FILE *logfd;
   class logfunctions *log;
+  struct bx_log_ring_t *ring; // asynchronous writer queue (NULL if disabled)
   void init(void);
-  void flush(void);
+  void queue_msg(const char *msg, Bit32u len);
 
 // Log Class types
 public:
@@ -107,6 +108,10 @@ public:
  ~iofunctions(void);
 
   void out(int level, const char *pre, const char *fmt, va_list ap);
+  void flush(void);
+  void set_async(bool enabled);
+  bool get_async(void) const { return ring != NULL; }
+  void async_writer(void);
 
   void init_log(const char *fn);
   void init_log(int fd);
@@ -149,9 +154,16 @@ typedef class iofunctions iofunc_t;
 
 #else
 
-#define BX_INFO(x)  (LOG_THIS info) x
-#define BX_DEBUG(x) (LOG_THIS ldebug) x
-#define BX_ERROR(x) (LOG_THIS error) x
+// Messages below the compile time log level of a module are removed by the
+// compiler. The default level is BX_LOG_COMPILE_LEVEL, a module can override
+// it by redefining BX_MODULE_LOG_LEVEL after the LOG_THIS definition. Modules
+// logging from frequently executed code use BX_LOG_COMPILE_LEVEL_HOT.
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL
+#define BX_LOG_COMPILED(level) ((level) >= BX_MODULE_LOG_LEVEL)
+
+#define BX_INFO(x)  do { if (BX_LOG_COMPILED(LOGLEV_INFO)) (LOG_THIS info) x; } while (0)
+#define BX_DEBUG(x) do { if (BX_LOG_COMPILED(LOGLEV_DEBUG)) (LOG_THIS ldebug) x; } while (0)
+#define BX_ERROR(x) do { if (BX_LOG_COMPILED(LOGLEV_ERROR)) (LOG_THIS error) x; } while (0)
 #define BX_PANIC(x) (LOG_THIS panic) x
 #define BX_FATAL(x) (LOG_THIS fatal1) x
 
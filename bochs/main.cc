@@ -1059,13 +1059,16 @@ int bx_begin_simulation(int argc, char *argv[])
       // SMP simulation: do a few instructions on each processor, then switch
       // to another.  Increasing quantum speeds up overall performance, but
       // reduces granularity of synchronization between processors.
-      // Current implementation uses dynamic quantum, each processor will
-      // execute exactly one trace then quit the cpu_loop and switch to
-      // the next processor.
+      // Each processor executes whole traces within a slice of at most
+      // 'quantum' instructions, which also ends at the next timer event.
+      // A trace is started only if it is already in the trace cache and
+      // fits in the rest of the slice.  Running several traces per switch
+      // keeps the per-processor state (icache, TLB, registers) hot in the
+      // host caches.
 
-      static int quantum = SIM->get_param_num(BXPN_SMP_QUANTUM)->get();
-      Bit32u executed = 0, processor = 0;
-      bool run = true;
+      static Bit32u quantum = SIM->get_param_num(BXPN_SMP_QUANTUM)->get();
+      Bit32u executed = 0, processor = 0, slice = quantum;
+      bool run = true, all_halted = true;
 
       if (setjmp(BX_CPU_C::jmp_buf_env)) {
         // can get here only from exception function or VMEXIT
@@ -1074,20 +1077,44 @@ int bx_begin_simulation(int argc, char *argv[])
       }
       while (1) {
          // do some instructions in each processor
-        if (run)
-          BX_CPU(processor)->cpu_run_trace();
+        if (run) {
+          BX_CPU_C *cpu = BX_CPU(processor);
+          // the ticks are advanced only after all processors ran their slice
+          slice = bx_pc_system.getNumCpuTicksLeftNextEvent();
+          if (slice == 0 || slice > quantum) slice = quantum;
+          Bit64u icount = cpu->get_icount();
+          for (;;) {
+            Bit64u prev_icount = icount;
+            cpu->cpu_run_trace();
+            icount = cpu->get_icount();
+            // the CPU is halted or returned without making progress
+            if (icount == prev_icount || bx_pc_system.kill_bochs_request) break;
+            unsigned tlen = cpu->nextTraceLength();
+            if (tlen == 0 || (icount - cpu->icount_last_sync) + tlen > slice) break;
+          }
+        }
         else
           run = true;
 
          // see how many instruction it was able to run
          Bit32u n = (Bit32u)(BX_CPU(processor)->get_icount() - BX_CPU(processor)->icount_last_sync);
-         if (n == 0) n = quantum; // the CPU was halted
+         if (n == 0) n = slice; // the CPU was halted
          executed += n;
+         if (BX_CPU(processor)->activity_state == BX_CPU_C::BX_ACTIVITY_STATE_ACTIVE)
+           all_halted = false;
 
          if (++processor == BX_SMP_PROCESSORS) {
            processor = 0;
-           BX_TICKN(executed / BX_SMP_PROCESSORS);
-           executed %= BX_SMP_PROCESSORS;
+           if (all_halted && bx_pc_system.idle_skip && !BX_HRQ) {
+             // no CPU can make progress until the next timer event
+             bx_pc_system.tick_next_event();
+             executed = 0;
+           }
+           else {
+             BX_TICKN(executed / BX_SMP_PROCESSORS);
+             executed %= BX_SMP_PROCESSORS;
+           }
+           all_halted = true;
          }
 
          BX_CPU(processor)->icount_last_sync = BX_CPU(processor)->get_icount();
@@ -1116,6 +1143,7 @@ void bx_stop_simulation(void)
 
 void bx_sr_after_restore_state(void)
 {
+  bx_pc_system.after_restore_state();
 #if BX_SUPPORT_SMP == 0
   BX_CPU(0)->after_restore_state();
 #else
@@ -1162,11 +1190,13 @@ void bx_init_hardware()
   // all configuration has been read, now initialize everything.
 
   bx_pc_system.initialize(SIM->get_param_num(BXPN_IPS)->get());
+  bx_pc_system.idle_skip = SIM->get_param_bool(BXPN_CLOCK_IDLE_SKIP)->get();
 
   if (SIM->get_param_string(BXPN_LOG_FILENAME)->getptr()[0]!='-') {
     BX_INFO(("using log file %s", SIM->get_param_string(BXPN_LOG_FILENAME)->getptr()));
     io->init_log(SIM->get_param_string(BXPN_LOG_FILENAME)->getptr());
   }
+  io->set_async(SIM->get_param_bool(BXPN_LOG_ASYNC)->get());
 
   io->set_log_prefix(SIM->get_param_string(BXPN_LOG_PREFIX)->getptr());
 
@@ -1334,6 +1364,7 @@ void bx_init_hardware()
   Bit32u memBlockSize = bxp_memblock_size->get64() * 1024;
 
   BX_MEM(0)->init_memory(memSize, hostMemSize, memBlockSize);
+  pageWriteStampTable.init(memSize);
 
   // First load the system BIOS (VGABIOS loading moved to the vga code)
   BX_MEM(0)->load_ROM(SIM->get_param_string(BXPN_ROM_PATH)->getptr(),
@@ -1449,6 +1480,14 @@ int bx_atexit(void)
   }
 #endif
 
+  if (traceStore.enabled()) {
+    int traces = traceStore.save();
+    if (traces < 0)
+      BX_ERROR(("failed to write decoded trace cache file"));
+    else if (traces > 0)
+      BX_INFO(("decoded trace cache: %d traces written", traces));
+  }
+
   BX_MEM(0)->cleanup_memory();
 
   bx_pc_system.exit();
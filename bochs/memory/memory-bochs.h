@@ -53,6 +53,9 @@ protected:
   Bit8u   *bogus;    // 4k for unexisting memory
 
   Bit32u used_blocks;
+#if BX_HAVE_SYS_MMAN_H
+  Bit64u  mapped_size; // size of host address space mapped for RAM file
+#endif
 #if BX_LARGE_RAMFILE
   static Bit8u * const swapped_out; // NULL; // (NULL - sizeof(Bit8u));
   Bit32u  next_swapout_idx;
@@ -86,6 +89,10 @@ public:
   BX_MEM_SMF Bit64u get_memory_len(void);
   BX_MEM_SMF void allocate_block(Bit32u index);
   BX_MEM_SMF Bit8u* alloc_vector_aligned(Bit64u bytes, Bit64u alignment);
+#if BX_HAVE_SYS_MMAN_H
+  BX_MEM_SMF Bit8u* alloc_vector_mapped(const char *path, Bit64u ram_bytes, Bit64u bytes);
+#endif
+  BX_MEM_SMF void free_vector(void);
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_MEM_SMF bool is_monitor(bx_phy_address begin_addr, unsigned len);
@@ -99,11 +106,10 @@ typedef bool (*memory_handler_t)(bx_phy_address addr, unsigned len, void *data,
 typedef Bit8u* (*memory_direct_access_handler_t)(bx_phy_address addr, unsigned rw, void *param);
 
 struct memory_handler_struct {
-  struct memory_handler_struct *next;
+  struct memory_handler_struct *next; // list of all registered handlers
   void *param;
   bx_phy_address begin;
   bx_phy_address end;
-  Bit16u bitmap;
   memory_handler_t read_handler;
   memory_handler_t write_handler;
   memory_direct_access_handler_t da_handler;
@@ -131,9 +137,16 @@ enum memory_area_t {
   BX_MEM_AREA_F0000
 };
 
+// Memory handlers are looked up by 4K page: an entry of the table indexed
+// by the megabyte is NULL if no handler is registered in the megabyte, or
+// points to the 256 pages of the megabyte. A page is covered by at most
+// one handler.
+#define BX_MEM_HANDLER_PAGES 256
+
 class BOCHSAPI BX_MEM_C : public BX_MEMORY_STUB_C {
 private:
-  struct memory_handler_struct **memory_handlers;
+  struct memory_handler_struct ***memory_handlers;
+  struct memory_handler_struct *memory_handler_list;
   bool pci_enabled;
   bool bios_write_enabled;
 
@@ -200,6 +213,7 @@ public:
      return registerMemoryHandlers(param, read_handler, write_handler, NULL, begin_addr, end_addr);
   }
   BX_MEM_SMF bool unregisterMemoryHandlers(void *param, bx_phy_address begin_addr, bx_phy_address end_addr);
+  BX_MEM_SMF BX_CPP_INLINE struct memory_handler_struct *getMemoryHandler(bx_phy_address a20addr);
 
   void register_state(void);
 
@@ -212,4 +226,17 @@ public:
 
 BOCHSAPI extern BX_MEM_C bx_mem;
 
+// returns the memory handler covering <a20addr> or NULL
+BX_CPP_INLINE struct memory_handler_struct *BX_MEM_C::getMemoryHandler(bx_phy_address a20addr)
+{
+  struct memory_handler_struct **pages = BX_MEM_THIS memory_handlers[a20addr >> 20];
+  if (pages == NULL) return NULL;
+
+  struct memory_handler_struct *memory_handler = pages[(a20addr >> 12) & (BX_MEM_HANDLER_PAGES-1)];
+  if (memory_handler && memory_handler->begin <= a20addr && memory_handler->end >= a20addr)
+    return memory_handler;
+
+  return NULL;
+}
+
 #endif
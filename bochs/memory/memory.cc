@@ -24,6 +24,8 @@
 #include "cpu/cpu.h"
 #include "iodev/iodev.h"
 #define LOG_THIS BX_MEM_THIS
+#undef BX_MODULE_LOG_LEVEL
+#define BX_MODULE_LOG_LEVEL BX_LOG_COMPILE_LEVEL_HOT
 
 //
 // Memory map inside the 1st megabyte:
@@ -69,17 +71,10 @@ void BX_MEM_C::writePhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned le
     }
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->write_handler != NULL) {
-      if (memory_handler->begin <= a20addr &&
-          memory_handler->end >= a20addr &&
-          memory_handler->write_handler(a20addr, len, data, memory_handler->param))
-      {
-        return;
-      }
-    }
-    memory_handler = memory_handler->next;
+  memory_handler = BX_MEM_THIS getMemoryHandler(a20addr);
+  if (memory_handler && memory_handler->write_handler != NULL) {
+    if (memory_handler->write_handler(a20addr, len, data, memory_handler->param))
+      return;
   }
 
 mem_write:
@@ -203,15 +198,10 @@ void BX_MEM_C::readPhysicalPage(BX_CPU_C *cpu, bx_phy_address addr, unsigned len
     }
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->begin <= a20addr &&
-          memory_handler->end >= a20addr &&
-          memory_handler->read_handler(a20addr, len, data, memory_handler->param))
-    {
+  memory_handler = BX_MEM_THIS getMemoryHandler(a20addr);
+  if (memory_handler) {
+    if (memory_handler->read_handler(a20addr, len, data, memory_handler->param))
       return;
-    }
-    memory_handler = memory_handler->next;
   }
 
 mem_read:
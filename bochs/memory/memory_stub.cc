@@ -21,10 +21,22 @@
 /////////////////////////////////////////////////////////////////////////
 
 #include "bochs.h"
+#include "gui/siminterface.h"
 #include "pc_system.h"
 #include "param_names.h"
 #include "cpu/cpu.h"
 #include "memory/memory-bochs.h"
+
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
 #define LOG_THIS BX_MEM(0)->
 
 // block size must be power of two
@@ -55,6 +67,9 @@ BX_MEMORY_STUB_C::BX_MEMORY_STUB_C()
   len    = 0;
   used_blocks = 0;
   allocated   = 0;
+#if BX_HAVE_SYS_MMAN_H
+  mapped_size = 0;
+#endif
 
 #if BX_LARGE_RAMFILE
   next_swapout_idx = 0;
@@ -96,6 +111,78 @@ Bit8u* BX_MEMORY_STUB_C::alloc_vector_aligned(Bit64u bytes, Bit64u alignment)
   return vector;
 }
 
+#if BX_HAVE_SYS_MMAN_H
+// Map the guest RAM from a file. When the file is located on hugetlbfs the
+// guest RAM is backed by host huge pages. Host pages are allocated on first
+// access and the file keeps the RAM contents after exit.
+Bit8u* BX_MEMORY_STUB_C::alloc_vector_mapped(const char *path, Bit64u ram_bytes, Bit64u bytes)
+{
+  int fd = ::open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    BX_PANIC(("alloc_vector_mapped: cannot open RAM file '%s'", path));
+    return 0;
+  }
+  // the mapping must be aligned to the page size of the file system,
+  // which is the huge page size for hugetlbfs
+  Bit64u page_size = BX_MEM_VECTOR_ALIGN;
+  struct statvfs fs;
+  if ((fstatvfs(fd, &fs) == 0) && (fs.f_bsize > page_size) && is_power_of_2(fs.f_bsize))
+    page_size = fs.f_bsize;
+  if (ram_bytes & (page_size - 1)) {
+    BX_PANIC(("alloc_vector_mapped: RAM size must be a multiple of %uK for file '%s'",
+        (unsigned)(page_size / 1024), path));
+    ::close(fd);
+    return 0;
+  }
+  struct stat stat_buf;
+  if ((fstat(fd, &stat_buf) < 0) || ((Bit64u) stat_buf.st_size < ram_bytes)) {
+    if (ftruncate(fd, (off_t) ram_bytes) < 0) {
+      BX_PANIC(("alloc_vector_mapped: cannot resize RAM file '%s'", path));
+      ::close(fd);
+      return 0;
+    }
+  }
+  // reserve host address space for RAM, ROM and bogus page first
+  BX_MEM_THIS mapped_size = bytes + page_size;
+  void *base = mmap(NULL, (size_t) BX_MEM_THIS mapped_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    BX_PANIC(("alloc_vector_mapped: unable to reserve host address space !"));
+    BX_MEM_THIS mapped_size = 0;
+    ::close(fd);
+    return 0;
+  }
+  BX_MEM_THIS actual_vector = (Bit8u *) base;
+  Bit8u *vector = (Bit8u *)(((bx_ptr_equiv_t) base + page_size - 1) & ~(bx_ptr_equiv_t)(page_size - 1));
+  // then place the file mapping over the RAM part
+  if (mmap(vector, (size_t) ram_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    BX_PANIC(("alloc_vector_mapped: unable to map RAM file '%s'", path));
+    munmap(base, (size_t) BX_MEM_THIS mapped_size);
+    BX_MEM_THIS mapped_size = 0;
+    BX_MEM_THIS actual_vector = NULL;
+    ::close(fd);
+    return 0;
+  }
+  ::close(fd);
+  return vector;
+}
+#endif
+
+void BX_MEMORY_STUB_C::free_vector(void)
+{
+#if BX_HAVE_SYS_MMAN_H
+  if (BX_MEM_THIS mapped_size > 0) {
+    munmap(BX_MEM_THIS actual_vector, (size_t) BX_MEM_THIS mapped_size);
+    BX_MEM_THIS mapped_size = 0;
+  }
+  else
+#endif
+  {
+    delete [] BX_MEM_THIS actual_vector;
+  }
+  BX_MEM_THIS actual_vector = NULL;
+}
+
 void BX_MEMORY_STUB_C::init_memory(Bit64u guest, Bit64u host, Bit32u block_size)
 {
   // accept only memory size which is multiply of 1M
@@ -108,14 +195,35 @@ void BX_MEMORY_STUB_C::init_memory(Bit64u guest, Bit64u host, Bit32u block_size)
 
   if (BX_MEM_THIS actual_vector != NULL) {
     BX_INFO(("freeing existing memory vector"));
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+    free_vector();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS blocks = NULL;
   }
-  BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
-  BX_INFO(("allocated memory at %p. after alignment, vector=%p, block_size = %dK",
-        BX_MEM_THIS actual_vector, BX_MEM_THIS vector, block_size/1024));
+
+  bx_param_string_c *ram_file = SIM->get_param_string(BXPN_MEM_FILE);
+  bool mapped = !ram_file->isempty();
+  if (mapped) {
+#if BX_HAVE_SYS_MMAN_H
+    // whole guest RAM is mapped, the host OS allocates the pages on demand
+    host = guest;
+    BX_MEM_THIS vector = alloc_vector_mapped(ram_file->getptr(), guest, host + BIOSROMSZ + EXROMSIZE + 4096);
+    if (BX_MEM_THIS vector != NULL) {
+      BX_INFO(("mapped RAM file '%s' at %p, block_size = %dK",
+            ram_file->getptr(), BX_MEM_THIS vector, block_size/1024));
+    } else {
+      BX_ERROR(("RAM file '%s' not used, the guest RAM is not kept after exit", ram_file->getptr()));
+      mapped = 0;
+    }
+#else
+    BX_PANIC(("RAM backing file is not supported on this platform"));
+    mapped = 0;
+#endif
+  }
+  if (! mapped) {
+    BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
+    BX_INFO(("allocated memory at %p. after alignment, vector=%p, block_size = %dK",
+          BX_MEM_THIS actual_vector, BX_MEM_THIS vector, block_size/1024));
+  }
 
   BX_MEM_THIS len = guest;
   BX_MEM_THIS allocated = host;
@@ -131,7 +239,7 @@ void BX_MEMORY_STUB_C::init_memory(Bit64u guest, Bit64u host, Bit32u block_size)
   BX_INFO(("%.2fMB", (float)(BX_MEM_THIS len / (1024.0*1024.0))));
   BX_INFO(("mem block size = 0x%08x, blocks=%u", BX_MEM_THIS block_size, num_blocks));
   BX_MEM_THIS blocks = new Bit8u* [num_blocks];
-  if (0) {
+  if (mapped) {
     // all guest memory is allocated, just map it
     for (unsigned idx = 0; idx < num_blocks; idx++) {
       BX_MEM_THIS blocks[idx] = BX_MEM_THIS vector + (idx * BX_MEM_THIS block_size);
@@ -246,8 +354,7 @@ void BX_MEMORY_STUB_C::allocate_block(Bit32u block)
 void BX_MEMORY_STUB_C::cleanup_memory()
 {
   if (BX_MEM_THIS vector != NULL) {
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+    free_vector();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS rom = NULL;
     BX_MEM_THIS bogus = NULL;
@@ -42,6 +42,7 @@
 BX_MEM_C::BX_MEM_C() : BX_MEMORY_STUB_C()
 {
   memory_handlers = NULL;
+  memory_handler_list = NULL;
 }
 
 BX_MEM_C::~BX_MEM_C()
@@ -59,9 +60,10 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host, Bit32u block_size)
   BX_MEM_THIS smram_enable = false;
   BX_MEM_THIS smram_restricted = false;
 
-  BX_MEM_THIS memory_handlers = new struct memory_handler_struct *[BX_MEM_HANDLERS];
+  BX_MEM_THIS memory_handlers = new struct memory_handler_struct **[BX_MEM_HANDLERS];
   for (idx = 0; idx < BX_MEM_HANDLERS; idx++)
     BX_MEM_THIS memory_handlers[idx] = NULL;
+  BX_MEM_THIS memory_handler_list = NULL;
 
   BX_MEM_THIS pci_enabled = SIM->get_param_bool(BXPN_PCI_ENABLED)->get();
   BX_MEM_THIS bios_write_enabled = false;
@@ -223,17 +225,16 @@ void BX_MEM_C::cleanup_memory()
 
   if (BX_MEM_THIS memory_handlers != NULL) {
     for (unsigned idx = 0; idx < BX_MEM_HANDLERS; idx++) {
-      struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[idx];
-      struct memory_handler_struct *prev = NULL;
-      while (memory_handler) {
-        prev = memory_handler;
-        memory_handler = memory_handler->next;
-        delete prev;
-      }
+      delete [] BX_MEM_THIS memory_handlers[idx];
     }
     delete [] BX_MEM_THIS memory_handlers;
     BX_MEM_THIS memory_handlers = NULL;
   }
+  while (BX_MEM_THIS memory_handler_list) {
+    struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handler_list;
+    BX_MEM_THIS memory_handler_list = memory_handler->next;
+    delete memory_handler;
+  }
 }
 
 bool BX_MEM_C::load_flash_data(const char *path)
@@ -529,16 +530,9 @@ bool BX_MEM_C::dbg_fetch_mem(BX_CPU_C *cpu, bx_phy_address addr, unsigned len, B
       use_smram = true;
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->begin <= a20addr && memory_handler->end >= a20addr)
-    {
-      if (!use_smram) {
-        use_memory_handler = true;
-        break;
-      }
-    }
-    memory_handler = memory_handler->next;
+  memory_handler = BX_MEM_THIS getMemoryHandler(a20addr);
+  if (memory_handler && !use_smram) {
+    use_memory_handler = true;
   }
 
   for (; len>0; len--) {
@@ -628,16 +622,9 @@ bool BX_MEM_C::dbg_set_mem(BX_CPU_C *cpu, bx_phy_address addr, unsigned len, Bit
       use_smram = true;
   }
 
-  memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->begin <= a20addr && memory_handler->end >= a20addr)
-    {
-      if (!use_smram) {
-        use_memory_handler = true;
-        break;
-      }
-    }
-    memory_handler = memory_handler->next;
+  memory_handler = BX_MEM_THIS getMemoryHandler(a20addr);
+  if (memory_handler && !use_smram) {
+    use_memory_handler = true;
   }
 
   for (; len>0; len--) {
@@ -695,16 +682,12 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
   }
 #endif
 
-  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->begin <= a20addr &&
-        memory_handler->end >= a20addr) {
-      if (memory_handler->da_handler)
-        return memory_handler->da_handler(a20addr, rw, memory_handler->param);
-      else
-        return(NULL); // Vetoed! memory handler for i/o apic, vram, mmio and PCI PnP
-    }
-    memory_handler = memory_handler->next;
+  struct memory_handler_struct *memory_handler = BX_MEM_THIS getMemoryHandler(a20addr);
+  if (memory_handler) {
+    if (memory_handler->da_handler)
+      return memory_handler->da_handler(a20addr, rw, memory_handler->param);
+    else
+      return(NULL); // Vetoed! memory handler for i/o apic, vram, mmio and PCI PnP
   }
 
   if (! write) {
@@ -793,75 +776,72 @@ BX_MEM_C::registerMemoryHandlers(void *param, memory_handler_t read_handler,
                 memory_handler_t write_handler, memory_direct_access_handler_t da_handler,
                 bx_phy_address begin_addr, bx_phy_address end_addr)
 {
+  bx_phy_address page;
+
   if (end_addr < begin_addr)
     return false;
   if (!read_handler) // allow NULL write and fetch handler
     return false;
   BX_INFO(("Register memory access handlers: 0x" FMT_PHY_ADDRX " - 0x" FMT_PHY_ADDRX, begin_addr, end_addr));
-  for (Bit32u page_idx = (Bit32u)(begin_addr >> 20); page_idx <= (Bit32u)(end_addr >> 20); page_idx++) {
-    Bit16u bitmap = 0xffff;
-    if (begin_addr > (page_idx << 20)) {
-      bitmap &= (0xffff << ((begin_addr >> 16) & 0xf));
-    }
-    if (end_addr < ((page_idx + 1) << 20)) {
-      bitmap &= (0xffff >> (0x0f - ((end_addr >> 16) & 0xf)));
-    }
-    if (BX_MEM_THIS memory_handlers[page_idx] != NULL) {
-      if ((bitmap & BX_MEM_THIS memory_handlers[page_idx]->bitmap) != 0) {
-        BX_ERROR(("Register failed: overlapping memory handlers!"));
-        return false;
-      } else {
-        bitmap |= BX_MEM_THIS memory_handlers[page_idx]->bitmap;
-      }
-    }
-    struct memory_handler_struct *memory_handler = new struct memory_handler_struct;
-    memory_handler->next = BX_MEM_THIS memory_handlers[page_idx];
-    BX_MEM_THIS memory_handlers[page_idx] = memory_handler;
-    memory_handler->read_handler = read_handler;
-    memory_handler->write_handler = write_handler;
-    memory_handler->da_handler = da_handler;
-    memory_handler->param = param;
-    memory_handler->begin = begin_addr;
-    memory_handler->end = end_addr;
-    memory_handler->bitmap = bitmap;
-  }
+  for (page = (begin_addr >> 12); page <= (end_addr >> 12); page++) {
+    struct memory_handler_struct **pages = BX_MEM_THIS memory_handlers[page >> 8];
+    if (pages != NULL && pages[page & (BX_MEM_HANDLER_PAGES-1)] != NULL) {
+      BX_ERROR(("Register failed: overlapping memory handlers!"));
+      return false;
+    }
+  }
+  struct memory_handler_struct *memory_handler = new struct memory_handler_struct;
+  memory_handler->next = BX_MEM_THIS memory_handler_list;
+  BX_MEM_THIS memory_handler_list = memory_handler;
+  memory_handler->read_handler = read_handler;
+  memory_handler->write_handler = write_handler;
+  memory_handler->da_handler = da_handler;
+  memory_handler->param = param;
+  memory_handler->begin = begin_addr;
+  memory_handler->end = end_addr;
+  for (page = (begin_addr >> 12); page <= (end_addr >> 12); page++) {
+    struct memory_handler_struct **pages = BX_MEM_THIS memory_handlers[page >> 8];
+    if (pages == NULL) {
+      pages = new struct memory_handler_struct *[BX_MEM_HANDLER_PAGES];
+      for (unsigned n = 0; n < BX_MEM_HANDLER_PAGES; n++)
+        pages[n] = NULL;
+      BX_MEM_THIS memory_handlers[page >> 8] = pages;
+    }
+    pages[page & (BX_MEM_HANDLER_PAGES-1)] = memory_handler;
+  }
+  // TLB entries of the range might allow direct access to the host memory
+  bx_pc_system.MemoryMappingChanged(begin_addr, end_addr);
   return true;
 }
 
 bool BX_MEM_C::unregisterMemoryHandlers(void *param, bx_phy_address begin_addr, bx_phy_address end_addr)
 {
-  bool ret = true;
   BX_INFO(("Memory access handlers unregistered: 0x" FMT_PHY_ADDRX " - 0x" FMT_PHY_ADDRX, begin_addr, end_addr));
-  for (Bit32u page_idx = (Bit32u)(begin_addr >> 20); page_idx <= (Bit32u)(end_addr >> 20); page_idx++) {
-    Bit16u bitmap = 0xffff;
-    if (begin_addr > (page_idx << 20)) {
-      bitmap &= (0xffff << ((begin_addr >> 16) & 0xf));
-    }
-    if (end_addr < ((page_idx + 1) << 20)) {
-      bitmap &= (0xffff >> (0x0f - ((end_addr >> 16) & 0xf)));
-    }
-    struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[page_idx];
-    struct memory_handler_struct *prev = NULL;
-    while (memory_handler &&
-         memory_handler->param != param &&
-         memory_handler->begin != begin_addr &&
-         memory_handler->end != end_addr)
-    {
-      memory_handler->bitmap &= ~bitmap;
-      prev = memory_handler;
-      memory_handler = memory_handler->next;
-    }
-    if (!memory_handler) {
-      ret = false;  // we should have found it
-      continue; // anyway, try the other pages
-    }
-    if (prev)
-      prev->next = memory_handler->next;
-    else
-      BX_MEM_THIS memory_handlers[page_idx] = memory_handler->next;
-    delete memory_handler;
+  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handler_list;
+  struct memory_handler_struct *prev = NULL;
+  while (memory_handler &&
+         (memory_handler->param != param ||
+          memory_handler->begin != begin_addr ||
+          memory_handler->end != end_addr))
+  {
+    prev = memory_handler;
+    memory_handler = memory_handler->next;
   }
-  return ret;
+  if (!memory_handler)
+    return false;  // we should have found it
+  if (prev)
+    prev->next = memory_handler->next;
+  else
+    BX_MEM_THIS memory_handler_list = memory_handler->next;
+  for (bx_phy_address page = (begin_addr >> 12); page <= (end_addr >> 12); page++) {
+    struct memory_handler_struct **pages = BX_MEM_THIS memory_handlers[page >> 8];
+    if (pages != NULL && pages[page & (BX_MEM_HANDLER_PAGES-1)] == memory_handler)
+      pages[page & (BX_MEM_HANDLER_PAGES-1)] = NULL;
+  }
+  delete memory_handler;
+  // drop TLB entries which cached the vetoed direct access of the range
+  bx_pc_system.MemoryMappingChanged(begin_addr, end_addr);
+  return true;
 }
 
 void BX_MEM_C::enable_smram(bool enable, bool restricted)
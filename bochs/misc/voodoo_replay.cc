@@ -0,0 +1,332 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+/////////////////////////////////////////////////////////////////////////
+
+// voodoo_replay: replays a triangle stream recorded with the Voodoo 'capture'
+// option through the scanline rasterizer and reports the pixel throughput.
+// The checksum of the frame buffer RAM after the replay must be the same for
+// all span pipelines.
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "bxthread.h"
+#include "iodev/display/bitblt.h"
+#include "iodev/display/voodoo_types.h"
+#include "iodev/display/voodoo_data.h"
+#include "iodev/display/voodoo_raster.h"
+
+typedef struct
+{
+  Bit8u *data;
+  Bit32u size;
+  Bit8u *fbi_ram;
+  Bit32u triangles;
+  Bit64u pixels;
+} replay_stream;
+
+static voodoo_state *v;
+static rgb_t replay_lookup[MAX_TMU][65536];
+
+void print_usage()
+{
+  fprintf(stderr,
+    "Usage: voodoo_replay [options] file\n\n"
+    "Supported options:\n"
+    "  -l loops     number of times the stream is replayed (default 1)\n"
+    "  -s pipeline  span pipeline: scalar, sse41 or avx2 (default: best available)\n"
+    "  -h           show this help\n\n");
+}
+
+void fatal(const char *msg)
+{
+  fprintf(stderr, "voodoo_replay: %s\n", msg);
+  exit(1);
+}
+
+// reads the capture file and checks the chunk layout
+void load_stream(const char *path, replay_stream *stream)
+{
+  raster_capture_header *header;
+  raster_capture_chunk *chunk;
+  Bit32u offset;
+  long size;
+  FILE *fp;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+    fatal("cannot open capture file");
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if ((size < (long)sizeof(raster_capture_header)) || (size > 0x7fffffff))
+    fatal("invalid capture file size");
+  stream->size = (Bit32u)size;
+  stream->data = (Bit8u*)malloc(stream->size);
+  if ((stream->data == NULL) || (fread(stream->data, stream->size, 1, fp) != 1))
+    fatal("cannot read capture file");
+  fclose(fp);
+
+  header = (raster_capture_header*)stream->data;
+  if ((header->magic != RASTER_CAPTURE_MAGIC) || (header->version != RASTER_CAPTURE_VERSION))
+    fatal("not a Voodoo triangle capture file");
+  if ((header->fbi_ram_size != (4 << 20)) && (header->fbi_ram_size != (16 << 20)))
+    fatal("unsupported frame buffer RAM size");
+  if ((header->tmu_ram_size != (4 << 20)) && (header->tmu_ram_size != (16 << 20)))
+    fatal("unsupported texture RAM size");
+
+  stream->fbi_ram = NULL;
+  stream->triangles = 0;
+  stream->pixels = 0;
+  offset = sizeof(raster_capture_header);
+  while (offset < stream->size) {
+    if (stream->size - offset < sizeof(raster_capture_chunk))
+      fatal("truncated chunk header");
+    chunk = (raster_capture_chunk*)(stream->data + offset);
+    offset += sizeof(raster_capture_chunk);
+    if (chunk->size > stream->size - offset)
+      fatal("truncated chunk");
+    switch (chunk->type) {
+      case RASTER_CAPTURE_FBI_RAM:
+        if (chunk->size != header->fbi_ram_size)
+          fatal("invalid frame buffer RAM chunk");
+        if (stream->fbi_ram == NULL)
+          stream->fbi_ram = stream->data + offset;
+        break;
+
+      case RASTER_CAPTURE_TMU_RAM:
+        if (((chunk->size != 4) && (chunk->size != 4 + header->tmu_ram_size)) ||
+            (*(Bit32u*)(stream->data + offset) >= MAX_TMU))
+          fatal("invalid texture RAM chunk");
+        break;
+
+      case RASTER_CAPTURE_LOOKUP:
+        if (((chunk->size != 4 + 256 * sizeof(rgb_t)) && (chunk->size != 4 + 65536 * sizeof(rgb_t))) ||
+            (*(Bit32u*)(stream->data + offset) >= MAX_TMU))
+          fatal("invalid lookup table chunk");
+        break;
+
+      case RASTER_CAPTURE_TRIANGLE:
+        {
+          raster_capture_triangle *tri = (raster_capture_triangle*)(stream->data + offset);
+          raster_capture_span *span = (raster_capture_span*)(tri + 1);
+
+          if ((chunk->size < sizeof(raster_capture_triangle)) ||
+              (tri->numscans != (chunk->size - sizeof(raster_capture_triangle)) / sizeof(raster_capture_span)) ||
+              (tri->texcount > MAX_TMU) || (tri->destoffs >= header->fbi_ram_size))
+            fatal("invalid triangle chunk");
+          for (Bit32u i = 0; i < tri->numscans; i++)
+            stream->pixels += span[i].stopx - span[i].startx;
+          stream->triangles++;
+        }
+        break;
+
+      default:
+        fatal("unknown chunk type");
+    }
+    offset += chunk->size;
+  }
+  if (stream->fbi_ram == NULL)
+    fatal("the capture file contains no triangles");
+}
+
+// sets up the state used by raster_function() for a recorded triangle
+void load_triangle(const raster_capture_triangle *tri, poly_extra_data *extra)
+{
+  unsigned i;
+
+  for (i = 0; i < RASTER_CAPTURE_REGS; i++)
+    v->reg[raster_capture_reg[i]].u = tri->reg[i];
+  v->fbi.yorigin = tri->yorigin;
+  v->fbi.clip_mask = tri->clip_mask;
+  v->fbi.rowpixels = tri->rowpixels;
+  v->fbi.auxoffs = tri->auxoffs;
+  v->send_config = tri->send_config;
+  v->tmu_config = tri->tmu_config;
+  memcpy(v->fbi.fogblend, tri->fogblend, sizeof(v->fbi.fogblend));
+  memcpy(v->fbi.fogdelta, tri->fogdelta, sizeof(v->fbi.fogdelta));
+  v->fbi.fogdelta_mask = tri->fogdelta_mask;
+  for (i = 0; i < MAX_TMU; i++) {
+    tmu_state *t = &v->tmu[i];
+    const raster_capture_tmu *ct = &tri->tmu[i];
+
+    t->reg[textureMode].u = ct->texmode;
+    t->lodmin = ct->lodmin;
+    t->lodmax = ct->lodmax;
+    t->lodbias = ct->lodbias;
+    t->lodmask = ct->lodmask;
+    memcpy(t->lodoffset, ct->lodoffset, sizeof(t->lodoffset));
+    t->detailmax = ct->detailmax;
+    t->detailbias = ct->detailbias;
+    t->detailscale = (Bit8u)ct->detailscale;
+    t->wmask = ct->wmask;
+    t->hmask = ct->hmask;
+    t->bilinear_mask = ct->bilinear_mask;
+  }
+  *extra = tri->extra;
+  extra->state = v;
+}
+
+// replays all chunks of the stream once
+void replay(const replay_stream *stream)
+{
+  const raster_capture_header *header = (raster_capture_header*)stream->data;
+  Bit32u offset = sizeof(raster_capture_header);
+
+  while (offset < stream->size) {
+    const raster_capture_chunk *chunk = (raster_capture_chunk*)(stream->data + offset);
+    const Bit8u *data = stream->data + offset + sizeof(raster_capture_chunk);
+    Bit32u index = *(Bit32u*)data;
+
+    switch (chunk->type) {
+      case RASTER_CAPTURE_FBI_RAM:
+        memcpy(v->fbi.ram, data, header->fbi_ram_size);
+        break;
+
+      case RASTER_CAPTURE_TMU_RAM:
+        if (chunk->size > 4)
+          memcpy(v->tmu[index].ram, data + 4, header->tmu_ram_size);
+        break;
+
+      case RASTER_CAPTURE_LOOKUP:
+        memcpy(replay_lookup[index], data + 4, chunk->size - 4);
+        break;
+
+      case RASTER_CAPTURE_TRIANGLE:
+        {
+          const raster_capture_triangle *tri = (raster_capture_triangle*)data;
+          const raster_capture_span *span = (raster_capture_span*)(tri + 1);
+          void *dest = v->fbi.ram + tri->destoffs;
+          poly_extra_data extra;
+          poly_extent extent;
+
+          load_triangle(tri, &extra);
+          for (Bit32u i = 0; i < tri->numscans; i++) {
+            extent.startx = span[i].startx;
+            extent.stopx = span[i].stopx;
+            raster_function(tri->texcount, dest, span[i].y, &extent, &extra, 0);
+          }
+        }
+        break;
+    }
+    offset += sizeof(raster_capture_chunk) + chunk->size;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  replay_stream stream;
+  const raster_capture_header *header;
+  const char *path = NULL;
+  int loops = 1, level = RASTER_SIMD_AVX2;
+  Bit32u checksum = 2166136261U;
+  clock_t start, end;
+  double seconds;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-l") && (i + 1 < argc)) {
+      loops = atoi(argv[++i]);
+      if (loops < 1)
+        fatal("invalid number of loops");
+    } else if (!strcmp(argv[i], "-s") && (i + 1 < argc)) {
+      i++;
+      if (!strcmp(argv[i], "scalar")) {
+        level = RASTER_SIMD_NONE;
+      } else if (!strcmp(argv[i], "sse41")) {
+        level = RASTER_SIMD_SSE41;
+      } else if (!strcmp(argv[i], "avx2")) {
+        level = RASTER_SIMD_AVX2;
+      } else {
+        fatal("unknown span pipeline");
+      }
+    } else if ((argv[i][0] == '-') || (path != NULL)) {
+      print_usage();
+      return 1;
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == NULL) {
+    print_usage();
+    return 1;
+  }
+
+  load_stream(path, &stream);
+  header = (raster_capture_header*)stream.data;
+
+  raster_init_tables();
+  v = new voodoo_state;
+  memset(v, 0, sizeof(voodoo_state));
+  v->thread_stats = new stats_block[1];
+  v->fbi.ram = (Bit8u*)malloc(header->fbi_ram_size);
+  v->fbi.mask = header->fbi_ram_size - 1;
+  for (i = 0; i < MAX_TMU; i++) {
+    v->tmu[i].reg = &v->reg[0x100 << i];
+    v->tmu[i].ram = (Bit8u*)calloc(1, header->tmu_ram_size);
+    v->tmu[i].mask = header->tmu_ram_size - 1;
+    v->tmu[i].lookup = replay_lookup[i];
+  }
+  // texture RAM chunks without data share the frame buffer RAM
+  for (Bit32u offset = sizeof(raster_capture_header); offset < stream.size;) {
+    const raster_capture_chunk *chunk = (raster_capture_chunk*)(stream.data + offset);
+    Bit32u index = *(Bit32u*)(stream.data + offset + sizeof(raster_capture_chunk));
+
+    if ((chunk->type == RASTER_CAPTURE_TMU_RAM) && (chunk->size == 4)) {
+      if (header->tmu_ram_size != header->fbi_ram_size)
+        fatal("invalid shared texture RAM");
+      v->tmu[index].ram = v->fbi.ram;
+    }
+    offset += sizeof(raster_capture_chunk) + chunk->size;
+  }
+
+  printf("Span pipeline: %s\n", raster_simd_name[raster_simd_select(level)]);
+  start = clock();
+  for (i = 0; i < loops; i++) {
+    // the statistics are reported for the last loop
+    memset(v->thread_stats, 0, sizeof(stats_block));
+    replay(&stream);
+  }
+  end = clock();
+  seconds = (double)(end - start) / CLOCKS_PER_SEC;
+
+  for (Bit32u n = 0; n < header->fbi_ram_size; n++)
+    checksum = (checksum ^ v->fbi.ram[n]) * 16777619U;
+
+  printf("Triangles:     %u\n", stream.triangles);
+  printf("Pixels:        %.0f\n", (double)stream.pixels);
+  printf("Time:          %.3f s (%d loops)\n", seconds, loops);
+  if (seconds > 0)
+    printf("Throughput:    %.2f Mpixels/s\n", (double)stream.pixels * loops / seconds / 1e6);
+  printf("Pixels in:     %d\n", v->thread_stats[0].pixels_in);
+  printf("Pixels out:    %d\n", v->thread_stats[0].pixels_out);
+  printf("Chroma fail:   %d\n", v->thread_stats[0].chroma_fail);
+  printf("Z func fail:   %d\n", v->thread_stats[0].zfunc_fail);
+  printf("A func fail:   %d\n", v->thread_stats[0].afunc_fail);
+  printf("Clip fail:     %d\n", v->thread_stats[0].clip_fail);
+  printf("Checksum:      %08x\n", checksum);
+  return 0;
+}
@@ -46,6 +46,12 @@
 #define BXPN_CONFIGURABLE_MSRS_PATH      "cpu.msrs"
 #define BXPN_CPUID_LIMIT_WINNT           "cpu.cpuid_limit_winnt"
 #define BXPN_MWAIT_IS_NOP                "cpu.mwait_is_nop"
+#define BXPN_DTLB_ENTRIES                "cpu.dtlb_entries"
+#define BXPN_ITLB_ENTRIES                "cpu.itlb_entries"
+#define BXPN_TLB_WAYS                    "cpu.tlb_ways"
+#define BXPN_ICACHE_ENTRIES              "cpu.icache_entries"
+#define BXPN_ICACHE_WAYS                 "cpu.icache_ways"
+#define BXPN_TRACE_CACHE_PATH            "cpu.trace_cache"
 #define BXPN_VENDOR_STRING               "cpuid.vendor_string"
 #define BXPN_BRAND_STRING                "cpuid.brand_string"
 #define BXPN_CPUID_LEVEL                 "cpuid.level"
@@ -83,6 +89,7 @@
 #define BXPN_MEM_SIZE                    "memory.standard.ram.guest"
 #define BXPN_HOST_MEM_SIZE               "memory.standard.ram.host"
 #define BXPN_MEM_BLOCK_SIZE              "memory.standard.ram.block_size"
+#define BXPN_MEM_FILE                    "memory.standard.ram.file"
 #define BXPN_ROMIMAGE                    "memory.standard.rom"
 #define BXPN_ROM_PATH                    "memory.standard.rom.file"
 #define BXPN_ROM_ADDRESS                 "memory.standard.rom.address"
@@ -95,6 +102,7 @@
 #define BXPN_CLOCK_SYNC                  "clock_cmos.clock_sync"
 #define BXPN_CLOCK_TIME0                 "clock_cmos.time0"
 #define BXPN_CLOCK_RTC_SYNC              "clock_cmos.rtc_sync"
+#define BXPN_CLOCK_IDLE_SKIP             "clock_cmos.idle_skip"
 #define BXPN_CMOSIMAGE_ENABLED           "clock_cmos.cmosimage.enabled"
 #define BXPN_CMOSIMAGE_PATH              "clock_cmos.cmosimage.path"
 #define BXPN_CMOSIMAGE_RTC_INIT          "clock_cmos.cmosimage.rtc_init"
@@ -153,6 +161,8 @@
 #define BXPN_ATA1_SLAVE                  "ata.1.slave"
 #define BXPN_ATA2_SLAVE                  "ata.2.slave"
 #define BXPN_ATA3_SLAVE                  "ata.3.slave"
+#define BXPN_AHCI                        "ata.ahci"
+#define BXPN_VIRTIO_BLK                  "ata.virtio_blk"
 #define BXPN_USB_UHCI                    "ports.usb.uhci"
 #define BXPN_UHCI_ENABLED                "ports.usb.uhci.enabled"
 #define BXPN_USB_OHCI                    "ports.usb.ohci"
@@ -174,6 +184,7 @@
 #define BXPN_NE2K                        "network.ne2k"
 #define BXPN_PNIC                        "network.pcipnic"
 #define BXPN_E1000                       "network.e1000"
+#define BXPN_VIRTIO_NET                  "network.virtio_net"
 #define BXPN_SOUNDLOW                    "sound.lowlevel"
 #define BXPN_SOUND_WAVEOUT_DRV           "sound.lowlevel.waveoutdrv"
 #define BXPN_SOUND_WAVEOUT               "sound.lowlevel.waveout"
@@ -191,6 +202,7 @@
 #define BXPN_GDBSTUB                     "misc.gdbstub"
 #define BXPN_LOG_FILENAME                "log.filename"
 #define BXPN_LOG_PREFIX                  "log.prefix"
+#define BXPN_LOG_ASYNC                   "log.async"
 #define BXPN_DEBUGGER_LOG_FILENAME       "log.debugger_filename"
 #define BXPN_MENU_DISK                   "menu.disk"
 #define BXPN_MENU_DISK_WIN32             "menu.disk_win32"
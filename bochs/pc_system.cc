@@ -44,23 +44,34 @@ bx_pc_system_c::bx_pc_system_c()
 
   BX_ASSERT(numTimers == 0);
 
+  timerBlocks = NULL;
+  numTimerBlocks = 0;
+  timerHeap = NULL;
+  timerHeapSize = 0;
+  triggeredList = NULL;
+  triggeredListSize = 0;
+  triggeredListUsed = 0;
+  allocTimerBlock();
+
   // Timer[0] is the null timer.  It is initialized as a special
   // case here.  It should never be turned off or modified, and its
   // duration should always remain the same.
   ticksTotal = 0; // Reset ticks since emulator started.
-  timer[0].inUse      = 1;
-  timer[0].period     = NullTimerInterval;
-  timer[0].active     = 1;
-  timer[0].continuous = 1;
-  timer[0].funct      = nullTimer;
-  timer[0].this_ptr   = this;
+  timer(0).inUse      = 1;
+  timer(0).period     = NullTimerInterval;
+  timer(0).active     = 1;
+  timer(0).continuous = 1;
+  timer(0).funct      = nullTimer;
+  timer(0).this_ptr   = this;
   numTimers = 1; // So far, only the nullTimer.
+  heapInsert(0);
 }
 
 void bx_pc_system_c::initialize(Bit32u ips)
 {
   ticksTotal = 0;
-  timer[0].timeToFire = NullTimerInterval;
+  timer(0).timeToFire = NullTimerInterval;
+  rebuildTimerHeap();
   currCountdown       = NullTimerInterval;
   currCountdownPeriod = NullTimerInterval;
   lastTimeUsec = 0;
@@ -68,6 +79,7 @@ void bx_pc_system_c::initialize(Bit32u ips)
   triggeredTimer = 0;
   HRQ = 0;
   kill_bochs_request = 0;
+  idle_skip = 0;
 
   // parameter 'ips' is the processor speed in Instructions-Per-Second
   m_ips = double(ips) / 1000000.0L;
@@ -177,6 +189,12 @@ void bx_pc_system_c::MemoryMappingChanged(void)
     BX_CPU(i)->TLB_flush();
 }
 
+void bx_pc_system_c::MemoryMappingChanged(bx_phy_address begin, bx_phy_address end)
+{
+  for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
+    BX_CPU(i)->TLB_invalidatePhysRange(begin, end);
+}
+
 void bx_pc_system_c::invlpg(bx_address addr)
 {
   for (unsigned i=0; i<BX_SMP_PROCESSORS; i++)
@@ -212,6 +230,7 @@ void bx_pc_system_c::exit(void)
 {
   // delete all registered timers (exception: null timer and APIC timer)
   numTimers = 1 + BX_SUPPORT_APIC;
+  rebuildTimerHeap();
   bx_devices.exit();
   if (bx_gui) {
     bx_gui->cleanup();
@@ -236,12 +255,117 @@ void bx_pc_system_c::register_state(void)
     char name[4];
     sprintf(name, "%u", i);
     bx_list_c *bxtimer = new bx_list_c(timers, name);
-    BXRS_PARAM_BOOL(bxtimer, inUse, timer[i].inUse);
-    BXRS_DEC_PARAM_FIELD(bxtimer, period, timer[i].period);
-    BXRS_DEC_PARAM_FIELD(bxtimer, timeToFire, timer[i].timeToFire);
-    BXRS_PARAM_BOOL(bxtimer, active, timer[i].active);
-    BXRS_PARAM_BOOL(bxtimer, continuous, timer[i].continuous);
-    BXRS_DEC_PARAM_FIELD(bxtimer, param, timer[i].param);
+    BXRS_PARAM_BOOL(bxtimer, inUse, timer(i).inUse);
+    BXRS_DEC_PARAM_FIELD(bxtimer, period, timer(i).period);
+    BXRS_DEC_PARAM_FIELD(bxtimer, timeToFire, timer(i).timeToFire);
+    BXRS_PARAM_BOOL(bxtimer, active, timer(i).active);
+    BXRS_PARAM_BOOL(bxtimer, continuous, timer(i).continuous);
+    BXRS_DEC_PARAM_FIELD(bxtimer, param, timer(i).param);
+  }
+}
+
+void bx_pc_system_c::after_restore_state(void)
+{
+  // timers state was restored directly into the timer fields
+  rebuildTimerHeap();
+}
+
+void bx_pc_system_c::allocTimerBlock(void)
+{
+  bx_timer_t **blocks = new bx_timer_t*[numTimerBlocks + 1];
+  for (unsigned n = 0; n < numTimerBlocks; n++)
+    blocks[n] = timerBlocks[n];
+  blocks[numTimerBlocks] = new bx_timer_t[BX_TIMER_BLOCK_SIZE];
+  memset(blocks[numTimerBlocks], 0, sizeof(bx_timer_t) * BX_TIMER_BLOCK_SIZE);
+  delete [] timerBlocks;
+  timerBlocks = blocks;
+
+  unsigned *heap = new unsigned[(numTimerBlocks + 1) * BX_TIMER_BLOCK_SIZE];
+  for (unsigned n = 0; n < timerHeapSize; n++)
+    heap[n] = timerHeap[n];
+  delete [] timerHeap;
+  timerHeap = heap;
+
+  numTimerBlocks++;
+
+  growTriggeredList(triggeredListUsed + numTimerBlocks * BX_TIMER_BLOCK_SIZE);
+}
+
+void bx_pc_system_c::growTriggeredList(unsigned size)
+{
+  if (size <= triggeredListSize) return;
+
+  unsigned *list = new unsigned[size];
+  for (unsigned n = 0; n < triggeredListUsed; n++)
+    list[n] = triggeredList[n];
+  delete [] triggeredList;
+  triggeredList = list;
+  triggeredListSize = size;
+}
+
+void bx_pc_system_c::heapSiftUp(unsigned pos)
+{
+  unsigned timerIndex = timerHeap[pos];
+  while (pos > 0) {
+    unsigned parent = (pos - 1) / 2;
+    if (! timerFiresBefore(timerIndex, timerHeap[parent])) break;
+    timerHeap[pos] = timerHeap[parent];
+    timer(timerHeap[pos]).heapIndex = pos;
+    pos = parent;
+  }
+  timerHeap[pos] = timerIndex;
+  timer(timerIndex).heapIndex = pos;
+}
+
+void bx_pc_system_c::heapSiftDown(unsigned pos)
+{
+  unsigned timerIndex = timerHeap[pos];
+  for (;;) {
+    unsigned child = 2 * pos + 1;
+    if (child >= timerHeapSize) break;
+    if (child + 1 < timerHeapSize && timerFiresBefore(timerHeap[child + 1], timerHeap[child]))
+      child++;
+    if (! timerFiresBefore(timerHeap[child], timerIndex)) break;
+    timerHeap[pos] = timerHeap[child];
+    timer(timerHeap[pos]).heapIndex = pos;
+    pos = child;
+  }
+  timerHeap[pos] = timerIndex;
+  timer(timerIndex).heapIndex = pos;
+}
+
+void bx_pc_system_c::heapInsert(unsigned timerIndex)
+{
+  timerHeap[timerHeapSize] = timerIndex;
+  heapSiftUp(timerHeapSize++);
+}
+
+void bx_pc_system_c::heapRemove(unsigned timerIndex)
+{
+  unsigned pos = timer(timerIndex).heapIndex;
+  unsigned last = timerHeap[--timerHeapSize];
+  if (pos < timerHeapSize) {
+    timerHeap[pos] = last;
+    timer(last).heapIndex = pos;
+    heapUpdate(last);
+  }
+}
+
+void bx_pc_system_c::heapUpdate(unsigned timerIndex)
+{
+  unsigned pos = timer(timerIndex).heapIndex;
+  if (pos > 0 && timerFiresBefore(timerIndex, timerHeap[(pos - 1) / 2]))
+    heapSiftUp(pos);
+  else
+    heapSiftDown(pos);
+}
+
+void bx_pc_system_c::rebuildTimerHeap(void)
+{
+  timerHeapSize = 0;
+  for (unsigned i = 0; i < numTimers; i++) {
+    if (timer(i).active)
+      heapInsert(i);
   }
 }
 
@@ -273,13 +397,17 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
 
   // search for new timer (i = 0 is reserved for NullTimer)
   for (i = 1; i < numTimers; i++) {
-    if (timer[i].inUse == 0)
+    if (timer(i).inUse == 0)
       break;
   }
 
-  if (numTimers >= BX_MAX_TIMERS) {
-    BX_PANIC(("register_timer: too many registered timers"));
-    return -1;
+  if (i == numTimers) {
+    if (numTimers >= BX_NULL_TIMER_HANDLE) {
+      BX_PANIC(("register_timer: too many registered timers"));
+      return -1;
+    }
+    if (numTimers == numTimerBlocks * BX_TIMER_BLOCK_SIZE)
+      allocTimerBlock();
   }
 #if BX_TIMER_DEBUG
   if (this_ptr == NULL)
@@ -288,18 +416,19 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
     BX_PANIC(("register_timer_ticks: funct is NULL!"));
 #endif
 
-  timer[i].inUse      = 1;
-  timer[i].period     = ticks;
-  timer[i].timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) + ticks;
-  timer[i].active     = active;
-  timer[i].continuous = continuous;
-  timer[i].funct      = funct;
-  timer[i].this_ptr   = this_ptr;
-  strncpy(timer[i].id, id, BxMaxTimerIDLen);
-  timer[i].id[BxMaxTimerIDLen-1] = 0; // Null terminate if not already.
-  timer[i].param      = 0;
+  timer(i).inUse      = 1;
+  timer(i).period     = ticks;
+  timer(i).timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) + ticks;
+  timer(i).active     = active;
+  timer(i).continuous = continuous;
+  timer(i).funct      = funct;
+  timer(i).this_ptr   = this_ptr;
+  strncpy(timer(i).id, id, BxMaxTimerIDLen);
+  timer(i).id[BxMaxTimerIDLen-1] = 0; // Null terminate if not already.
+  timer(i).param      = 0;
 
   if (active) {
+    heapInsert(i);
     if (ticks < Bit64u(currCountdown)) {
       // This new timer needs to fire before the current countdown.
       // Skew the current countdown and countdown period to be smaller
@@ -320,9 +449,8 @@ int bx_pc_system_c::register_timer_ticks(void* this_ptr, bx_timer_handler_t func
 
 void bx_pc_system_c::countdownEvent(void)
 {
-  unsigned i, first = numTimers, last = 0;
-  Bit64u   minTimeToFire;
-  bool  triggered[BX_MAX_TIMERS];
+  unsigned n, numTriggered;
+  unsigned base = triggeredListUsed;
 
   // The countdown decremented to 0.  We need to service all the active
   // timers, and invoke callbacks from those timers which have fired.
@@ -334,36 +462,34 @@ void bx_pc_system_c::countdownEvent(void)
   // Increment global ticks counter by number of ticks which have
   // elapsed since the last update.
   ticksTotal += Bit64u(currCountdownPeriod);
-  minTimeToFire = (Bit64u) -1;
 
-  for (i = 0; i < numTimers; i++) {
-    triggered[i] = 0; // Reset triggered flag.
-    if (timer[i].active) {
+  // only a nested countdown event could need more space than allocated
+  // along with the timer blocks
+  if (base + numTimers > triggeredListSize)
+    growTriggeredList(base + numTimers);
+
+  // The timers ready to fire are on top of the heap, they are taken in
+  // ascending timer index order.  The null timer is always active, so the
+  // heap is never empty.
+  while (timer(timerHeap[0]).timeToFire <= ticksTotal) {
+    unsigned i = timerHeap[0];
 #if BX_TIMER_DEBUG
-      if (ticksTotal > timer[i].timeToFire)
-        BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", i,
-                  timer[i].timeToFire-ticksTotal));
+    if (ticksTotal > timer(i).timeToFire)
+      BX_PANIC(("countdownEvent: ticksTotal > timeToFire[%u], D " FMT_LL "u", i,
+                timer(i).timeToFire-ticksTotal));
 #endif
-      if (ticksTotal == timer[i].timeToFire) {
-        // This timer is ready to fire.
-        triggered[i] = 1;
-
-        if (timer[i].continuous==0) {
-          // If triggered timer is one-shot, deactive.
-          timer[i].active = 0;
-        } else {
-          // Continuous timer, increment time-to-fire by period.
-          timer[i].timeToFire += timer[i].period;
-          if (timer[i].timeToFire < minTimeToFire)
-            minTimeToFire = timer[i].timeToFire;
-        }
-        if (i < first) first = i;
-        last = i;
-      } else {
-        // This timer is not ready to fire yet.
-        if (timer[i].timeToFire < minTimeToFire)
-          minTimeToFire = timer[i].timeToFire;
-      }
+    if (triggeredListUsed == triggeredListSize)
+      growTriggeredList(triggeredListSize + BX_TIMER_BLOCK_SIZE);
+    triggeredList[triggeredListUsed++] = i;
+
+    if (timer(i).continuous==0) {
+      // If triggered timer is one-shot, deactive.
+      timer(i).active = 0;
+      heapRemove(i);
+    } else {
+      // Continuous timer, increment time-to-fire by period.
+      timer(i).timeToFire += timer(i).period;
+      heapSiftDown(0);
     }
   }
 
@@ -371,17 +497,23 @@ void bx_pc_system_c::countdownEvent(void)
   // any of the callbacks, as they may call timer features, which need
   // to be advanced to the next countdown cycle.
   currCountdown = currCountdownPeriod =
-      Bit32u(minTimeToFire - ticksTotal);
+      Bit32u(timer(timerHeap[0]).timeToFire - ticksTotal);
 
-  for (i = first; i <= last; i++) {
+  numTriggered = triggeredListUsed - base;
+
+  for (n = 0; n < numTriggered; n++) {
     // Call requested timer function.  It may request a different
-    // timer period or deactivate etc.
-    if (triggered[i] && (timer[i].funct != NULL)) {
+    // timer period or deactivate etc.  The list is indexed on every
+    // iteration, a callback could grow it.
+    unsigned i = triggeredList[base + n];
+    if (timer(i).funct != NULL) {
       triggeredTimer = i;
-      timer[i].funct(timer[i].this_ptr);
+      timer(i).funct(timer(i).this_ptr);
       triggeredTimer = 0;
     }
   }
+
+  triggeredListUsed = base;
 }
 
 void bx_pc_system_c::nullTimer(void* this_ptr)
@@ -401,10 +533,10 @@ void bx_pc_system_c::nullTimer(void* this_ptr)
 #if SpewPeriodicTimerInfo
   BX_INFO(("==================================="));
   for (unsigned i=0; i < bx_pc_system.numTimers; i++) {
-    if (bx_pc_system.timer[i].active) {
+    if (bx_pc_system.timer(i).active) {
       BX_INFO(("BxTimer(%s): period=" FMT_LL "u, continuous=%u",
-               bx_pc_system.timer[i].id, bx_pc_system.timer[i].period,
-               bx_pc_system.timer[i].continuous));
+               bx_pc_system.timer(i).id, bx_pc_system.timer(i).period,
+               bx_pc_system.timer(i).continuous));
     }
   }
 #endif
@@ -477,9 +609,9 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bool continu
     BX_PANIC(("activate_timer_ticks: timer %u OOB", i));
   if (i == 0)
     BX_PANIC(("activate_timer_ticks: timer 0 is the NullTimer!"));
-  if (timer[i].period < MinAllowableTimerPeriod)
+  if (timer(i).period < MinAllowableTimerPeriod)
     BX_PANIC(("activate_timer_ticks: timer[%u].period of " FMT_LL "u < min of %u",
-              i, timer[i].period, MinAllowableTimerPeriod));
+              i, timer(i).period, MinAllowableTimerPeriod));
 #endif
 
   // If the timer frequency is rediculously low, make it more sane.
@@ -490,10 +622,15 @@ void bx_pc_system_c::activate_timer_ticks(unsigned i, Bit64u ticks, bool continu
     ticks = MinAllowableTimerPeriod;
   }
 
-  timer[i].period = ticks;
-  timer[i].timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) + ticks;
-  timer[i].active     = 1;
-  timer[i].continuous = continuous;
+  timer(i).period = ticks;
+  timer(i).timeToFire = (ticksTotal + Bit64u(currCountdownPeriod-currCountdown)) + ticks;
+  timer(i).continuous = continuous;
+  if (timer(i).active) {
+    heapUpdate(i);
+  } else {
+    timer(i).active = 1;
+    heapInsert(i);
+  }
 
   if (ticks < Bit64u(currCountdown)) {
     // This new timer needs to fire before the current countdown.
@@ -518,7 +655,7 @@ void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bool continuous
   // if useconds = 0, use default stored in period field
   // else set new period from useconds
   if (useconds==0) {
-    ticks = timer[i].period;
+    ticks = timer(i).period;
   } else {
     // convert useconds to number of ticks
     ticks = (Bit64u) (double(useconds) * m_ips);
@@ -529,7 +666,7 @@ void bx_pc_system_c::activate_timer(unsigned i, Bit32u useconds, bool continuous
       ticks = MinAllowableTimerPeriod;
     }
 
-    timer[i].period = ticks;
+    timer(i).period = ticks;
   }
 
   activate_timer_ticks(i, ticks, continuous);
@@ -542,7 +679,7 @@ void bx_pc_system_c::activate_timer_nsec(unsigned i, Bit64u nseconds, bool conti
   // if nseconds = 0, use default stored in period field
   // else set new period from useconds
   if (nseconds==0) {
-    ticks = timer[i].period;
+    ticks = timer(i).period;
   } else {
     // convert nseconds to number of ticks
     ticks = (Bit64u) (double(nseconds) * m_ips / 1000.0);
@@ -553,7 +690,7 @@ void bx_pc_system_c::activate_timer_nsec(unsigned i, Bit64u nseconds, bool conti
       ticks = MinAllowableTimerPeriod;
     }
 
-    timer[i].period = ticks;
+    timer(i).period = ticks;
   }
 
   activate_timer_ticks(i, ticks, continuous);
@@ -568,7 +705,10 @@ void bx_pc_system_c::deactivate_timer(unsigned i)
     BX_PANIC(("deactivate_timer: timer 0 is the nullTimer!"));
 #endif
 
-  timer[i].active = 0;
+  if (timer(i).active) {
+    timer(i).active = 0;
+    heapRemove(i);
+  }
 }
 
 bool bx_pc_system_c::unregisterTimer(unsigned timerIndex)
@@ -578,23 +718,23 @@ bool bx_pc_system_c::unregisterTimer(unsigned timerIndex)
     BX_PANIC(("unregisterTimer: timer %u OOB", timerIndex));
   if (timerIndex == 0)
     BX_PANIC(("unregisterTimer: timer 0 is the nullTimer!"));
-  if (timer[timerIndex].inUse == 0)
+  if (timer(timerIndex).inUse == 0)
     BX_PANIC(("unregisterTimer: timer %u is not in-use!", timerIndex));
 #endif
 
-  if (timer[timerIndex].active) {
-    BX_PANIC(("unregisterTimer: timer '%s' is still active!", timer[timerIndex].id));
+  if (timer(timerIndex).active) {
+    BX_PANIC(("unregisterTimer: timer '%s' is still active!", timer(timerIndex).id));
     return 0; // Fail.
   }
 
   // Reset timer fields for good measure.
-  timer[timerIndex].inUse      = 0; // No longer registered.
-  timer[timerIndex].period     = BX_MAX_BIT64S; // Max value (invalid)
-  timer[timerIndex].timeToFire = BX_MAX_BIT64S; // Max value (invalid)
-  timer[timerIndex].continuous = 0;
-  timer[timerIndex].funct      = NULL;
-  timer[timerIndex].this_ptr   = NULL;
-  memset(timer[timerIndex].id, 0, BxMaxTimerIDLen);
+  timer(timerIndex).inUse      = 0; // No longer registered.
+  timer(timerIndex).period     = BX_MAX_BIT64S; // Max value (invalid)
+  timer(timerIndex).timeToFire = BX_MAX_BIT64S; // Max value (invalid)
+  timer(timerIndex).continuous = 0;
+  timer(timerIndex).funct      = NULL;
+  timer(timerIndex).this_ptr   = NULL;
+  memset(timer(timerIndex).id, 0, BxMaxTimerIDLen);
 
   if (timerIndex == (numTimers - 1)) numTimers--;
 
@@ -607,7 +747,7 @@ void bx_pc_system_c::setTimerParam(unsigned timerIndex, Bit32u param)
   if (timerIndex >= numTimers)
     BX_PANIC(("setTimerParam: timer %u OOB", timerIndex));
 #endif
-  timer[timerIndex].param = param;
+  timer(timerIndex).param = param;
 }
 
 void bx_pc_system_c::isa_bus_delay(void)
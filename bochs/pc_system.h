@@ -23,7 +23,6 @@
 #ifndef BX_PCSYS_H
 #define BX_PCSYS_H
 
-#define BX_MAX_TIMERS 64
 #define BX_NULL_TIMER_HANDLE 10000
 
 typedef void (*bx_timer_handler_t)(void *);
@@ -41,7 +40,7 @@ private:
   // Timer oriented private features
   // ===============================
 
-  struct {
+  struct bx_timer_t {
     bool inUse;      // Timer slot is in-use (currently registered).
     Bit64u  period;     // Timer periodocity in cpu ticks.
     Bit64u  timeToFire; // Time to fire next (in absolute ticks).
@@ -54,7 +53,44 @@ private:
 #define BxMaxTimerIDLen 32
     char id[BxMaxTimerIDLen];  // String ID of timer.
     Bit32u param;              // Device-specific value assigned to timer (optional)
-  } timer[BX_MAX_TIMERS];
+    unsigned heapIndex;        // Position in the active timers heap.
+  };
+
+  // Timers are allocated in blocks, so the address of a timer never changes
+  // once it was registered (the save/restore parameters point into it).
+#define BX_TIMER_BLOCK_SIZE 64
+  bx_timer_t **timerBlocks;
+  unsigned   numTimerBlocks;
+
+  BX_CPP_INLINE bx_timer_t& timer(unsigned i) const {
+    return timerBlocks[i / BX_TIMER_BLOCK_SIZE][i % BX_TIMER_BLOCK_SIZE];
+  }
+
+  // Active timers are kept in a binary min-heap ordered by the time to fire
+  // and by the timer index for the timers firing at the same tick, so the
+  // next timer to fire is always on top.
+  unsigned  *timerHeap;
+  unsigned   timerHeapSize;
+
+  // Timers fired by a countdown event, collected before their callbacks are
+  // invoked.  A nested countdown event (from within a callback) appends its
+  // list behind the list of the outer event.
+  unsigned  *triggeredList;
+  unsigned   triggeredListSize;
+  unsigned   triggeredListUsed;
+
+  void   allocTimerBlock(void);
+  void   growTriggeredList(unsigned size);
+  BX_CPP_INLINE bool timerFiresBefore(unsigned a, unsigned b) const {
+    return (timer(a).timeToFire < timer(b).timeToFire) ||
+           (timer(a).timeToFire == timer(b).timeToFire && a < b);
+  }
+  void   heapSiftUp(unsigned pos);
+  void   heapSiftDown(unsigned pos);
+  void   heapInsert(unsigned timerIndex);
+  void   heapRemove(unsigned timerIndex);
+  void   heapUpdate(unsigned timerIndex);
+  void   rebuildTimerHeap(void);
 
   unsigned   numTimers;  // Number of currently allocated timers.
   unsigned   triggeredTimer;  // ID of the actually triggered timer.
@@ -101,7 +137,7 @@ public:
     return triggeredTimer;
   }
   Bit32u triggeredTimerParam(void) {
-    return timer[triggeredTimer].param;
+    return timer(triggeredTimer).param;
   }
   static BX_CPP_INLINE void tick1(void) {
     if (--bx_pc_system.currCountdown == 0) {
@@ -119,6 +155,10 @@ public:
     // the remaining requested ticks and continue.
     bx_pc_system.currCountdown -= n;
   }
+  // Jump directly to the next timer event, used when all CPUs are idle.
+  static BX_CPP_INLINE void tick_next_event(void) {
+    tickn(bx_pc_system.currCountdown);
+  }
 
   int register_timer_ticks(void* this_ptr, bx_timer_handler_t, Bit64u ticks,
                            bool continuous, bool active, const char *id);
@@ -167,6 +207,8 @@ public:
 
   volatile bool kill_bochs_request;
 
+  bool idle_skip; // skip the idle time when all CPUs are halted
+
   void set_HRQ(bool val);  // set the Hold ReQuest line
 
   void raise_INTR(void);
@@ -183,9 +225,11 @@ public:
   void    set_enable_a20(bool value);
   bool    get_enable_a20(void);
   void    MemoryMappingChanged(void); // flush TLB in all CPUs
+  void    MemoryMappingChanged(bx_phy_address begin, bx_phy_address end); // flush TLB entries of the physical range in all CPUs
   void    invlpg(bx_address addr);    // flush TLB page in all CPUs
   void    exit(void);
   void    register_state(void);
+  void    after_restore_state(void);
 };
 
 #define BX_TICK1()                  bx_pc_system.tick1()
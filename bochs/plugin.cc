@@ -1042,6 +1042,9 @@ plugin_t bx_builtin_plugins[] = {
 #if BX_SUPPORT_BUSMOUSE
   BUILTIN_OPT_PLUGIN_ENTRY(busmouse),
 #endif
+#if BX_SUPPORT_AHCI
+  BUILTIN_OPTPCI_PLUGIN_ENTRY(ahci),
+#endif
 #if BX_SUPPORT_E1000
   BUILTIN_OPTPCI_PLUGIN_ENTRY(e1000),
 #endif
@@ -1078,6 +1081,10 @@ plugin_t bx_builtin_plugins[] = {
 #if BX_SUPPORT_USB_XHCI
   BUILTIN_OPTPCI_PLUGIN_ENTRY(usb_xhci),
 #endif
+#if BX_SUPPORT_VIRTIO
+  BUILTIN_OPTPCI_PLUGIN_ENTRY(virtio_blk),
+  BUILTIN_OPTPCI_PLUGIN_ENTRY(virtio_net),
+#endif
 #if BX_SUPPORT_SOUNDLOW
   BUILTIN_SND_PLUGIN_ENTRY(dummy),
   BUILTIN_SND_PLUGIN_ENTRY(file),
@@ -1140,6 +1147,7 @@ plugin_t bx_builtin_plugins[] = {
   BUILTIN_IMG_PLUGIN_ENTRY(vbox),
   BUILTIN_IMG_PLUGIN_ENTRY(vpc),
   BUILTIN_IMG_PLUGIN_ENTRY(vvfat),
+  BUILTIN_IMG_PLUGIN_ENTRY(qcow2),
   {"NULL", PLUGTYPE_NULL, 0, NULL, 0}
 };
 
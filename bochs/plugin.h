@@ -75,6 +75,9 @@ extern "C" {
 #define BX_PLUGIN_IOAPIC    "ioapic"
 #define BX_PLUGIN_HPET      "hpet"
 #define BX_PLUGIN_VOODOO    "voodoo"
+#define BX_PLUGIN_AHCI      "ahci"
+#define BX_PLUGIN_VIRTIO_BLK "virtio_blk"
+#define BX_PLUGIN_VIRTIO_NET "virtio_net"
 
 
 #define BX_REGISTER_DEVICE_DEVMODEL(a,b,c,d) pluginRegisterDeviceDevmodel(a,b,c,d)
@@ -181,7 +184,8 @@ extern "C" {
 #define DEV_hd_write_handler(a, b, c, d) \
     (bx_devices.pluginHardDrive->virt_write_handler(b, c, d))
 #define DEV_hd_bmdma_read_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_read_sector(a,b,c)
-#define DEV_hd_bmdma_write_sector(a,b) bx_devices.pluginHardDrive->bmdma_write_sector(a,b)
+#define DEV_hd_bmdma_write_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_write_sector(a,b,c)
+#define DEV_hd_bmdma_io_status(a,b) bx_devices.pluginHardDrive->bmdma_io_status(a,b)
 #define DEV_hd_bmdma_complete(a) bx_devices.pluginHardDrive->bmdma_complete(a)
 
 #define DEV_bulk_io_quantum_requested() (bx_devices.bulkIOQuantumsRequested)
@@ -441,6 +445,9 @@ PLUGIN_ENTRY_FOR_MODULE(iodebug);
 PLUGIN_ENTRY_FOR_MODULE(ioapic);
 PLUGIN_ENTRY_FOR_MODULE(hpet);
 PLUGIN_ENTRY_FOR_MODULE(voodoo);
+PLUGIN_ENTRY_FOR_MODULE(ahci);
+PLUGIN_ENTRY_FOR_MODULE(virtio_blk);
+PLUGIN_ENTRY_FOR_MODULE(virtio_net);
 // config interface plugins
 PLUGIN_ENTRY_FOR_MODULE(textconfig);
 PLUGIN_ENTRY_FOR_MODULE(win32config);
@@ -489,6 +496,7 @@ PLUGIN_ENTRY_FOR_IMG_MODULE(vmware4);
 PLUGIN_ENTRY_FOR_IMG_MODULE(vbox);
 PLUGIN_ENTRY_FOR_IMG_MODULE(vpc);
 PLUGIN_ENTRY_FOR_IMG_MODULE(vvfat);
+PLUGIN_ENTRY_FOR_IMG_MODULE(qcow2);
 
 #endif
 